@@ -51,6 +51,17 @@ gchar * object_menu_names[] = {
 };
 
 
+/* the thread running the gtk main loop, only it can put up dialogs */
+static GThread * main_thread = NULL;
+
+typedef struct {
+  GLogLevelFlags log_level;
+  gchar * message;
+  gpointer preferences;
+} log_message_t;
+
+static gboolean log_message_idle(gpointer data);
+
 void amide_log_handler_nopopup(const gchar *log_domain,
 			       GLogLevelFlags log_level,
 			       const gchar *message,
@@ -84,6 +95,14 @@ void amide_log_handler(const gchar *log_domain,
       g_print("AMIDE INFO: %s\n", message);
     else if (log_level & G_LOG_LEVEL_DEBUG) /* G_LOG_LEVEL_WARNING */
       g_print("AMIDE DEBUG: %s\n", message);
+  } else if ((main_thread != NULL) && (g_thread_self() != main_thread)) {
+    /* logged from a background thread, put up the dialog from the main loop */
+    log_message_t * log_message;
+    log_message = g_new(log_message_t, 1);
+    log_message->log_level = log_level;
+    log_message->message = g_strdup(message);
+    log_message->preferences = preferences;
+    g_idle_add(log_message_idle, log_message);
   } else {
 
     dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -116,6 +135,19 @@ void amide_log_handler(const gchar *log_domain,
 
 
 
+static gboolean log_message_idle(gpointer data) {
+
+  log_message_t * log_message = data;
+
+  amide_log_handler(NULL, log_message->log_level, log_message->message, log_message->preferences);
+  g_free(log_message->message);
+  g_free(log_message);
+
+  return FALSE;
+}
+
+
+
 void missing_functionality_warning(AmitkPreferences * preferences) {
 
   gchar * comments;
@@ -326,6 +358,7 @@ int main (int argc, char *argv []) {
   g_object_unref(preferences); 
 
   /* the main event loop */
+  main_thread = g_thread_self();
   gtk_main(); 
   
   /* clean-up */
@@ -174,7 +174,6 @@ static void canvas_time_changed_cb(AmitkStudy * study, gpointer canvas);
 static void canvas_volume_changed_cb(AmitkVolume * vol, gpointer canvas);
 static void canvas_roi_changed_cb(AmitkRoi * roi, gpointer canvas);
 static void canvas_fiducial_mark_changed_cb(AmitkFiducialMark * fm, gpointer canvas);
-static void canvas_data_set_invalidate_slice_cache(AmitkDataSet * ds, gpointer data);
 static void data_set_changed_cb(AmitkDataSet * ds, gpointer canvas);
 static void data_set_subject_orientation_changed_cb(AmitkDataSet * ds, gpointer canvas);
 static void data_set_thresholding_changed_cb(AmitkDataSet * ds, gpointer data);
@@ -195,6 +194,8 @@ static void canvas_update_arrows(AmitkCanvas * canvas);
 static void canvas_update_line_profile(AmitkCanvas * canvas);
 static void canvas_update_time_on_image(AmitkCanvas * canvas);
 static void canvas_update_subject_orientation(AmitkCanvas * canvas);
+static gboolean canvas_request_slices(AmitkCanvas * canvas, gboolean force);
+static void canvas_slices_ready_cb(AmitkSlicer * slicer, guint request, gpointer data);
 static void canvas_update_pixbuf(AmitkCanvas * canvas);
 static void canvas_update_object(AmitkCanvas * canvas, AmitkObject * object);
 static void canvas_update_objects(AmitkCanvas * canvas, gboolean all);
@@ -326,12 +327,18 @@ static void canvas_init (AmitkCanvas *canvas)
   canvas->active_object = NULL;
 
   canvas->canvas = NULL;
-  canvas->slice_cache = NULL;
-  canvas->max_slice_cache_size = 15;
   canvas->slices=NULL;
   canvas->image=NULL;
   canvas->pixbuf=NULL;
 
+  canvas->slicer = amitk_slicer_new();
+  canvas->slicer_request = 0;
+  canvas->slicer_delivered = FALSE;
+  canvas->sliced_center = zero_point;
+  canvas->sliced_start = 0.0;
+  g_signal_connect(G_OBJECT(canvas->slicer), "slices_ready",
+		   G_CALLBACK(canvas_slices_ready_cb), canvas);
+
   canvas->time_on_image=FALSE;
   canvas->time_label=NULL;
 
@@ -366,13 +373,17 @@ static void canvas_destroy (GtkObject * object) {
     canvas->next_update_objects = amitk_objects_unref(canvas->next_update_objects);
   }
 
+  if (canvas->slicer != NULL) {
+    g_signal_handlers_disconnect_by_func(G_OBJECT(canvas->slicer), 
+					 G_CALLBACK(canvas_slices_ready_cb), canvas);
+    amitk_slicer_cancel(canvas->slicer);
+    g_object_unref(canvas->slicer);
+    canvas->slicer = NULL;
+  }
+
   if (canvas->volume != NULL) 
     canvas->volume = amitk_object_unref(canvas->volume);
 
-  if (canvas->slice_cache != NULL) {
-    canvas->slice_cache = amitk_objects_unref(canvas->slice_cache);
-  }
-
   if (canvas->slices != NULL) {
     canvas->slices = amitk_objects_unref(canvas->slices);
   }
@@ -658,17 +669,6 @@ static void canvas_fiducial_mark_changed_cb(AmitkFiducialMark * fm, gpointer dat
   return;
 }
 
-static void canvas_data_set_invalidate_slice_cache(AmitkDataSet * ds, gpointer data) {
-
-  AmitkCanvas * canvas = data;  
-
-  g_return_if_fail(AMITK_IS_CANVAS(canvas));
-  g_return_if_fail(AMITK_IS_DATA_SET(ds));
-
-  canvas->slice_cache = amitk_data_sets_remove_with_slice_parent(canvas->slice_cache, ds);
-
-}
-
 static void data_set_changed_cb(AmitkDataSet * ds, gpointer data) {
 
   AmitkCanvas * canvas = data;  
@@ -3223,6 +3223,84 @@ static void canvas_update_subject_orientation(AmitkCanvas * canvas) {
 
 
 
+/* returns TRUE if the pixbuf should be regenerated right away.  Otherwise the
+   slices are handed off to the background slicer, along with a few slices further
+   along in the direction the user is moving, and the pixbuf is updated once they're ready */
+static gboolean canvas_request_slices(AmitkCanvas * canvas, gboolean force) {
+
+  GList * data_sets;
+  AmitkCanvasPoint pixel_size;
+  amide_real_t pixel_dim;
+  amide_time_t start;
+  amide_real_t z_shift;
+  gint z_direction;
+  gint time_direction;
+  gboolean now;
+
+  g_return_val_if_fail(canvas->study != NULL, TRUE);
+
+  /* the slices we asked for are now in the cache */
+  if (canvas->slicer_delivered) {
+    canvas->slicer_delivered = FALSE;
+    force = TRUE;
+  }
+
+  /* the first image sets the size of the canvas, so don't wait for it */
+  if (canvas->image == NULL) force = TRUE;
+
+  data_sets = amitk_object_get_selected_children_of_type(AMITK_OBJECT(canvas->study),
+  							 AMITK_OBJECT_TYPE_DATA_SET,
+  							 canvas->view_mode,
+  							 TRUE);
+  if (data_sets == NULL) 
+    now = TRUE;
+  else {
+    pixel_dim = (1/AMITK_STUDY_ZOOM(canvas->study))*AMITK_STUDY_VOXEL_DIM(canvas->study); 
+    pixel_size.x = pixel_size.y = pixel_dim;
+    start = AMITK_STUDY_VIEW_START_TIME(canvas->study);
+
+    now = force || amitk_data_sets_slices_cached(data_sets, start,
+						 AMITK_STUDY_VIEW_DURATION(canvas->study),
+						 -1, pixel_size, canvas->volume);
+
+    if (!now) {
+      z_shift = point_dot_product(point_sub(canvas->center, canvas->sliced_center),
+				  amitk_space_get_axis(AMITK_SPACE(canvas->volume), AMITK_AXIS_Z));
+      z_direction = (z_shift > EPSILON) ? 1 : ((z_shift < -EPSILON) ? -1 : 0);
+      time_direction = (start > canvas->sliced_start) ? 1 : ((start < canvas->sliced_start) ? -1 : 0);
+
+      canvas->slicer_request = 
+	amitk_slicer_request(canvas->slicer, data_sets, start, 
+			     AMITK_STUDY_VIEW_DURATION(canvas->study),
+			     pixel_size, canvas->volume, z_direction, time_direction);
+    }
+    amitk_objects_unref(data_sets);
+  }
+
+  if (now) {
+    if (canvas->slicer_request != 0) {
+      amitk_slicer_cancel(canvas->slicer);
+      canvas->slicer_request = 0;
+    }
+    canvas->sliced_center = canvas->center;
+    canvas->sliced_start = AMITK_STUDY_VIEW_START_TIME(canvas->study);
+  }
+
+  return now;
+}
+
+static void canvas_slices_ready_cb(AmitkSlicer * slicer, guint request, gpointer data) {
+
+  AmitkCanvas * canvas = data;
+
+  if (request != canvas->slicer_request) return;
+  canvas->slicer_request = 0;
+  canvas->slicer_delivered = TRUE;
+  canvas_add_update(canvas, UPDATE_DATA_SETS);
+
+  return;
+}
+
 static void canvas_update_pixbuf(AmitkCanvas * canvas) {
 
   gint old_width, old_height;
@@ -3287,8 +3365,6 @@ static void canvas_update_pixbuf(AmitkCanvas * canvas) {
     else
       active_ds = NULL;
     canvas->pixbuf = image_from_data_sets(&(canvas->slices),
-					  &(canvas->slice_cache),
-					  canvas->max_slice_cache_size,
 					  data_sets,
 					  active_ds,
 					  AMITK_STUDY_VIEW_START_TIME(canvas->study),
@@ -3522,13 +3598,17 @@ static void canvas_add_update(AmitkCanvas * canvas, guint update_type) {
 static gboolean canvas_update_while_idle(gpointer data) {
 
   AmitkCanvas * canvas = data;
+  gboolean corners_changed;
 
   /* update the corners */
-  if (canvas_recalc_corners(canvas)) /* if corners changed */
+  corners_changed = canvas_recalc_corners(canvas);
+  if (corners_changed) 
     canvas->next_update = canvas->next_update | UPDATE_ALL;
 
+  /* if the corners changed, the image size may change, so don't defer the slicing */
   if (canvas->next_update & UPDATE_DATA_SETS) {
-    canvas_update_pixbuf(canvas);
+    if (canvas_request_slices(canvas, corners_changed))
+      canvas_update_pixbuf(canvas);
   } 
   
   if (canvas->next_update & UPDATE_ARROWS) {
@@ -3623,7 +3703,6 @@ static void canvas_add_object(AmitkCanvas * canvas, AmitkObject * object) {
   }
   if (AMITK_IS_DATA_SET(object)) {
     g_signal_connect(G_OBJECT(object), "data_set_changed", G_CALLBACK(data_set_changed_cb), canvas);
-    g_signal_connect(G_OBJECT(object), "invalidate_slice_cache", G_CALLBACK(canvas_data_set_invalidate_slice_cache), canvas);
     g_signal_connect(G_OBJECT(object), "interpolation_changed", G_CALLBACK(data_set_changed_cb), canvas);
     g_signal_connect(G_OBJECT(object), "rendering_changed", G_CALLBACK(data_set_changed_cb), canvas);
     g_signal_connect(G_OBJECT(object), "thresholding_changed", G_CALLBACK(data_set_thresholding_changed_cb), canvas);
@@ -3704,11 +3783,9 @@ static void canvas_remove_object(AmitkCanvas * canvas, AmitkObject * object) {
   }
   if (AMITK_IS_DATA_SET(object)) {
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_changed_cb, canvas);
-    g_signal_handlers_disconnect_by_func(G_OBJECT(object), canvas_data_set_invalidate_slice_cache, canvas);
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_thresholding_changed_cb, canvas);
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_color_table_changed_cb, canvas);
     g_signal_handlers_disconnect_by_func(G_OBJECT(object), data_set_subject_orientation_changed_cb, canvas);
-    canvas->slice_cache = amitk_data_sets_remove_with_slice_parent(canvas->slice_cache, AMITK_DATA_SET(object));
   }
   
   /* find corresponding CanvasItem and destroy */
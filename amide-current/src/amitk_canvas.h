@@ -32,6 +32,7 @@
 //#include <gtk/gtk.h>
 //#include <libgnomecanvas/libgnomecanvas.h>
 #include "amitk_study.h"
+#include "amitk_slicer.h"
 
 G_BEGIN_DECLS
 
@@ -80,13 +81,18 @@ struct _AmitkCanvas
   AmitkObject * active_object;
 
   GList * slices;
-  GList * slice_cache;
-  gint max_slice_cache_size;
   gint pixbuf_width, pixbuf_height;
   gdouble border_width;
   GnomeCanvasItem * image;
   GdkPixbuf * pixbuf;
 
+  /* background slicing stuff */
+  AmitkSlicer * slicer;
+  guint slicer_request; /* id of the outstanding request, 0 if none */
+  gboolean slicer_delivered;
+  AmitkPoint sliced_center; /* center and start time of the last displayed slices */
+  amide_time_t sliced_start;
+
   gboolean time_on_image;
   GnomeCanvasItem * time_label;
 
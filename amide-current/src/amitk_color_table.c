@@ -381,6 +381,61 @@ rgba_t amitk_color_table_lookup(amide_data_t datum, AmitkColorTable which,
   return rgba;
 }
 
+/* evaluates the color table across min to max, so that a full slice can be
+   colored with a table lookup per pixel.  Free with g_free */
+AmitkColorTableLut * amitk_color_table_lut_new(AmitkColorTable which, 
+					       amide_data_t min, amide_data_t max) {
+
+  AmitkColorTableLut * lut;
+  amide_data_t range;
+  gint i;
+
+  lut = g_try_new(AmitkColorTableLut, 1);
+  g_return_val_if_fail(lut != NULL, NULL);
+
+  lut->ref_count = 1;
+  lut->which = which;
+  lut->min = min;
+  lut->max = max;
+
+  range = max-min;
+  if (range > 0.0) 
+    lut->scale = (AMITK_COLOR_TABLE_LUT_SIZE-1)/range;
+  else 
+    lut->scale = 0.0;
+
+  for (i=0; i<AMITK_COLOR_TABLE_LUT_SIZE; i++)
+    lut->table[i] = amitk_color_table_lookup(min + i*range/(AMITK_COLOR_TABLE_LUT_SIZE-1), 
+					     which, min, max);
+
+  /* everything outside of min/max is saturated, except for the slight 
+     wraparound in the bwb/contour tables right above max */
+  lut->below = amitk_color_table_lookup(min - fabs(range), which, min, max);
+  lut->above = amitk_color_table_lookup(max + fabs(range), which, min, max);
+  lut->nan = amitk_color_table_lookup(NAN, which, min, max);
+
+  return lut;
+}
+
+AmitkColorTableLut * amitk_color_table_lut_ref(AmitkColorTableLut * lut) {
+
+  g_return_val_if_fail(lut != NULL, NULL);
+  g_atomic_int_inc(&(lut->ref_count));
+
+  return lut;
+}
+
+/* always returns NULL */
+AmitkColorTableLut * amitk_color_table_lut_unref(AmitkColorTableLut * lut) {
+
+  if (lut == NULL) return NULL;
+
+  if (g_atomic_int_dec_and_test(&(lut->ref_count)))
+    g_free(lut);
+
+  return NULL;
+}
+
 rgba_t amitk_color_table_uint32_to_rgba(guint32 color_uint32) {
   rgba_t rgba;
 
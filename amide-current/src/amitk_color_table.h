@@ -94,14 +94,52 @@ typedef struct hsv_t {
 } hsv_t;
 
 
+#define AMITK_COLOR_TABLE_LUT_SIZE 4096
+
+/* a color table evaluated ahead of time for a given min and max, 
+   values in between are quantized into AMITK_COLOR_TABLE_LUT_SIZE steps.
+   Reference counted, as tables can be handed out to several threads */
+typedef struct AmitkColorTableLut {
+  gint ref_count;
+  AmitkColorTable which;
+  amide_data_t min;
+  amide_data_t max;
+  amide_data_t scale; /* (AMITK_COLOR_TABLE_LUT_SIZE-1)/(max-min) */
+  rgba_t below; /* datum < min */
+  rgba_t above; /* datum > max */
+  rgba_t nan;
+  rgba_t table[AMITK_COLOR_TABLE_LUT_SIZE];
+} AmitkColorTableLut;
+
+
 /* defines */
 #define amitk_color_table_rgba_to_uint32(rgba) (((rgba).r<<24) | ((rgba).g<<16) | ((rgba).b<<8) | ((rgba).a<<0))
+#define AMITK_COLOR_TABLE_LUT_MATCHES(lut, which_ct, min_val, max_val) \
+  (((lut)->which == (which_ct)) && ((lut)->min == (min_val)) && ((lut)->max == (max_val)))
+
+/* same result as amitk_color_table_lookup, to within the quantization. NaN fails
+   all the comparisons and ends up at the end */
+static inline rgba_t amitk_color_table_lut_lookup(const AmitkColorTableLut * lut, 
+						  const amide_data_t datum) {
+  if (datum < lut->min)
+    return lut->below;
+  else if (datum > lut->max)
+    return lut->above;
+  else if (datum >= lut->min)
+    return lut->table[(gint) ((datum-lut->min)*lut->scale + 0.5)];
+  else
+    return lut->nan;
+}
 
 /* external functions */
 rgba_t amitk_color_table_uint32_to_rgba(guint32 color_uint32);
 rgba_t amitk_color_table_outline_color(AmitkColorTable which, gboolean highlight);
 rgba_t amitk_color_table_lookup(amide_data_t datum, AmitkColorTable which,
 				amide_data_t min, amide_data_t max);
+AmitkColorTableLut * amitk_color_table_lut_new(AmitkColorTable which, 
+					       amide_data_t min, amide_data_t max);
+AmitkColorTableLut * amitk_color_table_lut_ref(AmitkColorTableLut * lut);
+AmitkColorTableLut * amitk_color_table_lut_unref(AmitkColorTableLut * lut);
 const gchar * amitk_color_table_get_name(const AmitkColorTable which);
 /* external variables */
 extern gchar * color_table_menu_names[];
@@ -334,6 +334,144 @@ gboolean amitk_is_xif_flat_file(const gchar * filename, guint64 * plocation_le,
 
 
 
+/* ----------- simple parallel for loop over a shared thread pool ------------ */
+
+typedef struct {
+  AmitkParallelFunc func;
+  gpointer user_data;
+  gint num_tasks;
+  gint next_task; /* accessed atomically */
+  gint ref_count; /* accessed atomically */
+  gint running; /* protected by mutex */
+  gboolean closed; /* protected by mutex */
+  GMutex mutex;
+  GCond cond;
+} parallel_job_t;
+
+static GThreadPool * parallel_pool = NULL;
+static gint parallel_num_threads = 0;
+
+static void parallel_job_unref(parallel_job_t * job) {
+  if (g_atomic_int_dec_and_test(&job->ref_count)) {
+    g_mutex_clear(&job->mutex);
+    g_cond_clear(&job->cond);
+    g_free(job);
+  }
+}
+
+/* pull tasks off the job until there aren't any more */
+static void parallel_job_run(parallel_job_t * job) {
+
+  gint task;
+
+  while ((task = g_atomic_int_add(&job->next_task, 1)) < job->num_tasks)
+    (*job->func)(task, job->user_data);
+
+  return;
+}
+
+static void parallel_pool_func(gpointer data, gpointer unused) {
+
+  parallel_job_t * job = data;
+
+  /* the thread that queued us may have already finished all the work,
+     in which case it's no longer waiting on us */
+  g_mutex_lock(&job->mutex);
+  if (job->closed) {
+    g_mutex_unlock(&job->mutex);
+    parallel_job_unref(job);
+    return;
+  }
+  job->running++;
+  g_mutex_unlock(&job->mutex);
+
+  parallel_job_run(job);
+
+  g_mutex_lock(&job->mutex);
+  job->running--;
+  if (job->running == 0)
+    g_cond_signal(&job->cond);
+  g_mutex_unlock(&job->mutex);
+
+  parallel_job_unref(job);
+  return;
+}
+
+/* the number of threads used for parallel computations */
+gint amitk_get_num_threads(void) {
+
+  static gsize initialized = 0;
+  GError * error=NULL;
+
+  if (g_once_init_enter(&initialized)) {
+    parallel_num_threads = g_get_num_processors();
+    if (parallel_num_threads < 1) parallel_num_threads = 1;
+
+    if (parallel_num_threads > 1) {
+      parallel_pool = g_thread_pool_new(parallel_pool_func, NULL, parallel_num_threads-1, FALSE, &error);
+      if (parallel_pool == NULL) {
+	g_warning(_("couldn't start worker threads, computations will be single threaded: %s"),
+		  (error != NULL) ? error->message : "");
+	if (error != NULL) g_error_free(error);
+	parallel_num_threads = 1;
+      }
+    }
+    g_once_init_leave(&initialized, 1);
+  }
+
+  return parallel_num_threads;
+}
+
+/* runs func for each task in [0,num_tasks), spread across the available cores.
+   The calling thread also does work, and returns after all tasks have completed.
+   This can be called from within a task, as the caller never blocks on work
+   that hasn't yet been started by another thread. func must not touch gtk.  */
+void amitk_parallel_for(gint num_tasks, AmitkParallelFunc func, gpointer user_data) {
+
+  parallel_job_t * job;
+  gint num_helpers;
+  gint i;
+
+  if (num_tasks <= 0) return;
+
+  num_helpers = MIN(amitk_get_num_threads(), num_tasks)-1;
+
+  if (num_helpers <= 0) {
+    for (i=0; i<num_tasks; i++)
+      (*func)(i, user_data);
+    return;
+  }
+
+  job = g_new0(parallel_job_t, 1);
+  job->func = func;
+  job->user_data = user_data;
+  job->num_tasks = num_tasks;
+  job->next_task = 0;
+  job->ref_count = num_helpers+1;
+  job->running = 0;
+  job->closed = FALSE;
+  g_mutex_init(&job->mutex);
+  g_cond_init(&job->cond);
+
+  for (i=0; i<num_helpers; i++)
+    g_thread_pool_push(parallel_pool, job, NULL);
+
+  parallel_job_run(job);
+
+  /* wait for any helpers that are still working on tasks */
+  g_mutex_lock(&job->mutex);
+  job->closed = TRUE;
+  while (job->running > 0)
+    g_cond_wait(&job->cond, &job->mutex);
+  g_mutex_unlock(&job->mutex);
+
+  parallel_job_unref(job);
+
+  return;
+}
+
+
+
 
 
 const gchar * amitk_layout_get_name(const AmitkLayout layout) {
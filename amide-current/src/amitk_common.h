@@ -41,11 +41,18 @@ G_BEGIN_DECLS
 /* defines how many times we want the progress bar to be updated over the course of an action */
 #define AMITK_UPDATE_DIVIDER 40.0 /* must be float point */
 
+/* number of tasks handed out per worker thread by amitk_parallel_for, 
+   more tasks than threads helps balance uneven work */
+#define AMITK_PARALLEL_TASKS_PER_THREAD 4
+
 /* file info.  magic string needs to be < 64 bytes */
 #define AMITK_FILE_VERSION (xmlChar *) "2.0"
 #define AMITK_FLAT_FILE_MAGIC_STRING "AMIDE XML Image Format Flat File"
 
 /* typedef's */
+/* function run by amitk_parallel_for, task goes from 0 to num_tasks-1 */
+typedef void (*AmitkParallelFunc) (gint task, gpointer user_data);
+
 /* layout of the three views in a canvas */
 typedef enum {
   AMITK_LAYOUT_LINEAR, 
@@ -154,6 +161,9 @@ GdkPixbuf * amitk_get_pixbuf_from_canvas(GnomeCanvas * canvas, gint xoffset, gin
 gboolean amitk_is_xif_directory(const gchar * filename, gboolean * plegacy, gchar ** pxml_filename);
 gboolean amitk_is_xif_flat_file(const gchar * filename, guint64 * plocation_le, guint64 *psize_le);
 
+gint amitk_get_num_threads(void);
+void amitk_parallel_for(gint num_tasks, AmitkParallelFunc func, gpointer user_data);
+
 
 /* built in type functions */
 const gchar *   amitk_layout_get_name             (const AmitkLayout layout);
@@ -235,7 +235,6 @@ static void          data_set_scale                  (AmitkSpace        *space,
 						      AmitkPoint        *ref_point,
 						      AmitkPoint        *scaling);
 static void          data_set_space_changed          (AmitkSpace        *space);
-static void          data_set_selection_changed      (AmitkObject       *object);
 static AmitkObject * data_set_copy                   (const AmitkObject *object);
 static void          data_set_copy_in_place          (AmitkObject * dest_object, const AmitkObject * src_object);
 static void          data_set_write_xml              (const AmitkObject *object, 
@@ -246,6 +245,9 @@ static gchar *       data_set_read_xml               (AmitkObject       *object,
 						      FILE              *study_file,
 						      gchar             *error_buf);
 static void          data_set_invalidate_slice_cache (AmitkDataSet * ds);
+static void          data_set_drop_color_table_luts  (AmitkDataSet * ds);
+static void          data_set_color_table_changed    (AmitkDataSet * ds,
+						      AmitkViewMode * view_mode);
 static void          data_set_set_voxel_size         (AmitkDataSet * ds, 
 						      const AmitkPoint voxel_size);
 static void           data_set_drop_intercept        (AmitkDataSet * ds);
@@ -253,10 +255,13 @@ static void           data_set_reduce_scaling_dimension       (AmitkDataSet * ds
 static AmitkVolumeClass * parent_class;
 static guint         data_set_signals[LAST_SIGNAL];
 
+/* protects the data sets' color_table_lut's, which can be asked for off the main thread */
+static GMutex color_table_lut_mutex;
+
 
 static amide_data_t calculate_scale_factor(AmitkDataSet * ds);
-GList * slice_cache_trim(GList * slice_cache, gint max_size);
-#define MIN_LOCAL_CACHE_SIZE 3
+static void          slice_cache_remove_parent       (AmitkDataSet * parent_ds);
+static void          slice_cache_invalidate_parent   (AmitkDataSet * parent_ds);
 
 GType amitk_data_set_get_type(void) {
 
@@ -296,13 +301,14 @@ static void data_set_class_init (AmitkDataSetClass * class) {
   space_class->space_scale = data_set_scale;
   space_class->space_changed = data_set_space_changed;
 
-  object_class->object_selection_changed = data_set_selection_changed;
   object_class->object_copy = data_set_copy;
   object_class->object_copy_in_place = data_set_copy_in_place;
   object_class->object_write_xml = data_set_write_xml;
   object_class->object_read_xml = data_set_read_xml;
 
   class->invalidate_slice_cache = data_set_invalidate_slice_cache;
+  class->thresholds_changed = data_set_drop_color_table_luts;
+  class->color_table_changed = data_set_color_table_changed;
 
   gobject_class->finalize = data_set_finalize;
 
@@ -451,6 +457,8 @@ static void data_set_init (AmitkDataSet * data_set) {
   data_set->gate_time = NULL;
   data_set->frame_duration = NULL;
   data_set->min_max_calculated = FALSE;
+  data_set->data_generation = 0;
+  data_set->min_max_generation = 0;
   data_set->frame_max = NULL;
   data_set->frame_min = NULL;
   data_set->global_max = 0.0;
@@ -490,12 +498,14 @@ static void data_set_init (AmitkDataSet * data_set) {
   for(i_view_mode=0; i_view_mode < AMITK_VIEW_MODE_NUM; i_view_mode++) {
     data_set->color_table[i_view_mode] = AMITK_COLOR_TABLE_BW_LINEAR;
     data_set->color_table_independent[i_view_mode] = FALSE;
+    data_set->color_table_lut[i_view_mode] = NULL;
   }
   data_set->interpolation = AMITK_INTERPOLATION_NEAREST_NEIGHBOR;
   data_set->rendering = AMITK_RENDERING_MPR;
   data_set->subject_orientation = AMITK_SUBJECT_ORIENTATION_UNKNOWN;
   data_set->subject_sex = AMITK_SUBJECT_SEX_UNKNOWN;
-  data_set->slice_cache = NULL;
+  data_set->slice_cache_entries = 0;
+  data_set->slice_cache_generation = 0;
   data_set->slice_parent = NULL;
 
   for (i_window=0; i_window < AMITK_WINDOW_NUM; i_window++)
@@ -527,6 +537,8 @@ static void data_set_finalize (GObject *object)
 {
   AmitkDataSet * data_set = AMITK_DATA_SET(object);
 
+  data_set_drop_color_table_luts(data_set);
+
   if (data_set->raw_data != NULL) {
 #ifdef AMIDE_DEBUG
     if (data_set->raw_data->dim.z != 1) /* avoid slices */
@@ -601,10 +613,7 @@ static void data_set_finalize (GObject *object)
     data_set->dicom_image_type = NULL;
   }
 
-  if (data_set->slice_cache != NULL) {
-    amitk_objects_unref(data_set->slice_cache);
-    data_set->slice_cache = NULL;
-  }
+  slice_cache_remove_parent(data_set);
 
   if (data_set->slice_parent != NULL) {
     g_object_remove_weak_pointer(G_OBJECT(data_set->slice_parent),
@@ -651,23 +660,6 @@ static void data_set_space_changed(AmitkSpace * space) {
     AMITK_SPACE_CLASS(parent_class)->space_changed (space);
 }
 
-static void data_set_selection_changed(AmitkObject * object) {
-
-  AmitkDataSet * data_set;
-
-  g_return_if_fail(AMITK_IS_DATA_SET(object));
-  data_set = AMITK_DATA_SET(object);
-
-
-  if (!amitk_object_get_selected(object, AMITK_SELECTION_ANY)) {
-    data_set->slice_cache = 
-      slice_cache_trim(data_set->slice_cache, MIN_LOCAL_CACHE_SIZE);
-  }
-
-  return;
-}
-
-
 static AmitkObject * data_set_copy (const AmitkObject * object) {
 
   AmitkDataSet * copy;
@@ -783,6 +775,8 @@ static void data_set_copy_in_place (AmitkObject * dest_object, const AmitkObject
 
   /* if they've already been calculated, make a copy in memory of the data set's max/min values */
   dest_ds->min_max_calculated = AMITK_DATA_SET(src_object)->min_max_calculated;
+  dest_ds->data_generation = src_ds->data_generation;
+  dest_ds->min_max_generation = src_ds->min_max_generation;
 
   if (dest_ds->frame_max != NULL) {
     g_free(dest_ds->frame_max);
@@ -817,6 +811,58 @@ static void data_set_copy_in_place (AmitkObject * dest_object, const AmitkObject
 
 
 
+static guint min_max_key_add(guint key, gconstpointer data, gsize size) {
+
+  const guchar * bytes = data;
+  gsize i;
+
+  for (i=0; i<size; i++)
+    key = (key ^ bytes[i]) * 16777619U;
+
+  return key;
+}
+
+/* a hash over what the max/min values depend on besides the voxel contents,
+   so we can tell if saved values still fit the data set they're read back in with.
+   The voxel contents themselves are covered by only saving max/min values that
+   are current (see data_set_min_max_current), as the voxels are saved alongside */
+static guint data_set_min_max_key(AmitkDataSet * ds) {
+
+  guint key = 2166136261U;
+  AmitkRawData * scaling[2];
+  AmitkVoxel dim, i;
+  amide_data_t value;
+  gint j;
+
+  key = min_max_key_add(key, &(AMITK_RAW_DATA_FORMAT(ds->raw_data)), sizeof(AmitkFormat));
+  dim = AMITK_RAW_DATA_DIM(ds->raw_data);
+  key = min_max_key_add(key, &dim, sizeof(AmitkVoxel));
+  key = min_max_key_add(key, &(ds->scaling_type), sizeof(AmitkScalingType));
+  key = min_max_key_add(key, &(ds->scale_factor), sizeof(amide_data_t));
+
+  scaling[0] = ds->internal_scaling_factor;
+  scaling[1] = ds->internal_scaling_intercept;
+  for (j=0; j<2; j++) {
+    if (scaling[j] == NULL) continue;
+    dim = AMITK_RAW_DATA_DIM(scaling[j]);
+    for (i.t=0; i.t<dim.t; i.t++)
+      for (i.g=0; i.g<dim.g; i.g++)
+	for (i.z=0; i.z<dim.z; i.z++)
+	  for (i.y=0; i.y<dim.y; i.y++)
+	    for (i.x=0; i.x<dim.x; i.x++) {
+	      value = amitk_raw_data_get_value(scaling[j], i);
+	      key = min_max_key_add(key, &value, sizeof(amide_data_t));
+	    }
+  }
+
+  return key;
+}
+
+/* whether the max/min values were calculated on the voxels as they are now */
+static gboolean data_set_min_max_current(const AmitkDataSet * ds) {
+  return ds->min_max_calculated && (ds->min_max_generation == ds->data_generation);
+}
+
 static void data_set_write_xml(const AmitkObject * object, xmlNodePtr nodes, FILE * study_file) {
 
   AmitkDataSet * ds;
@@ -873,7 +919,7 @@ static void data_set_write_xml(const AmitkObject * object, xmlNodePtr nodes, FIL
     }
   }
 
-  if (ds->distribution != NULL) {
+  if ((ds->distribution != NULL) && data_set_min_max_current(ds)) {
     name = g_strdup_printf("data-set_%s_distribution",AMITK_OBJECT_NAME(ds));
     amitk_raw_data_write_xml(ds->distribution, name, study_file, &xml_filename, &location, &size);
     g_free(name);
@@ -885,6 +931,13 @@ static void data_set_write_xml(const AmitkObject * object, xmlNodePtr nodes, FIL
     }
   }
 
+  /* the max/min values, so they don't need to be recalculated on load */
+  if (data_set_min_max_current(ds)) {
+    xml_save_uint(nodes, "min_max_key", data_set_min_max_key(ds));
+    xml_save_datas(nodes, "frame_max", ds->frame_max, AMITK_DATA_SET_NUM_FRAMES(ds));
+    xml_save_datas(nodes, "frame_min", ds->frame_min, AMITK_DATA_SET_NUM_FRAMES(ds));
+  }
+
   xml_save_string(nodes, "scaling_type", amitk_scaling_type_get_name(ds->scaling_type));
   xml_save_data(nodes, "scale_factor", AMITK_DATA_SET_SCALE_FACTOR(ds));
   xml_save_string(nodes, "conversion", amitk_conversion_get_name(ds->conversion));
@@ -966,6 +1019,9 @@ static gchar * data_set_read_xml(AmitkObject * object, xmlNodePtr nodes,
   gchar * filename=NULL;
   guint64 location, size;
   gboolean intercept;
+  amide_data_t * frame_max;
+  amide_data_t * frame_min;
+  guint i_frame;
 
   error_buf = AMITK_OBJECT_CLASS(parent_class)->object_read_xml(object, nodes, study_file, error_buf);
 
@@ -1272,6 +1328,38 @@ static gchar * data_set_read_xml(AmitkObject * object, xmlNodePtr nodes,
   amitk_data_set_set_view_start_gate(ds, xml_get_int(nodes, "view_start_gate", &error_buf));
   amitk_data_set_set_view_end_gate(ds, xml_get_int(nodes, "view_end_gate", &error_buf));
 
+  /* reuse the saved max/min values, as long as they were saved against the same
+     data (added in 1.0.6).  If they weren't, the saved distribution is stale as well */
+  if (xml_node_exists(nodes, "min_max_key")) {
+    frame_max = xml_get_datas(nodes, "frame_max", AMITK_DATA_SET_NUM_FRAMES(ds), &error_buf);
+    frame_min = xml_get_datas(nodes, "frame_min", AMITK_DATA_SET_NUM_FRAMES(ds), &error_buf);
+    if ((frame_max != NULL) && (frame_min != NULL) &&
+	(xml_get_uint(nodes, "min_max_key", &error_buf) == data_set_min_max_key(ds))) {
+      g_free(ds->frame_max);
+      g_free(ds->frame_min);
+      ds->frame_max = frame_max;
+      ds->frame_min = frame_min;
+
+      ds->global_max = ds->frame_max[0];
+      ds->global_min = ds->frame_min[0];
+      for (i_frame=1; i_frame<AMITK_DATA_SET_NUM_FRAMES(ds); i_frame++) {
+	if (ds->global_max < ds->frame_max[i_frame]) 
+	  ds->global_max = ds->frame_max[i_frame];
+	if (ds->global_min > ds->frame_min[i_frame])
+	  ds->global_min = ds->frame_min[i_frame];
+      }
+      ds->min_max_calculated = TRUE;
+      ds->min_max_generation = ds->data_generation;
+    } else {
+      g_free(frame_max);
+      g_free(frame_min);
+      if (ds->distribution != NULL) {
+	g_object_unref(ds->distribution);
+	ds->distribution = NULL;
+      }
+    }
+  }
+
   /* recalc the temporary parameters */
   amitk_data_set_calc_far_corner(ds);
 
@@ -1284,13 +1372,29 @@ static gchar * data_set_read_xml(AmitkObject * object, xmlNodePtr nodes,
 
 static void data_set_invalidate_slice_cache(AmitkDataSet * data_set) {
 
-  /* invalidate cache */
-  if (data_set->slice_cache != NULL) {
-    amitk_objects_unref(data_set->slice_cache);
-    data_set->slice_cache = NULL;
-  }
+  /* invalidate cache, and anything still being sliced from the old state */
+  slice_cache_invalidate_parent(data_set);
+
+
+  return;
+}
+
+/* anyone still using one of the tables holds their own reference */
+static void data_set_drop_color_table_luts(AmitkDataSet * data_set) {
+
+  AmitkViewMode i_view_mode;
+
+  g_mutex_lock(&color_table_lut_mutex);
+  for (i_view_mode=0; i_view_mode < AMITK_VIEW_MODE_NUM; i_view_mode++)
+    data_set->color_table_lut[i_view_mode] = 
+      amitk_color_table_lut_unref(data_set->color_table_lut[i_view_mode]);
+  g_mutex_unlock(&color_table_lut_mutex);
 
+  return;
+}
 
+static void data_set_color_table_changed(AmitkDataSet * data_set, AmitkViewMode * view_mode) {
+  data_set_drop_color_table_luts(data_set);
   return;
 }
 
@@ -1459,9 +1563,11 @@ AmitkDataSet * amitk_data_set_import_raw_file(const gchar * file_name,
     return NULL;
   }
 
-  /* read in the data set */
-  ds->raw_data =  amitk_raw_data_import_raw_file(file_name, NULL, raw_format, data_dim, file_offset,
-						 update_func, update_data);
+  /* read in the data set, mapping the file if we can so frames are only brought in as needed */
+  ds->raw_data = amitk_raw_data_map_raw_file(file_name, NULL, raw_format, data_dim, file_offset);
+  if (ds->raw_data == NULL)
+    ds->raw_data =  amitk_raw_data_import_raw_file(file_name, NULL, raw_format, data_dim, file_offset,
+						   update_func, update_data);
   if (ds->raw_data == NULL) {
     g_warning(_("raw_data_read_file failed returning NULL data set"));
     amitk_object_unref(ds);
@@ -1843,6 +1949,7 @@ static gboolean export_raw(AmitkDataSet *ds,
   for(i.t = 0; i.t < dim.t; i.t++) {
     frame_start = amitk_data_set_get_start_time(ds, i.t) + EPSILON;
     frame_duration = amitk_data_set_get_frame_duration(ds, i.t) - EPSILON;
+    if (!resliced) amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(ds), i.t);
     for (i.g = 0; i.g < dim.g; i.g++) {
 
       if (resliced) /* reset the output slice */
@@ -2118,7 +2225,7 @@ gboolean amitk_data_sets_export_to_file(GList * data_sets,
 	/* advance the requested slice volume */
 	amitk_space_set_offset(AMITK_SPACE(volume), amitk_space_s2b(AMITK_SPACE(export_ds), new_offset));
 
-	slices = amitk_data_sets_get_slices(data_sets, NULL, 0,
+	slices = amitk_data_sets_get_slices(data_sets, FALSE,
 					    amitk_data_set_get_start_time(export_ds, i_voxel.t)+EPSILON,
 					    amitk_data_set_get_frame_duration(export_ds, i_voxel.t)-EPSILON,
 					    i_voxel.g,
@@ -2345,6 +2452,45 @@ AmitkColorTable amitk_data_set_get_color_table_to_use(AmitkDataSet * ds, const A
     return AMITK_DATA_SET_COLOR_TABLE(ds, AMITK_VIEW_MODE_SINGLE);
 }
 
+/* returns the color lookup table for the given min/max and the color table in 
+   use for view_mode.  The table is kept until one that differs is requested, or
+   the thresholds or color table are changed.  The returned table needs to be
+   released with amitk_color_table_lut_unref.  Safe to call off the main thread */
+AmitkColorTableLut * amitk_data_set_get_color_table_lut(AmitkDataSet * ds,
+							const AmitkViewMode view_mode,
+							const amide_data_t min,
+							const amide_data_t max) {
+
+  AmitkColorTable color_table;
+  AmitkColorTableLut * lut;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(view_mode >= 0, NULL);
+  g_return_val_if_fail(view_mode < AMITK_VIEW_MODE_NUM, NULL);
+
+  color_table = amitk_data_set_get_color_table_to_use(ds, view_mode);
+
+  g_mutex_lock(&color_table_lut_mutex);
+  lut = ds->color_table_lut[view_mode];
+  if ((lut != NULL) && AMITK_COLOR_TABLE_LUT_MATCHES(lut, color_table, min, max)) {
+    amitk_color_table_lut_ref(lut);
+    g_mutex_unlock(&color_table_lut_mutex);
+    return lut;
+  }
+  g_mutex_unlock(&color_table_lut_mutex);
+
+  /* build the table without holding the lock */
+  if ((lut = amitk_color_table_lut_new(color_table, min, max)) == NULL)
+    return NULL;
+
+  g_mutex_lock(&color_table_lut_mutex);
+  amitk_color_table_lut_unref(ds->color_table_lut[view_mode]);
+  ds->color_table_lut[view_mode] = amitk_color_table_lut_ref(lut);
+  g_mutex_unlock(&color_table_lut_mutex);
+
+  return lut;
+}
+
 void amitk_data_set_set_modality(AmitkDataSet * ds, const AmitkModality modality) {
 
   g_return_if_fail(AMITK_IS_DATA_SET(ds));
@@ -3081,7 +3227,7 @@ void amitk_data_set_calc_far_corner(AmitkDataSet * ds) {
 }
 
 
-static void (*calc_slice_min_max_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM])(AmitkDataSet *, const amide_intpoint_t, const amide_intpoint_t, const amide_intpoint_t, amitk_format_DOUBLE_t *, amitk_format_DOUBLE_t *) = {
+static void (*calc_slice_min_max_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM])(AmitkDataSet *, const amide_intpoint_t, const amide_intpoint_t, const amide_intpoint_t, amitk_format_DOUBLE_t *, amitk_format_DOUBLE_t *, guint32 *) = {
   {amitk_data_set_UBYTE_0D_SCALING_calc_slice_min_max, amitk_data_set_UBYTE_1D_SCALING_calc_slice_min_max,  amitk_data_set_UBYTE_2D_SCALING_calc_slice_min_max, amitk_data_set_UBYTE_0D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_UBYTE_1D_SCALING_INTERCEPT_calc_slice_min_max,  amitk_data_set_UBYTE_2D_SCALING_INTERCEPT_calc_slice_min_max  },
   {amitk_data_set_SBYTE_0D_SCALING_calc_slice_min_max, amitk_data_set_SBYTE_1D_SCALING_calc_slice_min_max,  amitk_data_set_SBYTE_2D_SCALING_calc_slice_min_max, amitk_data_set_SBYTE_0D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_SBYTE_1D_SCALING_INTERCEPT_calc_slice_min_max,  amitk_data_set_SBYTE_2D_SCALING_INTERCEPT_calc_slice_min_max  },
   {amitk_data_set_USHORT_0D_SCALING_calc_slice_min_max,amitk_data_set_USHORT_1D_SCALING_calc_slice_min_max, amitk_data_set_USHORT_2D_SCALING_calc_slice_min_max,amitk_data_set_USHORT_0D_SCALING_INTERCEPT_calc_slice_min_max,amitk_data_set_USHORT_1D_SCALING_INTERCEPT_calc_slice_min_max, amitk_data_set_USHORT_2D_SCALING_INTERCEPT_calc_slice_min_max },
@@ -3099,28 +3245,121 @@ void amitk_data_set_slice_calc_min_max (AmitkDataSet * ds,
 					const amide_intpoint_t z,
 					amitk_format_DOUBLE_t * pmin,
 					amitk_format_DOUBLE_t * pmax) {
-  (*calc_slice_min_max_func[ds->raw_data->format][ds->scaling_type])(ds, frame, gate, z, pmin, pmax);
+  (*calc_slice_min_max_func[ds->raw_data->format][ds->scaling_type])(ds, frame, gate, z, pmin, pmax, NULL);
 }
 
-/* function to calculate the max and min over the data frames */
-void amitk_data_set_calc_min_max(AmitkDataSet * ds,
-				 AmitkUpdateFunc update_func,
-				 gpointer update_data) {
+/* the per slice results of a min/max calculation */
+typedef struct {
+  AmitkDataSet * ds;
+  gint first_plane;
+  amitk_format_DOUBLE_t * plane_min;
+  amitk_format_DOUBLE_t * plane_max;
+  guint32 * plane_counts; /* NULL if not doing the distribution */
+} min_max_planes_t;
 
-  AmitkVoxel i;
-  amide_data_t max, min, temp;
-  amide_data_t slice_max, slice_min;
-  div_t x;
-  gint divider;
+static void calc_min_max_plane(gint task, gpointer data) {
+
+  min_max_planes_t * mm = data;
+  AmitkDataSet * ds = mm->ds;
+  AmitkVoxel dim;
+  gint plane;
+  guint32 * counts=NULL;
+
+  dim = AMITK_DATA_SET_DIM(ds);
+  plane = mm->first_plane+task;
+  if (mm->plane_counts != NULL)
+    counts = mm->plane_counts + ((gsize) plane)*AMITK_DATA_SET_SLICE_DISTRIBUTION_SIZE;
+
+  (*calc_slice_min_max_func[ds->raw_data->format][ds->scaling_type])
+    (ds, plane/(dim.g*dim.z), (plane/dim.z) % dim.g, plane % dim.z,
+     &(mm->plane_min[plane]), &(mm->plane_max[plane]), counts);
+
+  return;
+}
+
+/* combines the slice histograms into the distribution over the global min to max.
+   This needs the global min/max, which aren't known until every slice is done, so
+   the slices are binned over their own ranges and rebinned here.  The result is
+   an approximation, see AMITK_DATA_SET_SLICE_DISTRIBUTION_SIZE */
+static void data_set_set_distribution(AmitkDataSet * ds, min_max_planes_t * mm) {
+
+  AmitkRawData * distribution;
+  AmitkVoxel distribution_dim, j;
+  amide_data_t scale, diff, width, value;
+  guint32 * counts;
+  gint plane, bin;
+
+  diff = ds->global_max - ds->global_min;
+  if (diff == 0.0)
+    scale = 0.0;
+  else
+    scale = (AMITK_DATA_SET_DISTRIBUTION_SIZE-1)/diff;
+  
+  distribution_dim.x = AMITK_DATA_SET_DISTRIBUTION_SIZE;
+  distribution_dim.y = distribution_dim.z = distribution_dim.g = distribution_dim.t = 1;
+  distribution = amitk_raw_data_new_with_data(AMITK_FORMAT_DOUBLE, distribution_dim);
+  if (distribution == NULL) {
+    g_warning(_("couldn't allocate memory space for the data set structure to hold distribution data"));
+    return;
+  }
+
+  /* initialize the distribution array */
+  amitk_raw_data_DOUBLE_initialize_data(distribution, 0.0);
+
+  /* rebin each slice's counts, by the value at the center of each of its bins */
+  j = zero_voxel;
+  for (plane=0; plane < AMITK_DATA_SET_TOTAL_PLANES(ds); plane++) {
+    counts = mm->plane_counts + ((gsize) plane)*AMITK_DATA_SET_SLICE_DISTRIBUTION_SIZE;
+    width = (mm->plane_max[plane]-mm->plane_min[plane])/AMITK_DATA_SET_SLICE_DISTRIBUTION_SIZE;
+    for (bin=0; bin < AMITK_DATA_SET_SLICE_DISTRIBUTION_SIZE; bin++) {
+      if (counts[bin] > 0) {
+	value = mm->plane_min[plane] + (bin+0.5)*width;
+	j.x = scale*(value-ds->global_min);
+	if (j.x < 0) j.x = 0;
+	else if (j.x >= AMITK_DATA_SET_DISTRIBUTION_SIZE) j.x = AMITK_DATA_SET_DISTRIBUTION_SIZE-1;
+	AMITK_RAW_DATA_DOUBLE_SET_CONTENT(distribution,j) += counts[bin];
+      }
+    }
+  }
+  
+  /* do some log scaling so the distribution is more meaningful, and doesn't get
+     swamped by outlyers */
+  for (j.x = 0; j.x < distribution_dim.x ; j.x++) 
+    AMITK_RAW_DATA_DOUBLE_SET_CONTENT(distribution,j) = 
+      log10(AMITK_RAW_DATA_DOUBLE_CONTENT(distribution,j)+1.0);
+
+  /* and store the distribution with the data set */
+  if (ds->distribution != NULL)
+    g_object_unref(ds->distribution);
+  ds->distribution = distribution;
+
+  return;
+}
+
+/* calculates the max and min of each slice, spread over the threads, and from those
+   the max and min of each frame and of the data set.  If distribution is true,
+   the data set's distribution is gathered in the same pass.  Only the distribution
+   can be canceled, the max/min calculation carries on without it */
+static void data_set_calc_min_max(AmitkDataSet * ds,
+				  gboolean distribution,
+				  AmitkUpdateFunc update_func,
+				  gpointer update_data) {
+
+  min_max_planes_t mm;
+  amide_intpoint_t frame, last_frame;
+  amide_data_t max, min;
   gint total_planes;
-  gint i_plane;
+  gint planes_per_frame;
+  gint planes_per_batch;
+  gint num_planes;
+  gint plane;
   gchar * temp_string;
-  AmitkVoxel dim;
+  gboolean continue_work=TRUE;
+  guint generation;
 
   g_return_if_fail(AMITK_IS_DATA_SET(ds));
   g_return_if_fail(ds->raw_data != NULL);
-
-  dim = AMITK_DATA_SET_DIM(ds);
+  generation = ds->data_generation;
 
   /* allocate the arrays if we haven't already */
   if (ds->frame_max == NULL) {
@@ -3130,79 +3369,127 @@ void amitk_data_set_calc_min_max(AmitkDataSet * ds,
   g_return_if_fail(ds->frame_max != NULL);
   g_return_if_fail(ds->frame_min != NULL);
 
-  /* note, we can't cancel this */
+  total_planes = AMITK_DATA_SET_TOTAL_PLANES(ds);
+  planes_per_frame = AMITK_DATA_SET_DIM_G(ds)*AMITK_DATA_SET_DIM_Z(ds);
+
+  mm.ds = ds;
+  mm.plane_min = g_try_new(amitk_format_DOUBLE_t, total_planes);
+  mm.plane_max = g_try_new(amitk_format_DOUBLE_t, total_planes);
+  if ((mm.plane_min == NULL) || (mm.plane_max == NULL)) {
+    g_warning(_("couldn't allocate memory space for calculating max/min values"));
+    g_free(mm.plane_min);
+    g_free(mm.plane_max);
+    return;
+  }
+  mm.plane_counts = NULL;
+  if (distribution) {
+    mm.plane_counts = g_try_new0(guint32, ((gsize) total_planes)*AMITK_DATA_SET_SLICE_DISTRIBUTION_SIZE);
+    if (mm.plane_counts == NULL)
+      g_warning(_("couldn't allocate memory space for the data set structure to hold distribution data"));
+  }
+
+  /* note, only the distribution can be canceled */
   if (update_func != NULL) {
-    temp_string = g_strdup_printf(_("Calculating Max/Min Values for:\n   %s"), 
-				  AMITK_OBJECT_NAME(ds) == NULL ? "dataset" :
-				  AMITK_OBJECT_NAME(ds));
-    (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    if (mm.plane_counts != NULL)
+      temp_string = g_strdup_printf(_("Generating distribution data for:\n   %s"), 
+				    AMITK_OBJECT_NAME(ds) == NULL ? "dataset" :
+				    AMITK_OBJECT_NAME(ds));
+    else
+      temp_string = g_strdup_printf(_("Calculating Max/Min Values for:\n   %s"), 
+				    AMITK_OBJECT_NAME(ds) == NULL ? "dataset" :
+				    AMITK_OBJECT_NAME(ds));
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
     g_free(temp_string);
   }
 
-  total_planes = AMITK_DATA_SET_TOTAL_PLANES(ds);
-  divider = ((total_planes/AMITK_UPDATE_DIVIDER) < 1) ? 1 : (total_planes/AMITK_UPDATE_DIVIDER);
+  /* hand the slices out in batches, so we can keep the progress bar going */
+  planes_per_batch = amitk_get_num_threads()*AMITK_PARALLEL_TASKS_PER_THREAD;
+  for (mm.first_plane = 0; mm.first_plane < total_planes; mm.first_plane += num_planes) {
+    num_planes = MIN(planes_per_batch, total_planes-mm.first_plane);
 
-  i_plane=0;
-  for (i.t = 0; i.t < dim.t; i.t++) {
-    i.x = i.y = i.z = i.g = 0;
-    temp = amitk_data_set_get_value(ds,i);
-    if (finite(temp)) max = min = temp;   
-    else max = min = 0.0; /* just throw in zero */
+    if ((update_func != NULL) && (mm.first_plane > 0))
+      continue_work = (*update_func)(update_data, NULL, ((gdouble) mm.first_plane)/((gdouble)total_planes));
 
-    for (i.g = 0; i.g < dim.g; i.g++) {
-      for (i.z = 0; i.z < dim.z; i.z++, i_plane++) {
-	if (update_func != NULL) {
-	  x = div(i_plane, divider);
-	  if (x.rem == 0) 
-	    (*update_func)(update_data, NULL, ((gdouble) i_plane)/((gdouble)total_planes));
-	}
-	amitk_data_set_slice_calc_min_max(ds, i.t, i.g, i.z, &slice_min, &slice_max);
-	if (finite(slice_min))
-	  if (slice_min < min)
-	    min = slice_min;
-	if (finite(slice_max))
-	  if (slice_max > max)
-	    max = slice_max;
-      }
-    }    
-    ds->frame_max[i.t] = max;
-    ds->frame_min[i.t] = min;
-    
-#ifdef AMIDE_DEBUG
-    if (dim.z > 1) /* don't print for slices */
-      g_print("\tframe %d max %5.3g frame min %5.3g\n",i.t, ds->frame_max[i.t],ds->frame_min[i.t]);
-#endif
+    /* if the distribution was canceled, finish the max/min without it */
+    if ((!continue_work) && (mm.plane_counts != NULL)) {
+      g_free(mm.plane_counts);
+      mm.plane_counts = NULL;
+    }
+
+    last_frame = (mm.first_plane+num_planes-1)/planes_per_frame;
+    for (frame = mm.first_plane/planes_per_frame; frame <= last_frame; frame++)
+      amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(ds), frame);
+
+    amitk_parallel_for(num_planes, calc_min_max_plane, &mm);
   }
 
   if (update_func != NULL)
     (*update_func)(update_data, NULL, (gdouble) 2.0); /* remove progress bar */
 
+  /* combine the slices into frames, slice values are always finite */
+  for (frame = 0; frame < AMITK_DATA_SET_NUM_FRAMES(ds); frame++) {
+    plane = frame*planes_per_frame;
+    max = mm.plane_max[plane];
+    min = mm.plane_min[plane];
+    for (plane++; plane < (frame+1)*planes_per_frame; plane++) {
+      if (mm.plane_max[plane] > max) max = mm.plane_max[plane];
+      if (mm.plane_min[plane] < min) min = mm.plane_min[plane];
+    }
+    ds->frame_max[frame] = max;
+    ds->frame_min[frame] = min;
+    
+#ifdef AMIDE_DEBUG
+    if (AMITK_DATA_SET_DIM_Z(ds) > 1) /* don't print for slices */
+      g_print("\tframe %d max %5.3g frame min %5.3g\n",frame, ds->frame_max[frame],ds->frame_min[frame]);
+#endif
+  }
+
   /* calc the global max/min */
   ds->global_max = ds->frame_max[0];
   ds->global_min = ds->frame_min[0];
-  for (i.t=1; i.t<AMITK_DATA_SET_NUM_FRAMES(ds); i.t++) {
-    if (ds->global_max < ds->frame_max[i.t]) 
-      ds->global_max = ds->frame_max[i.t];
-    if (ds->global_min > ds->frame_min[i.t])
-      ds->global_min = ds->frame_min[i.t];
+  for (frame=1; frame<AMITK_DATA_SET_NUM_FRAMES(ds); frame++) {
+    if (ds->global_max < ds->frame_max[frame]) 
+      ds->global_max = ds->frame_max[frame];
+    if (ds->global_min > ds->frame_min[frame])
+      ds->global_min = ds->frame_min[frame];
   }
 
   /* note that we've calculated the max and mins */
   ds->min_max_calculated = TRUE;
+  ds->min_max_generation = generation;
 
 #ifdef AMIDE_DEBUG
   if (AMITK_DATA_SET_DIM_Z(ds) > 1) /* don't print for slices */
     g_print("\tglobal max %5.3g global min %5.3g\n",ds->global_max,ds->global_min);
 #endif
+
+  if (mm.plane_counts != NULL) {
+    data_set_set_distribution(ds, &mm);
+    g_free(mm.plane_counts);
+  }
+  g_free(mm.plane_min);
+  g_free(mm.plane_max);
    
   return;
 }
 
+/* function to calculate the max and min over the data frames.  The distribution
+   is gathered at the same time if the data set doesn't already have one */
+void amitk_data_set_calc_min_max(AmitkDataSet * ds,
+				 AmitkUpdateFunc update_func,
+				 gpointer update_data) {
+
+  g_return_if_fail(AMITK_IS_DATA_SET(ds));
+
+  data_set_calc_min_max(ds, ds->distribution == NULL, update_func, update_data);
+  return;
+}
+
 void amitk_data_set_calc_min_max_if_needed(AmitkDataSet * ds,
 					   AmitkUpdateFunc update_func,
 					   gpointer update_data) {
-  if (!ds->min_max_calculated)
-    amitk_data_set_calc_min_max(ds, update_func, update_data);
+  if (!data_set_min_max_current(ds))
+    data_set_calc_min_max(ds, FALSE, update_func, update_data);
   return;
 }
 
@@ -3391,17 +3678,6 @@ void amitk_data_set_get_thresholding_min_max(AmitkDataSet * ds,
 
   
 
-static void (*calc_distribution_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM])(AmitkDataSet *, AmitkUpdateFunc, gpointer) = {
-  {amitk_data_set_UBYTE_0D_SCALING_calc_distribution, amitk_data_set_UBYTE_1D_SCALING_calc_distribution,  amitk_data_set_UBYTE_2D_SCALING_calc_distribution, amitk_data_set_UBYTE_0D_SCALING_INTERCEPT_calc_distribution, amitk_data_set_UBYTE_1D_SCALING_INTERCEPT_calc_distribution,  amitk_data_set_UBYTE_2D_SCALING_INTERCEPT_calc_distribution  },
-  {amitk_data_set_SBYTE_0D_SCALING_calc_distribution, amitk_data_set_SBYTE_1D_SCALING_calc_distribution,  amitk_data_set_SBYTE_2D_SCALING_calc_distribution, amitk_data_set_SBYTE_0D_SCALING_INTERCEPT_calc_distribution, amitk_data_set_SBYTE_1D_SCALING_INTERCEPT_calc_distribution,  amitk_data_set_SBYTE_2D_SCALING_INTERCEPT_calc_distribution  },
-  {amitk_data_set_USHORT_0D_SCALING_calc_distribution,amitk_data_set_USHORT_1D_SCALING_calc_distribution, amitk_data_set_USHORT_2D_SCALING_calc_distribution,amitk_data_set_USHORT_0D_SCALING_INTERCEPT_calc_distribution,amitk_data_set_USHORT_1D_SCALING_INTERCEPT_calc_distribution, amitk_data_set_USHORT_2D_SCALING_INTERCEPT_calc_distribution },
-  {amitk_data_set_SSHORT_0D_SCALING_calc_distribution,amitk_data_set_SSHORT_1D_SCALING_calc_distribution, amitk_data_set_SSHORT_2D_SCALING_calc_distribution,amitk_data_set_SSHORT_0D_SCALING_INTERCEPT_calc_distribution,amitk_data_set_SSHORT_1D_SCALING_INTERCEPT_calc_distribution, amitk_data_set_SSHORT_2D_SCALING_INTERCEPT_calc_distribution },
-  {amitk_data_set_UINT_0D_SCALING_calc_distribution,  amitk_data_set_UINT_1D_SCALING_calc_distribution,   amitk_data_set_UINT_2D_SCALING_calc_distribution,  amitk_data_set_UINT_0D_SCALING_INTERCEPT_calc_distribution,  amitk_data_set_UINT_1D_SCALING_INTERCEPT_calc_distribution,   amitk_data_set_UINT_2D_SCALING_INTERCEPT_calc_distribution   },
-  {amitk_data_set_SINT_0D_SCALING_calc_distribution,  amitk_data_set_SINT_1D_SCALING_calc_distribution,   amitk_data_set_SINT_2D_SCALING_calc_distribution,  amitk_data_set_SINT_0D_SCALING_INTERCEPT_calc_distribution,  amitk_data_set_SINT_1D_SCALING_INTERCEPT_calc_distribution,   amitk_data_set_SINT_2D_SCALING_INTERCEPT_calc_distribution   },
-  {amitk_data_set_FLOAT_0D_SCALING_calc_distribution, amitk_data_set_FLOAT_1D_SCALING_calc_distribution,  amitk_data_set_FLOAT_2D_SCALING_calc_distribution, amitk_data_set_FLOAT_0D_SCALING_INTERCEPT_calc_distribution, amitk_data_set_FLOAT_1D_SCALING_INTERCEPT_calc_distribution,  amitk_data_set_FLOAT_2D_SCALING_INTERCEPT_calc_distribution  },
-  {amitk_data_set_DOUBLE_0D_SCALING_calc_distribution,amitk_data_set_DOUBLE_1D_SCALING_calc_distribution, amitk_data_set_DOUBLE_2D_SCALING_calc_distribution,amitk_data_set_DOUBLE_0D_SCALING_INTERCEPT_calc_distribution,amitk_data_set_DOUBLE_1D_SCALING_INTERCEPT_calc_distribution, amitk_data_set_DOUBLE_2D_SCALING_INTERCEPT_calc_distribution }
-};
-
 /* generate the distribution array for a data set */
 void amitk_data_set_calc_distribution(AmitkDataSet * ds, 
 				      AmitkUpdateFunc update_func,
@@ -3420,7 +3696,9 @@ void amitk_data_set_calc_distribution(AmitkDataSet * ds,
       ds->distribution = NULL;
     }
 
-  (*calc_distribution_func[ds->raw_data->format][ds->scaling_type])(ds, update_func, update_data);
+  /* the distribution comes along with a min/max pass */
+  if (ds->distribution == NULL)
+    data_set_calc_min_max(ds, TRUE, update_func, update_data);
   return;
 }
 
@@ -3953,6 +4231,7 @@ void amitk_data_set_set_value(AmitkDataSet * ds,
 			      const gboolean signal_change) {
 
   amide_data_t unscaled_value;
+  amide_data_t old_value;
 
   g_return_if_fail(AMITK_IS_DATA_SET(ds));
 
@@ -3998,6 +4277,7 @@ void amitk_data_set_set_value(AmitkDataSet * ds,
     unscaled_value = amitk_format_max[ds->raw_data->format];
 
 
+  old_value = amitk_raw_data_get_value(ds->raw_data, i);
   switch(ds->raw_data->format) {
   case AMITK_FORMAT_UBYTE:
     AMITK_RAW_DATA_UBYTE_SET_CONTENT((ds)->raw_data, (i)) = rint(unscaled_value);
@@ -4027,6 +4307,11 @@ void amitk_data_set_set_value(AmitkDataSet * ds,
     g_error("unexpected case in %s at line %d", __FILE__, __LINE__);
     break;
   }
+  /* a write of the same value (e.g. to get a data_set_changed signal) isn't a change */
+  if (amitk_raw_data_get_value(ds->raw_data, i) != old_value) {
+    amitk_raw_data_modify_frame(ds->raw_data, i.t);
+    ds->data_generation++;
+  }
 
   if (signal_change) {
     g_signal_emit (G_OBJECT (ds), data_set_signals[INVALIDATE_SLICE_CACHE], 0);
@@ -4045,6 +4330,7 @@ void amitk_data_set_set_internal_value(AmitkDataSet * ds,
 			      const gboolean signal_change) {
 
   amide_data_t unscaled_value;
+  amide_data_t old_value;
 
   g_return_if_fail(AMITK_IS_DATA_SET(ds));
 
@@ -4090,6 +4376,7 @@ void amitk_data_set_set_internal_value(AmitkDataSet * ds,
     unscaled_value = amitk_format_max[ds->raw_data->format];
 
 
+  old_value = amitk_raw_data_get_value(ds->raw_data, i);
   switch(ds->raw_data->format) {
   case AMITK_FORMAT_UBYTE:
     AMITK_RAW_DATA_UBYTE_SET_CONTENT((ds)->raw_data, (i)) = rint(unscaled_value);
@@ -4119,6 +4406,11 @@ void amitk_data_set_set_internal_value(AmitkDataSet * ds,
     g_error("unexpected case in %s at line %d", __FILE__, __LINE__);
     break;
   }
+  /* a write of the same value (e.g. to get a data_set_changed signal) isn't a change */
+  if (amitk_raw_data_get_value(ds->raw_data, i) != old_value) {
+    amitk_raw_data_modify_frame(ds->raw_data, i.t);
+    ds->data_generation++;
+  }
 
   if (signal_change) {
     g_signal_emit (G_OBJECT (ds), data_set_signals[INVALIDATE_SLICE_CACHE], 0);
@@ -4128,6 +4420,30 @@ void amitk_data_set_set_internal_value(AmitkDataSet * ds,
 
 
 
+static AmitkDataSetSampleFunc get_sample_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM] = {
+  {amitk_data_set_UBYTE_0D_SCALING_get_sample, amitk_data_set_UBYTE_1D_SCALING_get_sample, amitk_data_set_UBYTE_2D_SCALING_get_sample, amitk_data_set_UBYTE_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_UBYTE_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_UBYTE_2D_SCALING_INTERCEPT_get_sample},
+  {amitk_data_set_SBYTE_0D_SCALING_get_sample, amitk_data_set_SBYTE_1D_SCALING_get_sample, amitk_data_set_SBYTE_2D_SCALING_get_sample, amitk_data_set_SBYTE_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_SBYTE_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_SBYTE_2D_SCALING_INTERCEPT_get_sample},
+  {amitk_data_set_USHORT_0D_SCALING_get_sample, amitk_data_set_USHORT_1D_SCALING_get_sample, amitk_data_set_USHORT_2D_SCALING_get_sample, amitk_data_set_USHORT_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_USHORT_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_USHORT_2D_SCALING_INTERCEPT_get_sample},
+  {amitk_data_set_SSHORT_0D_SCALING_get_sample, amitk_data_set_SSHORT_1D_SCALING_get_sample, amitk_data_set_SSHORT_2D_SCALING_get_sample, amitk_data_set_SSHORT_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_SSHORT_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_SSHORT_2D_SCALING_INTERCEPT_get_sample},
+  {amitk_data_set_UINT_0D_SCALING_get_sample, amitk_data_set_UINT_1D_SCALING_get_sample, amitk_data_set_UINT_2D_SCALING_get_sample, amitk_data_set_UINT_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_UINT_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_UINT_2D_SCALING_INTERCEPT_get_sample},
+  {amitk_data_set_SINT_0D_SCALING_get_sample, amitk_data_set_SINT_1D_SCALING_get_sample, amitk_data_set_SINT_2D_SCALING_get_sample, amitk_data_set_SINT_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_SINT_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_SINT_2D_SCALING_INTERCEPT_get_sample},
+  {amitk_data_set_FLOAT_0D_SCALING_get_sample, amitk_data_set_FLOAT_1D_SCALING_get_sample, amitk_data_set_FLOAT_2D_SCALING_get_sample, amitk_data_set_FLOAT_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_FLOAT_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_FLOAT_2D_SCALING_INTERCEPT_get_sample},
+  {amitk_data_set_DOUBLE_0D_SCALING_get_sample, amitk_data_set_DOUBLE_1D_SCALING_get_sample, amitk_data_set_DOUBLE_2D_SCALING_get_sample, amitk_data_set_DOUBLE_0D_SCALING_INTERCEPT_get_sample, amitk_data_set_DOUBLE_1D_SCALING_INTERCEPT_get_sample, amitk_data_set_DOUBLE_2D_SCALING_INTERCEPT_get_sample}
+};
+
+/* returns the function giving the value of the data set at a point in the data set's
+   space (NAN outside the data set), for the data set's format, scaling and 
+   interpolation.  Meant for callers sampling a lot of points, so that the
+   type dispatch happens once instead of for every voxel read.  The function is
+   only good as long as the data set's format and scaling type don't change */
+AmitkDataSetSampleFunc amitk_data_set_get_sample_func(const AmitkDataSet * ds) {
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(ds->raw_data != NULL, NULL);
+
+  return get_sample_func[ds->raw_data->format][ds->scaling_type];
+}
+
 static AmitkDataSet * (*get_slice_func[AMITK_FORMAT_NUM][AMITK_SCALING_TYPE_NUM])(AmitkDataSet *, const amide_time_t, const amide_time_t, const amide_intpoint_t, const AmitkCanvasPoint, const AmitkVolume *) = {
   {amitk_data_set_UBYTE_0D_SCALING_get_slice, amitk_data_set_UBYTE_1D_SCALING_get_slice,  amitk_data_set_UBYTE_2D_SCALING_get_slice, amitk_data_set_UBYTE_0D_SCALING_INTERCEPT_get_slice, amitk_data_set_UBYTE_1D_SCALING_INTERCEPT_get_slice,  amitk_data_set_UBYTE_2D_SCALING_INTERCEPT_get_slice  },
   {amitk_data_set_SBYTE_0D_SCALING_get_slice, amitk_data_set_SBYTE_1D_SCALING_get_slice,  amitk_data_set_SBYTE_2D_SCALING_get_slice, amitk_data_set_SBYTE_0D_SCALING_INTERCEPT_get_slice, amitk_data_set_SBYTE_1D_SCALING_INTERCEPT_get_slice,  amitk_data_set_SBYTE_2D_SCALING_INTERCEPT_get_slice  },
@@ -5065,158 +5381,925 @@ static gboolean filter_fir(const AmitkDataSet * data_set,
 
 }
 
-#endif
+/* the state shared by the threads doing a whole volume FFT gaussian filter */
+typedef struct {
+  const AmitkDataSet * data_set;
+  AmitkDataSet * filtered_ds;
+  AmitkVoxel fft_dim; /* padded size of the real volume */
+  gint num_bins; /* complex values per row of the half spectrum, fft_dim.x/2+1 */
+  gdouble * spectrum; /* fft_dim.z*fft_dim.y*num_bins packed complex values */
+  gdouble * kernel_x; /* real kernel spectra, first n/2+1 values of each */
+  gdouble * kernel_y;
+  gdouble * kernel_z;
+  gsl_fft_real_wavetable * real_wavetable_x;
+  gsl_fft_halfcomplex_wavetable * halfcomplex_wavetable_x;
+  gsl_fft_complex_wavetable * wavetable_y;
+  gsl_fft_complex_wavetable * wavetable_z;
+  amide_intpoint_t frame;
+  amide_intpoint_t gate;
+  gboolean failed;
+} gaussian_fft_t;
+
+#define GAUSSIAN_FFT_ROW(gf, iz, iy) \
+  ((gf)->spectrum + 2*(((gsize) (iz)*(gf)->fft_dim.y + (iy))*(gf)->num_bins))
+
+/* loads one plane of the volume and does the real FFT's along x */
+static void filter_gaussian_fft_forward_x(gint task, gpointer data) {
+
+  gaussian_fft_t * gf = data;
+  gsl_fft_real_workspace * workspace;
+  AmitkVoxel dim, i;
+  gdouble * row;
+
+  if ((workspace = gsl_fft_real_workspace_alloc(gf->fft_dim.x)) == NULL) {
+    gf->failed = TRUE;
+    return;
+  }
 
-/* assumptions:
-   1- filtered_ds is of type FLOAT, 0D scaling
-   2- scale of filtered_ds is 1.0
-   3- kernel dimensions are odd
+  dim = AMITK_DATA_SET_DIM(gf->data_set);
+  i.t = gf->frame;
+  i.g = gf->gate;
+  i.z = task;
+  for (i.y=0; i.y < gf->fft_dim.y; i.y++) {
+    row = GAUSSIAN_FFT_ROW(gf, i.z, i.y);
+    memset(row, 0, sizeof(gdouble)*2*gf->num_bins);
+    if (i.y < dim.y) {
+      for (i.x=0; i.x < dim.x; i.x++)
+	row[i.x] = amitk_data_set_get_internal_value(gf->data_set, i);
+      gsl_fft_real_transform(row, 1, gf->fft_dim.x, gf->real_wavetable_x, workspace);
+      amitk_filter_halfcomplex_unpack(row, gf->fft_dim.x);
+    }
+  }
 
-   notes:
-   1. don't have a separate function for each data type, as getting the data_set data,
-   is a tiny fraction of the computational time, use amitk_data_set_get_internal_value instead
-   2. data set can be the same as filtered_ds
- */
-static gboolean filter_median_3D(const AmitkDataSet * data_set, AmitkDataSet * filtered_ds,
-				 AmitkVoxel kernel_dim, AmitkUpdateFunc update_func, gpointer update_data) {
+  gsl_fft_real_workspace_free(workspace);
+  return;
+}
+
+/* FFT's along y for one plane, forward or inverse */
+static void filter_gaussian_fft_y(gaussian_fft_t * gf, gint z, gboolean forward) {
+
+  gsl_fft_complex_workspace * workspace;
+  gint k_x;
+
+  if ((workspace = gsl_fft_complex_workspace_alloc(gf->fft_dim.y)) == NULL) {
+    gf->failed = TRUE;
+    return;
+  }
+
+  for (k_x=0; k_x < gf->num_bins; k_x++) {
+    if (forward)
+      gsl_fft_complex_forward(GAUSSIAN_FFT_ROW(gf, z, 0)+2*k_x, gf->num_bins, gf->fft_dim.y,
+			      gf->wavetable_y, workspace);
+    else
+      gsl_fft_complex_inverse(GAUSSIAN_FFT_ROW(gf, z, 0)+2*k_x, gf->num_bins, gf->fft_dim.y,
+			      gf->wavetable_y, workspace);
+  }
+
+  gsl_fft_complex_workspace_free(workspace);
+  return;
+}
+
+static void filter_gaussian_fft_forward_y(gint task, gpointer data) {
+  filter_gaussian_fft_y(data, task, TRUE);
+  return;
+}
+
+static void filter_gaussian_fft_inverse_y(gint task, gpointer data) {
+  filter_gaussian_fft_y(data, task, FALSE);
+  return;
+}
+
+/* for one y frequency, FFT's along z, multiplies by the kernel, and inverse FFT's back */
+static void filter_gaussian_fft_z(gint task, gpointer data) {
+
+  gaussian_fft_t * gf = data;
+  gsl_fft_complex_workspace * workspace;
+  gdouble * column;
+  gdouble weight;
+  gsize stride;
+  gint k_x, k_z;
+
+  if ((workspace = gsl_fft_complex_workspace_alloc(gf->fft_dim.z)) == NULL) {
+    gf->failed = TRUE;
+    return;
+  }
+
+  stride = ((gsize) gf->fft_dim.y)*gf->num_bins;
+  for (k_x=0; k_x < gf->num_bins; k_x++) {
+    column = GAUSSIAN_FFT_ROW(gf, 0, task)+2*k_x;
+    gsl_fft_complex_forward(column, stride, gf->fft_dim.z, gf->wavetable_z, workspace);
+
+    for (k_z=0; k_z < gf->fft_dim.z; k_z++) {
+      weight = gf->kernel_x[k_x] *
+	gf->kernel_y[MIN(task, gf->fft_dim.y-task)] *
+	gf->kernel_z[MIN(k_z, gf->fft_dim.z-k_z)];
+      column[2*k_z*stride] *= weight;
+      column[2*k_z*stride+1] *= weight;
+    }
+
+    gsl_fft_complex_inverse(column, stride, gf->fft_dim.z, gf->wavetable_z, workspace);
+  }
+
+  gsl_fft_complex_workspace_free(workspace);
+  return;
+}
+
+/* inverse FFT's along x for one plane, and stores the result */
+static void filter_gaussian_fft_inverse_x(gint task, gpointer data) {
+
+  gaussian_fft_t * gf = data;
+  gsl_fft_real_workspace * workspace;
+  AmitkVoxel dim, i;
+  gdouble * row;
+  gfloat * dest;
+
+  if ((workspace = gsl_fft_real_workspace_alloc(gf->fft_dim.x)) == NULL) {
+    gf->failed = TRUE;
+    return;
+  }
+
+  dim = AMITK_DATA_SET_DIM(gf->filtered_ds);
+  i.t = gf->frame;
+  i.g = gf->gate;
+  i.z = task;
+  i.x = 0;
+  for (i.y=0; i.y < dim.y; i.y++) {
+    row = GAUSSIAN_FFT_ROW(gf, i.z, i.y);
+    amitk_filter_halfcomplex_pack(row, gf->fft_dim.x);
+    gsl_fft_halfcomplex_inverse(row, 1, gf->fft_dim.x, gf->halfcomplex_wavetable_x, workspace);
+    dest = AMITK_RAW_DATA_FLOAT_POINTER(gf->filtered_ds->raw_data, i);
+    for (i.x=0; i.x < dim.x; i.x++)
+      dest[i.x] = row[i.x];
+    i.x = 0;
+  }
 
-  amide_data_t * partial_sort_data;
-  AmitkVoxel i,j, mid_dim, output_dim;
-  gint loc, median_size;
-  AmitkRawData * output_data;
+  gsl_fft_real_workspace_free(workspace);
+  return;
+}
+
+/* gaussian filter done with real to complex FFT's over a whole frame/gate at a time, 
+   padded out to fast FFT sizes and far enough that the convolution doesn't wrap around.
+   As the kernel is separable, its spectrum is the product of three 1D spectra, which
+   are calculated once up front.  The transforms along each axis are spread over the
+   threads.  Same assumptions as filter_fir.  Returns FALSE with out_of_memory set if
+   the volume won't fit in memory, in which case filter_fir should be used instead */
+static gboolean filter_gaussian_fft(const AmitkDataSet * data_set,
+				    AmitkDataSet * filtered_ds,
+				    const gint kernel_size,
+				    const amide_real_t fwhm,
+				    gboolean * out_of_memory,
+				    AmitkUpdateFunc update_func,
+				    gpointer update_data) {
+
+  gaussian_fft_t gf;
   AmitkVoxel ds_dim;
+  AmitkPoint voxel_size;
+  gfloat * kernel;
   gchar * temp_string;
+  gint half;
   gint image_num;
-  gint total_planes;
-  div_t x;
-  gint divider;
+  gint total_images;
   gboolean continue_work=TRUE;
 
-
-  g_return_val_if_fail(AMITK_IS_DATA_SET(data_set), FALSE);
-  g_return_val_if_fail(AMITK_IS_DATA_SET(filtered_ds), FALSE);
-  g_return_val_if_fail(VOXEL_EQUAL(AMITK_DATA_SET_DIM(data_set), AMITK_DATA_SET_DIM(filtered_ds)), FALSE);
-
+  g_return_val_if_fail((kernel_size & 0x1), FALSE); /* needs to be odd */
   g_return_val_if_fail(AMITK_RAW_DATA_FORMAT(AMITK_DATA_SET_RAW_DATA(filtered_ds)) == AMITK_FORMAT_FLOAT, FALSE);
-  g_return_val_if_fail(REAL_EQUAL(AMITK_DATA_SET_SCALE_FACTOR(filtered_ds), 1.0), FALSE);
-  g_return_val_if_fail(VOXEL_EQUAL(AMITK_RAW_DATA_DIM(filtered_ds->internal_scaling_factor), one_voxel), FALSE);
-  g_return_val_if_fail(kernel_dim.t == 1, FALSE); /* haven't written support yet */
-  g_return_val_if_fail(kernel_dim.g == 1, FALSE); /* haven't written support yet */
+  g_return_val_if_fail(VOXEL_EQUAL(AMITK_DATA_SET_DIM(data_set), AMITK_DATA_SET_DIM(filtered_ds)), FALSE);
 
-  /* check it's odd */
-  g_return_val_if_fail(kernel_dim.x & 0x1, FALSE);
-  g_return_val_if_fail(kernel_dim.y & 0x1, FALSE);
-  g_return_val_if_fail(kernel_dim.z & 0x1, FALSE);
+  *out_of_memory = FALSE;
+  memset(&gf, 0, sizeof(gaussian_fft_t));
+  gf.data_set = data_set;
+  gf.filtered_ds = filtered_ds;
 
   ds_dim = AMITK_DATA_SET_DIM(data_set);
-  if (ds_dim.z < kernel_dim.z) {
-    kernel_dim.z = 1;
-    g_warning(_("data set z dimension to small for kernel, setting kernel dimension to 1"));
+  voxel_size = AMITK_DATA_SET_VOXEL_SIZE(data_set);
+  half = kernel_size>>1;
+
+  gf.fft_dim.t = gf.fft_dim.g = 1;
+  gf.fft_dim.x = amitk_filter_fft_fast_size(ds_dim.x+half);
+  gf.fft_dim.y = amitk_filter_fft_fast_size(ds_dim.y+half);
+  gf.fft_dim.z = amitk_filter_fft_fast_size(ds_dim.z+half);
+  gf.num_bins = gf.fft_dim.x/2+1;
+
+  gf.spectrum = g_try_new(gdouble, 2*((gsize) gf.fft_dim.z)*gf.fft_dim.y*gf.num_bins);
+  if (gf.spectrum == NULL) {
+    *out_of_memory = TRUE;
+    return FALSE;
   }
-  if (ds_dim.y < kernel_dim.y) {
-    kernel_dim.y = 1;
-    g_warning(_("data set y dimension to small for kernel, setting kernel dimension to 1"));
+
+  /* the kernel spectra */
+  kernel = amitk_filter_calculate_gaussian_kernel_1D(kernel_size, voxel_size.x, fwhm);
+  if (kernel != NULL) {
+    gf.kernel_x = amitk_filter_calculate_kernel_spectrum_1D(kernel, kernel_size, gf.fft_dim.x);
+    g_free(kernel);
   }
-  if (ds_dim.x < kernel_dim.x) {
-    kernel_dim.x = 1;
-    g_warning(_("data set x dimension to small for kernel, setting kernel dimension to 1"));
+  kernel = amitk_filter_calculate_gaussian_kernel_1D(kernel_size, voxel_size.y, fwhm);
+  if (kernel != NULL) {
+    gf.kernel_y = amitk_filter_calculate_kernel_spectrum_1D(kernel, kernel_size, gf.fft_dim.y);
+    g_free(kernel);
+  }
+  kernel = amitk_filter_calculate_gaussian_kernel_1D(kernel_size, voxel_size.z, fwhm);
+  if (kernel != NULL) {
+    gf.kernel_z = amitk_filter_calculate_kernel_spectrum_1D(kernel, kernel_size, gf.fft_dim.z);
+    g_free(kernel);
+  }
+  if ((gf.kernel_x == NULL) || (gf.kernel_y == NULL) || (gf.kernel_z == NULL)) {
+    g_warning(_("failed to calculate 3D gaussian kernel"));
+    continue_work=FALSE;
+    goto exit_strategy;
   }
 
-  mid_dim.t = mid_dim.g = 0;
-  mid_dim.z = kernel_dim.z >> 1;
-  mid_dim.y = kernel_dim.y >> 1;
-  mid_dim.x = kernel_dim.x >> 1;
-
-  median_size = kernel_dim.z*kernel_dim.y*kernel_dim.x;
-
-  output_dim = ds_dim;
-  output_dim.t = output_dim.g = 1;
-  if ((output_data = amitk_raw_data_new_with_data(AMITK_FORMAT_FLOAT, output_dim)) == NULL) {
-    g_warning(_("couldn't allocate memory space for the internal raw data"));
-    return FALSE;
+  /* initialize gsl's FFT stuff, the wavetables are only read so can be shared between threads */
+  gf.real_wavetable_x = gsl_fft_real_wavetable_alloc(gf.fft_dim.x);
+  gf.halfcomplex_wavetable_x = gsl_fft_halfcomplex_wavetable_alloc(gf.fft_dim.x);
+  gf.wavetable_y = gsl_fft_complex_wavetable_alloc(gf.fft_dim.y);
+  gf.wavetable_z = gsl_fft_complex_wavetable_alloc(gf.fft_dim.z);
+  if ((gf.real_wavetable_x == NULL) || (gf.halfcomplex_wavetable_x == NULL) ||
+      (gf.wavetable_y == NULL) || (gf.wavetable_z == NULL)) {
+    g_warning(_("Filtering: Failed to allocate wavetable and workspace"));
+    continue_work=FALSE;
+    goto exit_strategy;
   }
-  amitk_raw_data_FLOAT_initialize_data(output_data, 0.0);
-  partial_sort_data = g_try_new(amide_data_t, median_size);
-  g_return_val_if_fail(partial_sort_data != NULL, FALSE);
 
   if (update_func != NULL) {
     temp_string = g_strdup_printf(_("Filtering Data Set:  %s"), AMITK_OBJECT_NAME(data_set));
     continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
     g_free(temp_string);
   }
-  total_planes = ds_dim.z*ds_dim.t*ds_dim.g;
-  divider = ((total_planes/AMITK_UPDATE_DIVIDER) < 1) ? 1 : (total_planes/AMITK_UPDATE_DIVIDER);
+  total_images = ds_dim.t*ds_dim.g;
 
+  for (gf.frame = 0; (gf.frame < ds_dim.t) && continue_work; gf.frame++) {
+    amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(data_set), gf.frame);
+    for (gf.gate = 0; (gf.gate < ds_dim.g) && continue_work; gf.gate++) {
+#if AMIDE_DEBUG
+      g_print("Filtering Frame %d/Gate %d\n", gf.frame, gf.gate);
+#endif
+      if (update_func != NULL) {
+	image_num = gf.gate+gf.frame*ds_dim.g;
+	continue_work = (*update_func)(update_data, NULL, ((gdouble) image_num)/((gdouble) total_images));
+	if (!continue_work) break;
+      }
 
-  /* iterate over all the voxels in the data_set */
-  i.t = i.g = 0;
-  for (j.t=0; (j.t < AMITK_DATA_SET_NUM_FRAMES(data_set)) && continue_work; j.t++) {
-    for (j.g=0; (j.g < AMITK_DATA_SET_NUM_GATES(data_set)) && continue_work; j.g++) {
-      for (i.z=0; (i.z < output_dim.z) && continue_work; i.z++) {
+      /* the padding planes get overwritten by the z transforms, so clear them.  The
+	 forward x transforms clear the rest.  Only the planes with data need the y 
+	 transforms, and only those are needed back out again */
+      memset(GAUSSIAN_FFT_ROW(&gf, ds_dim.z, 0), 0, 
+	     sizeof(gdouble)*2*((gsize) (gf.fft_dim.z-ds_dim.z))*gf.fft_dim.y*gf.num_bins);
+      amitk_parallel_for(ds_dim.z, filter_gaussian_fft_forward_x, &gf);
+      amitk_parallel_for(ds_dim.z, filter_gaussian_fft_forward_y, &gf);
+      amitk_parallel_for(gf.fft_dim.y, filter_gaussian_fft_z, &gf);
+      amitk_parallel_for(ds_dim.z, filter_gaussian_fft_inverse_y, &gf);
+      amitk_parallel_for(ds_dim.z, filter_gaussian_fft_inverse_x, &gf);
+
+      if (gf.failed) {
+	g_warning(_("Filtering: Failed to allocate wavetable and workspace"));
+	continue_work = FALSE;
+      }
+    }
+  }
 
-	if (update_func != NULL) {
-	  image_num = i.z+j.t*ds_dim.z+j.g*ds_dim.z*ds_dim.t;
-	  x = div(image_num,divider);
-	  if (x.rem == 0)
-	    continue_work = (*update_func)(update_data, NULL, ((gdouble) image_num)/((gdouble) total_planes));
+ exit_strategy:
+
+  if (gf.real_wavetable_x != NULL)
+    gsl_fft_real_wavetable_free(gf.real_wavetable_x);
+  if (gf.halfcomplex_wavetable_x != NULL)
+    gsl_fft_halfcomplex_wavetable_free(gf.halfcomplex_wavetable_x);
+  if (gf.wavetable_y != NULL)
+    gsl_fft_complex_wavetable_free(gf.wavetable_y);
+  if (gf.wavetable_z != NULL)
+    gsl_fft_complex_wavetable_free(gf.wavetable_z);
+
+  g_free(gf.kernel_x);
+  g_free(gf.kernel_y);
+  g_free(gf.kernel_z);
+  g_free(gf.spectrum);
+
+  if (update_func != NULL) /* remove progress bar */
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+
+  return continue_work;
+}
+
+#endif
+
+/* the state shared by the threads doing a separable gaussian filter */
+typedef struct {
+  const AmitkDataSet * data_set;
+  AmitkDataSet * filtered_ds;
+  gfloat * kernel_x;
+  gfloat * kernel_y;
+  gfloat * kernel_z;
+  gint kernel_size;
+  amide_intpoint_t frame;
+  gboolean failed;
+} gaussian_separable_t;
+
+/* convolves one plane along x then y, from data_set into filtered_ds */
+static void filter_gaussian_plane(gint task, gpointer data) {
+
+  gaussian_separable_t * gs = data;
+  AmitkVoxel dim, i;
+  gint half, k;
+  gfloat * row;
+  gfloat * plane;
+  gfloat * src;
+  gfloat * dest;
+  gfloat weight;
+
+  dim = AMITK_DATA_SET_DIM(gs->data_set);
+  half = gs->kernel_size>>1;
+
+  /* row is zero padded by half a kernel on either side */
+  row = g_try_new0(gfloat, dim.x+2*half);
+  plane = g_try_new(gfloat, dim.y*dim.x);
+  if ((row == NULL) || (plane == NULL)) {
+    gs->failed = TRUE;
+    g_free(row);
+    g_free(plane);
+    return;
+  }
+
+  i.t = gs->frame;
+  i.g = task / dim.z;
+  i.z = task % dim.z;
+
+  /* along x */
+  for (i.y=0; i.y < dim.y; i.y++) {
+    for (i.x=0; i.x < dim.x; i.x++)
+      row[half+i.x] = amitk_data_set_get_internal_value(gs->data_set, i);
+
+    dest = plane + i.y*dim.x;
+    for (i.x=0; i.x < dim.x; i.x++)
+      dest[i.x] = 0.0;
+    for (k=0; k < gs->kernel_size; k++) {
+      weight = gs->kernel_x[k];
+      src = row+k;
+      for (i.x=0; i.x < dim.x; i.x++)
+	dest[i.x] += weight*src[i.x];
+    }
+  }
+
+  /* along y, straight into the filtered data set */
+  i.x = 0;
+  for (i.y=0; i.y < dim.y; i.y++) {
+    dest = AMITK_RAW_DATA_FLOAT_POINTER(gs->filtered_ds->raw_data, i);
+    for (i.x=0; i.x < dim.x; i.x++)
+      dest[i.x] = 0.0;
+    for (k=0; k < gs->kernel_size; k++) {
+      if ((i.y+k-half < 0) || (i.y+k-half >= dim.y)) continue;
+      weight = gs->kernel_y[k];
+      src = plane + (i.y+k-half)*dim.x;
+      for (i.x=0; i.x < dim.x; i.x++)
+	dest[i.x] += weight*src[i.x];
+    }
+    i.x = 0;
+  }
+
+  g_free(row);
+  g_free(plane);
+  return;
+}
+
+/* convolves one xz slab of filtered_ds along z, in place */
+static void filter_gaussian_slab(gint task, gpointer data) {
+
+  gaussian_separable_t * gs = data;
+  AmitkVoxel dim, i;
+  gint half, k;
+  gfloat * slab;
+  gfloat * src;
+  gfloat * dest;
+  gfloat weight;
+
+  dim = AMITK_DATA_SET_DIM(gs->filtered_ds);
+  half = gs->kernel_size>>1;
+
+  slab = g_try_new(gfloat, dim.z*dim.x);
+  if (slab == NULL) {
+    gs->failed = TRUE;
+    return;
+  }
+
+  i.t = gs->frame;
+  i.g = task / dim.y;
+  i.y = task % dim.y;
+  i.x = 0;
+
+  for (i.z=0; i.z < dim.z; i.z++) 
+    memcpy(slab + i.z*dim.x, AMITK_RAW_DATA_FLOAT_POINTER(gs->filtered_ds->raw_data, i),
+	   sizeof(gfloat)*dim.x);
+
+  for (i.z=0; i.z < dim.z; i.z++) {
+    dest = AMITK_RAW_DATA_FLOAT_POINTER(gs->filtered_ds->raw_data, i);
+    for (i.x=0; i.x < dim.x; i.x++)
+      dest[i.x] = 0.0;
+    for (k=0; k < gs->kernel_size; k++) {
+      if ((i.z+k-half < 0) || (i.z+k-half >= dim.z)) continue;
+      weight = gs->kernel_z[k];
+      src = slab + (i.z+k-half)*dim.x;
+      for (i.x=0; i.x < dim.x; i.x++)
+	dest[i.x] += weight*src[i.x];
+    }
+    i.x = 0;
+  }
+
+  g_free(slab);
+  return;
+}
+
+/* gaussian filter done as three 1D convolutions in float, which for small kernels
+   is far cheaper than the FFT method.  Same assumptions as filter_fir, results
+   are the same to within float precision, as data outside the data set is 
+   treated as zero in both. Planes are spread over the threads */
+static gboolean filter_gaussian_separable(const AmitkDataSet * data_set,
+					  AmitkDataSet * filtered_ds,
+					  const gint kernel_size,
+					  const amide_real_t fwhm,
+					  AmitkUpdateFunc update_func,
+					  gpointer update_data) {
+
+  gaussian_separable_t gs;
+  AmitkVoxel ds_dim;
+  AmitkPoint voxel_size;
+  gchar * temp_string;
+  gboolean continue_work=TRUE;
+
+  g_return_val_if_fail((kernel_size & 0x1), FALSE); /* needs to be odd */
+  g_return_val_if_fail(AMITK_RAW_DATA_FORMAT(AMITK_DATA_SET_RAW_DATA(filtered_ds)) == AMITK_FORMAT_FLOAT, FALSE);
+  g_return_val_if_fail(VOXEL_EQUAL(AMITK_DATA_SET_DIM(data_set), AMITK_DATA_SET_DIM(filtered_ds)), FALSE);
+
+  ds_dim = AMITK_DATA_SET_DIM(data_set);
+  voxel_size = AMITK_DATA_SET_VOXEL_SIZE(data_set);
+
+  gs.data_set = data_set;
+  gs.filtered_ds = filtered_ds;
+  gs.kernel_size = kernel_size;
+  gs.failed = FALSE;
+  gs.kernel_x = amitk_filter_calculate_gaussian_kernel_1D(kernel_size, voxel_size.x, fwhm);
+  gs.kernel_y = amitk_filter_calculate_gaussian_kernel_1D(kernel_size, voxel_size.y, fwhm);
+  gs.kernel_z = amitk_filter_calculate_gaussian_kernel_1D(kernel_size, voxel_size.z, fwhm);
+  if ((gs.kernel_x == NULL) || (gs.kernel_y == NULL) || (gs.kernel_z == NULL)) {
+    g_warning(_("failed to calculate 3D gaussian kernel"));
+    continue_work = FALSE;
+    goto exit_strategy;
+  }
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Filtering Data Set:  %s"), AMITK_OBJECT_NAME(data_set));
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+
+  for (gs.frame = 0; (gs.frame < ds_dim.t) && continue_work; gs.frame++) {
+#if AMIDE_DEBUG
+    g_print("Filtering Frame %d\n", gs.frame);
+#endif
+    if (update_func != NULL)
+      continue_work = (*update_func)(update_data, NULL, ((gdouble) gs.frame)/((gdouble) ds_dim.t));
+    if (!continue_work) break;
+
+    amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(data_set), gs.frame);
+    amitk_parallel_for(ds_dim.g*ds_dim.z, filter_gaussian_plane, &gs);
+    amitk_parallel_for(ds_dim.g*ds_dim.y, filter_gaussian_slab, &gs);
+
+    if (gs.failed) {
+      g_warning(_("Couldn't allocate memory space for the subset data"));
+      continue_work = FALSE;
+    }
+  }
+
+ exit_strategy:
+
+  g_free(gs.kernel_x);
+  g_free(gs.kernel_y);
+  g_free(gs.kernel_z);
+
+  if (update_func != NULL) /* remove progress bar */
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+
+  return continue_work;
+}
+
+/* the state shared by the threads doing a median filter */
+typedef struct {
+  const AmitkDataSet * data_set;
+  AmitkDataSet * filtered_ds;
+  AmitkVoxel dim;
+  AmitkVoxel kernel_dim;
+  AmitkVoxel mid_dim;
+  amide_intpoint_t frame;
+  amide_intpoint_t gate;
+
+  /* the frame/gate being filtered, either as the internal values... */
+  gfloat * values;
+
+  /* ...or for integer data with a single scaling factor, as raw values offset to 
+     start at 0.  The zero padding outside the data set is given a histogram bin 
+     of its own, at zero_bin, and bins from zero_bin on are shifted up one */
+  guint16 * raw_bins;
+  gint raw_min;
+  gint zero_bin;
+  gint num_bins;
+  gfloat * bin_values; /* the value of each histogram bin */
+
+  gboolean failed;
+} median_t;
+
+#define MEDIAN_BIN(m, raw_bin) ((raw_bin) + (((raw_bin) >= (m)->zero_bin) ? 1 : 0))
+
+/* sets up the histogram method for this frame/gate if the data allows it, which needs 
+   integer data small enough to histogram, and a positive scaling factor that's the same
+   for the whole frame/gate so that the histogram bins are in order */
+static gboolean median_setup_histogram(median_t * m) {
+
+  const AmitkDataSet * ds = m->data_set;
+  AmitkVoxel i;
+  amide_data_t scale, intercept;
+  gint raw_max;
+  gint j;
+
+  switch(AMITK_RAW_DATA_FORMAT(ds->raw_data)) {
+  case AMITK_FORMAT_UBYTE:
+    m->raw_min = 0;
+    raw_max = G_MAXUINT8;
+    break;
+  case AMITK_FORMAT_SBYTE:
+    m->raw_min = G_MININT8;
+    raw_max = G_MAXINT8;
+    break;
+  case AMITK_FORMAT_USHORT:
+    m->raw_min = 0;
+    raw_max = G_MAXUINT16;
+    break;
+  case AMITK_FORMAT_SSHORT:
+    m->raw_min = G_MININT16;
+    raw_max = G_MAXINT16;
+    break;
+  default:
+    return FALSE;
+  }
+
+  i = zero_voxel;
+  i.t = m->frame;
+  i.g = m->gate;
+  switch(ds->scaling_type) {
+  case AMITK_SCALING_TYPE_0D:
+  case AMITK_SCALING_TYPE_0D_WITH_INTERCEPT:
+    scale = *(AMITK_RAW_DATA_DOUBLE_0D_SCALING_POINTER(ds->internal_scaling_factor, i));
+    break;
+  case AMITK_SCALING_TYPE_1D:
+  case AMITK_SCALING_TYPE_1D_WITH_INTERCEPT:
+    scale = *(AMITK_RAW_DATA_DOUBLE_1D_SCALING_POINTER(ds->internal_scaling_factor, i));
+    break;
+  default:
+    return FALSE;
+  }
+  if (!(scale > 0.0)) return FALSE;
+
+  intercept = 0.0;
+  if (ds->scaling_type == AMITK_SCALING_TYPE_0D_WITH_INTERCEPT)
+    intercept = *(AMITK_RAW_DATA_DOUBLE_0D_SCALING_POINTER(ds->internal_scaling_intercept, i));
+  else if (ds->scaling_type == AMITK_SCALING_TYPE_1D_WITH_INTERCEPT)
+    intercept = *(AMITK_RAW_DATA_DOUBLE_1D_SCALING_POINTER(ds->internal_scaling_intercept, i));
+
+  m->num_bins = raw_max-m->raw_min+2;
+  if (m->bin_values == NULL) 
+    if ((m->bin_values = g_try_new(gfloat, G_MAXUINT16+2)) == NULL)
+      return FALSE;
+
+  /* the padding goes in front of the first bin that's not negative */
+  m->zero_bin = raw_max-m->raw_min+1;
+  for (j=0; j <= raw_max-m->raw_min; j++)
+    if (scale*((m->raw_min+j) + intercept) >= 0.0) {
+      m->zero_bin = j;
+      break;
+    }
+
+  for (j=0; j <= raw_max-m->raw_min; j++)
+    m->bin_values[MEDIAN_BIN(m,j)] = scale*((m->raw_min+j) + intercept);
+  m->bin_values[m->zero_bin] = 0.0;
+
+  return TRUE;
+}
+
+/* loads one plane of the frame/gate into the median filter's buffers */
+static void median_load_plane(gint task, gpointer data) {
+
+  median_t * m = data;
+  AmitkVoxel i;
+  gsize loc;
+  amide_data_t value;
+
+  i.t = m->frame;
+  i.g = m->gate;
+  i.z = task;
+  loc = ((gsize) task)*m->dim.y*m->dim.x;
+  for (i.y=0; i.y < m->dim.y; i.y++) 
+    for (i.x=0; i.x < m->dim.x; i.x++, loc++) {
+      if (m->raw_bins != NULL) {
+	m->raw_bins[loc] = ((gint) amitk_raw_data_get_value(m->data_set->raw_data, i)) - m->raw_min;
+      } else {
+	value = amitk_data_set_get_internal_value(m->data_set, i);
+	if (isnan(value)) value = 0.0; /* can't be ordered */
+	m->values[loc] = value;
+      }
+    }
+
+  return;
+}
+
+/* gathers the voxels in a box of the frame/gate, voxels outside the data set are 0.  
+   Fills in values or bins depending on the method used */
+static gint median_gather(const median_t * m, 
+			  const gint x0, const gint x1,
+			  const gint y0, const gint y1, 
+			  const gint z0, const gint z1,
+			  gfloat * values, guint32 * bins) {
+
+  gint x, y, z;
+  gint num=0;
+  gsize loc;
+  gboolean outside;
+
+  for (z=z0; z <= z1; z++)
+    for (y=y0; y <= y1; y++) {
+      outside = (z < 0) || (z >= m->dim.z) || (y < 0) || (y >= m->dim.y);
+      loc = (((gsize) z)*m->dim.y + y)*m->dim.x;
+      for (x=x0; x <= x1; x++, num++) {
+	if (outside || (x < 0) || (x >= m->dim.x)) {
+	  if (bins != NULL) bins[num] = m->zero_bin;
+	  else values[num] = 0.0;
+	} else if (bins != NULL) {
+	  bins[num] = MEDIAN_BIN(m, m->raw_bins[loc+x]);
+	} else {
+	  values[num] = m->values[loc+x];
 	}
+      }
+    }
 
-	for (i.y=0; i.y < output_dim.y; i.y++) {
-	  for (i.x=0; i.x < output_dim.x; i.x++) {
-	    
-	    /* initialize the data for the iteration */
-	    loc = 0;
-	    for (j.z = i.z-mid_dim.z; j.z <= i.z+mid_dim.z; j.z++) {
-	      if ((j.z < 0) || (j.z >= ds_dim.z)) {
-		for (j.y=0; j.y < kernel_dim.y; j.y++) {
-		  for (j.x=0; j.x < kernel_dim.x; j.x++) {
-		    partial_sort_data[loc] = 0.0;
-		    loc++;
-		  }
-		}
-	      } else {
-		for (j.y = i.y-mid_dim.y; j.y <= i.y+mid_dim.y; j.y++) {
-		  if ((j.y < 0) || (j.y >= ds_dim.y)) {
-		    for (j.x=0; j.x < kernel_dim.x; j.x++) {
-		      partial_sort_data[loc] = 0.0;
-		      loc++;
-		    }
-		  } else {
-		    for (j.x = i.x-mid_dim.x; j.x <= i.x+mid_dim.x; j.x++) {
-		      if ((j.x < 0) || (j.x >= ds_dim.x)) {
-			partial_sort_data[loc] = 0.0;
-			loc++;
-		      } else {
-			partial_sort_data[loc] = amitk_data_set_get_internal_value(data_set, j);
-			loc++;
-		      }
-		    }
-		  }
-		}
-	      }
-	    } /* end initializing data */
-	    
-	    /* and store median value */
-	    AMITK_RAW_DATA_FLOAT_SET_CONTENT(output_data, i) = 
-	      amitk_filter_find_median_by_partial_sort(partial_sort_data, median_size);
-	    
-	  } /* i.x */
-	} /* i.y */
-      } /* i.z */
+  return num;
+}
+
+static gint median_compare_values(gconstpointer a, gconstpointer b) {
+  gfloat va = *((const gfloat *) a);
+  gfloat vb = *((const gfloat *) b);
+  return (va > vb) - (va < vb);
+}
+
+/* median filters one plane, moving the kernel window back and forth along x 
+   (and down a row in y at each end), so each step only changes one face of the window.
+   With the histogram the median is tracked as in Huang's algorithm, otherwise the 
+   window is kept sorted and the faces merged out and in */
+static void median_filter_plane(gint task, gpointer data) {
+
+  median_t * m = data;
+  AmitkVoxel i, mid;
+  gint face_size, num_out, num_in, size, median_point;
+  gint step_x, j, k, l;
+  gfloat * window=NULL;
+  gfloat * new_window=NULL;
+  gfloat * values_out=NULL;
+  gfloat * values_in=NULL;
+  guint32 * hist=NULL;
+  guint32 * bins_out=NULL;
+  guint32 * bins_in=NULL;
+  gfloat * temp;
+  gint median=0, below=0; /* histogram bin of the median, and count of values below it */
+  gfloat * dest;
+  gboolean use_hist;
+
+  mid = m->mid_dim;
+  size = m->kernel_dim.x*m->kernel_dim.y*m->kernel_dim.z;
+  median_point = (size-1) >> 1;
+  face_size = m->kernel_dim.z*MAX(m->kernel_dim.x, m->kernel_dim.y);
+  use_hist = (m->raw_bins != NULL);
+
+  if (use_hist) {
+    hist = g_try_new0(guint32, m->num_bins);
+    bins_out = g_try_new(guint32, MAX(face_size, size));
+    bins_in = g_try_new(guint32, MAX(face_size, size));
+    if ((hist == NULL) || (bins_out == NULL) || (bins_in == NULL)) {
+      m->failed = TRUE;
+      goto exit_strategy;
+    }
+  } else {
+    window = g_try_new(gfloat, size);
+    new_window = g_try_new(gfloat, size);
+    values_out = g_try_new(gfloat, face_size);
+    values_in = g_try_new(gfloat, face_size);
+    if ((window == NULL) || (new_window == NULL) || (values_out == NULL) || (values_in == NULL)) {
+      m->failed = TRUE;
+      goto exit_strategy;
+    }
+  }
+
+  i.t = m->frame;
+  i.g = m->gate;
+  i.z = task;
+  i.y = i.x = 0;
+  step_x = 1;
+
+  /* the starting window */
+  num_out = 0;
+  num_in = median_gather(m, -mid.x, mid.x, -mid.y, mid.y, i.z-mid.z, i.z+mid.z, window, bins_in);
+  if (!use_hist)
+    qsort(window, size, sizeof(gfloat), median_compare_values);
+
+  while (TRUE) {
+
+    /* update the window with the faces that moved out and in */
+    if (use_hist) {
+      for (j=0; j < num_out; j++) {
+	hist[bins_out[j]]--;
+	if (bins_out[j] < median) below--;
+      }
+      for (j=0; j < num_in; j++) {
+	hist[bins_in[j]]++;
+	if (bins_in[j] < median) below++;
+      }
+      while (below > median_point) {
+	median--;
+	below -= hist[median];
+      }
+      while (below + hist[median] <= median_point) {
+	below += hist[median];
+	median++;
+      }
+    } else if (num_out > 0) {
+      /* sort the two faces and merge them into the sorted window. This is O(k^3) per
+	 step for a k^3 kernel (the window gets copied), against O(k^3 log k) for sorting 
+	 from scratch, fine for the kernel sizes offered (up to 11^3) but not for large kernels */
+      qsort(values_out, num_out, sizeof(gfloat), median_compare_values);
+      qsort(values_in, num_in, sizeof(gfloat), median_compare_values);
+      for (j=0, k=0, l=0; j < size; j++) {
+	if ((k < num_out) && (window[j] == values_out[k])) {
+	  k++;
+	} else {
+	  while ((l < num_in) && (values_in[l] < window[j])) {
+	    new_window[j-k+l] = values_in[l];
+	    l++;
+	  }
+	  new_window[j-k+l] = window[j];
+	}
+      }
+      while (l < num_in) {
+	new_window[j-k+l] = values_in[l];
+	l++;
+      }
+      temp = window;
+      window = new_window;
+      new_window = temp;
+    }
+
+    dest = AMITK_RAW_DATA_FLOAT_POINTER(m->filtered_ds->raw_data, i);
+    *dest = use_hist ? m->bin_values[median] : window[median_point];
+
+    /* step along x, or down a row at the end and turn around */
+    if ((i.x+step_x >= 0) && (i.x+step_x < m->dim.x)) {
+      num_out = median_gather(m, i.x-step_x*mid.x, i.x-step_x*mid.x, i.y-mid.y, i.y+mid.y, 
+			      i.z-mid.z, i.z+mid.z, values_out, bins_out);
+      i.x += step_x;
+      num_in = median_gather(m, i.x+step_x*mid.x, i.x+step_x*mid.x, i.y-mid.y, i.y+mid.y, 
+			     i.z-mid.z, i.z+mid.z, values_in, bins_in);
+    } else if (i.y+1 < m->dim.y) {
+      num_out = median_gather(m, i.x-mid.x, i.x+mid.x, i.y-mid.y, i.y-mid.y,
+			      i.z-mid.z, i.z+mid.z, values_out, bins_out);
+      i.y++;
+      num_in = median_gather(m, i.x-mid.x, i.x+mid.x, i.y+mid.y, i.y+mid.y,
+			     i.z-mid.z, i.z+mid.z, values_in, bins_in);
+      step_x = -step_x;
+    } else {
+      break;
+    }
+  }
+
+ exit_strategy:
+  g_free(hist);
+  g_free(bins_out);
+  g_free(bins_in);
+  g_free(window);
+  g_free(new_window);
+  g_free(values_out);
+  g_free(values_in);
+
+  return;
+}
+
+/* assumptions:
+   1- filtered_ds is of type FLOAT, 0D scaling
+   2- scale of filtered_ds is 1.0
+   3- kernel dimensions are odd
+
+   notes:
+   1. data set can be the same as filtered_ds, as each frame/gate is read in before
+   it's written
+   2. each plane is filtered by sliding the kernel window, so only the faces of the 
+   window that change get read each step.  Integer data is kept as a histogram, so the
+   work per voxel doesn't depend on the kernel volume, other data as a sorted window,
+   where each step still costs a pass over the whole window (O(k^3) for a k^3 kernel).
+   Planes are spread over the threads.
+ */
+static gboolean filter_median_3D(const AmitkDataSet * data_set, AmitkDataSet * filtered_ds,
+				 AmitkVoxel kernel_dim, AmitkUpdateFunc update_func, gpointer update_data) {
+
+  median_t m;
+  AmitkVoxel ds_dim;
+  gchar * temp_string;
+  gint image_num;
+  gint total_images;
+  gsize plane_size;
+  gboolean continue_work=TRUE;
+
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(data_set), FALSE);
+  g_return_val_if_fail(AMITK_IS_DATA_SET(filtered_ds), FALSE);
+  g_return_val_if_fail(VOXEL_EQUAL(AMITK_DATA_SET_DIM(data_set), AMITK_DATA_SET_DIM(filtered_ds)), FALSE);
+
+  g_return_val_if_fail(AMITK_RAW_DATA_FORMAT(AMITK_DATA_SET_RAW_DATA(filtered_ds)) == AMITK_FORMAT_FLOAT, FALSE);
+  g_return_val_if_fail(REAL_EQUAL(AMITK_DATA_SET_SCALE_FACTOR(filtered_ds), 1.0), FALSE);
+  g_return_val_if_fail(VOXEL_EQUAL(AMITK_RAW_DATA_DIM(filtered_ds->internal_scaling_factor), one_voxel), FALSE);
+  g_return_val_if_fail(kernel_dim.t == 1, FALSE); /* haven't written support yet */
+  g_return_val_if_fail(kernel_dim.g == 1, FALSE); /* haven't written support yet */
+
+  /* check it's odd */
+  g_return_val_if_fail(kernel_dim.x & 0x1, FALSE);
+  g_return_val_if_fail(kernel_dim.y & 0x1, FALSE);
+  g_return_val_if_fail(kernel_dim.z & 0x1, FALSE);
+
+  ds_dim = AMITK_DATA_SET_DIM(data_set);
+  if (ds_dim.z < kernel_dim.z) {
+    kernel_dim.z = 1;
+    g_warning(_("data set z dimension to small for kernel, setting kernel dimension to 1"));
+  }
+  if (ds_dim.y < kernel_dim.y) {
+    kernel_dim.y = 1;
+    g_warning(_("data set y dimension to small for kernel, setting kernel dimension to 1"));
+  }
+  if (ds_dim.x < kernel_dim.x) {
+    kernel_dim.x = 1;
+    g_warning(_("data set x dimension to small for kernel, setting kernel dimension to 1"));
+  }
 
+  memset(&m, 0, sizeof(median_t));
+  m.data_set = data_set;
+  m.filtered_ds = filtered_ds;
+  m.dim = ds_dim;
+  m.kernel_dim = kernel_dim;
+  m.mid_dim.t = m.mid_dim.g = 0;
+  m.mid_dim.z = kernel_dim.z >> 1;
+  m.mid_dim.y = kernel_dim.y >> 1;
+  m.mid_dim.x = kernel_dim.x >> 1;
 
-      /* copy the output_data over into the filtered_ds */
-      for (i.z=0, j.z=0; i.z < output_dim.z; i.z++, j.z++)
-	for (i.y=0, j.y=0; i.y < output_dim.y; i.y++, j.y++)
-	  for (i.x=0, j.x=0; i.x < output_dim.x; i.x++, j.x++)
-	    AMITK_RAW_DATA_FLOAT_SET_CONTENT(filtered_ds->raw_data, j) = 
-	      AMITK_RAW_DATA_FLOAT_CONTENT(output_data, i);
-    } /* j.g */
-  } /* j.t */
+  plane_size = ((gsize) ds_dim.y)*ds_dim.x;
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Filtering Data Set:  %s"), AMITK_OBJECT_NAME(data_set));
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+  total_images = ds_dim.t*ds_dim.g;
+
+  for (m.frame=0; (m.frame < ds_dim.t) && continue_work; m.frame++) {
+    amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(data_set), m.frame);
+    for (m.gate=0; (m.gate < ds_dim.g) && continue_work; m.gate++) {
+
+      if (update_func != NULL) {
+	image_num = m.gate+m.frame*ds_dim.g;
+	continue_work = (*update_func)(update_data, NULL, ((gdouble) image_num)/((gdouble) total_images));
+	if (!continue_work) break;
+      }
+
+      /* get the buffer for the method this frame/gate can use */
+      if (median_setup_histogram(&m)) {
+	g_free(m.values);
+	m.values = NULL;
+	if (m.raw_bins == NULL) 
+	  m.raw_bins = g_try_new(guint16, plane_size*ds_dim.z);
+      } else {
+	g_free(m.raw_bins);
+	m.raw_bins = NULL;
+	if (m.values == NULL) 
+	  m.values = g_try_new(gfloat, plane_size*ds_dim.z);
+      }
+      if ((m.values == NULL) && (m.raw_bins == NULL)) {
+	g_warning(_("couldn't allocate memory space for the internal raw data"));
+	continue_work = FALSE;
+	break;
+      }
+
+      amitk_parallel_for(ds_dim.z, median_load_plane, &m);
+      amitk_parallel_for(ds_dim.z, median_filter_plane, &m);
+
+      if (m.failed) {
+	g_warning(_("couldn't allocate memory space for the internal raw data"));
+	continue_work = FALSE;
+      }
+    } /* m.gate */
+  } /* m.frame */
 
   /* garbage collection */
-  g_object_unref(output_data); 
-  g_free(partial_sort_data);
+  g_free(m.values);
+  g_free(m.raw_bins);
+  g_free(m.bin_values);
 
   if (update_func != NULL) /* remove progress bar */
     (*update_func)(update_data, NULL, (gdouble) 2.0); 
@@ -5262,11 +6345,409 @@ static gboolean filter_median_linear(const AmitkDataSet * data_set,
 
 
 
+/* ------------ neighborhood filters --------------- 
+   The framework handles reading in each frame/gate with a border around it (edge voxels
+   are repeated out into the border), splitting the volume into tiles of rows for the
+   threads, running one or more passes of the filter, and the progress bar.  A filter 
+   just supplies a function that fills in a row of output from the padded input */
+
+typedef struct _neighborhood_t neighborhood_t;
+
+/* center points at the first voxel of the row in the padded input, neighbors are
+   reached with NEIGHBORHOOD_OFFSET */
+typedef void (*neighborhood_row_func_t)(const neighborhood_t * nb, 
+					const gfloat * center, 
+					gfloat * dest, 
+					const gint num,
+					gpointer row_data);
+
+struct _neighborhood_t {
+  const AmitkDataSet * data_set;
+  AmitkVoxel dim; /* of the data set */
+  AmitkVoxel half; /* border width, half the neighborhood size */
+  AmitkVoxel padded_dim;
+  gfloat * input; /* padded */
+  gfloat * output; /* padded, only the interior is filled in by a pass */
+  gint rows_per_tile;
+  gint tiles_per_plane;
+  amide_intpoint_t frame;
+  amide_intpoint_t gate;
+  neighborhood_row_func_t row_func;
+  gpointer row_data;
+};
+
+#define NEIGHBORHOOD_OFFSET(nb, dz, dy, dx) \
+  ((((gssize) (dz))*(nb)->padded_dim.y + (dy))*(nb)->padded_dim.x + (dx))
+
+#define NEIGHBORHOOD_INTERIOR(nb, buffer, iz, iy) \
+  ((buffer) + NEIGHBORHOOD_OFFSET((nb), (iz)+(nb)->half.z, (iy)+(nb)->half.y, (nb)->half.x))
+
+static AmitkVoxel neighborhood_padded_dim(const AmitkVoxel dim, const AmitkVoxel half) {
+
+  AmitkVoxel padded_dim;
+
+  padded_dim.t = padded_dim.g = 1;
+  padded_dim.z = dim.z + 2*half.z;
+  padded_dim.y = dim.y + 2*half.y;
+  padded_dim.x = dim.x + 2*half.x;
+
+  return padded_dim;
+}
+
+/* reads a plane of the frame/gate into the interior of the input */
+static void neighborhood_load_plane(gint task, gpointer data) {
+
+  neighborhood_t * nb = data;
+  AmitkVoxel i;
+  gfloat * dest;
+
+  i.t = nb->frame;
+  i.g = nb->gate;
+  i.z = task;
+  for (i.y=0; i.y < nb->dim.y; i.y++) {
+    dest = NEIGHBORHOOD_INTERIOR(nb, nb->input, i.z, i.y);
+    for (i.x=0; i.x < nb->dim.x; i.x++)
+      dest[i.x] = amitk_data_set_get_internal_value(nb->data_set, i);
+  }
+
+  return;
+}
+
+/* fills in the border of one padded plane of the input from the nearest interior voxels */
+static void neighborhood_fill_border(gint task, gpointer data) {
+
+  neighborhood_t * nb = data;
+  gint y, x, src_z, src_y;
+  gfloat * row;
+  gfloat * src;
+
+  src_z = CLAMP(task - nb->half.z, 0, nb->dim.z-1);
+  for (y=0; y < nb->padded_dim.y; y++) {
+    row = nb->input + NEIGHBORHOOD_OFFSET(nb, task, y, 0);
+    src_y = CLAMP(y - nb->half.y, 0, nb->dim.y-1);
+    src = NEIGHBORHOOD_INTERIOR(nb, nb->input, src_z, src_y);
+    if ((src_z != task-nb->half.z) || (src_y != y-nb->half.y)) 
+      memcpy(row+nb->half.x, src, sizeof(gfloat)*nb->dim.x);
+    for (x=0; x < nb->half.x; x++) {
+      row[x] = src[0];
+      row[nb->half.x+nb->dim.x+x] = src[nb->dim.x-1];
+    }
+  }
+
+  return;
+}
+
+/* runs the filter over one tile of rows */
+static void neighborhood_filter_tile(gint task, gpointer data) {
+
+  neighborhood_t * nb = data;
+  gint z, y, end_y;
+
+  z = task / nb->tiles_per_plane;
+  y = (task % nb->tiles_per_plane)*nb->rows_per_tile;
+  end_y = MIN(y+nb->rows_per_tile, nb->dim.y);
+  for (; y < end_y; y++) 
+    (*nb->row_func)(nb, NEIGHBORHOOD_INTERIOR(nb, nb->input, z, y),
+		    NEIGHBORHOOD_INTERIOR(nb, nb->output, z, y), nb->dim.x, nb->row_data);
+
+  return;
+}
+
+typedef struct {
+  neighborhood_t * nb;
+  AmitkDataSet * filtered_ds;
+} neighborhood_store_t;
+
+static void neighborhood_store_plane(gint task, gpointer data) {
+
+  neighborhood_store_t * store = data;
+  neighborhood_t * nb = store->nb;
+  AmitkVoxel i;
+
+  i.t = nb->frame;
+  i.g = nb->gate;
+  i.z = task;
+  i.x = 0;
+  for (i.y=0; i.y < nb->dim.y; i.y++) 
+    memcpy(AMITK_RAW_DATA_FLOAT_POINTER(store->filtered_ds->raw_data, i),
+	   NEIGHBORHOOD_INTERIOR(nb, nb->input, i.z, i.y), sizeof(gfloat)*nb->dim.x);
+
+  return;
+}
+
+/* applies a neighborhood filter to each frame/gate of data_set.  With num_passes > 1,
+   the output of each pass is the input of the next.  Same assumptions as filter_fir, 
+   except data_set can be the same as filtered_ds */
+static gboolean filter_neighborhood(const AmitkDataSet * data_set,
+				    AmitkDataSet * filtered_ds,
+				    const AmitkVoxel half,
+				    const gint num_passes,
+				    neighborhood_row_func_t row_func,
+				    gpointer row_data,
+				    AmitkUpdateFunc update_func,
+				    gpointer update_data) {
+
+  neighborhood_t nb;
+  neighborhood_store_t store;
+  AmitkVoxel ds_dim;
+  gfloat * temp;
+  gsize padded_size;
+  gchar * temp_string;
+  gint num_tasks;
+  gint pass;
+  gint image_num;
+  gint total_images;
+  gboolean continue_work=TRUE;
+
+  g_return_val_if_fail(AMITK_RAW_DATA_FORMAT(AMITK_DATA_SET_RAW_DATA(filtered_ds)) == AMITK_FORMAT_FLOAT, FALSE);
+  g_return_val_if_fail(VOXEL_EQUAL(AMITK_DATA_SET_DIM(data_set), AMITK_DATA_SET_DIM(filtered_ds)), FALSE);
+  g_return_val_if_fail(num_passes > 0, FALSE);
+
+  ds_dim = AMITK_DATA_SET_DIM(data_set);
+  nb.data_set = data_set;
+  nb.dim = ds_dim;
+  nb.half = half;
+  nb.padded_dim = neighborhood_padded_dim(ds_dim, half);
+  nb.row_func = row_func;
+  nb.row_data = row_data;
+
+  /* split the planes into enough tiles to keep the threads busy */
+  num_tasks = amitk_get_num_threads()*AMITK_PARALLEL_TASKS_PER_THREAD;
+  nb.tiles_per_plane = CLAMP((num_tasks+ds_dim.z-1)/ds_dim.z, 1, ds_dim.y);
+  nb.rows_per_tile = (ds_dim.y+nb.tiles_per_plane-1)/nb.tiles_per_plane;
+  nb.tiles_per_plane = (ds_dim.y+nb.rows_per_tile-1)/nb.rows_per_tile;
+
+  padded_size = ((gsize) nb.padded_dim.z)*nb.padded_dim.y*nb.padded_dim.x;
+  nb.input = g_try_new(gfloat, padded_size);
+  nb.output = g_try_new(gfloat, padded_size);
+  if ((nb.input == NULL) || (nb.output == NULL)) {
+    g_warning(_("couldn't allocate memory space for the internal raw data"));
+    continue_work = FALSE;
+    goto exit_strategy;
+  }
+
+  store.nb = &nb;
+  store.filtered_ds = filtered_ds;
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Filtering Data Set:  %s"), AMITK_OBJECT_NAME(data_set));
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+  total_images = ds_dim.t*ds_dim.g*num_passes;
+
+  for (nb.frame=0; (nb.frame < ds_dim.t) && continue_work; nb.frame++) {
+    amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(data_set), nb.frame);
+    for (nb.gate=0; (nb.gate < ds_dim.g) && continue_work; nb.gate++) {
+
+      amitk_parallel_for(ds_dim.z, neighborhood_load_plane, &nb);
+
+      for (pass=0; (pass < num_passes) && continue_work; pass++) {
+	if (update_func != NULL) {
+	  image_num = (nb.gate+nb.frame*ds_dim.g)*num_passes + pass;
+	  continue_work = (*update_func)(update_data, NULL, ((gdouble) image_num)/((gdouble) total_images));
+	  if (!continue_work) break;
+	}
+
+	amitk_parallel_for(nb.padded_dim.z, neighborhood_fill_border, &nb);
+	amitk_parallel_for(ds_dim.z*nb.tiles_per_plane, neighborhood_filter_tile, &nb);
+
+	/* the output becomes the input for the next pass */
+	temp = nb.input;
+	nb.input = nb.output;
+	nb.output = temp;
+      }
+
+      if (continue_work)
+	amitk_parallel_for(ds_dim.z, neighborhood_store_plane, &store);
+    }
+  }
+
+ exit_strategy:
+  g_free(nb.input);
+  g_free(nb.output);
+
+  if (update_func != NULL) /* remove progress bar */
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+
+  return continue_work;
+}
+
+/* the bilateral filter weights each neighbor by a gaussian of its distance, and 
+   a gaussian of its difference in value from the center voxel, so smoothing stops
+   at edges.  An edge scale of zero is the limit of that, only neighbors with the
+   same value as the center voxel get averaged in */
+typedef struct {
+  gint num;
+  gssize * offsets;
+  gfloat * weights; /* spatial */
+  gfloat range_factor; /* 1/(2 sigma^2) for the value difference */
+  gboolean equal_only; /* edge scale of zero */
+} bilateral_t;
+
+static void bilateral_row(const neighborhood_t * nb, const gfloat * center, 
+			  gfloat * dest, const gint num, gpointer row_data) {
+
+  bilateral_t * bl = row_data;
+  gint x, k;
+  gfloat value, diff, weight, sum, total;
+
+  for (x=0; x < num; x++) {
+    sum = total = 0.0;
+    for (k=0; k < bl->num; k++) {
+      value = center[x+bl->offsets[k]];
+      diff = value - center[x];
+      if (bl->equal_only)
+	weight = (diff == 0.0) ? bl->weights[k] : 0.0;
+      else
+	weight = bl->weights[k]*expf(-diff*diff*bl->range_factor);
+      sum += weight*value;
+      total += weight;
+    }
+    dest[x] = sum/total; /* total includes the center voxel, so is never zero */
+  }
+
+  return;
+}
+
+static gboolean filter_bilateral(const AmitkDataSet * data_set,
+				 AmitkDataSet * filtered_ds,
+				 const gint kernel_size,
+				 const amide_real_t fwhm,
+				 const amide_data_t edge_fwhm,
+				 AmitkUpdateFunc update_func,
+				 gpointer update_data) {
+
+  bilateral_t bl;
+  AmitkVoxel half, padded_dim, i;
+  AmitkPoint voxel_size, location;
+  amide_real_t sigma, range_sigma;
+  gboolean good;
+
+  g_return_val_if_fail((kernel_size & 0x1), FALSE); /* needs to be odd */
+
+  half.t = half.g = 0;
+  half.z = half.y = half.x = kernel_size >> 1;
+  padded_dim = neighborhood_padded_dim(AMITK_DATA_SET_DIM(data_set), half);
+  voxel_size = AMITK_DATA_SET_VOXEL_SIZE(data_set);
+  sigma = fwhm/SIGMA_TO_FWHM;
+  range_sigma = edge_fwhm/SIGMA_TO_FWHM;
+
+  bl.num = kernel_size*kernel_size*kernel_size;
+  bl.offsets = g_try_new(gssize, bl.num);
+  bl.weights = g_try_new(gfloat, bl.num);
+  if ((bl.offsets == NULL) || (bl.weights == NULL)) {
+    g_warning(_("Couldn't allocate memory space for the kernel data"));
+    g_free(bl.offsets);
+    g_free(bl.weights);
+    return FALSE;
+  }
+  bl.equal_only = (range_sigma <= 0.0);
+  bl.range_factor = bl.equal_only ? 0.0 : 1.0/(2.0*range_sigma*range_sigma);
+
+  bl.num = 0;
+  for (i.z = -half.z; i.z <= half.z; i.z++) {
+    location.z = voxel_size.z*i.z;
+    for (i.y = -half.y; i.y <= half.y; i.y++) {
+      location.y = voxel_size.y*i.y;
+      for (i.x = -half.x; i.x <= half.x; i.x++) {
+	location.x = voxel_size.x*i.x;
+	bl.offsets[bl.num] = ((((gssize) i.z)*padded_dim.y + i.y)*padded_dim.x + i.x);
+	if (sigma > 0.0)
+	  bl.weights[bl.num] = exp(-point_dot_product(location, location)/(2.0*sigma*sigma));
+	else
+	  bl.weights[bl.num] = ((i.z == 0) && (i.y == 0) && (i.x == 0)) ? 1.0 : 0.0;
+	bl.num++;
+      }
+    }
+  }
+
+  good = filter_neighborhood(data_set, filtered_ds, half, 1, bilateral_row, &bl,
+			     update_func, update_data);
+
+  g_free(bl.offsets);
+  g_free(bl.weights);
+
+  return good;
+}
+
+/* Perona-Malik anisotropic diffusion, each pass diffuses between each voxel and its 
+   6 neighbors, with a conductance that drops off for differences larger than the
+   edge threshold */
+typedef struct {
+  gssize offsets[6];
+  gfloat rates[6]; /* time step, adjusted for anisotropic voxels */
+  gfloat edge_factor; /* 1/threshold^2 */
+} diffusion_t;
+
+/* under 1/6 for stability with 6 neighbors */
+#define DIFFUSION_TIME_STEP (1.0/7.0)
+
+static void diffusion_row(const neighborhood_t * nb, const gfloat * center,
+			  gfloat * dest, const gint num, gpointer row_data) {
+
+  diffusion_t * df = row_data;
+  gint x, k;
+  gfloat diff, flow;
+
+  for (x=0; x < num; x++) {
+    flow = 0.0;
+    for (k=0; k < 6; k++) {
+      diff = center[x+df->offsets[k]] - center[x];
+      flow += df->rates[k]*diff/(1.0+diff*diff*df->edge_factor);
+    }
+    dest[x] = center[x] + flow;
+  }
+
+  return;
+}
+
+static gboolean filter_anisotropic_diffusion(const AmitkDataSet * data_set,
+					     AmitkDataSet * filtered_ds,
+					     const gint iterations,
+					     const amide_data_t edge_threshold,
+					     AmitkUpdateFunc update_func,
+					     gpointer update_data) {
+
+  diffusion_t df;
+  AmitkVoxel half, padded_dim;
+  AmitkPoint voxel_size;
+  amide_real_t min_size;
+  AmitkAxis i_axis;
+  gint k;
+
+  g_return_val_if_fail(iterations > 0, FALSE);
+
+  half.t = half.g = 0;
+  half.z = half.y = half.x = 1;
+  padded_dim = neighborhood_padded_dim(AMITK_DATA_SET_DIM(data_set), half);
+  voxel_size = AMITK_DATA_SET_VOXEL_SIZE(data_set);
+  min_size = point_min_dim(voxel_size);
+
+  df.offsets[0] = -1;
+  df.offsets[1] = 1;
+  df.offsets[2] = -((gssize) padded_dim.x);
+  df.offsets[3] = padded_dim.x;
+  df.offsets[4] = -((gssize) padded_dim.y)*padded_dim.x;
+  df.offsets[5] = ((gssize) padded_dim.y)*padded_dim.x;
+  for (i_axis=AMITK_AXIS_X, k=0; i_axis <= AMITK_AXIS_Z; i_axis++, k+=2) {
+    df.rates[k] = df.rates[k+1] = DIFFUSION_TIME_STEP *
+      (min_size/point_get_component(voxel_size, i_axis))*(min_size/point_get_component(voxel_size, i_axis));
+  }
+  df.edge_factor = (edge_threshold > 0.0) ? 1.0/(edge_threshold*edge_threshold) : G_MAXFLOAT;
+
+  return filter_neighborhood(data_set, filtered_ds, half, iterations, diffusion_row, &df,
+			     update_func, update_data);
+}
+
+
 /* returns a filtered version of the given data set */
 AmitkDataSet *amitk_data_set_get_filtered(const AmitkDataSet * ds,
 					  const AmitkFilter filter_type,
 					  const gint kernel_size,
 					  const amide_real_t fwhm, 
+					  const amide_data_t edge_scale,
+					  const gint iterations,
 					  AmitkUpdateFunc update_func,
 					  gpointer update_data) {
 
@@ -5341,12 +6822,24 @@ AmitkDataSet *amitk_data_set_get_filtered(const AmitkDataSet * ds,
 
   switch(filter_type) {
 
-#ifdef AMIDE_LIBGSL_SUPPORT
   case AMITK_FILTER_GAUSSIAN:
+#ifdef AMIDE_LIBGSL_SUPPORT
     {
       AmitkRawData * kernel;
       AmitkVoxel kernel_size_3D;
 
+      gboolean out_of_memory;
+
+      if (kernel_size <= AMITK_FILTER_SEPARABLE_MAX_SIZE) {
+	good = filter_gaussian_separable(ds, filtered, kernel_size, fwhm, update_func, update_data);
+	break;
+      }
+
+      good = filter_gaussian_fft(ds, filtered, kernel_size, fwhm, &out_of_memory, update_func, update_data);
+      if (!out_of_memory) break;
+
+      /* fall back to filtering the data set in small blocks */
+
       kernel_size_3D.t=kernel_size_3D.g=1;
       kernel_size_3D.z=kernel_size_3D.y=kernel_size_3D.x=kernel_size;
 
@@ -5360,8 +6853,10 @@ AmitkDataSet *amitk_data_set_get_filtered(const AmitkDataSet * ds,
       good = filter_fir(ds, filtered, kernel, kernel_size_3D, update_func, update_data);
       g_object_unref(kernel);
     }
-    break;
+#else /* no libgsl support, the separable filter handles any kernel size, just slower */
+    good = filter_gaussian_separable(ds, filtered, kernel_size, fwhm, update_func, update_data);
 #endif
+    break;
 
   case AMITK_FILTER_MEDIAN_LINEAR:
     good = filter_median_linear(ds, filtered, kernel_size, update_func, update_data);
@@ -5374,6 +6869,25 @@ AmitkDataSet *amitk_data_set_get_filtered(const AmitkDataSet * ds,
     good = filter_median_3D(ds, filtered, kernel_dim, update_func, update_data);
     break;
 
+  case AMITK_FILTER_BILATERAL:
+  case AMITK_FILTER_ANISOTROPIC_DIFFUSION:
+    {
+      amide_data_t internal_edge_scale;
+
+      /* edge_scale is given in the data set's units, the filters work on internal values */
+      if (!EQUAL_ZERO(AMITK_DATA_SET_SCALE_FACTOR(ds)))
+	internal_edge_scale = edge_scale/fabs(AMITK_DATA_SET_SCALE_FACTOR(ds));
+      else
+	internal_edge_scale = edge_scale;
+
+      if (filter_type == AMITK_FILTER_BILATERAL)
+	good = filter_bilateral(ds, filtered, kernel_size, fwhm, internal_edge_scale, 
+				update_func, update_data);
+      else
+	good = filter_anisotropic_diffusion(ds, filtered, iterations, internal_edge_scale, 
+					    update_func, update_data);
+    }
+    break;
 
   default: 
     g_error("unexpected case in %s at line %d", __FILE__, __LINE__);
@@ -5548,21 +7062,13 @@ GList * amitk_data_sets_remove_with_slice_parent(GList * slices,const AmitkDataS
   return slices;
 }
 
-/* trim cache slice size down to max_size, removes from end */
-GList * slice_cache_trim(GList * slice_cache, gint max_size) {
-
-  GList * last;
-
-  while (g_list_length(slice_cache) > max_size) {
-    last = g_list_last(slice_cache);
-    slice_cache = g_list_remove_link(slice_cache, last);
-    amitk_objects_unref(last);
-  }
-
-  return slice_cache;
-}
+/* the slice cache is shared by everyone asking for slices (canvases, series
+   windows, exports, the background slicer).  Entries are hashed on everything that
+   determines a slice's contents, and the cache is trimmed least recently used first
+   down to a byte budget.  All access goes through slice_cache_mutex, which is
+   recursive as dropping a slice can reenter the cache from the slice's finalize.
 
-/* several things cause slice caches to get invalidated, so they don't need to be
+   several things cause slice caches to get invalidated, so they don't need to be
    explicitly checked here
 
    1. Scale factor changes
@@ -5571,63 +7077,403 @@ GList * slice_cache_trim(GList * slice_cache, gint max_size) {
    4. Any change to the raw data
 
 */
-static AmitkDataSet * slice_cache_find (GList * slice_cache, AmitkDataSet * parent_ds, 
-					const amide_time_t start, const amide_time_t duration,
-					const amide_intpoint_t gate,
-					const AmitkCanvasPoint pixel_size, const AmitkVolume * view_volume) {
-
-  AmitkDataSet * slice;
+#define SLICE_KEY_QUANTUM 1024.0 /* hash resolution, 1/1024 mm or s */
+#define DEFAULT_SLICE_CACHE_SIZE (128*1024*1024)
+
+typedef struct {
+  AmitkDataSet * parent;
+  AmitkPoint offset;
+  AmitkAxes axes;
+  amide_time_t start;
+  amide_time_t duration;
+  amide_intpoint_t start_gate;
+  amide_intpoint_t end_gate;
   AmitkVoxel dim;
-  amide_intpoint_t start_gate, end_gate;
+  amide_real_t thickness;
+  AmitkInterpolation interpolation;
+  AmitkRendering rendering;
+} slice_key_t;
 
-  if (slice_cache == NULL) {
-    return NULL;
+typedef struct {
+  slice_key_t key;
+  AmitkDataSet * slice;
+  gsize size;
+  GList * lru_link;
+} slice_cache_entry_t;
+
+static GRecMutex slice_cache_mutex;
+static GHashTable * slice_cache = NULL;
+static GQueue slice_cache_lru = G_QUEUE_INIT; /* most recently used first */
+static gsize slice_cache_used = 0;
+static gsize slice_cache_size = DEFAULT_SLICE_CACHE_SIZE;
+
+static void slice_key_init(slice_key_t * key, AmitkDataSet * parent_ds, 
+			   const amide_time_t start, const amide_time_t duration,
+			   const amide_intpoint_t gate,
+			   const AmitkCanvasPoint pixel_size, const AmitkVolume * view_volume) {
+
+  memset(key, 0, sizeof(slice_key_t)); /* no padding garbage */
+
+  key->parent = parent_ds;
+  key->offset = AMITK_SPACE_OFFSET(view_volume);
+  amitk_axes_copy_in_place(key->axes, AMITK_SPACE_AXES(view_volume));
+  key->start = start;
+  key->duration = duration;
+  if (gate < 0) {
+    key->start_gate = AMITK_DATA_SET_VIEW_START_GATE(parent_ds);
+    key->end_gate = AMITK_DATA_SET_VIEW_END_GATE(parent_ds);
   } else {
-    slice = slice_cache->data;
-    if (AMITK_DATA_SET_SLICE_PARENT(slice) == parent_ds) 
-      if (amitk_space_equal(AMITK_SPACE(slice), AMITK_SPACE(view_volume))) 
-	if (REAL_EQUAL(slice->scan_start, start)) 
-	  if (REAL_EQUAL(amitk_data_set_get_frame_duration(slice,0), duration)) {
-	    if (gate < 0) {
-	      start_gate = AMITK_DATA_SET_VIEW_START_GATE(AMITK_DATA_SET_SLICE_PARENT(slice));
-	      end_gate = AMITK_DATA_SET_VIEW_END_GATE(AMITK_DATA_SET_SLICE_PARENT(slice));
-	    } else {
-	      start_gate = gate;
-	      end_gate = gate;
-	    }
-	    if (AMITK_DATA_SET_VIEW_START_GATE(slice) == start_gate)
-	      if (AMITK_DATA_SET_VIEW_END_GATE(slice) == end_gate)
-		if (REAL_EQUAL(slice->voxel_size.z,AMITK_VOLUME_Z_CORNER(view_volume))) {
-		  dim.x = ceil(fabs(AMITK_VOLUME_X_CORNER(view_volume))/pixel_size.x);
-		  dim.y = ceil(fabs(AMITK_VOLUME_Y_CORNER(view_volume))/pixel_size.y);
-		  dim.z = dim.t = dim.g = 1;
-		  if (VOXEL_EQUAL(dim, AMITK_DATA_SET_DIM(slice))) 
-		    if (AMITK_DATA_SET_INTERPOLATION(slice) == AMITK_DATA_SET_INTERPOLATION(parent_ds)) 
-		      if (AMITK_DATA_SET_RENDERING(slice) == AMITK_DATA_SET_RENDERING(parent_ds)) 
-			return slice;
-		}
-	  }
+    key->start_gate = gate;
+    key->end_gate = gate;
   }
-  
+  key->dim.x = ceil(fabs(AMITK_VOLUME_X_CORNER(view_volume))/pixel_size.x);
+  key->dim.y = ceil(fabs(AMITK_VOLUME_Y_CORNER(view_volume))/pixel_size.y);
+  key->dim.z = key->dim.t = key->dim.g = 1;
+  key->thickness = AMITK_VOLUME_Z_CORNER(view_volume);
+  key->interpolation = AMITK_DATA_SET_INTERPOLATION(parent_ds);
+  key->rendering = AMITK_DATA_SET_RENDERING(parent_ds);
+
+  return;
+}
+
+/* the floating point members are compared with REAL_EQUAL, so they're only
+   hashed coarsely.  A key straddling a quantization boundary just costs a miss */
+static guint slice_key_quantize(const amide_real_t value) {
+  return (guint) ((gint64) floor(value*SLICE_KEY_QUANTUM+0.5));
+}
+
+static guint slice_key_hash(gconstpointer data) {
+
+  const slice_key_t * key = data;
+  guint hash;
+
+  hash = g_direct_hash(key->parent);
+  hash = hash*31 + key->start_gate;
+  hash = hash*31 + key->end_gate;
+  hash = hash*31 + key->dim.x;
+  hash = hash*31 + key->dim.y;
+  hash = hash*31 + key->interpolation;
+  hash = hash*31 + key->rendering;
+  hash = hash*31 + slice_key_quantize(key->offset.x);
+  hash = hash*31 + slice_key_quantize(key->offset.y);
+  hash = hash*31 + slice_key_quantize(key->offset.z);
+  hash = hash*31 + slice_key_quantize(key->start);
+
+  return hash;
+}
+
+static gboolean slice_key_equal(gconstpointer data1, gconstpointer data2) {
+
+  const slice_key_t * key1 = data1;
+  const slice_key_t * key2 = data2;
+  AmitkAxis i_axis;
+
+  if ((key1->parent != key2->parent) ||
+      (key1->start_gate != key2->start_gate) ||
+      (key1->end_gate != key2->end_gate) ||
+      (key1->interpolation != key2->interpolation) ||
+      (key1->rendering != key2->rendering) ||
+      !VOXEL_EQUAL(key1->dim, key2->dim))
+    return FALSE;
+
+  if (!POINT_EQUAL(key1->offset, key2->offset))
+    return FALSE;
+  for (i_axis=0; i_axis<AMITK_AXIS_NUM; i_axis++)
+    if (!POINT_EQUAL(key1->axes[i_axis], key2->axes[i_axis]))
+      return FALSE;
+
+  return (REAL_EQUAL(key1->start, key2->start) &&
+	  REAL_EQUAL(key1->duration, key2->duration) &&
+	  REAL_EQUAL(key1->thickness, key2->thickness));
+}
+
+/* entries are unlinked from the lru list and the parent's count by the caller,
+   this just releases the memory */
+static void slice_cache_entry_free(gpointer data) {
+
+  slice_cache_entry_t * entry = data;
+
+  amitk_object_unref(entry->slice);
+  g_free(entry);
+
+  return;
+}
+
+static void slice_cache_unlink(slice_cache_entry_t * entry) {
 
-  /* this one's not it, keep looking */
-  return slice_cache_find(slice_cache->next, parent_ds, start, duration, gate, pixel_size, view_volume);
+  g_queue_delete_link(&slice_cache_lru, entry->lru_link);
+  entry->lru_link = NULL;
+  slice_cache_used -= entry->size;
+  entry->key.parent->slice_cache_entries--;
+
+  return;
 }
 
+/* trim the cache down to max_size bytes, removes least recently used first */
+static void slice_cache_trim(gsize max_size) {
+
+  slice_cache_entry_t * entry;
+
+  g_rec_mutex_lock(&slice_cache_mutex);
+  while ((slice_cache_used > max_size) && (!g_queue_is_empty(&slice_cache_lru))) {
+    entry = g_queue_peek_tail(&slice_cache_lru);
+    slice_cache_unlink(entry);
+    g_hash_table_remove(slice_cache, &(entry->key));
+  }
+  g_rec_mutex_unlock(&slice_cache_mutex);
+
+  return;
+}
+
+/* removes all slices generated from parent_ds from the cache */
+static void slice_cache_remove_parent(AmitkDataSet * parent_ds) {
+
+  GList * removed=NULL;
+  GList * link;
+  GList * next;
+  slice_cache_entry_t * entry;
+
+  g_rec_mutex_lock(&slice_cache_mutex);
+  if (parent_ds->slice_cache_entries == 0) {
+    g_rec_mutex_unlock(&slice_cache_mutex);
+    return;
+  }
+
+  /* unlink everything first, as unref'ing the slices may reenter here */
+  link = slice_cache_lru.head;
+  while (link != NULL) {
+    next = link->next;
+    entry = link->data;
+    if (entry->key.parent == parent_ds) {
+      slice_cache_unlink(entry);
+      g_hash_table_steal(slice_cache, &(entry->key));
+      removed = g_list_prepend(removed, entry);
+    }
+    link = next;
+  }
+  g_rec_mutex_unlock(&slice_cache_mutex);
+
+  g_list_free_full(removed, slice_cache_entry_free);
+
+  return;
+}
+
+/* removes parent_ds's slices, and makes sure that slices still being generated
+   from its old state (by the background slicer) don't get added */
+static void slice_cache_invalidate_parent(AmitkDataSet * parent_ds) {
+
+  g_rec_mutex_lock(&slice_cache_mutex);
+  parent_ds->slice_cache_generation++;
+  slice_cache_remove_parent(parent_ds);
+  g_rec_mutex_unlock(&slice_cache_mutex);
+
+  return;
+}
+
+/* returns a referenced slice, or NULL if not in the cache */
+static AmitkDataSet * slice_cache_find(const slice_key_t * key) {
+
+  slice_cache_entry_t * entry;
+  AmitkDataSet * slice = NULL;
+
+  g_rec_mutex_lock(&slice_cache_mutex);
+  if (slice_cache != NULL) {
+    entry = g_hash_table_lookup(slice_cache, key);
+    if (entry != NULL) {
+      /* move to the front of the lru list */
+      g_queue_unlink(&slice_cache_lru, entry->lru_link);
+      g_queue_push_head_link(&slice_cache_lru, entry->lru_link);
+      slice = amitk_object_ref(entry->slice);
+    }
+  }
+  g_rec_mutex_unlock(&slice_cache_mutex);
+
+  return slice;
+}
+
+/* generation is the parent's slice_cache_generation from before the slice was 
+   generated, the slice is dropped if the parent's been invalidated since */
+static void slice_cache_add(const slice_key_t * key, AmitkDataSet * slice, const guint generation) {
+
+  slice_cache_entry_t * entry;
+
+  entry = g_new(slice_cache_entry_t, 1);
+  entry->key = *key;
+  entry->slice = amitk_object_ref(slice);
+  entry->size = sizeof(AmitkDataSet) + amitk_raw_data_size_data_mem(AMITK_DATA_SET_RAW_DATA(slice));
+
+  g_rec_mutex_lock(&slice_cache_mutex);
+  if (slice_cache == NULL)
+    slice_cache = g_hash_table_new_full(slice_key_hash, slice_key_equal, 
+					NULL, slice_cache_entry_free);
+
+  /* someone else may have generated the same slice in the meantime, or the 
+     slice may be from before the parent changed */
+  if ((g_hash_table_lookup(slice_cache, key) != NULL) ||
+      (key->parent->slice_cache_generation != generation)) {
+    g_rec_mutex_unlock(&slice_cache_mutex);
+    slice_cache_entry_free(entry);
+    return;
+  }
+
+  g_queue_push_head(&slice_cache_lru, entry);
+  entry->lru_link = slice_cache_lru.head;
+  slice_cache_used += entry->size;
+  key->parent->slice_cache_entries++;
+
+  g_hash_table_insert(slice_cache, &(entry->key), entry);
+  g_rec_mutex_unlock(&slice_cache_mutex);
+
+  return;
+}
+
+/* sets the memory budget (in bytes) of the slice cache shared by all data sets */
+void amitk_data_sets_set_slice_cache_size(const gsize cache_size) {
+
+  slice_cache_size = cache_size;
+  slice_cache_trim(slice_cache_size);
+
+  return;
+}
+
+
+
+/* returns TRUE if the slices for all the data sets in objects are already in the
+   slice cache, i.e. amitk_data_sets_get_slices will return without slicing */
+gboolean amitk_data_sets_slices_cached(GList * objects,
+				       const amide_time_t start,
+				       const amide_time_t duration,
+				       const amide_intpoint_t gate,
+				       const AmitkCanvasPoint pixel_size,
+				       const AmitkVolume * view_volume) {
+
+  slice_key_t key;
+  gboolean cached = TRUE;
+
+  g_rec_mutex_lock(&slice_cache_mutex);
+  while ((objects != NULL) && cached) {
+    if (AMITK_IS_DATA_SET(objects->data)) {
+      slice_key_init(&key, AMITK_DATA_SET(objects->data), start, duration, gate, pixel_size, view_volume);
+      if ((slice_cache == NULL) || (g_hash_table_lookup(slice_cache, &key) == NULL))
+	cached = FALSE;
+    }
+    objects = objects->next;
+  }
+  g_rec_mutex_unlock(&slice_cache_mutex);
+
+  return cached;
+}
+
+
+/* returns a copy of ds with just what's needed to slice it, sharing ds's raw data.
+   This is what gets handed to the background slicer, so that the scaling factors,
+   thresholding, gates, etc. of ds can change on the main thread while slicing.
+   Needs to be called from the main thread. */
+AmitkDataSet * amitk_data_set_get_slicing_snapshot(AmitkDataSet * ds) {
+
+  AmitkDataSet * snapshot;
+  guint i;
+
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+  g_return_val_if_fail(ds->raw_data != NULL, NULL);
+
+  snapshot = amitk_data_set_new(NULL, AMITK_DATA_SET_MODALITY(ds));
+  amitk_space_copy_in_place(AMITK_SPACE(snapshot), AMITK_SPACE(ds));
+  amitk_object_set_name(AMITK_OBJECT(snapshot), AMITK_OBJECT_NAME(ds));
+  snapshot->raw_data = g_object_ref(ds->raw_data);
+  snapshot->voxel_size = AMITK_DATA_SET_VOXEL_SIZE(ds);
+  amitk_data_set_calc_far_corner(snapshot);
+
+  snapshot->scaling_type = ds->scaling_type;
+  if (snapshot->internal_scaling_factor != NULL)
+    g_object_unref(snapshot->internal_scaling_factor);
+  snapshot->internal_scaling_factor = g_object_ref(ds->internal_scaling_factor);
+  if (ds->internal_scaling_intercept != NULL) {
+    if (snapshot->internal_scaling_intercept != NULL)
+      g_object_unref(snapshot->internal_scaling_intercept);
+    snapshot->internal_scaling_intercept = g_object_ref(ds->internal_scaling_intercept);
+  }
+  amitk_data_set_set_scale_factor(snapshot, AMITK_DATA_SET_SCALE_FACTOR(ds));
+
+  snapshot->scan_start = AMITK_DATA_SET_SCAN_START(ds);
+  snapshot->thresholding = AMITK_DATA_SET_THRESHOLDING(ds);
+  for (i=0; i<2; i++) {
+    snapshot->threshold_max[i] = AMITK_DATA_SET_THRESHOLD_MAX(ds, i);
+    snapshot->threshold_min[i] = AMITK_DATA_SET_THRESHOLD_MIN(ds, i);
+    snapshot->threshold_ref_frame[i] = AMITK_DATA_SET_THRESHOLD_REF_FRAME(ds, i);
+  }
+  snapshot->interpolation = AMITK_DATA_SET_INTERPOLATION(ds);
+  snapshot->rendering = AMITK_DATA_SET_RENDERING(ds);
+  snapshot->view_start_gate = AMITK_DATA_SET_VIEW_START_GATE(ds);
+  snapshot->view_end_gate = AMITK_DATA_SET_VIEW_END_GATE(ds);
+  snapshot->num_view_gates = AMITK_DATA_SET_NUM_VIEW_GATES(ds);
+
+  snapshot->gate_time = amitk_data_set_get_gate_time_mem(snapshot);
+  g_return_val_if_fail(snapshot->gate_time != NULL, snapshot);
+  for (i=0;i<AMITK_DATA_SET_NUM_GATES(snapshot);i++)
+    snapshot->gate_time[i] = amitk_data_set_get_gate_time(ds, i);
+
+  snapshot->frame_duration = amitk_data_set_get_frame_duration_mem(snapshot);
+  g_return_val_if_fail(snapshot->frame_duration != NULL, snapshot);
+  for (i=0;i<AMITK_DATA_SET_NUM_FRAMES(snapshot);i++)
+    snapshot->frame_duration[i] = amitk_data_set_get_frame_duration(ds, i);
+
+  return snapshot;
+}
+
+/* used by the background slicer: slices the snapshot of parent_ds (from 
+   amitk_data_set_get_slicing_snapshot), and puts the slice in the slice cache as 
+   a slice of parent_ds.  generation is parent_ds's slice cache generation from when
+   the snapshot was taken, the slice is dropped if parent_ds has changed since.
+   Safe to call from a thread other than the main thread. */
+void amitk_data_set_cache_slice(AmitkDataSet * parent_ds,
+				AmitkDataSet * snapshot,
+				const guint generation,
+				const amide_time_t start,
+				const amide_time_t duration,
+				const AmitkCanvasPoint pixel_size,
+				const AmitkVolume * view_volume) {
+
+  AmitkDataSet * slice;
+  slice_key_t key;
+
+  /* the key's taken from the snapshot, as parent_ds's gates, etc. may have changed */
+  slice_key_init(&key, snapshot, start, duration, -1, pixel_size, view_volume);
+  key.parent = parent_ds;
+
+  /* don't bother if it's already there, or already out of date */
+  if ((slice = slice_cache_find(&key)) != NULL) {
+    amitk_object_unref(slice);
+    return;
+  }
+  if (AMITK_DATA_SET_SLICE_CACHE_GENERATION(parent_ds) != generation)
+    return;
+
+  slice = amitk_data_set_get_slice(snapshot, start, duration, -1, pixel_size, view_volume);
+  g_return_if_fail(slice != NULL);
+
+  /* and make it look like it came from parent_ds */
+  g_object_remove_weak_pointer(G_OBJECT(snapshot), (gpointer *) &(slice->slice_parent));
+  slice->slice_parent = parent_ds;
+  g_object_add_weak_pointer(G_OBJECT(parent_ds), (gpointer *) &(slice->slice_parent));
+
+  slice_cache_add(&key, slice, generation);
+  amitk_object_unref(slice);
+  slice_cache_trim(slice_cache_size);
+
+  return;
+}
 
 
 /* give a list of data_sets, returns a list of slices of equal size and orientation
-   intersecting these data_sets.  The slice_cache is a list of already generated slices,
-   if an appropriate slice is found in there, it'll be used */
+   intersecting these data_sets.  Slices already in the shared slice cache will be reused,
+   newly generated slices are added to the cache if use_cache is TRUE */
 /* notes
-   - in real practice, the parent data set's local cache is rarely used,
-     as most slices, if there in the local cache, will also be in the passed in cache
    - the "gate" parameter should ordinarily by -1 (ignored).  Only use it to override the
      the data set's view_start_gate/view_end_gate parameters 
  */
 GList * amitk_data_sets_get_slices(GList * objects,
-				   GList ** pslice_cache,
-				   const gint max_slice_cache_size,
+				   const gboolean use_cache,
 				   const amide_time_t start,
 				   const amide_time_t duration,
 				   const amide_intpoint_t gate,
@@ -5636,11 +7482,10 @@ GList * amitk_data_sets_get_slices(GList * objects,
 
 
   GList * slices=NULL;
-  AmitkDataSet * local_slice;
-  AmitkDataSet * canvas_slice=NULL;
   AmitkDataSet * slice;
   AmitkDataSet * parent_ds;
-  gint num_data_sets=0;
+  slice_key_t key;
+  guint generation;
 
 #ifdef SLICE_TIMING
   struct timeval tv1;
@@ -5657,46 +7502,27 @@ GList * amitk_data_sets_get_slices(GList * objects,
   /* and get the slices */
   while (objects != NULL) {
     if (AMITK_IS_DATA_SET(objects->data)) {
-      num_data_sets++;
       parent_ds = AMITK_DATA_SET(objects->data);
 
-      /* try to find it in the caches first */
-      if (pslice_cache != NULL)
-	canvas_slice = slice_cache_find(*pslice_cache, parent_ds, start, duration, 
-					gate, pixel_size, view_volume);
+      /* try to find it in the cache first */
+      slice_key_init(&key, parent_ds, start, duration, gate, pixel_size, view_volume);
+      slice = slice_cache_find(&key);
 
-      local_slice = slice_cache_find(parent_ds->slice_cache, parent_ds, start, duration, 
-				     gate, pixel_size, view_volume);
-
-      if (canvas_slice != NULL) {
-	slice = amitk_object_ref(canvas_slice);
-      } else if (local_slice != NULL) {
-	slice = amitk_object_ref(local_slice);
-      } else {/* generate a new one */
+      if (slice == NULL) {/* generate a new one */
+	generation = AMITK_DATA_SET_SLICE_CACHE_GENERATION(parent_ds);
 	slice = amitk_data_set_get_slice(parent_ds, start, duration, gate, pixel_size, view_volume);
+	g_return_val_if_fail(slice != NULL, slices);
+	if (use_cache)
+	  slice_cache_add(&key, slice, generation);
       }
 
-      g_return_val_if_fail(slice != NULL, slices);
-
       slices = g_list_prepend(slices, slice);
-
-      if ((canvas_slice == NULL) && (pslice_cache != NULL))
-	*pslice_cache = g_list_prepend(*pslice_cache, amitk_object_ref(slice)); /* most recently used first */
-      if (local_slice == NULL) {
-	parent_ds->slice_cache = g_list_prepend(parent_ds->slice_cache, amitk_object_ref(slice));
-
-	/* regulate the size of the local per dataset cache */
-	parent_ds->slice_cache = 
-	  slice_cache_trim(parent_ds->slice_cache, 
-			   3 * MAX(AMITK_DATA_SET_NUM_FRAMES(parent_ds), AMITK_DATA_SET_NUM_GATES(parent_ds)));
-      }
     }
     objects = objects->next;
   }
 
-  /* regulate the size of the global cache */
-  if (pslice_cache != NULL) 
-    *pslice_cache = slice_cache_trim(*pslice_cache, max_slice_cache_size);
+  /* regulate the size of the cache, the slices we just returned are at the front */
+  slice_cache_trim(slice_cache_size);
 
 #ifdef SLICE_TIMING
   /* and wrapup our timing */
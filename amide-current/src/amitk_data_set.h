@@ -69,6 +69,7 @@ G_BEGIN_DECLS
 #define AMITK_DATA_SET_THRESHOLDING(ds)            (AMITK_DATA_SET(ds)->thresholding)
 #define AMITK_DATA_SET_THRESHOLD_STYLE(ds)         (AMITK_DATA_SET(ds)->threshold_style)
 #define AMITK_DATA_SET_SLICE_PARENT(ds)            (AMITK_DATA_SET(ds)->slice_parent)
+#define AMITK_DATA_SET_SLICE_CACHE_GENERATION(ds)  (AMITK_DATA_SET(ds)->slice_cache_generation)
 #define AMITK_DATA_SET_SCAN_DATE(ds)               (AMITK_DATA_SET(ds)->scan_date)
 #define AMITK_DATA_SET_SUBJECT_NAME(ds)            (AMITK_DATA_SET(ds)->subject_name)
 #define AMITK_DATA_SET_SUBJECT_ID(ds)              (AMITK_DATA_SET(ds)->subject_id)
@@ -102,6 +103,11 @@ G_BEGIN_DECLS
 #define AMITK_DATA_SET_NUM_VIEW_GATES(ds)          (AMITK_DATA_SET(ds)->num_view_gates)
 
 #define AMITK_DATA_SET_DISTRIBUTION_SIZE 256
+/* bins used for each slice while gathering the distribution, before they're 
+   combined over the data set's full range.  Each slice bin lands whole in the
+   distribution bin holding its center, so the distribution is approximate, 
+   off by at most one bin where a slice bin straddles a distribution bin edge */
+#define AMITK_DATA_SET_SLICE_DISTRIBUTION_SIZE 512
 
 typedef enum {
   AMITK_OPERATION_UNARY_RESCALE,
@@ -242,6 +248,10 @@ typedef enum { /*< skip >*/
 typedef struct _AmitkDataSetClass AmitkDataSetClass;
 typedef struct _AmitkDataSet AmitkDataSet;
 
+/* value of a data set at a point in its own space, see amitk_data_set_get_sample_func */
+typedef amide_data_t (*AmitkDataSetSampleFunc) (AmitkDataSet * ds, AmitkVoxel i_voxel, 
+						const AmitkPoint point);
+
 
 struct _AmitkDataSet
 {
@@ -301,6 +311,8 @@ struct _AmitkDataSet
   /* in theory, could be recalculated on the fly, but used enough we'll store... */
   AmitkRawData * distribution; /* 1D array of data distribution, used in thresholding */
   gboolean min_max_calculated; /* the min/max values can be calculated on demand */
+  guint data_generation; /* bumped whenever voxel values are changed in place */
+  guint min_max_generation; /* the data_generation the min/max values were calculated at */
   amide_data_t global_max;
   amide_data_t global_min;
   amide_data_t * frame_max; 
@@ -308,7 +320,9 @@ struct _AmitkDataSet
   AmitkRawData * current_scaling_factor; /* external_scaling * internal_scaling_factor[] */
   amide_intpoint_t num_view_gates;
 
-  GList * slice_cache;
+  guint slice_cache_entries; /* slices of this data set in the shared slice cache */
+  guint slice_cache_generation; /* bumped each time this data set's slices are invalidated */
+  AmitkColorTableLut * color_table_lut[AMITK_VIEW_MODE_NUM]; /* last used color lookup tables */
 
   /* only used by derived data sets (slices and projections)  */
   /* this is a weak pointer, it should be NULL'ed automatically by gtk on the parent's destruction */
@@ -402,6 +416,10 @@ amide_data_t   amitk_data_set_get_frame_min      (AmitkDataSet * ds,
 						  const guint frame);
 AmitkColorTable amitk_data_set_get_color_table_to_use(AmitkDataSet * ds, 
 						      const AmitkViewMode view_mode);
+AmitkColorTableLut * amitk_data_set_get_color_table_lut(AmitkDataSet * ds,
+							const AmitkViewMode view_mode,
+							const amide_data_t min,
+							const amide_data_t max);
 void           amitk_data_set_set_modality       (AmitkDataSet * ds,
 						  const AmitkModality modality);
 void           amitk_data_set_set_scan_start     (AmitkDataSet * ds,
@@ -565,8 +583,11 @@ AmitkDataSet * amitk_data_set_get_filtered        (const AmitkDataSet * ds,
 						   const AmitkFilter filter_type,
 						   const gint kernel_size,
 						   const amide_real_t fwhm,
+						   const amide_data_t edge_scale,
+						   const gint iterations,
 						   AmitkUpdateFunc update_func,
 						   gpointer update_data);
+AmitkDataSetSampleFunc amitk_data_set_get_sample_func (const AmitkDataSet * ds);
 AmitkDataSet * amitk_data_set_get_slice           (AmitkDataSet * ds,
 						   const amide_time_t start,
 						   const amide_time_t duration,
@@ -587,9 +608,23 @@ gint           amitk_data_sets_count                 (GList * objects, gboolean
 amide_time_t   amitk_data_sets_get_min_frame_duration(GList * objects);
 amide_real_t   amitk_data_sets_get_min_voxel_size    (GList * objects);
 amide_real_t   amitk_data_sets_get_max_min_voxel_size(GList * objects);
+void           amitk_data_sets_set_slice_cache_size  (const gsize cache_size);
+gboolean       amitk_data_sets_slices_cached         (GList * objects,
+						      const amide_time_t start,
+						      const amide_time_t duration,
+						      const amide_intpoint_t gate,
+						      const AmitkCanvasPoint pixel_size,
+						      const AmitkVolume * view_volume);
+AmitkDataSet * amitk_data_set_get_slicing_snapshot   (AmitkDataSet * ds);
+void           amitk_data_set_cache_slice            (AmitkDataSet * parent_ds,
+						      AmitkDataSet * snapshot,
+						      const guint generation,
+						      const amide_time_t start,
+						      const amide_time_t duration,
+						      const AmitkCanvasPoint pixel_size,
+						      const AmitkVolume * view_volume);
 GList *        amitk_data_sets_get_slices            (GList * objects,
-						      GList ** pslice_cache,
-						      const gint max_slice_cache_size,
+						      const gboolean use_cache,
 						      const amide_time_t start,
 						      const amide_time_t duration,
 						      const amide_intpoint_t gate,
@@ -76,19 +76,21 @@ void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_calc_slice_min_max(Ami
 									     const amide_intpoint_t gate,
 									     const amide_intpoint_t z,
 									     amitk_format_DOUBLE_t * pmin,
-									     amitk_format_DOUBLE_t * pmax);
+									     amitk_format_DOUBLE_t * pmax,
+									     guint32 * counts);
 void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_INTERCEPT_calc_slice_min_max(AmitkDataSet * data_set,
 										       const amide_intpoint_t frame,
 										       const amide_intpoint_t gate,
 										       const amide_intpoint_t z,
 										       amitk_format_DOUBLE_t * pmin,
-										       amitk_format_DOUBLE_t * pmax);
-void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_calc_distribution(AmitkDataSet * data_set,
-									     AmitkUpdateFunc update_func,
-									    gpointer update_data);
-void amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_INTERCEPT_calc_distribution(AmitkDataSet * data_set,
-										      AmitkUpdateFunc update_func,
-										      gpointer update_data);
+										       amitk_format_DOUBLE_t * pmax,
+										       guint32 * counts);
+amide_data_t amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_get_sample(AmitkDataSet * data_set,
+									     AmitkVoxel i_voxel,
+									     const AmitkPoint point);
+amide_data_t amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_INTERCEPT_get_sample(AmitkDataSet * data_set,
+										       AmitkVoxel i_voxel,
+										       const AmitkPoint point);
 AmitkDataSet * amitk_data_set_`'m4_Variable_Type`'_`'m4_Scale_Dim`'_get_slice(AmitkDataSet * data_set,
 									      const amide_time_t start_time,
 									      const amide_time_t duration,
@@ -105,6 +105,39 @@ AmitkRawData * amitk_filter_calculate_gaussian_kernel_complex(const AmitkVoxel k
   return kernel;
 }
 
+/* the 3D gaussian is separable, this is its profile along one axis, 
+   normalized so that the product of the three profiles matches the 
+   renormalized 3D kernel */
+gfloat * amitk_filter_calculate_gaussian_kernel_1D(const gint kernel_size,
+						   const amide_real_t voxel_size,
+						   const amide_real_t fwhm) {
+
+  gfloat * kernel;
+  amide_real_t sigma;
+  amide_real_t total;
+  gint half;
+  gint i;
+
+  g_return_val_if_fail((kernel_size & 0x1), NULL); /* needs to be odd */
+
+  if ((kernel = g_try_new(gfloat, kernel_size)) == NULL) {
+    g_warning(_("Couldn't allocate memory space for the kernel data"));
+    return NULL;
+  }
+
+  sigma = fwhm/SIGMA_TO_FWHM;
+  half = kernel_size>>1;
+
+  total = 0.0;
+  for (i=0; i<kernel_size; i++)
+    total += gaussian(voxel_size*(i-half), sigma);
+
+  for (i=0; i<kernel_size; i++)
+    kernel[i] = gaussian(voxel_size*(i-half), sigma)/total;
+
+  return kernel;
+}
+
 #ifdef AMIDE_LIBGSL_SUPPORT
 void amitk_filter_3D_FFT(AmitkRawData * data, 
 			   gsl_fft_complex_wavetable * wavetable,
@@ -225,6 +258,84 @@ void amitk_filter_complex_mult(AmitkRawData * data, AmitkRawData * kernel) {
   return;
 }
 
+/* the smallest size >= min_size that only has factors of 2, 3, and 5, 
+   which gsl's mixed radix FFT's handle quickly */
+gint amitk_filter_fft_fast_size(const gint min_size) {
+
+  gint size;
+  gint remainder;
+
+  for (size = MAX(min_size,1); ; size++) {
+    remainder = size;
+    while ((remainder % 2) == 0) remainder /= 2;
+    while ((remainder % 3) == 0) remainder /= 3;
+    while ((remainder % 5) == 0) remainder /= 5;
+    if (remainder == 1)
+      return size;
+  }
+}
+
+/* converts a row from gsl's halfcomplex format (the output of gsl_fft_real_transform)
+   to n/2+1 packed complex values, in place.  Row needs room for 2*(n/2+1) doubles */
+void amitk_filter_halfcomplex_unpack(gdouble * row, const gint n) {
+
+  gint k;
+  gdouble re, im;
+
+  for (k=n/2; k > 0; k--) {
+    re = row[2*k-1];
+    im = (2*k < n) ? row[2*k] : 0.0; /* for even n, the last value is real */
+    row[2*k] = re;
+    row[2*k+1] = im;
+  }
+  row[1] = 0.0;
+
+  return;
+}
+
+/* the reverse of amitk_filter_halfcomplex_unpack, the row can then go to 
+   gsl_fft_halfcomplex_inverse */
+void amitk_filter_halfcomplex_pack(gdouble * row, const gint n) {
+
+  gint k;
+
+  for (k=1; k <= n/2; k++) {
+    row[2*k-1] = row[2*k];
+    if (2*k < n)
+      row[2*k] = row[2*k+1];
+  }
+
+  return;
+}
+
+/* the spectrum of a symmetric 1D kernel centered on the origin of a length n FFT.
+   As the kernel is symmetric, the spectrum is real, returns the first n/2+1 values
+   (the rest are the mirror image) */
+gdouble * amitk_filter_calculate_kernel_spectrum_1D(const gfloat * kernel,
+						    const gint kernel_size,
+						    const gint n) {
+
+  gdouble * spectrum;
+  gint half;
+  gint k, j;
+
+  g_return_val_if_fail((kernel_size & 0x1), NULL); /* needs to be odd */
+
+  if ((spectrum = g_try_new(gdouble, n/2+1)) == NULL) {
+    g_warning(_("Couldn't allocate memory space for the kernel data"));
+    return NULL;
+  }
+
+  half = kernel_size>>1;
+  for (k=0; k <= n/2; k++) {
+    spectrum[k] = kernel[half];
+    for (j=1; j <= half; j++)
+      spectrum[k] += 2.0*kernel[half+j]*cos(2.0*M_PI*k*j/n);
+  }
+
+  return spectrum;
+}
+
 #endif
 
 
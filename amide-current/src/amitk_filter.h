@@ -34,6 +34,8 @@
 #include "amitk_raw_data.h"
 #ifdef AMIDE_LIBGSL_SUPPORT
 #include <gsl/gsl_fft_complex.h>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
 #endif
 
 G_BEGIN_DECLS
@@ -42,15 +44,23 @@ typedef enum {
   AMITK_FILTER_GAUSSIAN,
   AMITK_FILTER_MEDIAN_LINEAR,
   AMITK_FILTER_MEDIAN_3D,
+  AMITK_FILTER_BILATERAL,
+  AMITK_FILTER_ANISOTROPIC_DIFFUSION,
   AMITK_FILTER_NUM
 } AmitkFilter;
 
 #define AMITK_FILTER_FFT_SIZE 64
+/* gaussian kernels up to this size are applied as three 1D convolutions,
+   larger ones go through the FFT */
+#define AMITK_FILTER_SEPARABLE_MAX_SIZE 15
 
 
 AmitkRawData * amitk_filter_calculate_gaussian_kernel_complex(const AmitkVoxel kernel_size,
 							      const AmitkPoint voxel_size,
 							      const amide_real_t fwhm);
+gfloat * amitk_filter_calculate_gaussian_kernel_1D(const gint kernel_size,
+						   const amide_real_t voxel_size,
+						   const amide_real_t fwhm);
 
 #ifdef AMIDE_LIBGSL_SUPPORT
 void amitk_filter_3D_FFT(AmitkRawData * data, 
@@ -60,6 +70,12 @@ void amitk_filter_inverse_3D_FFT(AmitkRawData * data,
 				 gsl_fft_complex_wavetable * wavetable,
 				 gsl_fft_complex_workspace * workspace);
 void amitk_filter_complex_mult(AmitkRawData * data, AmitkRawData * kernel);
+gint amitk_filter_fft_fast_size(const gint min_size);
+void amitk_filter_halfcomplex_unpack(gdouble * row, const gint n);
+void amitk_filter_halfcomplex_pack(gdouble * row, const gint n);
+gdouble * amitk_filter_calculate_kernel_spectrum_1D(const gfloat * kernel,
+						    const gint kernel_size,
+						    const gint n);
 #endif
 amide_data_t amitk_filter_find_median_by_partial_sort(amide_data_t * partial_sort_data, gint size);
 
@@ -32,6 +32,9 @@
 #include "amitk_marshal.h"
 #include "amitk_type_builtins.h"
 #include "amitk_data_set.h"
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+#include "render.h"
+#endif
 
 #define GCONF_AMIDE_ROI "ROI"
 #define GCONF_AMIDE_CANVAS "CANVAS"
@@ -166,6 +169,36 @@ static void preferences_init (AmitkPreferences * preferences) {
   preferences->default_directory = 
     amide_gconf_get_string_with_default(GCONF_AMIDE_MISC,"DefaultDirectory", AMITK_PREFERENCES_DEFAULT_DEFAULT_DIRECTORY);
 
+  preferences->compress_raw_data = 
+    amide_gconf_get_bool_with_default(GCONF_AMIDE_MISC,"CompressRawData", AMITK_PREFERENCES_DEFAULT_COMPRESS_RAW_DATA);
+  amitk_raw_data_set_compress_on_save(preferences->compress_raw_data);
+
+  preferences->slice_cache_size = 
+    amide_gconf_get_int_with_default(GCONF_AMIDE_MISC,"SliceCacheSize", AMITK_PREFERENCES_DEFAULT_SLICE_CACHE_SIZE);
+  if (preferences->slice_cache_size < AMITK_PREFERENCES_MIN_SLICE_CACHE_SIZE)
+    preferences->slice_cache_size = AMITK_PREFERENCES_MIN_SLICE_CACHE_SIZE;
+  if (preferences->slice_cache_size > AMITK_PREFERENCES_MAX_SLICE_CACHE_SIZE)
+    preferences->slice_cache_size = AMITK_PREFERENCES_MAX_SLICE_CACHE_SIZE;
+  amitk_data_sets_set_slice_cache_size(((gsize) preferences->slice_cache_size)*1024*1024);
+
+  preferences->frame_store_size = 
+    amide_gconf_get_int_with_default(GCONF_AMIDE_MISC,"FrameStoreSize", AMITK_PREFERENCES_DEFAULT_FRAME_STORE_SIZE);
+  if (preferences->frame_store_size < AMITK_PREFERENCES_MIN_FRAME_STORE_SIZE)
+    preferences->frame_store_size = AMITK_PREFERENCES_MIN_FRAME_STORE_SIZE;
+  if (preferences->frame_store_size > AMITK_PREFERENCES_MAX_FRAME_STORE_SIZE)
+    preferences->frame_store_size = AMITK_PREFERENCES_MAX_FRAME_STORE_SIZE;
+  amitk_raw_data_set_frame_store_size(((gsize) preferences->frame_store_size)*1024*1024);
+
+  preferences->rendering_cache_size = 
+    amide_gconf_get_int_with_default(GCONF_AMIDE_MISC,"RenderingCacheSize", AMITK_PREFERENCES_DEFAULT_RENDERING_CACHE_SIZE);
+  if (preferences->rendering_cache_size < AMITK_PREFERENCES_MIN_RENDERING_CACHE_SIZE)
+    preferences->rendering_cache_size = AMITK_PREFERENCES_MIN_RENDERING_CACHE_SIZE;
+  if (preferences->rendering_cache_size > AMITK_PREFERENCES_MAX_RENDERING_CACHE_SIZE)
+    preferences->rendering_cache_size = AMITK_PREFERENCES_MAX_RENDERING_CACHE_SIZE;
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+  renderings_set_volume_cache_size(((gsize) preferences->rendering_cache_size)*1024*1024);
+#endif
+
   for (i_modality=0; i_modality<AMITK_MODALITY_NUM; i_modality++) {
     temp_str = g_strdup_printf("DefaultColorTable%s", amitk_modality_get_name(i_modality));
     preferences->color_table[i_modality] = 
@@ -361,6 +394,19 @@ void amitk_preferences_set_prompt_for_save_on_exit(AmitkPreferences * preference
   return;
 }
 
+void amitk_preferences_set_compress_raw_data(AmitkPreferences * preferences, gboolean new_value) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (AMITK_PREFERENCES_COMPRESS_RAW_DATA(preferences) != new_value) {
+    preferences->compress_raw_data = new_value;
+    amide_gconf_set_bool(GCONF_AMIDE_MISC,"CompressRawData",new_value);
+    amitk_raw_data_set_compress_on_save(new_value);
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
 void amitk_preferences_set_which_default_directory(AmitkPreferences * preferences, AmitkWhichDefaultDirectory new_value) {
 
   g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
@@ -375,6 +421,65 @@ void amitk_preferences_set_which_default_directory(AmitkPreferences * preference
 
 
 
+void amitk_preferences_set_slice_cache_size(AmitkPreferences * preferences, gint slice_cache_size) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (slice_cache_size < AMITK_PREFERENCES_MIN_SLICE_CACHE_SIZE) 
+    slice_cache_size = AMITK_PREFERENCES_MIN_SLICE_CACHE_SIZE;
+  if (slice_cache_size > AMITK_PREFERENCES_MAX_SLICE_CACHE_SIZE) 
+    slice_cache_size = AMITK_PREFERENCES_MAX_SLICE_CACHE_SIZE;
+
+  if (AMITK_PREFERENCES_SLICE_CACHE_SIZE(preferences) != slice_cache_size) {
+    preferences->slice_cache_size = slice_cache_size;
+    amide_gconf_set_int(GCONF_AMIDE_MISC,"SliceCacheSize",slice_cache_size);
+    amitk_data_sets_set_slice_cache_size(((gsize) slice_cache_size)*1024*1024);
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
+void amitk_preferences_set_frame_store_size(AmitkPreferences * preferences, gint frame_store_size) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (frame_store_size < AMITK_PREFERENCES_MIN_FRAME_STORE_SIZE) 
+    frame_store_size = AMITK_PREFERENCES_MIN_FRAME_STORE_SIZE;
+  if (frame_store_size > AMITK_PREFERENCES_MAX_FRAME_STORE_SIZE) 
+    frame_store_size = AMITK_PREFERENCES_MAX_FRAME_STORE_SIZE;
+
+  if (AMITK_PREFERENCES_FRAME_STORE_SIZE(preferences) != frame_store_size) {
+    preferences->frame_store_size = frame_store_size;
+    amide_gconf_set_int(GCONF_AMIDE_MISC,"FrameStoreSize",frame_store_size);
+    amitk_raw_data_set_frame_store_size(((gsize) frame_store_size)*1024*1024);
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
+/* 0 lets the rendering code size the cache from the volumes it's loading */
+void amitk_preferences_set_rendering_cache_size(AmitkPreferences * preferences, gint rendering_cache_size) {
+
+  g_return_if_fail(AMITK_IS_PREFERENCES(preferences));
+
+  if (rendering_cache_size < AMITK_PREFERENCES_MIN_RENDERING_CACHE_SIZE) 
+    rendering_cache_size = AMITK_PREFERENCES_MIN_RENDERING_CACHE_SIZE;
+  if (rendering_cache_size > AMITK_PREFERENCES_MAX_RENDERING_CACHE_SIZE) 
+    rendering_cache_size = AMITK_PREFERENCES_MAX_RENDERING_CACHE_SIZE;
+
+  if (AMITK_PREFERENCES_RENDERING_CACHE_SIZE(preferences) != rendering_cache_size) {
+    preferences->rendering_cache_size = rendering_cache_size;
+    amide_gconf_set_int(GCONF_AMIDE_MISC,"RenderingCacheSize",rendering_cache_size);
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+    renderings_set_volume_cache_size(((gsize) rendering_cache_size)*1024*1024);
+#endif
+    g_signal_emit(G_OBJECT(preferences), preferences_signals[MISC_PREFERENCES_CHANGED], 0);
+  }
+  return;
+}
+
+
+
 void amitk_preferences_set_default_directory(AmitkPreferences * preferences, const gchar * new_directory) {
 
   gboolean different=FALSE;
@@ -45,6 +45,10 @@ G_BEGIN_DECLS
 #define AMITK_PREFERENCES_PROMPT_FOR_SAVE_ON_EXIT(object) (AMITK_PREFERENCES(object)->prompt_for_save_on_exit)
 #define AMITK_PREFERENCES_WHICH_DEFAULT_DIRECTORY(object) (AMITK_PREFERENCES(object)->which_default_directory)
 #define AMITK_PREFERENCES_DEFAULT_DIRECTORY(object)       (AMITK_PREFERENCES(object)->default_directory)
+#define AMITK_PREFERENCES_SLICE_CACHE_SIZE(object)        (AMITK_PREFERENCES(object)->slice_cache_size)
+#define AMITK_PREFERENCES_FRAME_STORE_SIZE(object)        (AMITK_PREFERENCES(object)->frame_store_size)
+#define AMITK_PREFERENCES_RENDERING_CACHE_SIZE(object)    (AMITK_PREFERENCES(object)->rendering_cache_size)
+#define AMITK_PREFERENCES_COMPRESS_RAW_DATA(object)       (AMITK_PREFERENCES(object)->compress_raw_data)
 
 #define AMITK_PREFERENCES_CANVAS_ROI_WIDTH(pref)                (AMITK_PREFERENCES(pref)->canvas_roi_width)
 #ifdef AMIDE_LIBGNOMECANVAS_AA
@@ -82,15 +86,25 @@ typedef enum {
 #define AMITK_PREFERENCES_DEFAULT_PANEL_LAYOUT AMITK_PANEL_LAYOUT_MIXED
 #define AMITK_PREFERENCES_DEFAULT_WARNINGS_TO_CONSOLE FALSE
 #define AMITK_PREFERENCES_DEFAULT_PROMPT_FOR_SAVE_ON_EXIT TRUE
+#define AMITK_PREFERENCES_DEFAULT_COMPRESS_RAW_DATA FALSE
 #define AMITK_PREFERENCES_DEFAULT_SAVE_XIF_AS_DIRECTORY FALSE
 #define AMITK_PREFERENCES_DEFAULT_WHICH_DEFAULT_DIRECTORY AMITK_WHICH_DEFAULT_DIRECTORY_NONE
 #define AMITK_PREFERENCES_DEFAULT_DEFAULT_DIRECTORY NULL
 #define AMITK_PREFERENCES_DEFAULT_THRESHOLD_STYLE AMITK_THRESHOLD_STYLE_MIN_MAX
+#define AMITK_PREFERENCES_DEFAULT_SLICE_CACHE_SIZE 128 /* MB */
+#define AMITK_PREFERENCES_DEFAULT_FRAME_STORE_SIZE 1024 /* MB */
+#define AMITK_PREFERENCES_DEFAULT_RENDERING_CACHE_SIZE 0 /* automatic */
 
 #define AMITK_PREFERENCES_MIN_ROI_WIDTH 1
 #define AMITK_PREFERENCES_MAX_ROI_WIDTH 5
 #define AMITK_PREFERENCES_MIN_TARGET_EMPTY_AREA 0
 #define AMITK_PREFERENCES_MAX_TARGET_EMPTY_AREA 25
+#define AMITK_PREFERENCES_MIN_SLICE_CACHE_SIZE 8
+#define AMITK_PREFERENCES_MAX_SLICE_CACHE_SIZE 65536
+#define AMITK_PREFERENCES_MIN_FRAME_STORE_SIZE 64
+#define AMITK_PREFERENCES_MAX_FRAME_STORE_SIZE 65536
+#define AMITK_PREFERENCES_MIN_RENDERING_CACHE_SIZE 0
+#define AMITK_PREFERENCES_MAX_RENDERING_CACHE_SIZE 65536
 
 
 
@@ -109,6 +123,12 @@ struct _AmitkPreferences {
   gboolean save_xif_as_directory;
   AmitkWhichDefaultDirectory which_default_directory;
   gchar * default_directory;
+  gboolean compress_raw_data;
+
+  /* memory preferences */
+  gint slice_cache_size; /* in MB, shared by all canvases and series */
+  gint frame_store_size; /* in MB, frames of mapped data sets kept resident */
+  gint rendering_cache_size; /* in MB, converted rendering volumes, 0 is automatic */
 
   /* canvas preferences -> study preferences */
   gint canvas_roi_width;
@@ -170,12 +190,20 @@ void                amitk_preferences_set_warnings_to_console    (AmitkPreferenc
 								  gboolean new_value);
 void                amitk_preferences_set_prompt_for_save_on_exit(AmitkPreferences * preferences,
 								  gboolean new_value);
+void                amitk_preferences_set_compress_raw_data      (AmitkPreferences * preferences,
+								  gboolean new_value);
 void                amitk_preferences_set_xif_as_directory       (AmitkPreferences * preferences,
 							          gboolean new_value);
 void                amitk_preferences_set_which_default_directory(AmitkPreferences * preferences,
 								  const AmitkWhichDefaultDirectory which_default_directory);
 void                amitk_preferences_set_default_directory      (AmitkPreferences * preferences,
 								  const gchar * directory);
+void                amitk_preferences_set_slice_cache_size       (AmitkPreferences * preferences,
+								  gint slice_cache_size);
+void                amitk_preferences_set_frame_store_size       (AmitkPreferences * preferences,
+								  gint frame_store_size);
+void                amitk_preferences_set_rendering_cache_size   (AmitkPreferences * preferences,
+								  gint rendering_cache_size);
 void                amitk_preferences_set_color_table            (AmitkPreferences * preferences,
 								  AmitkModality modality,
 								  AmitkColorTable color_table);
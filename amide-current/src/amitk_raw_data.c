@@ -27,6 +27,14 @@
 
 #include <sys/stat.h>
 #include <stdio.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef AMIDE_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
 
 #include "amitk_raw_data.h"
 #include "amitk_marshal.h"
@@ -166,9 +174,32 @@ gchar * amitk_raw_format_names[] = {
 static void raw_data_class_init          (AmitkRawDataClass *klass);
 static void raw_data_init                (AmitkRawData      *object);
 static void raw_data_finalize            (GObject           *object);
+static void raw_data_unlink_frames      (AmitkRawData      *raw_data);
 static GObjectClass * parent_class;
 //static guint     raw_data_signals[LAST_SIGNAL];
 
+/* frames of mapped data sets whose pages have been brought in, least recently 
+   used at the head.  Shared by all mapped data, so that scrolling through a large 
+   dynamic study only keeps a bounded number of frames resident. */
+static GMutex frame_store_mutex;
+static GQueue frame_store = G_QUEUE_INIT;
+static gsize frame_store_used = 0;
+static gsize frame_store_size = ((gsize) 1024)*1024*1024;
+
+/* whether amitk_raw_data_write_xml stores data compressed */
+static gboolean compress_on_save = FALSE;
+
+/* progress reporting for amitk_raw_data_write_xml, per thread so a background
+   save doesn't report into a save being done elsewhere */
+typedef struct {
+  AmitkUpdateFunc update_func;
+  gpointer update_data;
+  guint64 total_bytes;
+  guint64 bytes_written;
+} raw_data_write_progress_t;
+
+static GPrivate write_progress = G_PRIVATE_INIT(g_free);
+
 
 
 GType amitk_raw_data_get_type(void) {
@@ -213,6 +244,10 @@ static void raw_data_init (AmitkRawData * raw_data) {
   raw_data->dim = zero_voxel;
   raw_data->data = NULL;
   raw_data->format = AMITK_FORMAT_DOUBLE;
+  raw_data->mapping = NULL;
+  raw_data->mapping_length = 0;
+  raw_data->frame_links = NULL;
+  raw_data->frame_modified = NULL;
 
   return;
 }
@@ -222,6 +257,25 @@ static void raw_data_finalize (GObject *object) {
 
   AmitkRawData * raw_data = AMITK_RAW_DATA(object);
 
+  if (raw_data->frame_links != NULL) {
+    raw_data_unlink_frames(raw_data);
+    g_free(raw_data->frame_links);
+    raw_data->frame_links = NULL;
+  }
+
+  if (raw_data->frame_modified != NULL) {
+    g_free(raw_data->frame_modified);
+    raw_data->frame_modified = NULL;
+  }
+
+#ifdef HAVE_MMAP
+  if (raw_data->mapping != NULL) {
+    munmap(raw_data->mapping, raw_data->mapping_length);
+    raw_data->mapping = NULL;
+    raw_data->data = NULL;
+  }
+#endif
+
   if (raw_data->data != NULL) {
 #ifdef AMIDE_DEBUG
     //g_print("\tfreeing raw data\n");
@@ -786,6 +840,323 @@ AmitkRawData * amitk_raw_data_import_raw_file(const gchar * file_name,
 
 /* function to write out the information content of a raw_data set into an xml
    file.  Returns a string containing the name of the file. */
+/* sets the function used to report progress from amitk_raw_data_write_xml calls 
+   in the current thread, total_bytes being the number of bytes of raw data that 
+   are expected to be written.  Pass a NULL update_func to stop reporting. */
+void amitk_raw_data_set_write_progress(AmitkUpdateFunc update_func, 
+				       gpointer update_data,
+				       guint64 total_bytes) {
+
+  raw_data_write_progress_t * progress=NULL;
+
+  if (update_func != NULL) {
+    progress = g_new(raw_data_write_progress_t, 1);
+    progress->update_func = update_func;
+    progress->update_data = update_data;
+    progress->total_bytes = MAX(total_bytes, 1);
+    progress->bytes_written = 0;
+  }
+  g_private_replace(&write_progress, progress);
+
+  return;
+}
+
+static void raw_data_write_progress(gsize num_bytes) {
+
+  raw_data_write_progress_t * progress;
+
+  if ((progress = g_private_get(&write_progress)) == NULL) return;
+
+  progress->bytes_written += num_bytes;
+  (*progress->update_func)(progress->update_data, NULL, 
+			   MIN(1.0, ((gdouble) progress->bytes_written)/((gdouble) progress->total_bytes)));
+
+  return;
+}
+
+#ifdef AMIDE_ZLIB_SUPPORT
+/* compressed data is stored as a series of independently compressed chunks,
+   each holding a whole number of planes, so that the chunks can be compressed
+   and decompressed in parallel */
+#define RAW_DATA_CHUNK_BYTES 0x400000 /* aim for 4MB of uncompressed data per chunk */
+
+typedef struct {
+  guchar * data; /* uncompressed data */
+  gsize total_bytes;
+  gsize chunk_bytes;
+  gint first_chunk; /* chunk corresponding to task 0 */
+  guchar ** buffers; /* compressed data, one per task */
+  gsize * sizes;
+  guint swap_size; /* if non-zero, swap the byte order of elements of this size */
+  gint error;
+} raw_data_chunks_t;
+
+static void raw_data_swap_bytes(guchar * data, gsize num_bytes, guint element_size) {
+
+  gsize i;
+
+  switch(element_size) {
+  case 2:
+    {
+      guint16 * p = (guint16 *) data;
+      for (i=0; i < num_bytes/2; i++) p[i] = GUINT16_SWAP_LE_BE(p[i]);
+    }
+    break;
+  case 4:
+    {
+      guint32 * p = (guint32 *) data;
+      for (i=0; i < num_bytes/4; i++) p[i] = GUINT32_SWAP_LE_BE(p[i]);
+    }
+    break;
+  case 8:
+    {
+      guint64 * p = (guint64 *) data;
+      for (i=0; i < num_bytes/8; i++) p[i] = GUINT64_SWAP_LE_BE(p[i]);
+    }
+    break;
+  default:
+    break;
+  }
+
+  return;
+}
+
+static void raw_data_compress_chunk(gint task, gpointer user_data) {
+
+  raw_data_chunks_t * chunks = user_data;
+  gsize offset;
+  uLongf compressed_size;
+
+  offset = (chunks->first_chunk+task)*chunks->chunk_bytes;
+  compressed_size = chunks->sizes[task];
+  if (compress2(chunks->buffers[task], &compressed_size, chunks->data+offset, 
+		MIN(chunks->chunk_bytes, chunks->total_bytes-offset), Z_BEST_SPEED) != Z_OK)
+    g_atomic_int_set(&(chunks->error), TRUE);
+  chunks->sizes[task] = compressed_size;
+
+  return;
+}
+
+static void raw_data_uncompress_chunk(gint task, gpointer user_data) {
+
+  raw_data_chunks_t * chunks = user_data;
+  gsize offset;
+  gsize num_bytes;
+  uLongf uncompressed_size;
+
+  offset = (chunks->first_chunk+task)*chunks->chunk_bytes;
+  num_bytes = MIN(chunks->chunk_bytes, chunks->total_bytes-offset);
+  uncompressed_size = num_bytes;
+  if ((uncompress(chunks->data+offset, &uncompressed_size, 
+		  chunks->buffers[task], chunks->sizes[task]) != Z_OK) ||
+      (uncompressed_size != num_bytes))
+    g_atomic_int_set(&(chunks->error), TRUE);
+  else if (chunks->swap_size > 1)
+    raw_data_swap_bytes(chunks->data+offset, num_bytes, chunks->swap_size);
+
+  return;
+}
+
+/* number of chunks to hold in memory at once */
+static gint raw_data_chunk_batch_size(gint num_chunks) {
+  return MIN(num_chunks, 2*amitk_get_num_threads());
+}
+
+/* compresses the data a batch of chunks at a time, writing each batch out in order.
+   The compressed size of each chunk is appended to chunk_sizes.  Returns the 
+   number of planes per chunk, or 0 on failure */
+static gint raw_data_write_chunks(AmitkRawData * raw_data, FILE * file_pointer, GString * chunk_sizes) {
+
+  raw_data_chunks_t chunks;
+  gsize plane_bytes;
+  gint planes_per_chunk;
+  gint num_chunks, batch_size, num_in_batch;
+  gsize bound;
+  gint i;
+  gint return_planes=0;
+
+  plane_bytes = ((gsize) raw_data->dim.x)*raw_data->dim.y*amitk_format_sizes[raw_data->format];
+  planes_per_chunk = MAX(1, RAW_DATA_CHUNK_BYTES/plane_bytes);
+
+  chunks.data = raw_data->data;
+  chunks.total_bytes = amitk_raw_data_size_data_mem(raw_data);
+  chunks.chunk_bytes = planes_per_chunk*plane_bytes;
+  chunks.swap_size = 0;
+  chunks.error = FALSE;
+  num_chunks = (chunks.total_bytes+chunks.chunk_bytes-1)/chunks.chunk_bytes;
+  batch_size = raw_data_chunk_batch_size(num_chunks);
+  bound = compressBound(chunks.chunk_bytes);
+
+  chunks.sizes = g_new(gsize, batch_size);
+  chunks.buffers = g_new0(guchar *, batch_size);
+  for (i=0; i < batch_size; i++) 
+    if ((chunks.buffers[i] = g_try_malloc(bound)) == NULL) {
+      g_warning(_("couldn't allocate memory space for compressing raw data"));
+      goto exit_strategy;
+    }
+
+  for (chunks.first_chunk=0; chunks.first_chunk < num_chunks; chunks.first_chunk += num_in_batch) {
+    num_in_batch = MIN(batch_size, num_chunks-chunks.first_chunk);
+    for (i=0; i < num_in_batch; i++) chunks.sizes[i] = bound;
+
+    amitk_parallel_for(num_in_batch, raw_data_compress_chunk, &chunks);
+    if (chunks.error) goto exit_strategy;
+
+    for (i=0; i < num_in_batch; i++) {
+      if (fwrite(chunks.buffers[i], 1, chunks.sizes[i], file_pointer) != chunks.sizes[i])
+	goto exit_strategy;
+      g_string_append_printf(chunk_sizes, (chunks.first_chunk+i == 0) ? "%" G_GSIZE_FORMAT : " %" G_GSIZE_FORMAT, 
+			     chunks.sizes[i]);
+    }
+    raw_data_write_progress(MIN(num_in_batch*chunks.chunk_bytes, 
+				chunks.total_bytes-chunks.first_chunk*chunks.chunk_bytes));
+  }
+  return_planes = planes_per_chunk;
+
+ exit_strategy:
+
+  for (i=0; i < batch_size; i++) g_free(chunks.buffers[i]);
+  g_free(chunks.buffers);
+  g_free(chunks.sizes);
+
+  return return_planes;
+}
+
+/* reads in data written by raw_data_write_chunks.  The compressed chunks are read 
+   in sequentially a batch at a time, and uncompressed in parallel straight into 
+   the new raw data */
+static AmitkRawData * raw_data_read_chunks(const gchar * file_name,
+					   FILE * existing_file,
+					   AmitkRawFormat raw_format,
+					   AmitkVoxel dim,
+					   long file_offset,
+					   gint planes_per_chunk,
+					   const gchar * chunk_sizes_str,
+					   gchar ** perror_buf,
+					   AmitkUpdateFunc update_func,
+					   gpointer update_data) {
+
+  AmitkRawData * raw_data=NULL;
+  raw_data_chunks_t chunks;
+  FILE * file_pointer=NULL;
+  gsize * all_sizes=NULL;
+  gsize buffer_sizes_needed;
+  gint num_chunks, batch_size, num_in_batch;
+  gint i;
+  gchar * end_ptr;
+  const gchar * ptr;
+  gchar * temp_string;
+  gboolean continue_work=TRUE;
+
+  chunks.buffers = NULL;
+  chunks.sizes = NULL;
+  batch_size = 0;
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Reading: %s"), (file_name != NULL) ? file_name : "raw data");
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+
+  if ((raw_data = amitk_raw_data_new_with_data(amitk_raw_format_to_format(raw_format), dim)) == NULL) {
+    amitk_append_str_with_newline(perror_buf, _("couldn't allocate memory space for the raw data set structure"));
+    goto error_condition;
+  }
+
+  chunks.data = raw_data->data;
+  chunks.total_bytes = amitk_raw_data_size_data_mem(raw_data);
+  chunks.chunk_bytes = ((gsize) planes_per_chunk)*dim.x*dim.y*amitk_format_sizes[raw_data->format];
+  chunks.swap_size = (amitk_format_to_raw_format(raw_data->format) != raw_format) ? 
+    amitk_format_sizes[raw_data->format] : 0;
+  chunks.error = FALSE;
+  num_chunks = (chunks.total_bytes+chunks.chunk_bytes-1)/chunks.chunk_bytes;
+
+  /* parse the chunk index */
+  all_sizes = g_new(gsize, num_chunks);
+  ptr = chunk_sizes_str;
+  for (i=0; i < num_chunks; i++) {
+    all_sizes[i] = g_ascii_strtoull(ptr, &end_ptr, 10);
+    if (end_ptr == ptr) break;
+    ptr = end_ptr;
+  }
+  if (i != num_chunks) {
+    amitk_append_str_with_newline(perror_buf, _("Compressed raw data has %d chunks, expected %d"), i, num_chunks);
+    goto error_condition;
+  }
+
+  /* open the file if needed */
+  if (existing_file == NULL) {
+    if ((file_pointer = fopen(file_name, "rb")) == NULL) {
+      amitk_append_str_with_newline(perror_buf, _("couldn't open raw data file %s"), file_name);
+      goto error_condition;
+    }
+  } else {
+    file_pointer = existing_file;
+  }
+  if (fseek(file_pointer, file_offset, SEEK_SET) != 0) {
+    amitk_append_str_with_newline(perror_buf, _("could not seek forward %ld bytes in raw data file"), file_offset);
+    goto error_condition;
+  }
+
+  batch_size = raw_data_chunk_batch_size(num_chunks);
+  chunks.buffers = g_new0(guchar *, batch_size);
+  buffer_sizes_needed = 0;
+  for (i=0; i < num_chunks; i++)
+    buffer_sizes_needed = MAX(buffer_sizes_needed, all_sizes[i]);
+  for (i=0; i < batch_size; i++) 
+    if ((chunks.buffers[i] = g_try_malloc(buffer_sizes_needed)) == NULL) {
+      amitk_append_str_with_newline(perror_buf, _("couldn't allocate memory space for reading compressed raw data"));
+      goto error_condition;
+    }
+
+  for (chunks.first_chunk=0; (chunks.first_chunk < num_chunks) && continue_work; chunks.first_chunk += num_in_batch) {
+    num_in_batch = MIN(batch_size, num_chunks-chunks.first_chunk);
+    chunks.sizes = all_sizes+chunks.first_chunk;
+
+    for (i=0; i < num_in_batch; i++) 
+      if (fread(chunks.buffers[i], 1, chunks.sizes[i], file_pointer) != chunks.sizes[i]) {
+	amitk_append_str_with_newline(perror_buf, _("read wrong # of elements from compressed raw data"));
+	goto error_condition;
+      }
+
+    amitk_parallel_for(num_in_batch, raw_data_uncompress_chunk, &chunks);
+    if (chunks.error) {
+      amitk_append_str_with_newline(perror_buf, _("Compressed raw data is corrupt"));
+      goto error_condition;
+    }
+
+    if (update_func != NULL)
+      continue_work = (*update_func)(update_data, NULL, 
+				     ((gdouble) chunks.first_chunk+num_in_batch)/((gdouble) num_chunks));
+  }
+
+  if (!continue_work) goto error_condition;
+
+  goto exit_strategy;
+
+ error_condition:
+  if (raw_data != NULL) {
+    g_object_unref(raw_data);
+    raw_data = NULL;
+  }
+
+ exit_strategy:
+
+  if (update_func != NULL) /* remove progress bar */
+    (*update_func)(update_data, NULL, (gdouble) 2.0); 
+
+  if (chunks.buffers != NULL) {
+    for (i=0; i < batch_size; i++) g_free(chunks.buffers[i]);
+    g_free(chunks.buffers);
+  }
+  g_free(all_sizes);
+  if ((file_pointer != NULL) && (existing_file == NULL)) fclose(file_pointer);
+
+  return raw_data;
+}
+#endif /* AMIDE_ZLIB_SUPPORT */
+
+
 void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name, 
 			      FILE *study_file, gchar ** output_filename, guint64 * plocation,
 			      guint64 * psize) {
@@ -803,6 +1174,8 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
   size_t bytes_per_unit;
   size_t total_to_write;
   size_t total_wrote = 0;
+  GString * chunk_sizes=NULL;
+  gint planes_per_chunk=0;
 
   if (study_file == NULL) {
     /* make a guess as to our filename */
@@ -836,9 +1209,31 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
   }
   
   /* write it on out.  */
-  location = ftell(file_pointer);
   num_to_write = amitk_raw_data_num_voxels(raw_data);
   bytes_per_unit = amitk_format_sizes[AMITK_RAW_DATA_FORMAT(raw_data)]; 
+  location = ftell(file_pointer);
+
+#ifdef AMIDE_ZLIB_SUPPORT
+  if (compress_on_save && (num_to_write > 0)) {
+    chunk_sizes = g_string_new(NULL);
+    planes_per_chunk = raw_data_write_chunks(raw_data, file_pointer, chunk_sizes);
+    if (planes_per_chunk <= 0) {
+      g_warning(_("incomplete save of compressed raw data, file: %s"), raw_filename);
+      g_string_free(chunk_sizes, TRUE);
+      g_free(xml_filename);
+      g_free(raw_filename);
+      if (study_file == NULL) fclose(file_pointer);
+      return;
+    }
+    num_to_write = 0; /* already written */
+  }
+#endif
+
+  /* align the data to its type, so that it can be mapped back in on loading */
+  while ((chunk_sizes == NULL) && ((location % bytes_per_unit) != 0)) {
+    fputc(0, file_pointer);
+    location++;
+  }
   total_to_write = num_to_write;
    
   /* write in small chunks (<=16MB) to get around a bad samba/cygwin interaction */
@@ -852,6 +1247,7 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
     num_wrote = fwrite((raw_data->data + total_wrote*bytes_per_unit),
 		       bytes_per_unit, num_to_write_this_time, file_pointer);
     total_wrote += num_wrote;
+    raw_data_write_progress(num_wrote*bytes_per_unit);
     
     if (num_wrote != num_to_write_this_time) {
       g_warning(_("incomplete save of raw data, wrote %zd (bytes), needed %zd (bytes), file: %s"),
@@ -876,8 +1272,20 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
   xml_save_string(doc->children,"raw_format", 
 		  amitk_raw_format_get_name(amitk_format_to_raw_format(raw_data->format)));
 
-  /* store the info on our associated data */
-  if (study_file == NULL) {
+  /* store the info on our associated data.  Compressed data is stored under
+     different names so older versions of amide don't read it in as raw data */
+  if (chunk_sizes != NULL) {
+    xml_save_string(doc->children, "compression", "zlib");
+    xml_save_int(doc->children, "compressed_chunk_planes", planes_per_chunk);
+    xml_save_string(doc->children, "compressed_chunk_sizes", chunk_sizes->str);
+    g_string_free(chunk_sizes, TRUE);
+    if (study_file == NULL) {
+      xml_save_string(doc->children, "compressed_data_file", raw_filename);
+      g_free(raw_filename);
+    } else {
+      xml_save_location_and_size(doc->children, "compressed_data_location_and_size", location, size);
+    }
+  } else if (study_file == NULL) {
     xml_save_string(doc->children, "raw_data_file", raw_filename);
     g_free(raw_filename);
   } else {
@@ -903,6 +1311,259 @@ void amitk_raw_data_write_xml(AmitkRawData * raw_data, const gchar * name,
 }
 
 
+/* for data stored in the native in-memory format, map the file instead of reading 
+   it.  The mapping is private, so pages are only read in when touched, and are 
+   only copied if the data is modified.  Returns NULL if the data can't be mapped,
+   in which case the caller should read in the file as usual. 
+
+   Saving a study unlinks the old files before writing, so the mapped file stays
+   intact for as long as the mapping exists.  The file shouldn't be truncated 
+   while mapped, access beyond the new end of the file would fault. */
+AmitkRawData * amitk_raw_data_map_raw_file(const gchar * file_name,
+					   FILE * existing_file,
+					   AmitkRawFormat raw_format,
+					   AmitkVoxel dim,
+					   guint64 file_offset) {
+
+#ifdef HAVE_MMAP
+  AmitkRawData * raw_data;
+  AmitkFormat format;
+  struct stat file_info;
+  gint fd;
+  long page_size;
+  guint64 map_offset;
+  guint64 num_bytes;
+  gsize delta;
+  gpointer mapping;
+
+  if (raw_format == AMITK_RAW_FORMAT_ASCII_8_NE) return NULL;
+  format = amitk_raw_format_to_format(raw_format);
+  if (amitk_format_to_raw_format(format) != raw_format) return NULL; /* needs conversion */
+
+  /* data needs to be aligned for its type */
+  if ((file_offset % amitk_format_sizes[format]) != 0) return NULL;
+
+  num_bytes = amitk_raw_format_calc_num_bytes(dim, raw_format);
+  if (num_bytes == 0) return NULL;
+
+  page_size = sysconf(_SC_PAGESIZE);
+  if (page_size <= 0) return NULL;
+  map_offset = file_offset - (file_offset % page_size);
+  delta = file_offset - map_offset;
+  if ((num_bytes + delta) > G_MAXSIZE) return NULL;
+
+  if (existing_file != NULL) {
+    fd = fileno(existing_file);
+  } else {
+    if ((fd = open(file_name, O_RDONLY)) < 0) return NULL;
+  }
+
+  /* make sure the file actually holds all the data, otherwise we'd fault on access */
+  if ((fstat(fd, &file_info) != 0) || (((guint64) file_info.st_size) < file_offset + num_bytes)) 
+    mapping = MAP_FAILED;
+  else
+    mapping = mmap(NULL, num_bytes+delta, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) map_offset);
+
+  if (existing_file == NULL) close(fd); /* the mapping holds its own reference */
+  if (mapping == MAP_FAILED) return NULL;
+
+  raw_data = amitk_raw_data_new();
+  if (raw_data == NULL) {
+    munmap(mapping, num_bytes+delta);
+    return NULL;
+  }
+
+  raw_data->format = format;
+  raw_data->dim = dim;
+  raw_data->mapping = mapping;
+  raw_data->mapping_length = num_bytes+delta;
+  raw_data->data = ((guchar *) mapping) + delta;
+  raw_data->frame_links = g_new0(GList, dim.t);
+  raw_data->frame_modified = g_new0(gboolean, dim.t);
+
+  return raw_data;
+#else /* no mmap */
+  return NULL;
+#endif
+}
+
+static gsize raw_data_frame_bytes(const AmitkRawData * raw_data) {
+  return ((gsize) raw_data->dim.x)*raw_data->dim.y*raw_data->dim.z*raw_data->dim.g*
+    amitk_format_sizes[raw_data->format];
+}
+
+#ifdef HAVE_MMAP
+/* page align the byte range of a frame.  If outward, the range is grown to 
+   cover every page the frame touches, otherwise it is shrunk to the pages that 
+   belong only to this frame */
+static gboolean raw_data_frame_range(const AmitkRawData * raw_data,
+				     const amide_intpoint_t frame,
+				     const gboolean outward,
+				     guchar ** pstart, 
+				     gsize * plength) {
+  gsize page_size;
+  gsize frame_bytes;
+  gsize start, end;
+
+  page_size = sysconf(_SC_PAGESIZE);
+  frame_bytes = raw_data_frame_bytes(raw_data);
+  start = GPOINTER_TO_SIZE(raw_data->data) + frame*frame_bytes;
+  end = start + frame_bytes;
+
+  if (outward) {
+    start -= start % page_size;
+    end += (page_size - end % page_size) % page_size;
+  } else {
+    start += (page_size - start % page_size) % page_size;
+    end -= end % page_size;
+  }
+
+  /* stay within the mapping */
+  if (start < GPOINTER_TO_SIZE(raw_data->mapping))
+    start = GPOINTER_TO_SIZE(raw_data->mapping);
+  if (end > GPOINTER_TO_SIZE(raw_data->mapping) + raw_data->mapping_length)
+    end = GPOINTER_TO_SIZE(raw_data->mapping) + raw_data->mapping_length;
+  if (end <= start) return FALSE;
+
+  *pstart = GSIZE_TO_POINTER(start);
+  *plength = end-start;
+  return TRUE;
+}
+
+/* let the kernel know this frame's pages can go.  Pages that were modified 
+   are anonymous copies and stay put, untouched pages are reread from the 
+   file the next time they're needed.  MADV_PAGEOUT and MADV_COLD leave
+   modified pages alone, so where neither is available (or the kernel
+   rejects them) an unmodified frame is dropped with MADV_DONTNEED instead.
+   A modified frame can't be dropped that way without losing the changes, 
+   so for those the frame store size is only advisory. */
+static void raw_data_release_frame(const AmitkRawData * raw_data,
+				   const amide_intpoint_t frame) {
+  guchar * start;
+  gsize length;
+
+  if (!raw_data_frame_range(raw_data, frame, FALSE, &start, &length)) return;
+
+#ifdef MADV_PAGEOUT
+  if (madvise(start, length, MADV_PAGEOUT) == 0) return;
+#endif
+#ifdef MADV_COLD
+  if (madvise(start, length, MADV_COLD) == 0) return;
+#endif
+  if (!raw_data->frame_modified[frame])
+    madvise(start, length, MADV_DONTNEED);
+
+  return;
+}
+#endif
+
+/* take any of this data's frames out of the frame store */
+static void raw_data_unlink_frames(AmitkRawData * raw_data) {
+
+  amide_intpoint_t i_frame;
+
+  g_mutex_lock(&frame_store_mutex);
+  for (i_frame=0; i_frame < raw_data->dim.t; i_frame++) 
+    if (raw_data->frame_links[i_frame].data != NULL) {
+      g_queue_unlink(&frame_store, &(raw_data->frame_links[i_frame]));
+      raw_data->frame_links[i_frame].data = NULL;
+      frame_store_used -= raw_data_frame_bytes(raw_data);
+    }
+  g_mutex_unlock(&frame_store_mutex);
+
+  return;
+}
+
+/* drop the least recently used frames until we're back within budget.  The 
+   most recently used frame is always kept. frame_store_mutex must be held */
+static void frame_store_trim(void) {
+
+  GList * link;
+  AmitkRawData * raw_data;
+
+  while ((frame_store_used > frame_store_size) && (frame_store.length > 1)) {
+    link = g_queue_pop_head_link(&frame_store);
+    raw_data = link->data;
+    link->data = NULL;
+    frame_store_used -= raw_data_frame_bytes(raw_data);
+#ifdef HAVE_MMAP
+    raw_data_release_frame(raw_data, link - raw_data->frame_links);
+#endif
+  }
+
+  return;
+}
+
+/* note that the given frame is about to be accessed.  For data mapped from 
+   a file, this brings the frame's pages in ahead of use and releases the 
+   least recently used frames when over the frame store size.  Does nothing
+   for data held in memory. */
+void amitk_raw_data_use_frame(AmitkRawData * raw_data, const amide_intpoint_t frame) {
+
+  GList * link;
+#ifdef HAVE_MMAP
+  guchar * start;
+  gsize length;
+#endif
+
+  g_return_if_fail(AMITK_IS_RAW_DATA(raw_data));
+  if (raw_data->frame_links == NULL) return;
+  g_return_if_fail((frame >= 0) && (frame < raw_data->dim.t));
+
+  link = &(raw_data->frame_links[frame]);
+
+  g_mutex_lock(&frame_store_mutex);
+  if (link->data != NULL) { /* already resident, just mark as recently used */
+    g_queue_unlink(&frame_store, link);
+    g_queue_push_tail_link(&frame_store, link);
+  } else {
+#ifdef HAVE_MMAP
+    if (raw_data_frame_range(raw_data, frame, TRUE, &start, &length))
+      madvise(start, length, MADV_WILLNEED);
+#endif
+    link->data = raw_data;
+    g_queue_push_tail_link(&frame_store, link);
+    frame_store_used += raw_data_frame_bytes(raw_data);
+    frame_store_trim();
+  }
+  g_mutex_unlock(&frame_store_mutex);
+
+  return;
+}
+
+/* note that the given frame of mapped data has been written to, so its pages 
+   aren't dropped when the frame leaves the frame store.  Does nothing for data
+   held in memory. */
+void amitk_raw_data_modify_frame(AmitkRawData * raw_data, const amide_intpoint_t frame) {
+
+  g_return_if_fail(AMITK_IS_RAW_DATA(raw_data));
+  if (raw_data->frame_modified == NULL) return;
+  g_return_if_fail((frame >= 0) && (frame < raw_data->dim.t));
+
+  raw_data->frame_modified[frame] = TRUE;
+
+  return;
+}
+
+/* sets whether raw data is compressed when saved.  Has no effect if amide
+   was compiled without zlib */
+void amitk_raw_data_set_compress_on_save(const gboolean compress) {
+  compress_on_save = compress;
+  return;
+}
+
+/* sets how many bytes of mapped frames to keep resident */
+void amitk_raw_data_set_frame_store_size(const gsize num_bytes) {
+
+  g_mutex_lock(&frame_store_mutex);
+  frame_store_size = num_bytes;
+  frame_store_trim();
+  g_mutex_unlock(&frame_store_mutex);
+
+  return;
+}
+
+
 /* function to load in a raw data xml file */
 AmitkRawData * amitk_raw_data_read_xml(gchar * xml_filename,
 				       FILE * study_file,
@@ -921,6 +1582,11 @@ AmitkRawData * amitk_raw_data_read_xml(gchar * xml_filename,
   guint64 offset, dummy;
   long offset_long=0;
   AmitkVoxel dim;
+  gchar * compression;
+#ifdef AMIDE_ZLIB_SUPPORT
+  gchar * chunk_sizes;
+  gint planes_per_chunk;
+#endif
 
 
   if ((doc = xml_open_doc(xml_filename, study_file, location, size, perror_buf)) == NULL)
@@ -956,6 +1622,37 @@ AmitkRawData * amitk_raw_data_read_xml(gchar * xml_filename,
       raw_format = i_raw_format;
 
   g_free(temp_string);
+
+  /* data saved compressed */
+  compression = xml_get_string(nodes, "compression");
+  if (compression != NULL) {
+    raw_data = NULL;
+#ifdef AMIDE_ZLIB_SUPPORT
+    if (g_ascii_strcasecmp(compression, "zlib") == 0) {
+      planes_per_chunk = xml_get_int(nodes, "compressed_chunk_planes", perror_buf);
+      chunk_sizes = xml_get_string(nodes, "compressed_chunk_sizes");
+      if (study_file == NULL) {
+	raw_filename = xml_get_string(nodes, "compressed_data_file");
+      } else {
+	xml_get_location_and_size(nodes, "compressed_data_location_and_size", &offset, &dummy, perror_buf);
+	offset_long = offset;
+      }
+      if ((planes_per_chunk <= 0) || (chunk_sizes == NULL))
+	amitk_append_str_with_newline(perror_buf, _("Compressed raw data is missing its chunk index"));
+      else if ((study_file != NULL) && !xml_check_file_32bit_okay(offset))
+	amitk_append_str_with_newline(perror_buf, _("File to large to read on 32bit platform."));
+      else
+	raw_data = raw_data_read_chunks(raw_filename, study_file, raw_format, dim, offset_long,
+					planes_per_chunk, chunk_sizes, perror_buf, update_func, update_data);
+      g_free(chunk_sizes);
+    } else
+#endif
+      amitk_append_str_with_newline(perror_buf, _("Can't read raw data stored with compression: %s"), compression);
+    g_free(compression);
+    if (raw_filename != NULL) g_free(raw_filename);
+    xmlFreeDoc(doc);
+    return raw_data;
+  }
   
   /* get the filename or location of our associated data */
   if (study_file == NULL) {
@@ -976,8 +1673,12 @@ AmitkRawData * amitk_raw_data_read_xml(gchar * xml_filename,
   }
 
 
-  raw_data = amitk_raw_data_import_raw_file(raw_filename, study_file, raw_format, dim, offset_long, 
-					    update_func, update_data);
+  raw_data = amitk_raw_data_map_raw_file(raw_filename, study_file, raw_format, dim, offset_long);
+  if (raw_data == NULL)
+    raw_data = amitk_raw_data_import_raw_file(raw_filename, study_file, raw_format, dim, offset_long, 
+					      update_func, update_data);
+  else if (update_func != NULL)
+    (*update_func)(update_data, NULL, (gdouble) 2.0); /* remove progress bar */
 
   /* and we're done */
   if (raw_filename != NULL) g_free(raw_filename);
@@ -47,6 +47,7 @@ G_BEGIN_DECLS
 #define AMITK_RAW_DATA_DIM_Z(rd)          (AMITK_RAW_DATA(rd)->dim.z)
 #define AMITK_RAW_DATA_DIM_G(rd)          (AMITK_RAW_DATA(rd)->dim.g)
 #define AMITK_RAW_DATA_DIM_T(rd)          (AMITK_RAW_DATA(rd)->dim.t)
+#define AMITK_RAW_DATA_MAPPED(rd)         (AMITK_RAW_DATA(rd)->mapping != NULL)
 
 /* glib doesn't define these for PDP */
 #ifdef G_BIG_ENDIAN
@@ -121,6 +122,19 @@ struct _AmitkRawData {
   AmitkVoxel dim;
   gpointer data;
   AmitkFormat format;
+
+  /* if non-NULL, data points into this private mapping of the file 
+     instead of allocated memory */
+  gpointer mapping;
+  gsize mapping_length;
+
+  /* for mapped data, one link per frame, linked into the frame store when
+     the frame's pages have been brought in */
+  GList * frame_links;
+
+  /* for mapped data, whether each frame has been written to since it was
+     mapped, in which case its pages can no longer be reread from the file */
+  gboolean * frame_modified;
   
 };
 
@@ -170,6 +184,20 @@ AmitkRawData *  amitk_raw_data_import_raw_file      (const gchar * file_name,
 						     long file_offset,
 						     AmitkUpdateFunc update_func,
 						     gpointer update_data);
+AmitkRawData *  amitk_raw_data_map_raw_file         (const gchar * file_name,
+						     FILE * existing_file,
+						     AmitkRawFormat raw_format,
+						     AmitkVoxel dim,
+						     guint64 file_offset);
+void            amitk_raw_data_use_frame            (AmitkRawData * rd,
+						     const amide_intpoint_t frame);
+void            amitk_raw_data_modify_frame         (AmitkRawData * rd,
+						     const amide_intpoint_t frame);
+void            amitk_raw_data_set_frame_store_size (const gsize num_bytes);
+void            amitk_raw_data_set_compress_on_save (const gboolean compress);
+void            amitk_raw_data_set_write_progress   (AmitkUpdateFunc update_func,
+						     gpointer update_data,
+						     guint64 total_bytes);
 void            amitk_raw_data_write_xml            (AmitkRawData  * raw_data, const gchar * name,
 						     FILE * study_file, gchar ** output_filename, 
 						     guint64 * location, guint64 * size);
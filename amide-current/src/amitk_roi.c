@@ -26,6 +26,7 @@
 #include "amide_config.h"
 
 #include "amitk_roi.h"
+#include "amitk_study.h"
 #include "amitk_marshal.h"
 #include "amitk_type_builtins.h"
 
@@ -86,6 +87,12 @@ static void          roi_get_center          (const AmitkVolume *volume,
 					      AmitkPoint        *center);
 static void          roi_set_voxel_size      (AmitkRoi * roi, 
 					      AmitkPoint voxel_size);
+static void          roi_space_changed       (AmitkSpace * space);
+static void          roi_volume_changed      (AmitkVolume * volume);
+static void          roi_invalidate_masks    (AmitkRoi * roi);
+static void          roi_remove_masks        (AmitkRoi * roi,
+					      AmitkDataSet * ds,
+					      gboolean data_set_alive);
 
 static AmitkVolumeClass * parent_class;
 static guint        roi_signals[LAST_SIGNAL];
@@ -129,6 +136,7 @@ static void roi_class_init (AmitkRoiClass * class) {
   parent_class = g_type_class_peek_parent(class);
 
   space_class->space_scale = roi_scale;
+  space_class->space_changed = roi_space_changed;
 
   object_class->object_copy = roi_copy;
   object_class->object_copy_in_place = roi_copy_in_place;
@@ -136,6 +144,9 @@ static void roi_class_init (AmitkRoiClass * class) {
   object_class->object_read_xml = roi_read_xml;
 
   volume_class->volume_get_center = roi_get_center;
+  volume_class->volume_changed = roi_volume_changed;
+
+  class->roi_changed = roi_invalidate_masks;
 
   gobject_class->finalize = roi_finalize;
 
@@ -170,6 +181,8 @@ static void roi_init (AmitkRoi * roi) {
   roi->isocontour_min_value = 0.0;
   roi->isocontour_max_value = 0.0;
   roi->isocontour_range = AMITK_ROI_ISOCONTOUR_RANGE_ABOVE_MIN;
+
+  roi->masks = NULL;
 }
 
 
@@ -177,6 +190,8 @@ static void roi_finalize (GObject *object)
 {
   AmitkRoi * roi = AMITK_ROI(object);
 
+  roi_remove_masks(roi, NULL, TRUE);
+
   if (roi->map_data != NULL) {
     g_object_unref(roi->map_data);
     roi->map_data = NULL;
@@ -210,6 +225,27 @@ static void roi_scale(AmitkSpace *space, AmitkPoint *ref_point, AmitkPoint *scal
 }
 
 
+static void roi_space_changed(AmitkSpace * space) {
+
+  g_return_if_fail(AMITK_IS_ROI(space));
+
+  roi_invalidate_masks(AMITK_ROI(space));
+
+  if (AMITK_SPACE_CLASS(parent_class)->space_changed)
+    AMITK_SPACE_CLASS(parent_class)->space_changed (space);
+}
+
+static void roi_volume_changed(AmitkVolume * volume) {
+
+  g_return_if_fail(AMITK_IS_ROI(volume));
+
+  roi_invalidate_masks(AMITK_ROI(volume));
+
+  if (parent_class->volume_changed)
+    parent_class->volume_changed (volume);
+}
+
+
 static AmitkObject * roi_copy (const AmitkObject * object) {
 
   AmitkRoi * copy;
@@ -743,25 +779,16 @@ void amitk_roi_set_type(AmitkRoi * roi, AmitkRoiType new_type) {
   return;
 }
 
-/* iterates over the voxels in the given data set that are inside the given roi,
-   and performs the specified calculation function for those points */
-/* if inverse is true, the calculation is done for the portion of the data set not in the roi */
-/* if accurate is true, uses much slower but more accurate calculation */
-/* calulation should be a function taking the following arguments:
-   calculation(AmitkVoxel dataset_voxel, amide_data_t value, amide_real_t voxel_fraction, gpointer data) */
-void amitk_roi_calculate_on_data_set(const AmitkRoi * roi,  
-				     const AmitkDataSet * ds, 
-				     const guint frame,
-				     const guint gate,
-				     const gboolean inverse,
-				     const gboolean accurate,
-				     void (*calculation)(),
-				     gpointer data) {
-
-  g_return_if_fail(AMITK_IS_ROI(roi));
-  g_return_if_fail(AMITK_IS_DATA_SET(ds));
-  
-  if (AMITK_ROI_UNDRAWN(roi)) return;
+/* hands the calculation off to the roi type specific function, which works out
+   the voxel fractions from the roi's shape */
+static void roi_calculate_on_data_set(const AmitkRoi * roi,  
+				      const AmitkDataSet * ds, 
+				      const guint frame,
+				      const guint gate,
+				      const gboolean inverse,
+				      const gboolean accurate,
+				      void (*calculation)(),
+				      gpointer data) {
 
   switch(AMITK_ROI_TYPE(roi)) {
   case AMITK_ROI_TYPE_ELLIPSOID:
@@ -814,6 +841,340 @@ void amitk_roi_calculate_on_data_set(const AmitkRoi * roi,
   return;
 }
 
+/* the voxel fractions of an roi on a data set.  These only depend on the roi
+   and the data set's geometry, so they're kept to save working them out again for
+   every frame and every analysis.  Stored as runs of voxels along x, only runs of
+   voxels partially in the roi need their fractions stored.  The masks of all rois
+   are guarded by roi_mask_mutex, and a mask is reference counted so one in use can 
+   be dropped from its roi by another thread */
+typedef struct {
+  AmitkVoxel start;
+  gint length;
+  gint fractions; /* offset into the mask's fractions, or -1 if all voxels are fully in */
+} roi_mask_run_t;
+
+typedef struct _AmitkRoiMask roi_mask_t;
+
+struct _AmitkRoiMask {
+  AmitkDataSet * data_set; /* not referenced, dropped when the data set goes away */
+  gboolean accurate;
+  roi_mask_run_t * runs;
+  gint num_runs;
+  gint alloc_runs;
+  amide_real_t * fractions;
+  gint num_fractions;
+  gint alloc_fractions;
+  gint ref_count;
+
+  /* calculation to pass voxels on to while the mask is being made */
+  void (* calculation)();
+  gpointer data;
+};
+
+static GMutex roi_mask_mutex;
+
+static void roi_mask_data_set_changed_cb(AmitkDataSet * ds, gpointer roi) {
+  roi_remove_masks(AMITK_ROI(roi), ds, TRUE);
+  return;
+}
+
+static void roi_mask_data_set_finalized(gpointer roi, GObject * where_the_object_was) {
+  roi_remove_masks(AMITK_ROI(roi), (AmitkDataSet *) where_the_object_was, FALSE);
+  return;
+}
+
+static roi_mask_t * roi_mask_new(AmitkDataSet * ds, const gboolean accurate) {
+
+  roi_mask_t * mask;
+
+  mask = g_new0(roi_mask_t, 1);
+  mask->data_set = ds;
+  mask->accurate = accurate;
+  mask->ref_count = 1;
+
+  return mask;
+}
+
+static void roi_mask_unref(roi_mask_t * mask) {
+
+  if (!g_atomic_int_dec_and_test(&(mask->ref_count))) return;
+
+  g_free(mask->runs);
+  g_free(mask->fractions);
+  g_free(mask);
+
+  return;
+}
+
+/* hands a newly made mask over to the roi.  If another thread got there first,
+   the new mask is dropped.  roi_mask_mutex must be held */
+static void roi_mask_add(AmitkRoi * roi, roi_mask_t * mask) {
+
+  GList * masks;
+  roi_mask_t * existing;
+
+  for (masks = roi->masks; masks != NULL; masks = masks->next) {
+    existing = masks->data;
+    if ((existing->data_set == mask->data_set) && (existing->accurate == mask->accurate)) {
+      roi_mask_unref(mask);
+      return;
+    }
+  }
+
+  g_signal_connect(G_OBJECT(mask->data_set), "space_changed", 
+		   G_CALLBACK(roi_mask_data_set_changed_cb), roi);
+  g_signal_connect(G_OBJECT(mask->data_set), "voxel_size_changed", 
+		   G_CALLBACK(roi_mask_data_set_changed_cb), roi);
+  g_object_weak_ref(G_OBJECT(mask->data_set), roi_mask_data_set_finalized, roi);
+
+  roi->masks = g_list_prepend(roi->masks, mask);
+
+  return;
+}
+
+/* drops the cached masks for the given data set, or all of them if ds is NULL */
+static void roi_remove_masks(AmitkRoi * roi, AmitkDataSet * ds, gboolean data_set_alive) {
+
+  GList * masks;
+  GList * next;
+  roi_mask_t * mask;
+
+  g_mutex_lock(&roi_mask_mutex);
+  masks = roi->masks;
+  while (masks != NULL) {
+    next = masks->next;
+    mask = masks->data;
+    if ((ds == NULL) || (mask->data_set == ds)) {
+      roi->masks = g_list_delete_link(roi->masks, masks);
+      if (data_set_alive) {
+	g_signal_handlers_disconnect_by_func(G_OBJECT(mask->data_set), 
+					     G_CALLBACK(roi_mask_data_set_changed_cb), roi);
+	g_object_weak_unref(G_OBJECT(mask->data_set), roi_mask_data_set_finalized, roi);
+      }
+      roi_mask_unref(mask);
+    }
+    masks = next;
+  }
+  g_mutex_unlock(&roi_mask_mutex);
+
+  return;
+}
+
+static void roi_invalidate_masks(AmitkRoi * roi) {
+  roi_remove_masks(roi, NULL, TRUE);
+  return;
+}
+
+/* returns a reference to the roi's mask for the data set, or NULL */
+static roi_mask_t * roi_mask_lookup(const AmitkRoi * roi, const AmitkDataSet * ds, 
+				    const gboolean accurate) {
+
+  GList * masks;
+  roi_mask_t * mask;
+
+  g_mutex_lock(&roi_mask_mutex);
+  for (masks = roi->masks; masks != NULL; masks = masks->next) {
+    mask = masks->data;
+    if ((mask->data_set == ds) && (mask->accurate == accurate)) {
+      g_atomic_int_inc(&(mask->ref_count));
+      g_mutex_unlock(&roi_mask_mutex);
+      return mask;
+    }
+  }
+  g_mutex_unlock(&roi_mask_mutex);
+
+  return NULL;
+}
+
+/* records the voxel fractions handed out by the roi type specific functions, which
+   come in data set storage order.  Voxels handed out with no weight are kept as
+   well, so that replaying the mask calls back for the same voxels */
+static void roi_mask_record(AmitkVoxel voxel,
+			    amide_data_t value,
+			    amide_real_t voxel_fraction,
+			    gpointer data) {
+
+  roi_mask_t * mask = data;
+  roi_mask_run_t * run;
+  gboolean full;
+
+  if (mask->calculation != NULL)
+    (*mask->calculation)(voxel, value, voxel_fraction, mask->data);
+
+  full = (voxel_fraction >= 1.0);
+
+  run = (mask->num_runs > 0) ? &(mask->runs[mask->num_runs-1]) : NULL;
+  if ((run == NULL) || (run->start.z != voxel.z) || (run->start.y != voxel.y) ||
+      (run->start.x+run->length != voxel.x) || (full != (run->fractions < 0))) {
+    if (mask->num_runs == mask->alloc_runs) {
+      mask->alloc_runs = MAX(2*mask->alloc_runs, 256);
+      mask->runs = g_renew(roi_mask_run_t, mask->runs, mask->alloc_runs);
+    }
+    run = &(mask->runs[mask->num_runs]);
+    mask->num_runs++;
+    run->start = voxel;
+    run->start.t = run->start.g = 0;
+    run->length = 0;
+    run->fractions = full ? -1 : mask->num_fractions;
+  }
+  run->length++;
+
+  if (!full) {
+    if (mask->num_fractions == mask->alloc_fractions) {
+      mask->alloc_fractions = MAX(2*mask->alloc_fractions, 256);
+      mask->fractions = g_renew(amide_real_t, mask->fractions, mask->alloc_fractions);
+    }
+    mask->fractions[mask->num_fractions] = voxel_fraction;
+    mask->num_fractions++;
+  }
+
+  return;
+}
+
+/* does the calculation using the voxel fractions in the mask, so only the data 
+   values need to be read */
+static void roi_mask_calculate(const roi_mask_t * mask,
+			       const AmitkDataSet * ds,
+			       const guint frame,
+			       const guint gate,
+			       void (*calculation)(),
+			       gpointer data) {
+
+  const roi_mask_run_t * run;
+  AmitkVoxel i;
+  amide_real_t voxel_fraction;
+  gint r, k;
+
+  i.t = frame;
+  i.g = gate;
+
+  for (r=0; r < mask->num_runs; r++) {
+    run = &(mask->runs[r]);
+    i.z = run->start.z;
+    i.y = run->start.y;
+    for (k=0, i.x = run->start.x; k < run->length; k++, i.x++) {
+      voxel_fraction = (run->fractions < 0) ? 1.0 : mask->fractions[run->fractions+k];
+      (*calculation)(i, amitk_data_set_get_value(ds, i), voxel_fraction, data);
+    }
+  }
+
+  return;
+}
+
+/* iterates over the voxels in the given data set that are inside the given roi,
+   and performs the specified calculation function for those points */
+/* if inverse is true, the calculation is done for the portion of the data set not in the roi */
+/* if accurate is true, uses much slower but more accurate calculation */
+/* calulation should be a function taking the following arguments:
+   calculation(AmitkVoxel dataset_voxel, amide_data_t value, amide_real_t voxel_fraction, gpointer data) */
+/* the voxel fractions are cached with the roi after the first call for a data set,
+   and dropped when either the roi or the data set's space or voxel size changes.
+   Inverse calculations visit the whole data set anyway and don't use the cache */
+void amitk_roi_calculate_on_data_set(const AmitkRoi * roi,  
+				     const AmitkDataSet * ds, 
+				     const guint frame,
+				     const guint gate,
+				     const gboolean inverse,
+				     const gboolean accurate,
+				     void (*calculation)(),
+				     gpointer data) {
+
+  roi_mask_t * mask;
+
+  g_return_if_fail(AMITK_IS_ROI(roi));
+  g_return_if_fail(AMITK_IS_DATA_SET(ds));
+  
+  if (AMITK_ROI_UNDRAWN(roi)) return;
+  amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(ds), frame);
+
+  if (inverse) {
+    roi_calculate_on_data_set(roi, ds, frame, gate, TRUE, accurate, calculation, data);
+    return;
+  }
+
+  mask = roi_mask_lookup(roi, ds, accurate);
+  if (mask == NULL) { /* do the calculation while making the mask */
+    mask = roi_mask_new(AMITK_DATA_SET(ds), accurate);
+    mask->calculation = calculation;
+    mask->data = data;
+    roi_calculate_on_data_set(roi, ds, frame, gate, FALSE, accurate, roi_mask_record, mask);
+    mask->calculation = NULL;
+    mask->data = NULL;
+
+    g_mutex_lock(&roi_mask_mutex);
+    roi_mask_add(AMITK_ROI(roi), mask);
+    g_mutex_unlock(&roi_mask_mutex);
+    return;
+  }
+
+  roi_mask_calculate(mask, ds, frame, gate, calculation, data);
+  roi_mask_unref(mask);
+
+  return;
+}
+
+/* returns a reference to the voxel fractions of the roi on the data set, the same
+   ones amitk_roi_calculate_on_data_set uses, working them out if they aren't
+   cached yet.  The mask doesn't change once made, and stays valid after it's dropped
+   from the roi until it's unreferenced */
+AmitkRoiMask * amitk_roi_get_mask(const AmitkRoi * roi, 
+				  const AmitkDataSet * ds,
+				  const gboolean accurate) {
+
+  roi_mask_t * mask;
+
+  g_return_val_if_fail(AMITK_IS_ROI(roi), NULL);
+  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+
+  mask = roi_mask_lookup(roi, ds, accurate);
+  if (mask != NULL) return mask;
+
+  mask = roi_mask_new(AMITK_DATA_SET(ds), accurate);
+  if (AMITK_ROI_UNDRAWN(roi)) return mask; /* empty, and not worth caching */
+
+  amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(ds), 0);
+  roi_calculate_on_data_set(roi, ds, 0, 0, FALSE, accurate, roi_mask_record, mask);
+
+  g_atomic_int_inc(&(mask->ref_count)); /* one for the roi, one for the caller */
+  g_mutex_lock(&roi_mask_mutex);
+  roi_mask_add(AMITK_ROI(roi), mask);
+  g_mutex_unlock(&roi_mask_mutex);
+
+  return mask;
+}
+
+AmitkRoiMask * amitk_roi_mask_unref(AmitkRoiMask * mask) {
+
+  if (mask != NULL) roi_mask_unref(mask);
+
+  return NULL;
+}
+
+/* steps through the mask's runs of voxels along x, in data set storage order.
+   iter should start at 0.  Fractions is set to NULL for runs of voxels fully in
+   the roi.  Voxels with a fraction of 0 can be included.  Returns FALSE once
+   there are no runs left */
+gboolean amitk_roi_mask_next_run(const AmitkRoiMask * mask,
+				 gint * iter,
+				 AmitkVoxel * start,
+				 gint * length,
+				 const amide_real_t ** fractions) {
+
+  const roi_mask_run_t * run;
+
+  g_return_val_if_fail(mask != NULL, FALSE);
+
+  if (*iter >= mask->num_runs) return FALSE;
+
+  run = &(mask->runs[*iter]);
+  *start = run->start;
+  *length = run->length;
+  *fractions = (run->fractions < 0) ? NULL : &(mask->fractions[run->fractions]);
+  (*iter)++;
+
+  return TRUE;
+}
+
 static void erase_volume(AmitkVoxel voxel, 
 			 amide_data_t value, 
 			 amide_real_t voxel_fraction, 
@@ -836,20 +1197,26 @@ void amitk_roi_erase_volume(const AmitkRoi * roi,
 
   guint i_frame;
   guint i_gate;
+  AmitkObject * study;
+
+  /* a background save of the study may still be writing out this raw data */
+  study = amitk_object_get_parent_of_type(AMITK_OBJECT(ds), AMITK_OBJECT_TYPE_STUDY);
+  if (study != NULL)
+    amitk_study_save_wait(AMITK_STUDY(study));
 
   for (i_frame=0; i_frame<AMITK_DATA_SET_NUM_FRAMES(ds); i_frame++) 
     for (i_gate=0; i_gate<AMITK_DATA_SET_NUM_GATES(ds); i_gate++) 
       amitk_roi_calculate_on_data_set(roi, ds, i_frame, i_gate, outside, FALSE, erase_volume, ds);
 
-  /* recalc max and min */
-  amitk_data_set_calc_min_max(ds, update_func, update_data);
-
   /* mark the distribution data as invalid */
   if (AMITK_DATA_SET_DISTRIBUTION(ds) != NULL) {
     g_object_unref(AMITK_DATA_SET_DISTRIBUTION(ds));
     ds->distribution = NULL;
   }
 
+  /* recalc max and min, which regenerates the distribution as well */
+  amitk_data_set_calc_min_max(ds, update_func, update_data);
+
   /* this is a no-op to get a data_set_changed signal */
   amitk_data_set_set_value(AMITK_DATA_SET(ds), zero_voxel,
 			   amitk_data_set_get_value(AMITK_DATA_SET(ds), zero_voxel),
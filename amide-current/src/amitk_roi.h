@@ -56,6 +56,10 @@ G_BEGIN_DECLS
 #define AMITK_ROI_GRANULARITY 4 /* # subvoxels in one dimension, so 1/64 is grain size */
 //#define AMITK_ROI_GRANULARITY 10 - takes way to long
 
+/* for the accurate calculation on ellipsoids, cylinders and boxes, how many times a voxel 
+   crossing the roi surface gets split in half in each dimension */
+#define AMITK_ROI_ACCURATE_LEVELS 3 /* so down to 1/512 of a voxel */
+
 typedef enum {
   AMITK_ROI_TYPE_ELLIPSOID, 
   AMITK_ROI_TYPE_CYLINDER, 
@@ -77,6 +81,7 @@ typedef enum {
 
 typedef struct _AmitkRoiClass AmitkRoiClass;
 typedef struct _AmitkRoi AmitkRoi;
+typedef struct _AmitkRoiMask AmitkRoiMask; /* voxel fractions of an roi on a data set */
 
 
 struct _AmitkRoi
@@ -99,6 +104,9 @@ struct _AmitkRoi
   amide_data_t isocontour_max_value; /* what the user draws may lie outside of this range */
   AmitkRoiIsocontourRange isocontour_range;
 
+  /* voxel fractions of the roi on data sets, cached by amitk_roi_calculate_on_data_set */
+  GList * masks;
+
 };
 
 struct _AmitkRoiClass
@@ -154,6 +162,15 @@ void            amitk_roi_calculate_on_data_set   (const AmitkRoi * roi,
 						   const gboolean accurate,
 						   void (* calculation)(),
 						   gpointer data);
+AmitkRoiMask *  amitk_roi_get_mask                (const AmitkRoi * roi,
+						   const AmitkDataSet * ds,
+						   const gboolean accurate);
+AmitkRoiMask *  amitk_roi_mask_unref              (AmitkRoiMask * mask);
+gboolean        amitk_roi_mask_next_run           (const AmitkRoiMask * mask,
+						   gint * iter,
+						   AmitkVoxel * start,
+						   gint * length,
+						   const amide_real_t ** fractions);
 void            amitk_roi_erase_volume            (const AmitkRoi * roi, 
 						   AmitkDataSet * ds,
 						   const gboolean outside,
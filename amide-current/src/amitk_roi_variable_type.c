@@ -89,6 +89,8 @@ GSList * amitk_roi_`'m4_Variable_Type`'_get_intersection_line(const AmitkRoi * r
   AmitkVoxel i;
   AmitkVoxel canvas_dim;
   gboolean voxel_in=FALSE, prev_voxel_intersection, saved=TRUE;
+  AmitkSpaceS2S canvas_to_roi;
+  AmitkPoint roi_point, roi_stride_x;
 #if defined(ROI_TYPE_ELLIPSOID) || defined(ROI_TYPE_CYLINDER)
   AmitkPoint center, radius;
 #endif
@@ -129,22 +131,25 @@ GSList * amitk_roi_`'m4_Variable_Type`'_get_intersection_line(const AmitkRoi * r
   canvas_dim.x = ceil((canvas_corner.x)/pixel_dim);
   g_return_val_if_fail(canvas_dim.z == 1, NULL);
 
+  amitk_space_s2s_init(&canvas_to_roi, AMITK_SPACE(canvas_slice), AMITK_SPACE(roi));
+  roi_stride_x = amitk_space_s2s_stride(&canvas_to_roi, AMITK_AXIS_X, pixel_dim);
+
   for (i.y=0; i.y < canvas_dim.y ; i.y++) {
 
     view_point.x = slice_corners[0].x+pixel_dim/2.0;
     prev_voxel_intersection = FALSE;
+    roi_point = amitk_space_s2s_point(&canvas_to_roi, view_point);
 
     for (i.x=0; i.x < canvas_dim.x ; i.x++) {
-      temp_point = amitk_space_s2s(AMITK_SPACE(canvas_slice), AMITK_SPACE(roi), view_point);
       
 #ifdef ROI_TYPE_BOX
-      voxel_in = point_in_box(temp_point, AMITK_VOLUME_CORNER(roi));
+      voxel_in = point_in_box(roi_point, AMITK_VOLUME_CORNER(roi));
 #endif
 #ifdef ROI_TYPE_CYLINDER
-      voxel_in = point_in_elliptic_cylinder(temp_point, center, height, radius);
+      voxel_in = point_in_elliptic_cylinder(roi_point, center, height, radius);
 #endif
 #ifdef ROI_TYPE_ELLIPSOID
-      voxel_in = point_in_ellipsoid(temp_point,center,radius);
+      voxel_in = point_in_ellipsoid(roi_point,center,radius);
 #endif
 	
       /* is it an edge */
@@ -166,6 +171,7 @@ GSList * amitk_roi_`'m4_Variable_Type`'_get_intersection_line(const AmitkRoi * r
       
       prev_voxel_intersection = voxel_in;
       view_point.x += pixel_dim; /* advance one voxel */
+      POINT_ADD(roi_point, roi_stride_x, roi_point);
     }
     
     /* check if the edge of this row is still in the roi, if it is, add it as
@@ -298,7 +304,7 @@ AmitkDataSet * amitk_roi_`'m4_Variable_Type`'_get_intersection_slice(const Amitk
   AmitkPoint canvas_voxel_size;
   amitk_format_UBYTE_t value;
 #if FAST_INTERSECTION_SLICE
-  AmitkPoint alt, start_point;
+  AmitkSpaceS2S canvas_to_roi;
   AmitkPoint stride[AMITK_AXIS_NUM], last_point;
   AmitkAxis i_axis;
 #endif
@@ -332,21 +338,12 @@ AmitkDataSet * amitk_roi_`'m4_Variable_Type`'_get_intersection_slice(const Amitk
   view_point.x = slice_corners[0].x+((double) start.x + 0.5)*pixel_dim;
 
   /* figure out what point in the roi we're going to start at */
-  start_point = amitk_space_s2s(AMITK_SPACE(canvas_slice),AMITK_SPACE(roi), view_point);
+  amitk_space_s2s_init(&canvas_to_roi, AMITK_SPACE(canvas_slice), AMITK_SPACE(roi));
+  roi_point = amitk_space_s2s_point(&canvas_to_roi, view_point);
 
   /* figure out what stepping one voxel in a given direction in our slice coresponds to in our roi */
-  for (i_axis = 0; i_axis <= AMITK_AXIS_Y; i_axis++) {
-    alt.x = (i_axis == AMITK_AXIS_X) ? pixel_dim : 0.0;
-    alt.y = (i_axis == AMITK_AXIS_Y) ? pixel_dim : 0.0;
-    alt.z = 0.0;
-    alt = point_add(point_sub(amitk_space_s2b(AMITK_SPACE(canvas_slice), alt),
-			      AMITK_SPACE_OFFSET(canvas_slice)),
-		    AMITK_SPACE_OFFSET(roi));
-    stride[i_axis] = amitk_space_b2s(AMITK_SPACE(roi), alt);
-  }
-
-
-  roi_point = start_point;
+  for (i_axis = 0; i_axis <= AMITK_AXIS_Y; i_axis++) 
+    stride[i_axis] = amitk_space_s2s_stride(&canvas_to_roi, i_axis, pixel_dim);
 #endif
   i_voxel.z = i_voxel.g = i_voxel.t = 0;
   for (i_voxel.y=0; i_voxel.y<dim.y; i_voxel.y++) {
@@ -837,6 +834,8 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_fast(const AmitkRoi *
   AmitkPoint ds_voxel_size;
   AmitkPoint sub_voxel_size;
   amide_real_t grain_size;
+  AmitkSpaceS2S ds_to_roi;
+  AmitkPoint roi_stride_x, fine_roi_stride_x;
 
 #if defined (ROI_TYPE_BOX)
   AmitkPoint box_corner;
@@ -867,6 +866,11 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_fast(const AmitkRoi *
 
   grain_size = 1.0/(AMITK_ROI_GRANULARITY*AMITK_ROI_GRANULARITY*AMITK_ROI_GRANULARITY);
 
+  /* data set to roi transform, points get stepped along x instead of recomputed */
+  amitk_space_s2s_init(&ds_to_roi, AMITK_SPACE(ds), AMITK_SPACE(roi));
+  roi_stride_x = amitk_space_s2s_stride(&ds_to_roi, AMITK_AXIS_X, ds_voxel_size.x);
+  fine_roi_stride_x = amitk_space_s2s_stride(&ds_to_roi, AMITK_AXIS_X, sub_voxel_size.x);
+
   /* figure out the intersection between the data set and the roi */
   if (inverse) {
     start = zero_voxel;
@@ -931,17 +935,17 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_fast(const AmitkRoi *
       j.y = i.y+start.y;
       far_ds_pt.y = (j.y+1)*ds_voxel_size.y;
       center_ds_pt.y = (j.y+0.5)*ds_voxel_size.y;
+      far_ds_pt.x = (start.x+1)*ds_voxel_size.x;
+      center_ds_pt.x = (start.x+0.5)*ds_voxel_size.x;
+
+      /* get the roi points for the start of the row, these get advanced at bottom of loop */
+      roi_pt_corner = amitk_space_s2s_point(&ds_to_roi, far_ds_pt);
+      roi_pt_center = amitk_space_s2s_point(&ds_to_roi, center_ds_pt);
       
       for (i.x = 0; i.x < dim.x; i.x++) {
 	j.x = i.x+start.x;
-	far_ds_pt.x = (j.x+1)*ds_voxel_size.x;
-	center_ds_pt.x = (j.x+0.5)*ds_voxel_size.x;
 	
 	/* figure out if the center and the next far corner is in the roi or not */
-	/* get the corresponding roi points */
-	roi_pt_corner = amitk_space_s2s(AMITK_SPACE(ds),  AMITK_SPACE(roi), far_ds_pt);
-	roi_pt_center = amitk_space_s2s(AMITK_SPACE(ds),  AMITK_SPACE(roi), center_ds_pt);
-
 	/* calculate the one corner of the voxel "box" to determine if it's in or not */
 	/* along with the center of the voxel */
 #if defined (ROI_TYPE_BOX)
@@ -1003,12 +1007,12 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_fast(const AmitkRoi *
 
 	    for (k.y = 0;k.y<AMITK_ROI_GRANULARITY;k.y++) {
 	      fine_ds_pt.y = j.y*ds_voxel_size.y+ (k.y+0.5)*sub_voxel_size.y;
+	      fine_ds_pt.x = j.x*ds_voxel_size.x+0.5*sub_voxel_size.x;
 
-	      for (k.x = 0;k.x<AMITK_ROI_GRANULARITY;k.x++) {
-		fine_ds_pt.x = j.x*ds_voxel_size.x+(k.x+0.5)*sub_voxel_size.x;
-		
-		fine_roi_pt = amitk_space_s2s(AMITK_SPACE(ds), AMITK_SPACE(roi), fine_ds_pt);
+	      /* fine_roi_pt gets advanced at bottom of loop */
+	      fine_roi_pt = amitk_space_s2s_point(&ds_to_roi, fine_ds_pt);
 
+	      for (k.x = 0;k.x<AMITK_ROI_GRANULARITY;k.x++) {
 		/* calculate the one corner of the voxel "box" to determine if it's in or not */
 #if defined (ROI_TYPE_BOX)
 		if (point_in_box(fine_roi_pt, box_corner)) voxel_fraction += grain_size;
@@ -1025,6 +1029,7 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_fast(const AmitkRoi *
 		    (AMITK_RAW_DATA_UBYTE_CONTENT(roi->map_data, roi_voxel) != 0))
 		  voxel_fraction += grain_size;
 #endif
+		POINT_ADD(fine_roi_pt, fine_roi_stride_x, fine_roi_pt);
 	      } /* k.x loop */
 	    } /* k.y loop */
 	  } /* k.z loop */
@@ -1041,6 +1046,9 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_fast(const AmitkRoi *
 	    (*calculation)(j, value, 1.0, data);
 	  }
 	}
+
+	POINT_ADD(roi_pt_corner, roi_stride_x, roi_pt_corner);
+	POINT_ADD(roi_pt_center, roi_stride_x, roi_pt_center);
       } /* i.x loop */
     } /* i.y loop */
     
@@ -1060,10 +1068,158 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_fast(const AmitkRoi *
 }
 
 
+#if defined(ROI_TYPE_BOX) || defined(ROI_TYPE_CYLINDER) || defined(ROI_TYPE_ELLIPSOID)
+
+/* the roi's shape, in the roi's coordinate space */
+typedef struct {
+#if defined(ROI_TYPE_BOX)
+  AmitkPoint box_corner;
+#else
+  AmitkPoint center;
+  AmitkPoint radius;
+  amide_real_t min_radius;
+#if defined(ROI_TYPE_CYLINDER)
+  amide_real_t height;
+#endif
+#endif
+} roi_shape_t;
+
+/* returns the signed distance from the point to the surface of the roi, negative
+   if inside.  This is never more than the true distance in magnitude, so a cell
+   closer to the surface than that can't cross it.  estimate and normal are set to
+   a first order approximation of the distance and the outward normal of the surface */
+static amide_real_t shape_distance(const roi_shape_t * shape, const AmitkPoint p,
+				   amide_real_t * estimate, AmitkPoint * normal) {
+
+  amide_real_t bound;
+
+#if defined(ROI_TYPE_BOX)
+  amide_real_t d;
+
+  bound = MAX(-p.x, p.x-shape->box_corner.x);
+  *normal = zero_point;
+  normal->x = (p.x < 0.5*shape->box_corner.x) ? -1.0 : 1.0;
+
+  d = MAX(-p.y, p.y-shape->box_corner.y);
+  if (d > bound) {
+    bound = d;
+    *normal = zero_point;
+    normal->y = (p.y < 0.5*shape->box_corner.y) ? -1.0 : 1.0;
+  }
+
+  d = MAX(-p.z, p.z-shape->box_corner.z);
+  if (d > bound) {
+    bound = d;
+    *normal = zero_point;
+    normal->z = (p.z < 0.5*shape->box_corner.z) ? -1.0 : 1.0;
+  }
+
+  *estimate = bound;
+#else
+  AmitkPoint q, gradient;
+  amide_real_t r, mag;
+
+  /* scale the ellipse/ellipsoid to a unit circle/sphere, distances shrink
+     by at most the smallest radius */
+  q.x = (p.x-shape->center.x)/shape->radius.x;
+  q.y = (p.y-shape->center.y)/shape->radius.y;
+#if defined(ROI_TYPE_CYLINDER)
+  q.z = 0.0;
+#else
+  q.z = (p.z-shape->center.z)/shape->radius.z;
+#endif
+  r = POINT_MAGNITUDE(q);
+  bound = (r-1.0)*shape->min_radius;
+
+  if (r > 0.0) {
+    gradient.x = q.x/(r*shape->radius.x);
+    gradient.y = q.y/(r*shape->radius.y);
+    gradient.z = q.z/(r*shape->radius.z);
+    mag = POINT_MAGNITUDE(gradient);
+    *estimate = (r-1.0)/mag;
+    POINT_CMULT(1.0/mag, gradient, *normal);
+  } else {
+    *estimate = bound;
+    *normal = zero_point;
+    normal->x = 1.0;
+  }
+
+#if defined(ROI_TYPE_CYLINDER)
+  {
+    amide_real_t d;
+
+    d = fabs(p.z-shape->center.z)-shape->height/2.0;
+    if (d > bound) bound = d;
+    if (d > *estimate) {
+      *estimate = d;
+      *normal = zero_point;
+      normal->z = (p.z < shape->center.z) ? -1.0 : 1.0;
+    }
+  }
+#endif
+#endif
+
+  return bound;
+}
+
+/* returns the fraction of the cell with the given corner and edges (in roi space)
+   that's in the roi.  Cells that don't reach the surface are entirely in or out,
+   cells that do are split in half along each edge until level runs out, and then 
+   estimated by treating the surface as flat across the cell */
+static amide_real_t shape_fraction(const roi_shape_t * shape,
+				   const AmitkPoint corner,
+				   AmitkPoint dx, 
+				   AmitkPoint dy, 
+				   AmitkPoint dz,
+				   const gint level) {
+
+  AmitkPoint center, normal, sub_corner;
+  amide_real_t bound, estimate, reach, width, fraction;
+  gint i;
+
+  center.x = corner.x + 0.5*(dx.x+dy.x+dz.x);
+  center.y = corner.y + 0.5*(dx.y+dy.y+dz.y);
+  center.z = corner.z + 0.5*(dx.z+dy.z+dz.z);
+  bound = shape_distance(shape, center, &estimate, &normal);
+
+  /* furthest the cell can reach from its center */
+  reach = 0.5*(POINT_MAGNITUDE(dx)+POINT_MAGNITUDE(dy)+POINT_MAGNITUDE(dz));
+  if (bound >= reach) return 0.0;
+  if (-bound >= reach) return 1.0;
+
+  if (level <= 0) {
+    width = fabs(POINT_DOT_PRODUCT(normal, dx)) + 
+      fabs(POINT_DOT_PRODUCT(normal, dy)) + 
+      fabs(POINT_DOT_PRODUCT(normal, dz));
+    fraction = 0.5-estimate/width;
+    return CLAMP(fraction, 0.0, 1.0);
+  }
+
+  POINT_CMULT(0.5, dx, dx);
+  POINT_CMULT(0.5, dy, dy);
+  POINT_CMULT(0.5, dz, dz);
+  fraction = 0.0;
+  for (i=0; i<8; i++) {
+    sub_corner = corner;
+    if (i & 0x1) POINT_ADD(sub_corner, dx, sub_corner);
+    if (i & 0x2) POINT_ADD(sub_corner, dy, sub_corner);
+    if (i & 0x4) POINT_ADD(sub_corner, dz, sub_corner);
+    fraction += shape_fraction(shape, sub_corner, dx, dy, dz, level-1);
+  }
+
+  return fraction/8.0;
+}
+
+#endif
+
+
 /* iterates over the voxels in the given data set that are inside the given roi,
    and performs the specified calculation function for those points */
 /* calulation should be a function taking the following arguments:
    calculation(AmitkVoxel dataset_voxel, amide_data_t value, amide_real_t voxel_fraction, gpointer data) */
+/* ellipsoids, cylinders and boxes only refine the voxels crossing the roi surface, 
+   see shape_fraction, map based rois are sampled AMITK_ROI_GRANULARITY times in each 
+   dimension for each voxel */
 void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_accurate(const AmitkRoi * roi,  
 								   const AmitkDataSet * ds, 
 								   const guint frame,
@@ -1072,33 +1228,38 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_accurate(const AmitkRo
 								   void (* calculation)(),
 								   gpointer data) {
 
-  AmitkPoint fine_roi_pt, fine_ds_pt;
-  amide_data_t value;
   amide_real_t voxel_fraction;
-  AmitkVoxel j, k;
+  AmitkVoxel j;
   AmitkVoxel start, end, ds_dim;
   AmitkCorners intersection_corners;
   AmitkPoint ds_voxel_size;
-  AmitkPoint sub_voxel_size;
-  amide_real_t grain_size;
+  AmitkSpaceS2S ds_to_roi;
 
-#if defined (ROI_TYPE_BOX)
-  AmitkPoint box_corner;
-  box_corner = AMITK_VOLUME_CORNER(roi);
-#endif
+#if defined(ROI_TYPE_BOX) || defined(ROI_TYPE_CYLINDER) || defined(ROI_TYPE_ELLIPSOID)
+  roi_shape_t shape;
+  AmitkPoint ds_pt, roi_corner;
+  AmitkPoint roi_stride_x, roi_stride_y, roi_stride_z;
 
-#if defined(ROI_TYPE_ELLIPSOID) || defined(ROI_TYPE_CYLINDER)
-  AmitkPoint center;
-  AmitkPoint radius;
+#if defined (ROI_TYPE_BOX)
+  shape.box_corner = AMITK_VOLUME_CORNER(roi);
+#else
+  shape.center = amitk_space_b2s(AMITK_SPACE(roi), amitk_volume_get_center(AMITK_VOLUME(roi)));
+  shape.radius = point_cmult(0.5, AMITK_VOLUME_CORNER(roi));
 #if defined(ROI_TYPE_CYLINDER)
-  amide_real_t height;
-  height = AMITK_VOLUME_Z_CORNER(roi);
-#endif  
-  center = amitk_space_b2s(AMITK_SPACE(roi), amitk_volume_get_center(AMITK_VOLUME(roi)));
-  radius = point_cmult(0.5, AMITK_VOLUME_CORNER(roi));
+  shape.height = AMITK_VOLUME_Z_CORNER(roi);
+  shape.min_radius = MIN(shape.radius.x, shape.radius.y);
+#else
+  shape.min_radius = point_min_dim(shape.radius);
+#endif
+#endif
 #endif
 
 #if defined(ROI_TYPE_ISOCONTOUR_2D) || defined(ROI_TYPE_ISOCONTOUR_3D) || defined(ROI_TYPE_FREEHAND_2D) || defined(ROI_TYPE_FREEHAND_3D)
+  AmitkPoint fine_roi_pt, fine_ds_pt;
+  AmitkVoxel k;
+  AmitkPoint sub_voxel_size;
+  amide_real_t grain_size;
+  AmitkPoint fine_roi_stride_x;
   AmitkPoint roi_voxel_size;
   AmitkVoxel roi_voxel;
 
@@ -1106,11 +1267,22 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_accurate(const AmitkRo
 #endif
 
   ds_voxel_size = AMITK_DATA_SET_VOXEL_SIZE(ds);
-  sub_voxel_size = point_cmult(1.0/AMITK_ROI_GRANULARITY, ds_voxel_size);
   ds_dim = AMITK_DATA_SET_DIM(ds);
+  amitk_space_s2s_init(&ds_to_roi, AMITK_SPACE(ds), AMITK_SPACE(roi));
 
+#if defined(ROI_TYPE_BOX) || defined(ROI_TYPE_CYLINDER) || defined(ROI_TYPE_ELLIPSOID)
+  /* the edges of a data set voxel in roi space, voxel corners get stepped along x */
+  roi_stride_x = amitk_space_s2s_stride(&ds_to_roi, AMITK_AXIS_X, ds_voxel_size.x);
+  roi_stride_y = amitk_space_s2s_stride(&ds_to_roi, AMITK_AXIS_Y, ds_voxel_size.y);
+  roi_stride_z = amitk_space_s2s_stride(&ds_to_roi, AMITK_AXIS_Z, ds_voxel_size.z);
+#else
+  sub_voxel_size = point_cmult(1.0/AMITK_ROI_GRANULARITY, ds_voxel_size);
   grain_size = 1.0/(AMITK_ROI_GRANULARITY*AMITK_ROI_GRANULARITY*AMITK_ROI_GRANULARITY);
 
+  /* fine points get stepped along x */
+  fine_roi_stride_x = amitk_space_s2s_stride(&ds_to_roi, AMITK_AXIS_X, sub_voxel_size.x);
+#endif
+
   /* figure out the intersection between the data set and the roi */
   if (inverse) {
     start = zero_voxel;
@@ -1144,13 +1316,26 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_accurate(const AmitkRo
 
   j.t = frame;
   j.g = gate;
+#if defined(ROI_TYPE_ISOCONTOUR_2D) || defined(ROI_TYPE_ISOCONTOUR_3D) || defined(ROI_TYPE_FREEHAND_2D) || defined(ROI_TYPE_FREEHAND_3D)
   k.t = k.g = 0;
+#endif
 
   for (j.z = start.z; j.z <= end.z; j.z++) {
     for (j.y = start.y; j.y <= end.y; j.y++) {
+#if defined(ROI_TYPE_BOX) || defined(ROI_TYPE_CYLINDER) || defined(ROI_TYPE_ELLIPSOID)
+      ds_pt.x = start.x*ds_voxel_size.x;
+      ds_pt.y = j.y*ds_voxel_size.y;
+      ds_pt.z = j.z*ds_voxel_size.z;
+      roi_corner = amitk_space_s2s_point(&ds_to_roi, ds_pt);
+#endif
+
       for (j.x = start.x; j.x <= end.x; j.x++) {
 
-	value = amitk_data_set_get_value(ds,j);
+#if defined(ROI_TYPE_BOX) || defined(ROI_TYPE_CYLINDER) || defined(ROI_TYPE_ELLIPSOID)
+	voxel_fraction = shape_fraction(&shape, roi_corner, roi_stride_x, roi_stride_y, roi_stride_z,
+					AMITK_ROI_ACCURATE_LEVELS);
+	POINT_ADD(roi_corner, roi_stride_x, roi_corner);
+#else
 	voxel_fraction=0;
 
 	for (k.z = 0;k.z<AMITK_ROI_GRANULARITY;k.z++) {
@@ -1159,40 +1344,30 @@ void amitk_roi_`'m4_Variable_Type`'_calculate_on_data_set_accurate(const AmitkRo
 	  for (k.y = 0;k.y<AMITK_ROI_GRANULARITY;k.y++) {
 	    fine_ds_pt.y = j.y*ds_voxel_size.y+ (k.y+0.5)*sub_voxel_size.y;
 
-	    /* fine_ds_pt.x gets advanced at bottom of loop */
 	    fine_ds_pt.x = j.x*ds_voxel_size.x+0.5*sub_voxel_size.x;
 
-	    for (k.x = 0;k.x<AMITK_ROI_GRANULARITY;k.x++) {
-	      fine_roi_pt = amitk_space_s2s(AMITK_SPACE(ds), AMITK_SPACE(roi), fine_ds_pt);
+	    /* fine_roi_pt gets advanced at bottom of loop */
+	    fine_roi_pt = amitk_space_s2s_point(&ds_to_roi, fine_ds_pt);
 
+	    for (k.x = 0;k.x<AMITK_ROI_GRANULARITY;k.x++) {
 	      /* is this point in */
-#if defined (ROI_TYPE_BOX)
-	      if (point_in_box(fine_roi_pt, box_corner)) voxel_fraction+=grain_size;
-#endif
-#if defined(ROI_TYPE_CYLINDER)
-	      if (point_in_elliptic_cylinder(fine_roi_pt, center, height, radius)) voxel_fraction+=grain_size;
-#endif
-#if defined(ROI_TYPE_ELLIPSOID)
-	      if (point_in_ellipsoid(fine_roi_pt,center,radius)) voxel_fraction+=grain_size;
-#endif
-#if defined(ROI_TYPE_ISOCONTOUR_2D) || defined(ROI_TYPE_ISOCONTOUR_3D) || defined(ROI_TYPE_FREEHAND_2D) || defined(ROI_TYPE_FREEHAND_3D)
 	      POINT_TO_VOXEL(fine_roi_pt, roi_voxel_size, 0, 0, roi_voxel);
 	      if (amitk_raw_data_includes_voxel(roi->map_data, roi_voxel) &&
 		  (AMITK_RAW_DATA_UBYTE_CONTENT(roi->map_data, roi_voxel) != 0)) 
 		voxel_fraction+=grain_size;
-#endif
-	      fine_ds_pt.x += sub_voxel_size.x;
+	      POINT_ADD(fine_roi_pt, fine_roi_stride_x, fine_roi_pt);
 	    } /* k.x loop */
 	  } /* k.y loop */
 	} /* k.z loop */
+#endif
 
 	if (!inverse) {
 	  if (voxel_fraction > 0.0) {
-	    (*calculation)(j, value, voxel_fraction, data);
+	    (*calculation)(j, amitk_data_set_get_value(ds,j), voxel_fraction, data);
 	  }
 	} else {
 	  if (voxel_fraction < 1.0) {
-	    (*calculation)(j, value, 1.0-voxel_fraction, data);
+	    (*calculation)(j, amitk_data_set_get_value(ds,j), 1.0-voxel_fraction, data);
 	  }
 	}
       } /* i.x loop */
@@ -0,0 +1,369 @@
+/* amitk_slicer.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+ 
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#include "amide_config.h"
+
+#include "amitk_slicer.h"
+#include "amitk_marshal.h"
+
+enum {
+  SLICES_READY,
+  LAST_SIGNAL
+};
+
+/* the data sets are sliced from snapshots taken on the main thread when the
+   request was made, so they can keep changing while we're slicing.  The
+   data sets' slice cache generations are from the same time, slices from 
+   a data set that's been invalidated since don't go into the cache */
+typedef struct slicer_job_t {
+  AmitkSlicer * slicer;
+  guint generation;
+  gint num_data_sets;
+  AmitkDataSet ** data_sets;
+  AmitkDataSet ** snapshots;
+  guint * cache_generations;
+  amide_time_t start;
+  amide_time_t duration;
+  AmitkCanvasPoint pixel_size;
+  AmitkVolume * view_volume;
+} slicer_job_t;
+
+static void slicer_class_init          (AmitkSlicerClass *klass);
+static void slicer_init                (AmitkSlicer      *slicer);
+static void slicer_finalize            (GObject          *object);
+static void slicer_clear_jobs          (AmitkSlicer      *slicer);
+static void slicer_queue_job           (AmitkSlicer      *slicer,
+					const gint        num_data_sets,
+					AmitkDataSet    **data_sets,
+					AmitkDataSet    **snapshots,
+					const guint      *cache_generations,
+					const amide_time_t start,
+					const amide_time_t duration,
+					const AmitkCanvasPoint pixel_size,
+					const AmitkVolume *view_volume,
+					const amide_real_t z_shift);
+static gboolean slicer_job_done        (gpointer data);
+static gpointer slicer_thread          (gpointer data);
+static GObjectClass * parent_class;
+static guint     slicer_signals[LAST_SIGNAL];
+
+
+
+GType amitk_slicer_get_type(void) {
+
+  static GType slicer_type = 0;
+
+  if (!slicer_type)
+    {
+      static const GTypeInfo slicer_info =
+      {
+	sizeof (AmitkSlicerClass),
+	(GBaseInitFunc) NULL,
+	(GBaseFinalizeFunc) NULL,
+	(GClassInitFunc) slicer_class_init,
+	(GClassFinalizeFunc) NULL,
+	NULL,		/* class_data */
+	sizeof (AmitkSlicer),
+	0,			/* n_preallocs */
+	(GInstanceInitFunc) slicer_init,
+	NULL /* value table */
+      };
+      
+      slicer_type = g_type_register_static (G_TYPE_OBJECT, "AmitkSlicer", &slicer_info, 0);
+    }
+  
+  return slicer_type;
+}
+
+
+static void slicer_class_init (AmitkSlicerClass * class) {
+
+  GObjectClass *gobject_class = G_OBJECT_CLASS (class);
+
+  parent_class = g_type_class_peek_parent(class);
+  
+  gobject_class->finalize = slicer_finalize;
+
+  slicer_signals[SLICES_READY] =
+    g_signal_new ("slices_ready",
+		  G_TYPE_FROM_CLASS(class),
+		  G_SIGNAL_RUN_LAST,
+		  G_STRUCT_OFFSET(AmitkSlicerClass, slices_ready),
+		  NULL, NULL, amitk_marshal_NONE__UINT,
+		  G_TYPE_NONE,1,
+		  G_TYPE_UINT);
+
+}
+
+static void slicer_init (AmitkSlicer * slicer) {
+
+  g_mutex_init(&(slicer->mutex));
+  g_cond_init(&(slicer->cond));
+  g_queue_init(&(slicer->jobs));
+  slicer->generation = 0;
+  slicer->shutdown = FALSE;
+
+  /* the worker only holds a pointer, finalize joins it before the slicer goes away */
+  slicer->thread = g_thread_new("amitk_slicer", slicer_thread, slicer);
+
+  return;
+}
+
+
+static void slicer_finalize (GObject *object) {
+
+  AmitkSlicer * slicer = AMITK_SLICER(object);
+
+  g_mutex_lock(&(slicer->mutex));
+  slicer->shutdown = TRUE;
+  slicer_clear_jobs(slicer);
+  g_cond_signal(&(slicer->cond));
+  g_mutex_unlock(&(slicer->mutex));
+
+  g_thread_join(slicer->thread);
+  slicer->thread = NULL;
+
+  g_cond_clear(&(slicer->cond));
+  g_mutex_clear(&(slicer->mutex));
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+
+static void slicer_job_free(slicer_job_t * job) {
+
+  gint i;
+
+  for (i=0; i < job->num_data_sets; i++) {
+    amitk_object_unref(job->data_sets[i]);
+    amitk_object_unref(job->snapshots[i]);
+  }
+  g_free(job->data_sets);
+  g_free(job->snapshots);
+  g_free(job->cache_generations);
+  if (job->view_volume != NULL) {
+    amitk_object_unref(job->view_volume);
+    job->view_volume = NULL;
+  }
+  if (job->slicer != NULL) {
+    g_object_unref(job->slicer);
+    job->slicer = NULL;
+  }
+  g_free(job);
+
+  return;
+}
+
+/* hands the job back to the main loop, where all unref'ing is done */
+static gboolean slicer_job_done(gpointer data) {
+
+  slicer_job_t * job = data;
+  AmitkSlicer * slicer = job->slicer;
+
+  if ((!slicer->shutdown) && (job->generation == slicer->generation))
+    g_signal_emit(G_OBJECT(slicer), slicer_signals[SLICES_READY], 0, job->generation);
+
+  slicer_job_free(job);
+
+  return FALSE;
+}
+
+/* needs to be called with the mutex held */
+static void slicer_clear_jobs(AmitkSlicer * slicer) {
+
+  slicer_job_t * job;
+
+  while ((job = g_queue_pop_head(&(slicer->jobs))) != NULL)
+    g_idle_add(slicer_job_done, job);
+
+  return;
+}
+
+
+static gpointer slicer_thread(gpointer data) {
+
+  AmitkSlicer * slicer = data;
+  slicer_job_t * job;
+  gint i;
+
+  g_mutex_lock(&(slicer->mutex));
+  while (!slicer->shutdown) {
+    job = g_queue_pop_head(&(slicer->jobs));
+    if (job == NULL) {
+      g_cond_wait(&(slicer->cond), &(slicer->mutex));
+      continue;
+    }
+
+    if (job->generation == slicer->generation) {
+      g_mutex_unlock(&(slicer->mutex));
+      for (i=0; i < job->num_data_sets; i++)
+	amitk_data_set_cache_slice(job->data_sets[i], job->snapshots[i], job->cache_generations[i],
+				   job->start, job->duration, job->pixel_size, job->view_volume);
+      g_mutex_lock(&(slicer->mutex));
+    }
+
+    g_idle_add(slicer_job_done, job);
+  }
+  g_mutex_unlock(&(slicer->mutex));
+
+  return NULL;
+}
+
+
+
+AmitkSlicer * amitk_slicer_new (void) {
+
+  AmitkSlicer * slicer;
+
+  slicer = g_object_new(amitk_slicer_get_type(), NULL);
+
+  return slicer;
+}
+
+
+static void slicer_queue_job(AmitkSlicer * slicer,
+			     const gint num_data_sets,
+			     AmitkDataSet ** data_sets,
+			     AmitkDataSet ** snapshots,
+			     const guint * cache_generations,
+			     const amide_time_t start,
+			     const amide_time_t duration,
+			     const AmitkCanvasPoint pixel_size,
+			     const AmitkVolume * view_volume,
+			     const amide_real_t z_shift) {
+
+  slicer_job_t * job;
+  gint i;
+
+  job = g_new0(slicer_job_t, 1);
+  job->slicer = g_object_ref(slicer);
+  job->generation = slicer->generation;
+  job->num_data_sets = num_data_sets;
+  job->data_sets = g_new(AmitkDataSet *, num_data_sets);
+  job->snapshots = g_new(AmitkDataSet *, num_data_sets);
+  job->cache_generations = g_memdup(cache_generations, num_data_sets*sizeof(guint));
+  for (i=0; i < num_data_sets; i++) {
+    job->data_sets[i] = amitk_object_ref(data_sets[i]);
+    job->snapshots[i] = amitk_object_ref(snapshots[i]);
+  }
+  job->start = start;
+  job->duration = duration;
+  job->pixel_size = pixel_size;
+  job->view_volume = AMITK_VOLUME(amitk_object_copy(AMITK_OBJECT(view_volume)));
+  if (!REAL_EQUAL(z_shift, 0.0))
+    amitk_space_shift_offset(AMITK_SPACE(job->view_volume),
+			     point_cmult(z_shift, amitk_space_get_axis(AMITK_SPACE(view_volume), AMITK_AXIS_Z)));
+
+  g_queue_push_tail(&(slicer->jobs), job);
+
+  return;
+}
+
+/* queues up slicing of the given view, followed by a few views further
+   along the direction the user is moving in.  Any requests that haven't
+   been started yet are dropped.  Returns the id that'll be passed to 
+   "slices_ready" once the requested view is in the slice cache. */
+guint amitk_slicer_request(AmitkSlicer * slicer,
+			   GList * data_sets,
+			   const amide_time_t start,
+			   const amide_time_t duration,
+			   const AmitkCanvasPoint pixel_size,
+			   const AmitkVolume * view_volume,
+			   const gint z_direction,
+			   const gint time_direction) {
+
+  gint i;
+  amide_real_t thickness;
+  guint generation;
+  gint num_data_sets;
+  AmitkDataSet ** parents;
+  AmitkDataSet ** snapshots;
+  guint * cache_generations;
+
+  g_return_val_if_fail(AMITK_IS_SLICER(slicer), 0);
+  g_return_val_if_fail(AMITK_IS_VOLUME(view_volume), 0);
+
+  thickness = AMITK_VOLUME_Z_CORNER(view_volume);
+
+  /* snapshot the data sets as they are now, this needs to be done here on the main thread */
+  num_data_sets = 0;
+  parents = g_new(AmitkDataSet *, g_list_length(data_sets));
+  snapshots = g_new(AmitkDataSet *, g_list_length(data_sets));
+  cache_generations = g_new(guint, g_list_length(data_sets));
+  for (; data_sets != NULL; data_sets = data_sets->next) 
+    if (AMITK_IS_DATA_SET(data_sets->data)) {
+      parents[num_data_sets] = AMITK_DATA_SET(data_sets->data);
+      cache_generations[num_data_sets] = AMITK_DATA_SET_SLICE_CACHE_GENERATION(data_sets->data);
+      snapshots[num_data_sets] = amitk_data_set_get_slicing_snapshot(parents[num_data_sets]);
+      if (snapshots[num_data_sets] != NULL)
+	num_data_sets++;
+    }
+
+  g_mutex_lock(&(slicer->mutex));
+  slicer->generation++;
+  if (slicer->generation == 0) slicer->generation++; /* 0 is never a valid id */
+  generation = slicer->generation;
+  slicer_clear_jobs(slicer);
+
+  slicer_queue_job(slicer, num_data_sets, parents, snapshots, cache_generations, 
+		   start, duration, pixel_size, view_volume, 0.0);
+
+  if (z_direction != 0)
+    for (i=1; i <= AMITK_SLICER_PREFETCH_PLANES; i++)
+      slicer_queue_job(slicer, num_data_sets, parents, snapshots, cache_generations, 
+		       start, duration, pixel_size, view_volume, i*z_direction*thickness);
+
+  if (time_direction != 0)
+    for (i=1; i <= AMITK_SLICER_PREFETCH_FRAMES; i++)
+      slicer_queue_job(slicer, num_data_sets, parents, snapshots, cache_generations, 
+		       start+i*time_direction*duration, duration, pixel_size, view_volume, 0.0);
+
+  g_cond_signal(&(slicer->cond));
+  g_mutex_unlock(&(slicer->mutex));
+
+  /* the jobs hold their own references */
+  for (i=0; i < num_data_sets; i++)
+    amitk_object_unref(snapshots[i]);
+  g_free(parents);
+  g_free(snapshots);
+  g_free(cache_generations);
+
+  return generation;
+}
+
+/* drops any requests that haven't been started yet, "slices_ready" won't be 
+   emitted for anything requested before this call */
+void amitk_slicer_cancel(AmitkSlicer * slicer) {
+
+  g_return_if_fail(AMITK_IS_SLICER(slicer));
+
+  g_mutex_lock(&(slicer->mutex));
+  slicer->generation++;
+  if (slicer->generation == 0) slicer->generation++;
+  slicer_clear_jobs(slicer);
+  g_mutex_unlock(&(slicer->mutex));
+
+  return;
+}
@@ -0,0 +1,92 @@
+/* amitk_slicer.h
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+ 
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#ifndef __AMITK_SLICER_H__
+#define __AMITK_SLICER_H__
+
+/* header files that are always needed with this file */
+#include <glib-object.h>
+#include "amitk_data_set.h"
+
+G_BEGIN_DECLS
+
+#define	AMITK_TYPE_SLICER		(amitk_slicer_get_type ())
+#define AMITK_SLICER(object)		(G_TYPE_CHECK_INSTANCE_CAST ((object), AMITK_TYPE_SLICER, AmitkSlicer))
+#define AMITK_SLICER_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST ((klass), AMITK_TYPE_SLICER, AmitkSlicerClass))
+#define AMITK_IS_SLICER(object)		(G_TYPE_CHECK_INSTANCE_TYPE ((object), AMITK_TYPE_SLICER))
+#define AMITK_IS_SLICER_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE ((klass), AMITK_TYPE_SLICER))
+#define	AMITK_SLICER_GET_CLASS(object)	(G_TYPE_CHECK_GET_CLASS ((object), AMITK_TYPE_SLICER, AmitkSlicerClass))
+
+#define AMITK_SLICER_PREFETCH_PLANES 3 /* planes ahead in the scroll direction */
+#define AMITK_SLICER_PREFETCH_FRAMES 1 /* time steps ahead during playback */
+
+typedef struct _AmitkSlicerClass AmitkSlicerClass;
+typedef struct _AmitkSlicer      AmitkSlicer;
+
+/* The AmitkSlicer generates slices on a worker thread and puts them in the
+ * shared slice cache.  Each request cancels any older request that hasn't
+ * been started yet, and "slices_ready" is emitted (from the main loop) only 
+ * for the most recent request.
+ */
+struct _AmitkSlicer {
+
+  GObject parent;
+
+  /* private info */
+  GThread * thread;
+  GMutex mutex;
+  GCond cond;
+  GQueue jobs; /* waiting to be sliced, protected by mutex */
+  guint generation; /* id of the most recent request */
+  gboolean shutdown;
+
+};
+
+struct _AmitkSlicerClass
+{
+  GObjectClass parent_class;
+
+  void (* slices_ready) (AmitkSlicer * slicer,
+			 guint request);
+
+};
+
+
+/* ------------ external functions ---------- */
+
+GType	      amitk_slicer_get_type	    (void);
+AmitkSlicer * amitk_slicer_new              (void);
+guint         amitk_slicer_request          (AmitkSlicer * slicer,
+					     GList * data_sets,
+					     const amide_time_t start,
+					     const amide_time_t duration,
+					     const AmitkCanvasPoint pixel_size,
+					     const AmitkVolume * view_volume,
+					     const gint z_direction,
+					     const gint time_direction);
+void          amitk_slicer_cancel           (AmitkSlicer * slicer);
+
+G_END_DECLS
+#endif /* __AMITK_SLICER_H__ */
@@ -671,6 +671,58 @@ AmitkPoint amitk_space_s2b(const AmitkSpace * space, const AmitkPoint in_point)
   return return_point;
 }
 
+/* fill in the affine transform that takes points in in_space to out_space,
+   i.e. amitk_space_s2s(in_space, out_space, p) == step * p + offset */
+void amitk_space_s2s_init(AmitkSpaceS2S * s2s,
+			  const AmitkSpace * in_space,
+			  const AmitkSpace * out_space) {
+
+  AmitkAxis i_axis;
+  AmitkPoint shift;
+
+  for (i_axis=0; i_axis<AMITK_AXIS_NUM; i_axis++) {
+    s2s->step[i_axis].x = POINT_DOT_PRODUCT(in_space->axes[i_axis], out_space->axes[AMITK_AXIS_X]);
+    s2s->step[i_axis].y = POINT_DOT_PRODUCT(in_space->axes[i_axis], out_space->axes[AMITK_AXIS_Y]);
+    s2s->step[i_axis].z = POINT_DOT_PRODUCT(in_space->axes[i_axis], out_space->axes[AMITK_AXIS_Z]);
+  }
+
+  POINT_SUB(in_space->offset, out_space->offset, shift);
+  s2s->offset.x = POINT_DOT_PRODUCT(shift, out_space->axes[AMITK_AXIS_X]);
+  s2s->offset.y = POINT_DOT_PRODUCT(shift, out_space->axes[AMITK_AXIS_Y]);
+  s2s->offset.z = POINT_DOT_PRODUCT(shift, out_space->axes[AMITK_AXIS_Z]);
+
+  return;
+}
+
+/* convert a point using a precomputed space to space transform */
+AmitkPoint amitk_space_s2s_point(const AmitkSpaceS2S * s2s, const AmitkPoint in_point) {
+
+  AmitkPoint return_point;
+
+  return_point.x = s2s->offset.x +
+    in_point.x * s2s->step[AMITK_AXIS_X].x +
+    in_point.y * s2s->step[AMITK_AXIS_Y].x +
+    in_point.z * s2s->step[AMITK_AXIS_Z].x;
+  return_point.y = s2s->offset.y +
+    in_point.x * s2s->step[AMITK_AXIS_X].y +
+    in_point.y * s2s->step[AMITK_AXIS_Y].y +
+    in_point.z * s2s->step[AMITK_AXIS_Z].y;
+  return_point.z = s2s->offset.z +
+    in_point.x * s2s->step[AMITK_AXIS_X].z +
+    in_point.y * s2s->step[AMITK_AXIS_Y].z +
+    in_point.z * s2s->step[AMITK_AXIS_Z].z;
+
+  return return_point;
+}
+
+/* what moving length along the given in_space axis corresponds to in out_space,
+   add this to a transformed point to step it incrementally */
+AmitkPoint amitk_space_s2s_stride(const AmitkSpaceS2S * s2s, 
+				  const AmitkAxis which_axis,
+				  const amide_real_t length) {
+  return point_cmult(length, s2s->step[which_axis]);
+}
+
 /* converts a "dimensional" quantity (i.e. the size of a voxel) from a
    given space to the base coordinate system */
 AmitkPoint amitk_space_s2b_dim(const AmitkSpace * space, const AmitkPoint in_point) {
@@ -153,6 +153,23 @@ AmitkPoint     amitk_space_s2b_dim       (const AmitkSpace * space, const AmitkP
 AmitkPoint     amitk_space_b2s_dim       (const AmitkSpace * space, const AmitkPoint in_rp);
 #define amitk_space_s2s_dim(in_space, out_space, in) (amitk_space_b2s_dim((out_space), amitk_space_s2b_dim((in_space), (in))))
 
+/* precomputed in_space -> out_space mapping, for loops that would otherwise
+   call amitk_space_s2s on every voxel.  step[i] is a unit move along in_space's
+   i axis expressed in out_space, offset is in_space's origin in out_space */
+typedef struct _AmitkSpaceS2S AmitkSpaceS2S;
+struct _AmitkSpaceS2S {
+  AmitkAxes step;
+  AmitkPoint offset;
+};
+
+void           amitk_space_s2s_init      (AmitkSpaceS2S * s2s,
+					  const AmitkSpace * in_space,
+					  const AmitkSpace * out_space);
+AmitkPoint     amitk_space_s2s_point     (const AmitkSpaceS2S * s2s, const AmitkPoint in_rp);
+AmitkPoint     amitk_space_s2s_stride    (const AmitkSpaceS2S * s2s, 
+					  const AmitkAxis which_axis,
+					  const amide_real_t length);
+
 
 /* debugging functions */
 void amitk_space_print(AmitkSpace * space, gchar * message);
@@ -37,6 +37,9 @@
 #include "amitk_type_builtins.h"
 #include "legacy.h"
 
+/* stdio buffer size used when writing flat xif files */
+#define STUDY_SAVE_BUFFER_SIZE 0x100000
+
 
 enum {
   FILENAME_CHANGED,
@@ -1210,6 +1213,8 @@ gboolean amitk_study_save_xml(AmitkStudy * study, const gchar * study_filename,
       g_warning(_("Couldn't open file %s\n"), study_filename);
       return FALSE;
     }
+    /* the xml portions are written in lots of small pieces, buffer them up */
+    setvbuf(study_file, NULL, _IOFBF, STUDY_SAVE_BUFFER_SIZE);
     fprintf(study_file, "%s Version %s", 
 	    AMITK_FLAT_FILE_MAGIC_STRING,
 	    AMITK_FILE_VERSION);
@@ -1238,6 +1243,209 @@ gboolean amitk_study_save_xml(AmitkStudy * study, const gchar * study_filename,
 }
 
 
+/* state for a save running in the background */
+typedef struct {
+  AmitkStudy * study; /* held for the duration of the save */
+  AmitkStudy * snapshot; /* copy of the study that's actually written out */
+  gchar * filename;
+  guint64 total_bytes;
+  AmitkUpdateFunc update_func;
+  gpointer update_data;
+  AmitkStudySaveFunc done_func;
+  gpointer done_data;
+  GThread * thread;
+  gboolean successful;
+
+  /* below are shared with the save thread */
+  GMutex mutex;
+  gdouble fraction;
+  guint progress_idle;
+  guint done_idle;
+} study_save_t;
+
+/* saves in progress, only touched from the main thread */
+static GList * study_saves = NULL;
+
+static gboolean study_save_progress_cb(gpointer data) {
+
+  study_save_t * save = data;
+  gdouble fraction;
+
+  g_mutex_lock(&save->mutex);
+  fraction = save->fraction;
+  save->progress_idle = 0;
+  g_mutex_unlock(&save->mutex);
+
+  (*save->update_func)(save->update_data, NULL, fraction);
+
+  return FALSE;
+}
+
+/* called from the save thread as raw data gets written, passes the progress 
+   on to the main loop */
+static gboolean study_save_thread_progress(gpointer data, char * message, gdouble fraction) {
+
+  study_save_t * save = data;
+
+  g_mutex_lock(&save->mutex);
+  save->fraction = fraction;
+  if (save->progress_idle == 0) 
+    save->progress_idle = g_idle_add(study_save_progress_cb, save);
+  g_mutex_unlock(&save->mutex);
+
+  return TRUE;
+}
+
+/* called once the save thread is done and joined */
+static void study_save_finish(study_save_t * save) {
+
+  study_saves = g_list_remove(study_saves, save);
+
+  if (save->progress_idle != 0) g_source_remove(save->progress_idle);
+  if (save->done_idle != 0) g_source_remove(save->done_idle);
+
+  if (save->update_func != NULL) /* remove progress bar */
+    (*save->update_func)(save->update_data, NULL, (gdouble) 2.0);
+
+  save->snapshot = amitk_object_unref(save->snapshot);
+  if (save->done_func != NULL)
+    (*save->done_func)(save->study, save->filename, save->successful, save->done_data);
+
+  save->study = amitk_object_unref(save->study);
+  g_free(save->filename);
+  g_mutex_clear(&save->mutex);
+  g_free(save);
+
+  return;
+}
+
+static gboolean study_save_done_cb(gpointer data) {
+
+  study_save_t * save = data;
+
+  g_thread_join(save->thread);
+  save->done_idle = 0;
+  study_save_finish(save);
+
+  return FALSE;
+}
+
+static gpointer study_save_thread(gpointer data) {
+
+  study_save_t * save = data;
+
+  if (save->update_func != NULL)
+    amitk_raw_data_set_write_progress(study_save_thread_progress, save, save->total_bytes);
+  save->successful = amitk_study_save_xml(save->snapshot, save->filename, FALSE);
+  amitk_raw_data_set_write_progress(NULL, NULL, 0);
+
+  g_mutex_lock(&save->mutex);
+  save->done_idle = g_idle_add(study_save_done_cb, save);
+  g_mutex_unlock(&save->mutex);
+
+  return NULL;
+}
+
+/* saves the study to a flat xif file without blocking.  A copy of the study is 
+   made, which shares the raw data with the original, and is written out from 
+   a separate thread while the main loop keeps running.  Progress is reported 
+   through update_func from the main loop, and done_func is called from the main 
+   loop once the save has finished.  Raw data shouldn't be modified in place 
+   while the save is running, use amitk_study_save_wait first.
+
+   Saving as a directory changes the working directory of the whole process,
+   so is done synchronously. */
+void amitk_study_save_xml_async(AmitkStudy * study, 
+				const gchar * study_filename,
+				const gboolean save_as_directory,
+				AmitkUpdateFunc update_func,
+				gpointer update_data,
+				AmitkStudySaveFunc done_func,
+				gpointer done_data) {
+
+  study_save_t * save;
+  GList * data_sets;
+  GList * temp_data_sets;
+  gboolean successful;
+
+  g_return_if_fail(AMITK_IS_STUDY(study));
+  g_return_if_fail(study_filename != NULL);
+
+  if (save_as_directory) {
+    successful = amitk_study_save_xml(study, study_filename, save_as_directory);
+    if (done_func != NULL)
+      (*done_func)(study, study_filename, successful, done_data);
+    return;
+  }
+
+  /* don't start writing over a file that's still being written */
+  amitk_study_save_wait(study);
+
+  /* remember the name of the xif file of this study */
+  amitk_study_set_filename(study, study_filename);
+
+  save = g_new0(study_save_t, 1);
+  save->study = amitk_object_ref(study);
+  save->snapshot = AMITK_STUDY(amitk_object_copy(AMITK_OBJECT(study)));
+  save->filename = g_strdup(study_filename);
+  save->update_func = update_func;
+  save->update_data = update_data;
+  save->done_func = done_func;
+  save->done_data = done_data;
+  g_mutex_init(&save->mutex);
+
+  /* figure out how much raw data we'll be writing, for the progress bar */
+  data_sets = amitk_object_get_children_of_type(AMITK_OBJECT(save->snapshot), AMITK_OBJECT_TYPE_DATA_SET, TRUE);
+  for (temp_data_sets = data_sets; temp_data_sets != NULL; temp_data_sets = temp_data_sets->next)
+    save->total_bytes += amitk_raw_data_size_data_mem(AMITK_DATA_SET_RAW_DATA(temp_data_sets->data));
+  amitk_objects_unref(data_sets);
+
+  if (update_func != NULL) {
+    gchar * temp_string;
+    temp_string = g_strdup_printf(_("Saving: %s"), study_filename);
+    (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+
+  study_saves = g_list_append(study_saves, save);
+  save->thread = g_thread_new("amitk_study_save", study_save_thread, save);
+
+  return;
+}
+
+/* blocks until any background saves of the given study are done, 
+   or of all studies if study is NULL */
+void amitk_study_save_wait(AmitkStudy * study) {
+
+  GList * saves;
+  study_save_t * save;
+
+  saves = g_list_copy(study_saves);
+  while (saves != NULL) {
+    save = saves->data;
+    if ((study == NULL) || (save->study == study)) {
+      g_thread_join(save->thread);
+      study_save_finish(save);
+    }
+    saves = g_list_delete_link(saves, saves);
+  }
+
+  return;
+}
+
+/* whether the study is currently being saved in the background */
+gboolean amitk_study_save_in_progress(AmitkStudy * study) {
+
+  GList * saves;
+
+  for (saves = study_saves; saves != NULL; saves = saves->next) 
+    if (((study_save_t *) saves->data)->study == study)
+      return TRUE;
+
+  return FALSE;
+}
+
+
 const gchar * amitk_fuse_type_get_name(const AmitkFuseType fuse_type) {
 
   GEnumClass * enum_class;
@@ -83,6 +83,10 @@ typedef enum {
 typedef struct _AmitkStudyClass AmitkStudyClass;
 typedef struct _AmitkStudy AmitkStudy;
 
+/* called from the main loop when amitk_study_save_xml_async is done */
+typedef void (*AmitkStudySaveFunc) (AmitkStudy * study, const gchar * study_filename,
+				    gboolean successful, gpointer data);
+
 
 struct _AmitkStudy
 {
@@ -204,6 +208,15 @@ AmitkStudy *    amitk_study_load_xml                (const gchar * study_filenam
 gboolean        amitk_study_save_xml                (AmitkStudy * study, 
 						     const gchar * study_filename,
 						     const gboolean save_as_directory);
+void            amitk_study_save_xml_async          (AmitkStudy * study,
+						     const gchar * study_filename,
+						     const gboolean save_as_directory,
+						     AmitkUpdateFunc update_func,
+						     gpointer update_data,
+						     AmitkStudySaveFunc done_func,
+						     gpointer done_data);
+void            amitk_study_save_wait               (AmitkStudy * study);
+gboolean        amitk_study_save_in_progress        (AmitkStudy * study);
 
 const gchar *   amitk_fuse_type_get_name            (const AmitkFuseType fuse_type);
 const gchar *   amitk_view_mode_get_name            (const AmitkViewMode view_mode);
@@ -44,35 +44,19 @@
 //#endif
 
 #define EMPTY 0.0
+typedef struct _analysis_buffer_t analysis_buffer_t;
+typedef struct _analysis_batch_t analysis_batch_t;
 
 static analysis_gate_t * analysis_gate_unref(analysis_gate_t *gate_analysis);
-static analysis_gate_t * analysis_gate_init(AmitkRoi * roi, AmitkDataSet *ds,guint frame, 
-					    analysis_calculation_t calculation_type,
-					    gboolean accurate,
-					    gdouble subfraction, 
-					    gdouble threshold_percentage, 
-					    gdouble threshold_value);
+static analysis_gate_t * analysis_gate_init(analysis_batch_t * batch, gint roi_index, guint frame);
 static analysis_frame_t * analysis_frame_unref(analysis_frame_t * frame_analysis);
-static analysis_frame_t * analysis_frame_init(AmitkRoi * roi, AmitkDataSet *ds, 
-					      analysis_calculation_t calculation_type,
-					      gboolean accurate,
-					      gdouble subfraction, 
-					      gdouble threshold_percentage,
-					      gdouble threshold_value);
+static analysis_frame_t * analysis_frame_init(AmitkRoi * roi, gint roi_index,
+					      analysis_batch_t * batch);
 static analysis_volume_t * analysis_volume_unref(analysis_volume_t *volume_analysis);
-static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, GList * volumes, 
-						analysis_calculation_t calculation_type,
-						gboolean accurate,
-						gdouble subfraction, 
-						gdouble threshold_percentage, 
-						gdouble threshold_value);
+static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, gint roi_index,
+						GList * volumes, GList * batches);
 
 
-void free_array_element(gpointer data, gpointer user_data) {
-  analysis_element_t * element = data;
-  g_free(element);
-}
-
 static analysis_gate_t * analysis_gate_unref(analysis_gate_t * gate_analysis) {
 
   analysis_gate_t * return_list;
@@ -89,9 +73,6 @@ static analysis_gate_t * analysis_gate_unref(analysis_gate_t * gate_analysis) {
   /* if we've removed all reference's, free the roi */
   if (gate_analysis->ref_count == 0) {
 
-    g_ptr_array_foreach(gate_analysis->data_array, free_array_element, NULL); /* free the elements */
-    g_ptr_array_free(gate_analysis->data_array, TRUE); /* TRUE frees the array of pointers to elements as well */
-
     /* recursively delete rest of list */
     return_list = analysis_gate_unref(gate_analysis->next_gate_analysis);
     gate_analysis->next_gate_analysis = NULL;
@@ -104,41 +85,208 @@ static analysis_gate_t * analysis_gate_unref(analysis_gate_t * gate_analysis) {
 }
 
 
-static void record_stats(AmitkVoxel ds_voxel,
-			 amide_data_t value,
-			 amide_real_t voxel_fraction,
-			 gpointer data) {
+/* voxels in an roi for the gate being calculated, kept as separate value and weight
+   arrays.  Buffers are sized from the roi map up front, so filling them in the
+   inner loop never needs to reallocate */
+struct _analysis_buffer_t {
+  amide_data_t * values;
+  amide_real_t * weights;
+  gint len;
+};
+
+/* the voxels of a data set that are in each of the rois being analyzed.  These are
+   the rois' cached masks, which only depend on the roi and the data set's geometry, 
+   so a map serves every frame/gate */
+struct _analysis_map_t {
+  AmitkDataSet * data_set; /* the geometry this map was made for */
+  gint num_rois;
+  AmitkRoiMask ** masks;
+  gint * roi_voxels; /* number of voxels in each roi */
+  gint max_roi_voxels;
+  guint ref_count;
+};
+
+/* the statistics of every roi on every frame/gate of one data set */
+struct _analysis_batch_t {
+  AmitkDataSet * data_set;
+  analysis_map_t * map;
+  analysis_calculation_t calculation_type;
+  gdouble subfraction;
+  gdouble threshold_percentage;
+  gdouble threshold_value;
+  analysis_gate_t ** gate_analyses; /* indexed by roi, then frame, then gate */
+};
+
+/* gets the masks of the list of rois on the data set's voxel grid, and counts the
+   voxels actually in each roi */
+static analysis_map_t * analysis_map_new(GList * rois, AmitkDataSet * ds, gboolean accurate) {
+
+  analysis_map_t * map;
+  AmitkVoxel start;
+  gint length, iter, k;
+  const amide_real_t * fractions;
+  gint roi_index;
+
+  map = g_new0(analysis_map_t, 1);
+  map->ref_count = 1;
+  map->data_set = amitk_object_ref(ds);
+  map->num_rois = g_list_length(rois);
+  map->masks = g_new0(AmitkRoiMask *, map->num_rois);
+  map->roi_voxels = g_new0(gint, map->num_rois);
+
+  for (roi_index=0; rois != NULL; rois = rois->next, roi_index++) {
+    map->masks[roi_index] = amitk_roi_get_mask(AMITK_ROI(rois->data), ds, accurate);
+    iter = 0;
+    while (amitk_roi_mask_next_run(map->masks[roi_index], &iter, &start, &length, &fractions)) {
+      if (fractions == NULL)
+	map->roi_voxels[roi_index] += length;
+      else 
+	for (k=0; k < length; k++)
+	  if (fractions[k] > 0.0) map->roi_voxels[roi_index]++;
+    }
+    map->max_roi_voxels = MAX(map->max_roi_voxels, map->roi_voxels[roi_index]);
+  }
+
+  return map;
+}
+
+static analysis_map_t * analysis_map_ref(analysis_map_t * map) {
+  map->ref_count++;
+  return map;
+}
 
-  GPtrArray * array = data;
-  analysis_element_t * element;
-  
-  /* crashes if alloc fails, but I don't want to do error checking in the inner loop... 
-     let's not run out of memory */
-  if (voxel_fraction > 0.0) {
-    element = g_malloc(sizeof(analysis_element_t)); 
-    
-    element->value = value;
-    element->weight = voxel_fraction;
-    element->ds_voxel = ds_voxel;
-    g_ptr_array_add(array, element);
+static analysis_map_t * analysis_map_unref(analysis_map_t * map) {
+
+  gint roi_index;
+
+  if (map == NULL) return map;
+
+  g_return_val_if_fail(map->ref_count > 0, NULL);
+
+  map->ref_count--;
+  if (map->ref_count == 0) {
+    map->data_set = amitk_object_unref(map->data_set);
+    for (roi_index=0; roi_index < map->num_rois; roi_index++)
+      amitk_roi_mask_unref(map->masks[roi_index]);
+    g_free(map->masks);
+    g_free(map->roi_voxels);
+    g_free(map);
+  }
+
+  return NULL;
+}
+
+/* fill the buffer with the values and weights of an roi's voxels on a frame/gate.  If
+   voxels is non-NULL, the voxel locations are stored there as well */
+static void analysis_map_fill(const analysis_map_t * map, gint roi_index, 
+			      AmitkDataSet * ds, guint frame, guint gate,
+			      analysis_buffer_t * buffer, AmitkVoxel * voxels) {
+
+  AmitkVoxel i, start;
+  const amide_real_t * fractions;
+  amide_real_t weight;
+  gint length, iter, k;
+
+  i.t = frame;
+  i.g = gate;
+  buffer->len = 0;
+
+  iter = 0;
+  while (amitk_roi_mask_next_run(map->masks[roi_index], &iter, &start, &length, &fractions)) {
+    i.z = start.z;
+    i.y = start.y;
+    for (k=0, i.x = start.x; k < length; k++, i.x++) {
+      weight = (fractions == NULL) ? 1.0 : fractions[k];
+      if (weight <= 0.0) continue;
+      buffer->values[buffer->len] = amitk_data_set_get_value(ds, i);
+      buffer->weights[buffer->len] = weight;
+      if (voxels != NULL) voxels[buffer->len] = i;
+      buffer->len++;
+    }
   }
 
   return;
 }
 
-static gint array_comparison(gconstpointer a, gconstpointer b) {
+/* returns true if the map can be used for the given data set */
+static gboolean analysis_map_fits(const analysis_map_t * map, const AmitkDataSet * ds) {
 
-  const analysis_element_t * ea = *((analysis_element_t **) a);
-  const analysis_element_t * eb = *((analysis_element_t **) b);
+  AmitkVoxel map_dim, ds_dim;
 
-  if (ea->value > eb->value) 
-    return -1;
-  else if (ea->value < eb->value) 
-    return 1;
-  else
-    return 0;
+  map_dim = AMITK_DATA_SET_DIM(map->data_set);
+  ds_dim = AMITK_DATA_SET_DIM(ds);
+
+  return ((map_dim.x == ds_dim.x) && (map_dim.y == ds_dim.y) && (map_dim.z == ds_dim.z) &&
+	  POINT_EQUAL(AMITK_DATA_SET_VOXEL_SIZE(map->data_set), AMITK_DATA_SET_VOXEL_SIZE(ds)) &&
+	  amitk_space_equal(AMITK_SPACE(map->data_set), AMITK_SPACE(ds)));
+}
+
+static inline void buffer_swap(analysis_buffer_t * buffer, gint i, gint j) {
+
+  amide_data_t value;
+  amide_real_t weight;
+
+  value = buffer->values[i];
+  buffer->values[i] = buffer->values[j];
+  buffer->values[j] = value;
+  weight = buffer->weights[i];
+  buffer->weights[i] = buffer->weights[j];
+  buffer->weights[j] = weight;
+
+  return;
+}
+
+/* partial sort of elements left to right so that element k ends up with the value 
+   it would have if they were sorted into decreasing order, with everything before it
+   >= and everything after it <=.  Expected order(N), versus order(NlogN) for a sort */
+static void buffer_select(analysis_buffer_t * buffer, gint left, gint right, gint k) {
+
+  amide_data_t * values = buffer->values;
+  amide_data_t pivot;
+  gint i, j, mid;
+
+  while (right > left) {
+
+    /* median of three, also leaves guards at both ends for the scans below */
+    mid = left + (right-left)/2;
+    if (values[mid] > values[left]) buffer_swap(buffer, mid, left);
+    if (values[right] > values[left]) buffer_swap(buffer, right, left);
+    if (values[right] > values[mid]) buffer_swap(buffer, right, mid);
+    pivot = values[mid];
+
+    i = left;
+    j = right;
+    while (i <= j) {
+      while (values[i] > pivot) i++;
+      while (values[j] < pivot) j--;
+      if (i <= j) {
+	buffer_swap(buffer, i, j);
+	i++;
+	j--;
+      }
+    }
+
+    if (k <= j) right = j;
+    else if (k >= i) left = i;
+    else return;
+  }
+
+  return;
 }
 
+/* moves all elements >= cutoff to the front of the buffer, returns how many there are */
+static gint buffer_partition(analysis_buffer_t * buffer, amide_data_t cutoff) {
+
+  gint i, num_above=0;
+
+  for (i=0; i < buffer->len; i++) 
+    if (buffer->values[i] >= cutoff) {
+      if (i != num_above) buffer_swap(buffer, i, num_above);
+      num_above++;
+    }
+
+  return num_above;
+}
 
 
 /* note, the following function for weight variance calculation is
@@ -147,16 +295,15 @@ static gint array_comparison(gconstpointer a, gconstpointer b) {
 /* The variance is divided by N-1, since the mean in a sense is being
    "estimated" from the data set....  If anyone else with more
    statistical experience disagrees, please speak up */
-static gdouble wvariance (GPtrArray * array, guint num_elements, gdouble wmean)
+static gdouble wvariance (analysis_buffer_t * buffer, gint num_elements, gdouble wmean)
 {
-  analysis_element_t * element;
   gdouble wsumofsquares = 0 ;
   gdouble Wa = 0;
   gdouble Wb = 0;
   gdouble wi;
   gdouble delta;
   gdouble factor;
-  guint i;
+  gint i;
 
   if (num_elements < 2) return NAN;
 
@@ -164,11 +311,10 @@ static gdouble wvariance (GPtrArray * array, guint num_elements, gdouble wmean)
   /* computes sum(wi*(valuei-mean))/sum(wi) */
   /* and computes the weighted version of N/(N-1) */
   for (i = 0; i < num_elements; i++) {
-    element = g_ptr_array_index(array, i);
-    wi = element->weight;
+    wi = buffer->weights[i];
 
     if (wi > 0) {
-      delta = element->value-wmean;
+      delta = buffer->values[i]-wmean;
       Wa += wi ;
       Wb += wi*wi;
       wsumofsquares += (delta * delta - wsumofsquares) * (wi / Wa);
@@ -182,99 +328,74 @@ static gdouble wvariance (GPtrArray * array, guint num_elements, gdouble wmean)
 
 
 
-/* calculate an analysis of several statistical values for an roi on a given data set frame/gate. */
-static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi, 
-						    AmitkDataSet * ds, 
-						    guint frame,
-						    guint gate,
-						    analysis_calculation_t calculation_type,
-						    gboolean accurate,
-						    gdouble subfraction,
-						    gdouble threshold_percentage,
-						    gdouble threshold_value) {
+/* orders indexes into the buffer by descending value */
+static gint buffer_order_compare(gconstpointer a, gconstpointer b, gpointer data) {
 
-  GPtrArray * data_array;
-  analysis_gate_t * analysis;
-  guint subfraction_voxels;
-  guint i;
-  analysis_element_t * element;
-  gdouble max;
-  gboolean done;
-#ifdef AMIDE_DEBUG
-  struct timeval tv1;
-  struct timeval tv2;
-  gdouble time1;
-  gdouble time2;
+  const analysis_buffer_t * buffer = data;
+  amide_data_t value_a = buffer->values[*((const gint *) a)];
+  amide_data_t value_b = buffer->values[*((const gint *) b)];
 
-  /* let's do some timing */
-  gettimeofday(&tv1, NULL);
-#endif
+  if (value_a > value_b) 
+    return -1;
+  else if (value_a < value_b) 
+    return 1;
+  else
+    return 0;
+}
 
-  if (gate == AMITK_DATA_SET_NUM_GATES(ds)) return NULL; /* check if we're done */
 
-  /* and now calculate this gate's data */
-  if ((data_array = g_ptr_array_new()) == NULL) {
-    g_warning(_("couldn't allocate memory space for data array for frame %d/gate %d"), frame, gate);
-    return NULL;
-  }
-  /* fill the array with the appropriate info from the data set */
-  /* note, I really only need a partial sort to get the median value, but
-     glib doesn't have one (only has a full qsort), so I'll just do that.
-     Partial sort would be order(N), qsort is order(NlogN), so it's not that
-     much worse.
-
-     If I used a partial sort, I'd have to iterate over the subfraction to find the 
-     max and min, and I'd have to do another partial sort to find the median 
-  */
-  amitk_roi_calculate_on_data_set(roi, ds, frame, gate,FALSE, accurate, record_stats, data_array);
-  g_ptr_array_sort(data_array, array_comparison);
-  
+/* calculate an analysis of several statistical values for the voxels of an roi
+   on a given data set frame/gate, as held in the buffer */
+static analysis_gate_t * analysis_gate_calculate(AmitkDataSet * ds,
+						 guint frame,
+						 guint gate,
+						 analysis_calculation_t calculation_type,
+						 gdouble subfraction,
+						 gdouble threshold_percentage,
+						 gdouble threshold_value,
+						 analysis_buffer_t * buffer) {
+
+  analysis_gate_t * analysis;
+  gint subfraction_voxels;
+  gint i;
+  gdouble max;
+
+  /* figure out how many of the highest voxels we're using, and move them to the 
+     front of the buffer.  Only selection is needed for this and the median below, 
+     not a full sort */
   switch(calculation_type) {
   case ALL_VOXELS:
-    subfraction_voxels = data_array->len;
+    subfraction_voxels = buffer->len;
     break;
   case HIGHEST_FRACTION_VOXELS:
-    subfraction_voxels = ceil(subfraction*data_array->len);
+    subfraction_voxels = ceil(subfraction*buffer->len);
 
-    if ((subfraction_voxels == 0) && (data_array->len > 0))
+    if ((subfraction_voxels == 0) && (buffer->len > 0))
       subfraction_voxels = 1; /* have at least one voxel if the roi is in the data set*/
+    if (subfraction_voxels > buffer->len)
+      subfraction_voxels = buffer->len;
 
+    if ((subfraction_voxels > 0) && (subfraction_voxels < buffer->len))
+      buffer_select(buffer, 0, buffer->len-1, subfraction_voxels-1);
     break;
   case VOXELS_NEAR_MAX:
     subfraction_voxels = 0;
 
-    if (data_array->len > 0) {
-      element = g_ptr_array_index(data_array, 0);
-      max = element->value;
-      done = FALSE;
-      for (i=0; i<data_array->len && !done; i++) {
-	element = g_ptr_array_index(data_array, i);
-	if (element->value >= max*threshold_percentage/100.0)
-	  subfraction_voxels++;
-	else
-	  done = TRUE;
-      }
+    if (buffer->len > 0) {
+      max = buffer->values[0];
+      for (i=1; i<buffer->len; i++)
+	if (buffer->values[i] > max) max = buffer->values[i];
+      subfraction_voxels = buffer_partition(buffer, max*threshold_percentage/100.0);
     }
 
-    if ((subfraction_voxels == 0) && (data_array->len > 0))
+    if ((subfraction_voxels == 0) && (buffer->len > 0)) {
       subfraction_voxels = 1; /* have at least one voxel if the roi is in the data set*/
+      buffer_select(buffer, 0, buffer->len-1, 0);
+    }
 
     break;
   case VOXELS_GREATER_THAN_VALUE:
-    subfraction_voxels = 0;
-
-    if (data_array->len > 0) {
-      element = g_ptr_array_index(data_array, 0);
-      max = element->value;
-      done = FALSE;
-      for (i=0; i<data_array->len && !done; i++) {
-	element = g_ptr_array_index(data_array, i);
-	if (element->value >= threshold_value)
-	  subfraction_voxels++;
-	else
-	  done = TRUE;
-      }
-    }
+    subfraction_voxels = buffer_partition(buffer, threshold_value);
     break;
   default:
     subfraction_voxels=0;
@@ -288,9 +409,9 @@ static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi,
     return analysis;
   }
   analysis->ref_count = 1;
+  analysis->next_gate_analysis = NULL;
 
   /* set values */
-  analysis->data_array = data_array;
   analysis->duration = amitk_data_set_get_frame_duration(ds, frame);
   analysis->time_midpoint = amitk_data_set_get_midpt_time(ds, frame);
   analysis->gate_time = amitk_data_set_get_gate_time(ds, gate);
@@ -311,70 +432,161 @@ static analysis_gate_t * analysis_gate_init_recurse(AmitkRoi * roi,
 
   } else { 
 
-    /* max */
-    element = g_ptr_array_index(data_array, 0);
-    analysis->max = element->value;
-
-    /* min */
-    element = g_ptr_array_index(data_array, subfraction_voxels-1);
-    analysis->min = element->value;
-
-    /* median */
-    if (subfraction_voxels & 0x1) { /* odd */
-      element = g_ptr_array_index(data_array, (subfraction_voxels-1)/2);
-      analysis->median = element->value;
-    } else { /* even */
-      element = g_ptr_array_index(data_array, subfraction_voxels/2-1);
-      analysis->median = 0.5*element->value;
-      element = g_ptr_array_index(data_array, subfraction_voxels/2);
-      analysis->median += 0.5*element->value;
-    }
-
-    /* total and #fractional_voxels */
+    /* max, min, total and #fractional_voxels */
+    analysis->max = analysis->min = buffer->values[0];
     for (i=0; i<subfraction_voxels; i++) {
-      element = g_ptr_array_index(data_array, i);
-      analysis->total += element->weight*element->value;
-      analysis->fractional_voxels += element->weight;
+      if (buffer->values[i] > analysis->max) analysis->max = buffer->values[i];
+      if (buffer->values[i] < analysis->min) analysis->min = buffer->values[i];
+      analysis->total += buffer->weights[i]*buffer->values[i];
+      analysis->fractional_voxels += buffer->weights[i];
     }
 
     /* calculate the mean */
     analysis->mean = analysis->total/analysis->fractional_voxels;
 
     /* calculate variance */
-    analysis->var = wvariance(data_array, subfraction_voxels, analysis->mean);
+    analysis->var = wvariance(buffer, subfraction_voxels, analysis->mean);
+
+    /* median, done last as selection reorders the buffer */
+    buffer_select(buffer, 0, subfraction_voxels-1, (subfraction_voxels-1)/2);
+    analysis->median = buffer->values[(subfraction_voxels-1)/2];
+    if (!(subfraction_voxels & 0x1)) { /* even, average with the next value down */
+      max = buffer->values[subfraction_voxels/2];
+      for (i=subfraction_voxels/2+1; i<subfraction_voxels; i++)
+	if (buffer->values[i] > max) max = buffer->values[i];
+      analysis->median = 0.5*analysis->median + 0.5*max;
+    }
   }
   
+  return analysis;
+}
+
+
+/* one task of a batch: the statistics for each roi on a frame/gate of the data set.
+   The rois take turns with a single buffer, sized for the largest of them */
+static void analysis_batch_gate(gint task, gpointer data) {
+
+  analysis_batch_t * batch = data;
+  analysis_map_t * map = batch->map;
+  AmitkDataSet * ds = batch->data_set;
+  analysis_buffer_t buffer;
+  guint num_frames, num_gates;
+  guint frame, gate;
+  gint roi_index;
+
+  num_frames = AMITK_DATA_SET_NUM_FRAMES(ds);
+  num_gates = AMITK_DATA_SET_NUM_GATES(ds);
+  frame = task / num_gates;
+  gate = task % num_gates;
+
+  buffer.values = g_new(amide_data_t, map->max_roi_voxels);
+  buffer.weights = g_new(amide_real_t, map->max_roi_voxels);
+
+  amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(ds), frame);
+
+  for (roi_index=0; roi_index < map->num_rois; roi_index++) {
+    analysis_map_fill(map, roi_index, ds, frame, gate, &buffer, NULL);
+    batch->gate_analyses[(roi_index*num_frames + frame)*num_gates + gate] =
+      analysis_gate_calculate(ds, frame, gate, batch->calculation_type, batch->subfraction,
+			      batch->threshold_percentage, batch->threshold_value,
+			      &buffer);
+  }
+
+  g_free(buffer.values);
+  g_free(buffer.weights);
+
+  return;
+}
+
+/* calculates the statistics of all the rois in the map over every frame/gate of the
+   data set.  Frames/gates are independent, and are spread over the worker threads */
+static analysis_batch_t * analysis_batch_new(AmitkDataSet * ds,
+					     analysis_map_t * map,
+					     analysis_calculation_t calculation_type,
+					     gdouble subfraction,
+					     gdouble threshold_percentage,
+					     gdouble threshold_value) {
+
+  analysis_batch_t * batch;
+  gint num_tasks;
+#ifdef AMIDE_DEBUG
+  struct timeval tv1;
+  struct timeval tv2;
+  gdouble time1;
+  gdouble time2;
+
+  /* let's do some timing */
+  gettimeofday(&tv1, NULL);
+#endif
+
+  num_tasks = AMITK_DATA_SET_NUM_FRAMES(ds)*AMITK_DATA_SET_NUM_GATES(ds);
+
+  batch = g_new(analysis_batch_t, 1);
+  batch->data_set = amitk_object_ref(ds);
+  batch->map = analysis_map_ref(map);
+  batch->calculation_type = calculation_type;
+  batch->subfraction = subfraction;
+  batch->threshold_percentage = threshold_percentage;
+  batch->threshold_value = threshold_value;
+  batch->gate_analyses = g_new0(analysis_gate_t *, map->num_rois*num_tasks);
+
+  amitk_parallel_for(num_tasks, analysis_batch_gate, batch);
+
 #ifdef AMIDE_DEBUG
   /* and wrapup our timing */
   gettimeofday(&tv2, NULL);
   time1 = ((double) tv1.tv_sec) + ((double) tv1.tv_usec)/1000000.0;
   time2 = ((double) tv2.tv_sec) + ((double) tv2.tv_usec)/1000000.0;
 
-  g_print("Calculated ROI: %s on Data Set: %s Frame %d Gate %d.  Took %5.3f (s) \n", 
-	  AMITK_OBJECT_NAME(roi), AMITK_OBJECT_NAME(ds), frame, gate, time2-time1);
+  g_print("Calculated %d ROIs on Data Set: %s, %d Frames/Gates.  Took %5.3f (s) \n",
+	  map->num_rois, AMITK_OBJECT_NAME(ds), num_tasks, time2-time1);
 #endif
 
+  return batch;
+}
+
+static void analysis_batch_free(analysis_batch_t * batch) {
 
-  /* now let's recurse  */
-  analysis->next_gate_analysis = 
-    analysis_gate_init_recurse(roi, ds, frame, gate+1, calculation_type, accurate, 
-			       subfraction, threshold_percentage, threshold_value);
+  gint i, num;
 
-  return analysis;
+  /* gate analyses not handed over to an roi analysis get freed here */
+  num = batch->map->num_rois*
+    AMITK_DATA_SET_NUM_FRAMES(batch->data_set)*AMITK_DATA_SET_NUM_GATES(batch->data_set);
+  for (i=0; i<num; i++)
+    analysis_gate_unref(batch->gate_analyses[i]);
+  g_free(batch->gate_analyses);
+
+  analysis_map_unref(batch->map);
+  amitk_object_unref(batch->data_set);
+  g_free(batch);
+
+  return;
 }
 
 
 
-static analysis_gate_t * analysis_gate_init(AmitkRoi * roi, AmitkDataSet * ds,
-					    guint frame, 
-					    analysis_calculation_t calculation_type,
-					    gboolean accurate,
-					    gdouble subfraction,
-					    gdouble threshold_percentage,
-					    gdouble threshold_value) {
+/* links the already calculated gate analyses of an roi on a frame into a list,
+   handing them over from the batch */
+static analysis_gate_t * analysis_gate_init(analysis_batch_t * batch, gint roi_index, guint frame) {
+
+  analysis_gate_t * gate_analyses = NULL;
+  analysis_gate_t ** gate_analysis;
+  guint num_gates;
+  guint gate;
+
+  num_gates = AMITK_DATA_SET_NUM_GATES(batch->data_set);
+  gate_analysis =
+    &(batch->gate_analyses[(roi_index*AMITK_DATA_SET_NUM_FRAMES(batch->data_set) + frame)*num_gates]);
+
+  for (gate = num_gates; gate > 0; gate--) {
+    if (gate_analysis[gate-1] != NULL) {
+      gate_analysis[gate-1]->next_gate_analysis = gate_analyses;
+      gate_analyses = gate_analysis[gate-1];
+      gate_analysis[gate-1] = NULL;
+    }
+  }
 
-  return analysis_gate_init_recurse(roi, ds, frame, 0, calculation_type, accurate,
-				    subfraction, threshold_percentage, threshold_value);
+  return gate_analyses;
 }
 
 
@@ -408,18 +620,13 @@ static analysis_frame_t * analysis_frame_unref(analysis_frame_t * frame_analysis
 
 
 /* returns a calculated analysis structure of an roi on a frame of a data set */
-static analysis_frame_t * analysis_frame_init_recurse(AmitkRoi * roi, 
-						      AmitkDataSet *ds, 
-						      guint frame,
-						      analysis_calculation_t calculation_type,
-						      gboolean accurate,
-						      gdouble subfraction,
-						      gdouble threshold_percentage,
-						      gdouble threshold_value) {
+static analysis_frame_t * analysis_frame_init_recurse(gint roi_index,
+						      analysis_batch_t * batch,
+						      guint frame) {
   
   analysis_frame_t * temp_frame_analysis;
   
-  if (frame == AMITK_DATA_SET_NUM_FRAMES(ds)) return NULL; /* check if we're done */
+  if (frame == AMITK_DATA_SET_NUM_FRAMES(batch->data_set)) return NULL; /* check if we're done */
 
   if ((temp_frame_analysis =  g_try_new(analysis_frame_t,1)) == NULL) {
     g_warning(_("couldn't allocate memory space for roi analysis of frames"));
@@ -429,36 +636,25 @@ static analysis_frame_t * analysis_frame_init_recurse(AmitkRoi * roi,
   temp_frame_analysis->ref_count = 1;
 
   /* calculate this one */
-  temp_frame_analysis->gate_analyses = 
-    analysis_gate_init(roi, ds, frame, calculation_type, accurate, subfraction, 
-		       threshold_percentage, threshold_value);
+  temp_frame_analysis->gate_analyses = analysis_gate_init(batch, roi_index, frame);
 
   /* recurse */
   temp_frame_analysis->next_frame_analysis = 
-    analysis_frame_init_recurse(roi, ds, frame+1, calculation_type, accurate, subfraction, 
-				threshold_percentage, threshold_value);
+    analysis_frame_init_recurse(roi_index, batch, frame+1);
 
   return temp_frame_analysis;
 }
 
 
-static analysis_frame_t * analysis_frame_init(AmitkRoi * roi, AmitkDataSet *ds, 
-					      analysis_calculation_t calculation_type,
-					      gboolean accurate,
-					      gdouble subfraction,
-					      gdouble threshold_percentage,
-					      gdouble threshold_value) {
-
-  /* sanity checks */
-  g_return_val_if_fail(AMITK_IS_DATA_SET(ds), NULL);
+static analysis_frame_t * analysis_frame_init(AmitkRoi * roi, gint roi_index,
+					      analysis_batch_t * batch) {
 
   if (AMITK_ROI_UNDRAWN(roi)) {
     g_warning(_("ROI: %s appears not to have been drawn"), AMITK_OBJECT_NAME(roi));
     return NULL;
   }
 
-  return analysis_frame_init_recurse(roi, ds, 0, calculation_type, accurate, subfraction, 
-				     threshold_percentage, threshold_value);
+  return analysis_frame_init_recurse(roi_index, batch, 0);
 }
 
 
@@ -483,6 +679,7 @@ static analysis_volume_t * analysis_volume_unref(analysis_volume_t * volume_anal
     volume_analysis->next_volume_analysis = NULL;
 
     volume_analysis->frame_analyses = analysis_frame_unref(volume_analysis->frame_analyses);
+    volume_analysis->map = analysis_map_unref(volume_analysis->map);
     if (volume_analysis->data_set != NULL)
       volume_analysis->data_set=amitk_object_unref(volume_analysis->data_set);
     g_free(volume_analysis);
@@ -493,20 +690,15 @@ static analysis_volume_t * analysis_volume_unref(analysis_volume_t * volume_anal
   return return_list;
 }
 
-/* returns an initialized roi analysis of a list of volumes */
-static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, GList * data_sets, 
-						analysis_calculation_t calculation_type,
-						gboolean accurate,
-						gdouble subfraction,
-						gdouble threshold_percentage,
-						gdouble threshold_value) {
+/* returns an initialized roi analysis of a list of volumes, batches holds
+   the calculated statistics for the corresponding volumes */
+static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, gint roi_index,
+						GList * data_sets, GList * batches) {
   
   analysis_volume_t * temp_volume_analysis;
 
   
-  if (data_sets == NULL)  return NULL;
-
-  g_return_val_if_fail(AMITK_IS_DATA_SET(data_sets->data), NULL);
+  if ((data_sets == NULL) || (batches == NULL))  return NULL;
 
   if ((temp_volume_analysis =  g_try_new(analysis_volume_t,1)) == NULL) {
     g_warning(_("couldn't allocate memory space for roi analysis of volumes"));
@@ -515,16 +707,16 @@ static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, GList * data_set
 
   temp_volume_analysis->ref_count = 1;
   temp_volume_analysis->data_set = amitk_object_ref(data_sets->data);
+  temp_volume_analysis->map = analysis_map_ref(((analysis_batch_t *) batches->data)->map);
+  temp_volume_analysis->roi_index = roi_index;
 
   /* calculate this one */
   temp_volume_analysis->frame_analyses = 
-    analysis_frame_init(roi, temp_volume_analysis->data_set, calculation_type, accurate,
-			subfraction, threshold_percentage, threshold_value);
+    analysis_frame_init(roi, roi_index, batches->data);
 
   /* recurse */
   temp_volume_analysis->next_volume_analysis = 
-    analysis_volume_init(roi, data_sets->next, calculation_type, accurate,
-			 subfraction, threshold_percentage, threshold_value);
+    analysis_volume_init(roi, roi_index, data_sets->next, batches->next);
 
   
   return temp_volume_analysis;
@@ -532,6 +724,50 @@ static analysis_volume_t * analysis_volume_init(AmitkRoi * roi, GList * data_set
 
 
 
+/* hands the voxels of the roi on a frame/gate of the volume analysis to the given
+   function, highest value first, with voxels of equal value in storage order.  The
+   voxels are those that were in the roi when the analysis was done */
+void analysis_volume_foreach_voxel(const analysis_volume_t * volume_analysis,
+				   guint frame,
+				   guint gate,
+				   void (*func)(AmitkVoxel, amide_data_t, amide_real_t, gpointer),
+				   gpointer data) {
+
+  analysis_map_t * map;
+  analysis_buffer_t buffer;
+  AmitkVoxel * voxels;
+  gint * order;
+  gint i;
+
+  g_return_if_fail(volume_analysis != NULL);
+  map = volume_analysis->map;
+
+  buffer.values = g_new(amide_data_t, map->roi_voxels[volume_analysis->roi_index]);
+  buffer.weights = g_new(amide_real_t, map->roi_voxels[volume_analysis->roi_index]);
+  voxels = g_new(AmitkVoxel, map->roi_voxels[volume_analysis->roi_index]);
+
+  amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(volume_analysis->data_set), frame);
+  analysis_map_fill(map, volume_analysis->roi_index, volume_analysis->data_set, 
+		    frame, gate, &buffer, voxels);
+
+  /* g_qsort_with_data is a stable sort */
+  order = g_new(gint, buffer.len);
+  for (i=0; i<buffer.len; i++) order[i] = i;
+  g_qsort_with_data(order, buffer.len, sizeof(gint), buffer_order_compare, &buffer);
+
+  for (i=0; i<buffer.len; i++)
+    (*func)(voxels[order[i]], buffer.values[order[i]], buffer.weights[order[i]], data);
+
+  g_free(order);
+  g_free(voxels);
+  g_free(buffer.values);
+  g_free(buffer.weights);
+
+  return;
+}
+
+
+
 /* free up a list of roi analyses */
 analysis_roi_t * analysis_roi_unref(analysis_roi_t * roi_analysis) {
 
@@ -567,14 +803,15 @@ analysis_roi_t * analysis_roi_unref(analysis_roi_t * roi_analysis) {
   return return_list;
 }
 
-/* returns an initialized list of roi analyses */
-analysis_roi_t * analysis_roi_init(AmitkStudy * study, GList * rois, 
-				   GList * data_sets, 
-				   analysis_calculation_t calculation_type,
-				   gboolean accurate,
-				   gdouble subfraction, 
-				   gdouble threshold_percentage,
-				   gdouble threshold_value) {
+static analysis_roi_t * analysis_roi_init_recurse(AmitkStudy * study, GList * rois, 
+						  gint roi_index,
+						  GList * data_sets, 
+						  GList * batches,
+						  analysis_calculation_t calculation_type,
+						  gboolean accurate,
+						  gdouble subfraction, 
+						  gdouble threshold_percentage,
+						  gdouble threshold_value) {
   
   analysis_roi_t * temp_roi_analysis;
   
@@ -596,17 +833,65 @@ analysis_roi_t * analysis_roi_init(AmitkStudy * study, GList * rois,
 
   /* calculate this one */
   temp_roi_analysis->volume_analyses = 
-    analysis_volume_init(temp_roi_analysis->roi, data_sets, calculation_type, accurate,
-			 subfraction, threshold_percentage, threshold_value);
+    analysis_volume_init(temp_roi_analysis->roi, roi_index, data_sets, batches);
 
   /* recurse */
   temp_roi_analysis->next_roi_analysis = 
-    analysis_roi_init(study, rois->next, data_sets, calculation_type, accurate,
-		      subfraction, threshold_percentage, threshold_value);
+    analysis_roi_init_recurse(study, rois->next, roi_index+1, data_sets, batches,
+			      calculation_type, accurate, subfraction,
+			      threshold_percentage, threshold_value);
 
   
   return temp_roi_analysis;
 }
 
+/* returns an initialized list of roi analyses.  All the rois are done together:
+   they're rasterized once per data set geometry, and then each frame/gate of a data
+   set is read in a single pass that gathers the voxels for every roi */
+analysis_roi_t * analysis_roi_init(AmitkStudy * study, GList * rois, 
+				   GList * data_sets, 
+				   analysis_calculation_t calculation_type,
+				   gboolean accurate,
+				   gdouble subfraction, 
+				   gdouble threshold_percentage,
+				   gdouble threshold_value) {
+
+  analysis_roi_t * roi_analyses;
+  GList * batches=NULL;
+  GList * temp_data_sets;
+  GList * temp_batches;
+  analysis_batch_t * batch;
+  analysis_map_t * map;
+  AmitkDataSet * ds;
+
+  for (temp_data_sets = data_sets; temp_data_sets != NULL; temp_data_sets = temp_data_sets->next) {
+    g_return_val_if_fail(AMITK_IS_DATA_SET(temp_data_sets->data), NULL);
+    ds = AMITK_DATA_SET(temp_data_sets->data);
+
+    /* data sets sharing a geometry can share a map */
+    map = NULL;
+    for (temp_batches = batches; (temp_batches != NULL) && (map == NULL);
+	 temp_batches = temp_batches->next) {
+      batch = temp_batches->data;
+      if (analysis_map_fits(batch->map, ds))
+	map = analysis_map_ref(batch->map);
+    }
+    if (map == NULL)
+      map = analysis_map_new(rois, ds, accurate);
 
+    batch = analysis_batch_new(ds, map, calculation_type, subfraction,
+			       threshold_percentage, threshold_value);
+    analysis_map_unref(map);
+    batches = g_list_append(batches, batch);
+  }
+
+  roi_analyses = analysis_roi_init_recurse(study, rois, 0, data_sets, batches,
+					   calculation_type, accurate, subfraction,
+					   threshold_percentage, threshold_value);
 
+  for (temp_batches = batches; temp_batches != NULL; temp_batches = temp_batches->next)
+    analysis_batch_free(temp_batches->data);
+  g_list_free(batches);
+
+  return roi_analyses;
+}
@@ -46,21 +46,12 @@ typedef struct _analysis_frame_t analysis_frame_t;
 typedef struct _analysis_volume_t analysis_volume_t;
 typedef struct _analysis_roi_t analysis_roi_t;
 typedef struct _analysis_study_t analysis_study_t;
+typedef struct _analysis_map_t analysis_map_t;
 
 
 
-typedef struct analysis_element_t {
-  amide_data_t value;
-  amide_real_t weight;
-  AmitkVoxel ds_voxel;
-} analysis_element_t;
-
-
 struct _analysis_gate_t {
 
-  /* roi data - array of analysis_element's */
-  GPtrArray * data_array;
-
   /* stats */
   amide_data_t mean;
   amide_data_t median;
@@ -91,6 +82,11 @@ struct _analysis_frame_t {
 struct _analysis_volume_t {
   AmitkDataSet * data_set;
   analysis_frame_t * frame_analyses;
+
+  /* internal, the roi's voxels as of the analysis */
+  analysis_map_t * map;
+  gint roi_index;
+
   guint ref_count;
   analysis_volume_t * next_volume_analysis;
 };
@@ -123,6 +119,12 @@ analysis_roi_t * analysis_roi_init(AmitkStudy * study,
 				   gdouble threshold_percentage, 
 				   gdouble threshold_value);
 
+void analysis_volume_foreach_voxel(const analysis_volume_t * volume_analysis,
+				   guint frame,
+				   guint gate,
+				   void (*func)(AmitkVoxel, amide_data_t, amide_real_t, gpointer),
+				   gpointer data);
+
 #endif /* __ANALYSIS_H__ */
 
 
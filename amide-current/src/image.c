@@ -27,7 +27,14 @@
 #include "image.h"
 #include "amitk_data_set_DOUBLE_0D_SCALING.h"
 #include "amitk_study.h"
+#include <string.h>
 
+/* runtime dispatched avx2 version of the fused image blending */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && \
+  (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_BLEND_AVX2
+#include <immintrin.h>
+#endif
 
 #define OBJECT_ICON_XSIZE 24
 #define OBJECT_ICON_YSIZE 24
@@ -319,8 +326,13 @@ GdkPixbuf * image_from_renderings(renderings_t * renderings,
   gdouble rot;
   AmideEye i_eye;
   gint j;
+  guint num_renderings, i_rendering;
+  guchar ** eye_images = NULL;
+  guchar * rendered_image;
+  renderings_t * temp_renderings;
 
   total_width = image_width+(eyes-1)*eye_width;
+  num_renderings = renderings_count(renderings);
 
   /* allocate and initialize space for a temporary storage buffer */
   if ((rgba16_data = g_try_new(rgba16_t,total_width * image_height)) == NULL) {
@@ -334,27 +346,49 @@ GdkPixbuf * image_from_renderings(renderings_t * renderings,
     rgba16_data[j].a = 0;
   }
 
-  /* iterate through the eyes and rendering contexts, 
+  /* render all the contexts at once for each eye, for stereo we need to 
+     hang onto each eye's images until they've all been rendered */
+  if (eyes == 1) {
+    renderings_render(renderings);
+  } else {
+    if ((eye_images = g_try_new0(guchar *, num_renderings*eyes)) == NULL) {
+      g_warning(_("couldn't allocate memory for the stereo rendering images"));
+      g_free(rgba16_data);
+      return NULL;
+    }
+    for (i_eye = 0; i_eye < eyes; i_eye ++) {
+      rot = (-0.5 + i_eye*1.0) * eye_angle;
+      rot = M_PI*rot/180; /* convert to radians */
+
+      renderings_set_rotation(renderings, AMITK_AXIS_Y, -rot);
+      renderings_render(renderings);
+      renderings_set_rotation(renderings, AMITK_AXIS_Y, rot);
+
+      temp_renderings = renderings;
+      for (i_rendering = 0; i_rendering < num_renderings; i_rendering++) {
+	eye_images[i_rendering*eyes+i_eye] = 
+	  g_memdup(temp_renderings->rendering->image, image_width*image_height*sizeof(guchar));
+	temp_renderings = temp_renderings->next;
+      }
+    }
+  }
+
+  /* iterate through the rendering contexts and eyes, 
      tranfering the image data into the temp storage buffer */
+  i_rendering = 0;
   while (renderings != NULL) {
 
     for (i_eye = 0; i_eye < eyes; i_eye ++) {
 
-      if (eyes == 1) {
-	rendering_render(renderings->rendering);
-      } else {
-	rot = (-0.5 + i_eye*1.0) * eye_angle;
-	rot = M_PI*rot/180; /* convert to radians */
-
-	rendering_set_rotation(renderings->rendering, AMITK_AXIS_Y, -rot);
-	rendering_render(renderings->rendering);
-	rendering_set_rotation(renderings->rendering, AMITK_AXIS_Y, rot);
-      }
+      if (eyes == 1) 
+	rendered_image = renderings->rendering->image;
+      else
+	rendered_image = eye_images[i_rendering*eyes+i_eye];
 
       i.t = i.g = i.z = 0;
       for (i.y = 0; i.y < image_height; i.y++) 
 	for (i.x = 0; i.x < image_width; i.x++) {
-	  rgba_temp = amitk_color_table_lookup(renderings->rendering->image[i.x+i.y*image_width], 
+	  rgba_temp = amitk_color_table_lookup(rendered_image[i.x+i.y*image_width], 
 					       renderings->rendering->color_table, 
 					       0, RENDERING_DENSITY_MAX);
 	  /* compensate for the fact that X defines the origin as top left, not bottom left */
@@ -397,6 +431,13 @@ GdkPixbuf * image_from_renderings(renderings_t * renderings,
 	}
     }      
     renderings = renderings->next;
+    i_rendering++;
+  }
+
+  if (eye_images != NULL) {
+    for (j=0; j < num_renderings*eyes; j++)
+      g_free(eye_images[j]);
+    g_free(eye_images);
   }
 
   /* allocate space for the true rgb buffer */
@@ -620,7 +661,7 @@ GdkPixbuf * image_from_slice(AmitkDataSet * slice, AmitkViewMode view_mode) {
   GdkPixbuf * temp_image;
   guint index;
   rgba_t rgba_temp;
-  AmitkColorTable color_table;
+  AmitkColorTableLut * lut;
 
   /* sanity checks */
   g_return_val_if_fail(AMITK_IS_DATA_SET(slice), NULL);
@@ -639,7 +680,11 @@ GdkPixbuf * image_from_slice(AmitkDataSet * slice, AmitkViewMode view_mode) {
 					  amitk_data_set_get_frame_duration(slice,0),
 					  &min, &max);
       
-  color_table = amitk_data_set_get_color_table_to_use(AMITK_DATA_SET_SLICE_PARENT(slice), view_mode);
+  lut = amitk_data_set_get_color_table_lut(AMITK_DATA_SET_SLICE_PARENT(slice), view_mode, min, max);
+  if (lut == NULL) {
+    g_free(rgba_data);
+    return NULL;
+  }
 
   i.t = i.g = i.z = 0;
   index=0;
@@ -647,14 +692,14 @@ GdkPixbuf * image_from_slice(AmitkDataSet * slice, AmitkViewMode view_mode) {
   /* compensate for the fact that X defines the origin as top left, not bottom left */
   for (i.y = dim.y-1; i.y >= 0; i.y--) 
     for (i.x = 0; i.x < dim.x; i.x++, index+=4) {
-      rgba_temp =
-	amitk_color_table_lookup(AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,i), color_table,min, max);
+      rgba_temp = amitk_color_table_lut_lookup(lut, AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,i));
       
 	rgba_data[index+0] = rgba_temp.r;
 	rgba_data[index+1] = rgba_temp.g;
 	rgba_data[index+2] = rgba_temp.b;
 	rgba_data[index+3] = rgba_temp.a;
     }
+  amitk_color_table_lut_unref(lut);
 
   /* from the rgb_data, generate a GdkPixbuf */
   temp_image = gdk_pixbuf_new_from_data(rgba_data, GDK_COLORSPACE_RGB,
@@ -664,11 +709,114 @@ GdkPixbuf * image_from_slice(AmitkDataSet * slice, AmitkViewMode view_mode) {
   return temp_image;
 }
 
+/* blends a row of colors into the accumulated row.  Where neither has any alpha, 
+   the colors are averaged over the slice_num slices blended so far, otherwise
+   they're weighted by alpha.  The integer divides by a per pixel denominator
+   keep compilers from vectorizing this, see image_blend_row_avx2 for that */
+static void image_blend_row(rgba16_t * accum, const rgba_t * colors, 
+			    const gint num, const gint slice_num) {
+
+  gint x;
+  guint32 total_alpha;
+  guint32 accum_weight, color_weight, denom;
+
+  for (x=0; x < num; x++) {
+    total_alpha = accum[x].a + colors[x].a;
+    accum_weight = (total_alpha != 0) ? accum[x].a : slice_num-1;
+    color_weight = (total_alpha != 0) ? colors[x].a : 1;
+    denom = (total_alpha != 0) ? total_alpha : slice_num;
+
+    accum[x].r = (accum[x].r*accum_weight + colors[x].r*color_weight)/denom;
+    accum[x].g = (accum[x].g*accum_weight + colors[x].g*color_weight)/denom;
+    accum[x].b = (accum[x].b*accum_weight + colors[x].b*color_weight)/denom;
+    accum[x].a = total_alpha;
+  }
+
+  return;
+}
+
+#ifdef IMAGE_BLEND_AVX2
+/* same as image_blend_row, four pixels at a time.  Each 128 bit lane holds the 
+   r,g,b,a of one pixel as 32 bit integers.  The division is done in single 
+   precision and then corrected by one step, so the quotient is exactly the 
+   truncated integer quotient */
+__attribute__((target("avx2")))
+static void image_blend_row_avx2(rgba16_t * accum, const rgba_t * colors, 
+				 const gint num, const gint slice_num) {
+
+  gint x;
+  __m256i acc[2], col[2], acc_a, col_a, total;
+  __m256i no_alpha, accum_weight, color_weight, denom;
+  __m256i numer, quot, rem, packed;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+  const __m256i alpha_lanes = _mm256_set_epi32(-1,0,0,0,-1,0,0,0);
+  const __m256i num_slices = _mm256_set1_epi32(slice_num);
+  const __m256i prev_slices = _mm256_set1_epi32(slice_num-1);
+  gint j;
+
+  for (x=0; x+4 <= num; x+=4) {
+    for (j=0; j<2; j++) {
+      acc[j] = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (accum+x+2*j)));
+      col[j] = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (colors+x+2*j)));
+
+      acc_a = _mm256_shuffle_epi32(acc[j], _MM_SHUFFLE(3,3,3,3));
+      col_a = _mm256_shuffle_epi32(col[j], _MM_SHUFFLE(3,3,3,3));
+      total = _mm256_add_epi32(acc_a, col_a);
+
+      no_alpha = _mm256_cmpeq_epi32(total, zero);
+      accum_weight = _mm256_blendv_epi8(acc_a, prev_slices, no_alpha);
+      color_weight = _mm256_blendv_epi8(col_a, one, no_alpha);
+      denom = _mm256_blendv_epi8(total, num_slices, no_alpha);
+
+      numer = _mm256_add_epi32(_mm256_mullo_epi32(acc[j], accum_weight),
+			       _mm256_mullo_epi32(col[j], color_weight));
+      quot = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(numer), 
+					       _mm256_cvtepi32_ps(denom)));
+      rem = _mm256_sub_epi32(numer, _mm256_mullo_epi32(quot, denom));
+      quot = _mm256_add_epi32(quot, _mm256_cmpgt_epi32(zero, rem)); /* rem < 0, -1 */
+      quot = _mm256_sub_epi32(quot, _mm256_cmpgt_epi32(rem, _mm256_sub_epi32(denom, one))); /* rem >= denom, +1 */
+
+      /* alpha is the total, truncated to 16 bits like the scalar version */
+      acc[j] = _mm256_and_si256(_mm256_blendv_epi8(quot, total, alpha_lanes), low16);
+    }
+
+    /* lanes come out as pixel 0,2,1,3 */
+    packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(acc[0], acc[1]), _MM_SHUFFLE(3,1,2,0));
+    _mm256_storeu_si256((__m256i *) (accum+x), packed);
+  }
+
+  /* and the leftovers */
+  if (x < num)
+    image_blend_row(accum+x, colors+x, num-x, slice_num);
+
+  return;
+}
+#endif
+
+typedef void (*image_blend_row_t)(rgba16_t *, const rgba_t *, const gint, const gint);
+
+/* picks the fastest blending routine this cpu supports */
+static image_blend_row_t image_get_blend_row(void) {
+
+  static image_blend_row_t blend_row = NULL;
+
+  if (blend_row == NULL) {
+    blend_row = image_blend_row;
+#ifdef IMAGE_BLEND_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      blend_row = image_blend_row_avx2;
+#endif
+  }
+
+  return blend_row;
+}
+
 /* note, generally call this function with gate -1, only use the gate
    parameter if you want to override the data set's specified gate */
 GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
-				 GList ** pslice_cache,
-				 const gint max_slice_cache_size,
 				 GList * objects,
 				 const AmitkDataSet * active_ds,
 				 const amide_time_t start,
@@ -679,11 +827,11 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
 				 const AmitkFuseType fuse_type,
 				 const AmitkViewMode view_mode) {
 
-  gint slice_num;
-  guint32 total_alpha;
+  gint num_blended;
   guchar * rgb_data;
-  rgba16_t * rgba16_data;
-  guint location;
+  guchar * rgb_row;
+  rgba16_t * rgba16_row;
+  rgba_t * row_colors;
   AmitkVoxel i;
   AmitkVoxel dim;
   amide_data_t max,min;
@@ -692,8 +840,11 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
   GList * slices;
   GList * temp_slices;
   AmitkDataSet * slice;
-  AmitkColorTable color_table;
+  AmitkDataSet ** blend_slices;
+  AmitkColorTableLut ** blend_luts;
+  AmitkColorTableLut * overlay_lut=NULL;
   AmitkDataSet * overlay_slice = NULL;
+  image_blend_row_t blend_row;
   gint j;
   AmitkCanvasPoint pixel_size2;
   
@@ -702,122 +853,90 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
   g_return_val_if_fail(objects != NULL, NULL);
 
   pixel_size2.x = pixel_size2.y = pixel_size;
-  slices = amitk_data_sets_get_slices(objects, pslice_cache, max_slice_cache_size,
+  slices = amitk_data_sets_get_slices(objects, TRUE,
 				      start, duration, gate, pixel_size2,view_volume);
   g_return_val_if_fail(slices != NULL, NULL);
 
   /* get the dimensions.  since all slices have the same dimensions, we'll just get the first */
   dim = AMITK_DATA_SET_DIM(slices->data);
 
-  /* allocate and initialize space for a temporary storage buffer */
-  rgba16_data = g_try_new(rgba16_t,dim.y*dim.x);
-  g_return_val_if_fail(rgba16_data != NULL, NULL);
-
-  for (j=0; j<dim.y*dim.x; j++) {
-    rgba16_data[j].r = 0;
-    rgba16_data[j].g = 0;
-    rgba16_data[j].b = 0;
-    rgba16_data[j].a = 0;
+  /* allocate space for the rgb buffer, and the per row working space */
+  rgb_data = g_try_new(guchar,3*dim.y*dim.x);
+  rgba16_row = g_try_new(rgba16_t,dim.x);
+  row_colors = g_try_new(rgba_t, dim.x);
+  j = g_list_length(slices);
+  blend_slices = g_try_new(AmitkDataSet *, j);
+  blend_luts = g_try_new(AmitkColorTableLut *, j);
+  if ((rgb_data == NULL) || (rgba16_row == NULL) || (row_colors == NULL) ||
+      (blend_slices == NULL) || (blend_luts == NULL)) {
+    g_warning(_("couldn't allocate memory for fused image"));
+    g_free(rgb_data);
+    g_free(rgba16_row);
+    g_free(row_colors);
+    g_free(blend_slices);
+    g_free(blend_luts);
+    amitk_objects_unref(slices);
+    return NULL;
   }
 
-  /* iterate through all the slices */
-  temp_slices = slices;
-  slice_num = 0;
-
-  while (temp_slices != NULL) {
+  /* figure out the colors for each slice ahead of time */
+  num_blended = 0;
+  for (temp_slices = slices; temp_slices != NULL; temp_slices = temp_slices->next) {
     slice = temp_slices->data;
+    amitk_data_set_get_thresholding_min_max(AMITK_DATA_SET_SLICE_PARENT(slice),
+					    AMITK_DATA_SET(slice),
+					    start, duration, &min, &max);
     if ((fuse_type == AMITK_FUSE_TYPE_OVERLAY) && (AMITK_DATA_SET_SLICE_PARENT(slice) == active_ds)) {
       overlay_slice = slice;
-    } else { /* blend this slice */
-      slice_num++;
-
-      amitk_data_set_get_thresholding_min_max(AMITK_DATA_SET_SLICE_PARENT(slice),
-					      AMITK_DATA_SET(slice),
-					      start, duration, &min, &max);
-      
-      
-      color_table = amitk_data_set_get_color_table_to_use(AMITK_DATA_SET_SLICE_PARENT(slice), view_mode);
-      /* now add this slice into the rgba16 data */
-      i.t = i.g = i.z = 0;
-      location=0;
-      /* compensate for the fact that X defines the origin as top left, not bottom left */
-      for (i.y = dim.y-1; i.y >= 0; i.y--) 
-	for (i.x = 0; i.x < dim.x; i.x++, location++) {
-	  rgba_temp = 
-	    amitk_color_table_lookup(AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,i), color_table,min, max);
-	  
-	  total_alpha = rgba16_data[location].a + rgba_temp.a;
-	  if (total_alpha == 0) {
-	    rgba16_data[location].r = (((slice_num-1)*rgba16_data[location].r + 
-					rgba_temp.r)/
-				       ((gdouble) slice_num));
-	    rgba16_data[location].g = (((slice_num-1)*rgba16_data[location].g + 
-					rgba_temp.g)/
-				       ((gdouble) slice_num));
-	    rgba16_data[location].b = (((slice_num-1)*rgba16_data[location].b + 
-					rgba_temp.b)/
-				       ((gdouble) slice_num));
-	  } else if (rgba16_data[location].a == 0) {
-	    rgba16_data[location].r = rgba_temp.r;
-	    rgba16_data[location].g = rgba_temp.g;
-	    rgba16_data[location].b = rgba_temp.b;
-	    rgba16_data[location].a = rgba_temp.a;
-	  } else if (rgba_temp.a != 0) {
-	    rgba16_data[location].r = ((rgba16_data[location].r*rgba16_data[location].a 
-					+ rgba_temp.r*rgba_temp.a)/
-				       ((gdouble) total_alpha));
-	    rgba16_data[location].g = ((rgba16_data[location].g*rgba16_data[location].a 
-					+ rgba_temp.g*rgba_temp.a)/
-				       ((gdouble) total_alpha));
-	    rgba16_data[location].b = ((rgba16_data[location].b*rgba16_data[location].a 
-					+ rgba_temp.b*rgba_temp.a)/
-				       ((gdouble) total_alpha));
-	    rgba16_data[location].a = total_alpha;
-	  }
-	}
+      overlay_lut = amitk_data_set_get_color_table_lut(AMITK_DATA_SET_SLICE_PARENT(slice), 
+						       view_mode, min, max);
+    } else { /* to be blended */
+      blend_slices[num_blended] = slice;
+      blend_luts[num_blended] = amitk_data_set_get_color_table_lut(AMITK_DATA_SET_SLICE_PARENT(slice), 
+								   view_mode, min, max);
+      if (blend_luts[num_blended] != NULL) 
+	num_blended++;
     }
-    temp_slices = temp_slices->next;
   }
+  if (overlay_lut == NULL) overlay_slice = NULL;
 
-  /* allocate space for the true rgb buffer */
-  rgb_data = g_try_new(guchar,3*dim.y*dim.x);
-  g_return_val_if_fail(rgb_data != NULL, NULL);
+  blend_row = image_get_blend_row();
 
-  /* now convert our temp rgb data to real rgb data */
-  i.z = 0;
-  location=0;
-  for (i.y = 0; i.y < dim.y; i.y++) 
-    for (i.x = 0; i.x < dim.x; i.x++, location++) {
-      rgb_data[3*location+0] = rgba16_data[location].r < 0xFF ? rgba16_data[location].r : 0xFF;
-      rgb_data[3*location+1] = rgba16_data[location].g < 0xFF ? rgba16_data[location].g : 0xFF;
-      rgb_data[3*location+2] = rgba16_data[location].b < 0xFF ? rgba16_data[location].b : 0xFF;
+  /* work a row at a time, blending all the slices and then laying the
+     overlay on top. compensate for the fact that X defines the origin as 
+     top left, not bottom left */
+  i.t = i.g = i.z = 0;
+  rgb_row = rgb_data;
+  for (i.y = dim.y-1; i.y >= 0; i.y--, rgb_row += 3*dim.x) {
+
+    memset(rgba16_row, 0, dim.x*sizeof(rgba16_t));
+    for (j=0; j < num_blended; j++) {
+      for (i.x = 0; i.x < dim.x; i.x++) 
+	row_colors[i.x] = 
+	  amitk_color_table_lut_lookup(blend_luts[j], 
+				       AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(blend_slices[j],i));
+      (*blend_row)(rgba16_row, row_colors, dim.x, j+1);
     }
 
-  /* if we have a data set we're overlaying, add it in now */
-  if (overlay_slice != NULL) {
-      amitk_data_set_get_thresholding_min_max(AMITK_DATA_SET_SLICE_PARENT(overlay_slice),
-					      AMITK_DATA_SET(overlay_slice),
-					      start, duration, &min, &max);
-      
-      color_table = amitk_data_set_get_color_table_to_use(AMITK_DATA_SET_SLICE_PARENT(overlay_slice), view_mode);
-
-      i.t = i.g = i.z = 0;
-      for (i.y = 0; i.y < dim.y; i.y++) 
-	for (i.x = 0; i.x < dim.x; i.x++) {
-	  rgba_temp = 
-	    amitk_color_table_lookup(AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(overlay_slice,i), 
-				     color_table,min, max);
+    for (i.x = 0; i.x < dim.x; i.x++) {
+      rgb_row[3*i.x+0] = rgba16_row[i.x].r < 0xFF ? rgba16_row[i.x].r : 0xFF;
+      rgb_row[3*i.x+1] = rgba16_row[i.x].g < 0xFF ? rgba16_row[i.x].g : 0xFF;
+      rgb_row[3*i.x+2] = rgba16_row[i.x].b < 0xFF ? rgba16_row[i.x].b : 0xFF;
+    }
 
-	  /* compensate for the fact that X defines the origin as top left, not bottom left */
-	  location = (dim.y - i.y - 1)*dim.x+i.x;
-	  if (rgba_temp.a != 0) {
-	    rgb_data[3*location+0] = rgba_temp.r;
-	    rgb_data[3*location+1] = rgba_temp.g;
-	    rgb_data[3*location+2] = rgba_temp.b;
-	  }
+    /* if we have a data set we're overlaying, add it in now */
+    if (overlay_slice != NULL) 
+      for (i.x = 0; i.x < dim.x; i.x++) {
+	rgba_temp = 
+	  amitk_color_table_lut_lookup(overlay_lut, 
+				       AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(overlay_slice,i));
+	if (rgba_temp.a != 0) {
+	  rgb_row[3*i.x+0] = rgba_temp.r;
+	  rgb_row[3*i.x+1] = rgba_temp.g;
+	  rgb_row[3*i.x+2] = rgba_temp.b;
 	}
+      }
   }
-  
 
   /* from the rgb_data, generate a GdkPixbuf */
   temp_image = gdk_pixbuf_new_from_data(rgb_data, GDK_COLORSPACE_RGB,
@@ -825,7 +944,13 @@ GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
   					image_free_rgb_data, NULL);
 
   /* cleanup */
-  g_free(rgba16_data);
+  for (j=0; j < num_blended; j++)
+    amitk_color_table_lut_unref(blend_luts[j]);
+  amitk_color_table_lut_unref(overlay_lut);
+  g_free(rgba16_row);
+  g_free(row_colors);
+  g_free(blend_slices);
+  g_free(blend_luts);
 
   if (pdisp_slices != NULL) {
     amitk_objects_unref((*pdisp_slices));
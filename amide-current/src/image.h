@@ -77,8 +77,6 @@ GdkPixbuf * image_from_projection(AmitkDataSet * projection);
 GdkPixbuf * image_from_slice(AmitkDataSet * slice,
 			     AmitkViewMode view_mode);
 GdkPixbuf * image_from_data_sets(GList ** pdisp_slices,
-				 GList ** pslice_cache,
-				 const gint max_slice_cache_size,
 				 GList * objects,
 				 const AmitkDataSet * active_ds,
 				 const amide_time_t start,
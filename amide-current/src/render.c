@@ -31,10 +31,12 @@
 #include <stdlib.h>
 #include "render.h"
 #include "amitk_roi.h"
-#include "amitk_data_set_DOUBLE_0D_SCALING.h"
 
 #include <sys/time.h>
 #include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #ifdef AMIDE_DEBUG
 #include <sys/timeb.h>
 #endif
@@ -52,6 +54,168 @@ gchar * pixel_type_names[] = {
   N_("Opacity"),
   N_("Grayscale")
 };
+gchar * rendering_engine_names[] = {
+  N_("VolPack (shear-warp)"),
+  N_("Ray Caster")
+};
+
+
+/* converted volumes, least recently used at the head.  Shared by all renderings,
+   so that going back to a frame that's already been converted (e.g. on each loop
+   through a gated movie) only needs a reclassification.  Only used from the 
+   main thread. */
+static GQueue volume_cache = G_QUEUE_INIT;
+static gsize volume_cache_used = 0;
+static gsize volume_cache_size = 0; /* 0 is automatic, see volume_cache_budget */
+static guint volume_cache_round = 1; /* see renderings_preload_start */
+
+
+static rendering_volume_t * volume_free(rendering_volume_t * volume) {
+
+  if (volume == NULL)
+    return volume;
+
+  g_free(volume->rendering_data);
+  volume->ray_caster = ray_caster_free(volume->ray_caster);
+  g_free(volume);
+
+  return NULL;
+}
+
+/* whether the two frames of the rendering's object convert to the same volume */
+static gboolean frames_equal(const rendering_t * rendering, 
+			     const rendering_frame_t * frame1,
+			     const rendering_frame_t * frame2) {
+
+  AmitkDataSet * ds;
+  guint start_frame;
+
+  /* roi's don't change with time */
+  if (!AMITK_IS_DATA_SET(rendering->object))
+    return TRUE;
+
+  if ((frame1->view_start_gate != frame2->view_start_gate) ||
+      (frame1->view_end_gate != frame2->view_end_gate))
+    return FALSE;
+
+  if (REAL_EQUAL(frame1->start, frame2->start) && REAL_EQUAL(frame1->duration, frame2->duration))
+    return TRUE;
+
+  /* any time completely inside of the same data set frame gives the same volume */
+  ds = AMITK_DATA_SET(rendering->object);
+  start_frame = amitk_data_set_get_frame(ds, frame1->start+EPSILON);
+  return ((start_frame == amitk_data_set_get_frame(ds, frame1->start+frame1->duration-EPSILON)) &&
+	  (start_frame == amitk_data_set_get_frame(ds, frame2->start+EPSILON)) &&
+	  (start_frame == amitk_data_set_get_frame(ds, frame2->start+frame2->duration-EPSILON)));
+}
+
+/* returns the cached volume of the rendering at the given frame, or NULL */
+static rendering_volume_t * volume_cache_lookup(const rendering_t * rendering,
+						const rendering_frame_t * frame) {
+
+  GList * link;
+  rendering_volume_t * volume;
+
+  for (link = volume_cache.head; link != NULL; link = link->next) {
+    volume = link->data;
+    if ((volume->rendering == rendering) && frames_equal(rendering, &(volume->frame), frame)) {
+      g_queue_unlink(&volume_cache, link);
+      g_queue_push_tail_link(&volume_cache, link);
+      return volume;
+    }
+  }
+
+  return NULL;
+}
+
+/* the most the automatic budget can grow to */
+static gsize volume_cache_max_size(void) {
+
+  static gsize max_size = 0;
+#if defined(HAVE_UNISTD_H) && defined(_SC_PHYS_PAGES)
+  glong num_pages, page_size;
+#endif
+
+  if (max_size > 0) return max_size;
+
+  max_size = G_MAXSIZE;
+#if defined(HAVE_UNISTD_H) && defined(_SC_PHYS_PAGES)
+  num_pages = sysconf(_SC_PHYS_PAGES);
+  page_size = sysconf(_SC_PAGESIZE);
+  if ((num_pages > 0) && (page_size > 0))
+    max_size = (((gsize) num_pages)/RENDERING_VOLUME_CACHE_MEMORY_FRACTION)*page_size;
+#endif
+
+  return max_size;
+}
+
+/* the cache's budget, when it's holding volumes of num_bytes each */
+static gsize volume_cache_budget(const gsize num_bytes) {
+
+  if (volume_cache_size > 0)
+    return volume_cache_size;
+  else
+    return MIN(MAX(RENDERING_VOLUME_CACHE_DEFAULT_SIZE, RENDERING_VOLUME_CACHE_MIN_VOLUMES*num_bytes),
+	       volume_cache_max_size());
+}
+
+/* drop the least recently used volumes until there's room for another room bytes 
+   within budget.  Volumes currently loaded into their rendering are always kept, 
+   as are those of the current preload round if keep_round is set */
+static void volume_cache_trim(const gsize num_bytes, const gsize room, const gboolean keep_round) {
+
+  GList * link;
+  GList * next;
+  rendering_volume_t * volume;
+  gsize budget;
+
+  budget = volume_cache_budget(num_bytes);
+  link = volume_cache.head;
+  while ((volume_cache_used+room > budget) && (link != NULL)) {
+    next = link->next;
+    volume = link->data;
+    if ((volume->rendering->volume != volume) && 
+	!(keep_round && (volume->preload_round == volume_cache_round))) {
+      g_queue_delete_link(&volume_cache, link);
+      volume_cache_used -= volume->num_bytes;
+      volume_free(volume);
+    }
+    link = next;
+  }
+
+  return;
+}
+
+static void volume_cache_add(rendering_volume_t * volume) {
+
+  g_queue_push_tail(&volume_cache, volume);
+  volume_cache_used += volume->num_bytes;
+  volume_cache_trim(volume->num_bytes, 0, FALSE);
+
+  return;
+}
+
+/* frees all the volumes of a rendering that's going away */
+static void volume_cache_remove_rendering(const rendering_t * rendering) {
+
+  GList * link;
+  GList * next;
+  rendering_volume_t * volume;
+
+  link = volume_cache.head;
+  while (link != NULL) {
+    next = link->next;
+    volume = link->data;
+    if (volume->rendering == rendering) {
+      g_queue_delete_link(&volume_cache, link);
+      volume_cache_used -= volume->num_bytes;
+      volume_free(volume);
+    }
+    link = next;
+  }
+
+  return;
+}
 
 
 rendering_t * rendering_unref(rendering_t * rendering) {
@@ -78,10 +242,11 @@ rendering_t * rendering_unref(rendering_t * rendering) {
       rendering->object = NULL;
     }
 
-    if (rendering->rendering_data != NULL) {
-      g_free(rendering->rendering_data);
-      rendering->rendering_data = NULL;
-    }
+    /* this also frees the volume we've currently got loaded */
+    volume_cache_remove_rendering(rendering);
+    rendering->volume = NULL;
+    rendering->rendering_data = NULL;
+    rendering->ray_caster = NULL;
 
     if (rendering->name != NULL) {
       g_free(rendering->name);
@@ -98,6 +263,11 @@ rendering_t * rendering_unref(rendering_t * rendering) {
       rendering->image = NULL;
     }
 
+    if (rendering->preview_image != NULL) {
+      g_free(rendering->preview_image);
+      rendering->preview_image = NULL;
+    }
+
     for (i_class = 0; i_class < NUM_CLASSIFICATIONS; i_class++) {
       g_free(rendering->ramp_x[i_class]);
       g_free(rendering->ramp_y[i_class]);
@@ -123,6 +293,42 @@ rendering_t * rendering_unref(rendering_t * rendering) {
 
 
 
+/* tell a volpack context about our voxel structure */
+static gboolean set_voxel_layout(vpContext * vpc, const gchar * name) {
+
+  if (vpSetVoxelSize(vpc,  RENDERING_BYTES_PER_VOXEL, RENDERING_VOXEL_FIELDS, 
+		     RENDERING_SHADE_FIELDS, RENDERING_CLSFY_FIELDS) != VP_OK) {
+    g_warning(_("Error Setting the Rendering Voxel Size (%s): %s"), 
+	      name, vpGetErrorString(vpGetError(vpc)));
+    return FALSE;
+  }
+
+  /* now tell the rendering context the location of each field in voxel, 
+     do this for each field in the context */
+  if (vpSetVoxelField (vpc,RENDERING_NORMAL_FIELD, RENDERING_NORMAL_SIZE, 
+		       RENDERING_NORMAL_OFFSET, RENDERING_NORMAL_MAX) != VP_OK) {
+    g_warning(_("Error Specifying the Rendering Voxel Fields (%s, NORMAL): %s"), 
+	      name, vpGetErrorString(vpGetError(vpc)));
+    return FALSE;
+  }
+  if (vpSetVoxelField (vpc,RENDERING_DENSITY_FIELD, RENDERING_DENSITY_SIZE, 
+		       RENDERING_DENSITY_OFFSET, RENDERING_DENSITY_MAX) != VP_OK) {
+    g_warning(_("Error Specifying the Rendering Voxel Fields (%s, DENSITY): %s"), 
+	      name, vpGetErrorString(vpGetError(vpc)));
+    return FALSE;
+  }
+
+  if (vpSetVoxelField (vpc,RENDERING_GRADIENT_FIELD, RENDERING_GRADIENT_SIZE, 
+		       RENDERING_GRADIENT_OFFSET, RENDERING_GRADIENT_MAX) != VP_OK) {
+    g_warning(_("Error Specifying the Rendering Voxel Fields (%s, GRADIENT): %s"),
+	      name, vpGetErrorString(vpGetError(vpc)));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
 /* either volume or object must be NULL */
 rendering_t * rendering_init(const AmitkObject * object,
 			     AmitkVolume * rendering_volume,
@@ -132,6 +338,7 @@ rendering_t * rendering_init(const AmitkObject * object,
 			     const gboolean zero_fill,
 			     const gboolean optimize_rendering,
 			     const gboolean no_gradient_opacity,
+			     const rendering_engine_t engine,
 			     AmitkUpdateFunc update_func,
 			     gpointer update_data) {
 
@@ -155,7 +362,9 @@ rendering_t * rendering_init(const AmitkObject * object,
   new_rendering->need_reclassify = TRUE;
   
   /* start initializing what we can */
+  new_rendering->engine = engine;
   new_rendering->vpc = vpCreateContext();
+  new_rendering->ray_caster = NULL;
   new_rendering->object = amitk_object_copy(object);
   new_rendering->name = g_strdup(AMITK_OBJECT_NAME(object));
   if (AMITK_IS_DATA_SET(object))
@@ -168,6 +377,10 @@ rendering_t * rendering_init(const AmitkObject * object,
     new_rendering->pixel_type = RENDERING_DEFAULT_PIXEL_TYPE;
 
   new_rendering->image = NULL;
+  new_rendering->refinement = 0;
+  new_rendering->preview_image = NULL;
+  new_rendering->cancel = NULL;
+  new_rendering->volume = NULL;
   new_rendering->rendering_data = NULL;
   new_rendering->curve_type[DENSITY_CLASSIFICATION] = CURVE_LINEAR;
   new_rendering->curve_type[GRADIENT_CLASSIFICATION] = CURVE_LINEAR;
@@ -185,6 +398,12 @@ rendering_t * rendering_init(const AmitkObject * object,
     new_rendering->view_end_gate = 0;
   new_rendering->zero_fill = zero_fill;
   new_rendering->optimize_rendering = optimize_rendering;
+  new_rendering->zoom = RENDERING_DEFAULT_ZOOM;
+  new_rendering->max_ray_opacity = 1.0;
+  new_rendering->min_voxel_opacity = 0.0;
+  new_rendering->depth_cueing = RENDERING_DEFAULT_DEPTH_CUEING;
+  new_rendering->front_factor = RENDERING_DEFAULT_FRONT_FACTOR;
+  new_rendering->depth_cueing_density = RENDERING_DEFAULT_DENSITY;
 
   /* figure out the size of our context */
   new_rendering->dim.x = ceil((AMITK_VOLUME_X_CORNER(rendering_volume))/voxel_size);
@@ -267,35 +486,7 @@ rendering_t * rendering_init(const AmitkObject * object,
   }
 
   /* tell the rendering context info on the voxel structure */
-  if (vpSetVoxelSize(new_rendering->vpc,  RENDERING_BYTES_PER_VOXEL, RENDERING_VOXEL_FIELDS, 
-		     RENDERING_SHADE_FIELDS, RENDERING_CLSFY_FIELDS) != VP_OK) {
-    g_warning(_("Error Setting the Rendering Voxel Size (%s): %s"), 
-	      new_rendering->name, vpGetErrorString(vpGetError(new_rendering->vpc)));
-    new_rendering = rendering_unref(new_rendering);
-    return new_rendering;
-  }
-
-  /* now tell the rendering context the location of each field in voxel, 
-     do this for each field in the context */
-  if (vpSetVoxelField (new_rendering->vpc,RENDERING_NORMAL_FIELD, RENDERING_NORMAL_SIZE, 
-		       RENDERING_NORMAL_OFFSET, RENDERING_NORMAL_MAX) != VP_OK) {
-    g_warning(_("Error Specifying the Rendering Voxel Fields (%s, NORMAL): %s"), 
-	      new_rendering->name, vpGetErrorString(vpGetError(new_rendering->vpc)));
-    new_rendering = rendering_unref(new_rendering);
-    return new_rendering;
-  }
-  if (vpSetVoxelField (new_rendering->vpc,RENDERING_DENSITY_FIELD, RENDERING_DENSITY_SIZE, 
-		       RENDERING_DENSITY_OFFSET, RENDERING_DENSITY_MAX) != VP_OK) {
-    g_warning(_("Error Specifying the Rendering Voxel Fields (%s, DENSITY): %s"), 
-	      new_rendering->name, vpGetErrorString(vpGetError(new_rendering->vpc)));
-    new_rendering = rendering_unref(new_rendering);
-    return new_rendering;
-  }
-
-  if (vpSetVoxelField (new_rendering->vpc,RENDERING_GRADIENT_FIELD, RENDERING_GRADIENT_SIZE, 
-		       RENDERING_GRADIENT_OFFSET, RENDERING_GRADIENT_MAX) != VP_OK) {
-    g_warning(_("Error Specifying the Rendering Voxel Fields (%s, GRADIENT): %s"),
-	      new_rendering->name, vpGetErrorString(vpGetError(new_rendering->vpc)));
+  if (!set_voxel_layout(new_rendering->vpc, new_rendering->name)) {
     new_rendering = rendering_unref(new_rendering);
     return new_rendering;
   }
@@ -385,11 +576,250 @@ gboolean rendering_reload_object(rendering_t * rendering,
 
 
 
-/* function to update the rendering structure's concept of the object */
-gboolean rendering_load_object(rendering_t * rendering, 
-			       AmitkUpdateFunc update_func,
-			       gpointer update_data) {
+/* everything load_data_set_plane needs to resample planes of a data set 
+   straight into the density volume */
+typedef struct {
+  AmitkDataSet * ds;
+  AmitkDataSetSampleFunc sample_func; /* for the data set's format and scaling */
+  rendering_t * rendering;
+  rendering_density_t * density;
+  gfloat * float_density; /* if not NULL, used instead of density */
+  AmitkSpaceS2S to_ds; /* extraction volume space to data set space */
+  AmitkPoint stride_x; /* one rendering voxel along x, in data set space */
+  amide_intpoint_t start_frame;
+  amide_intpoint_t end_frame;
+  amide_data_t * time_weights; /* indexed from start_frame, includes the gate weighting */
+  gint view_start_gate;
+  gint num_gates;
+  gint num_z_steps; /* samples along z within each rendering voxel */
+  AmitkPoint * z_strides; /* from the bottom of a rendering voxel to each sample */
+  amide_data_t * z_weights;
+  amide_data_t min;
+  amide_data_t scale;
+  amide_intpoint_t first_plane;
+} load_data_set_t;
+
+/* fills in one plane of the density volume */
+static void load_data_set_plane(gint task, gpointer data) {
+
+  load_data_set_t * lds = data;
+  rendering_t * rendering = lds->rendering;
+  AmitkPoint voxel_size;
+  AmitkPoint start_point, point, sample_point;
+  AmitkVoxel i_voxel, ds_voxel;
+  amide_data_t value, sample, sum, total_weight, weight;
+  amide_data_t temp_val;
+  gint i_gate, k;
+  rendering_density_t * density_row;
+  gfloat * float_density_row;
+
+  voxel_size.x = voxel_size.y = voxel_size.z = rendering->voxel_size;
+  i_voxel.t = i_voxel.g = 0;
+  i_voxel.z = lds->first_plane + task;
+  ds_voxel.t = ds_voxel.g = 0;
+
+  for (i_voxel.y = 0; i_voxel.y < rendering->dim.y; i_voxel.y++) {
+
+    /* note, volpack needs a mirror reversal on the z axis */
+    if (lds->float_density != NULL) {
+      float_density_row = lds->float_density + 
+	(((gsize) (rendering->dim.z-i_voxel.z-1))*rendering->dim.y + i_voxel.y)*rendering->dim.x;
+      density_row = NULL;
+    } else {
+      density_row = lds->density + 
+	(((gsize) (rendering->dim.z-i_voxel.z-1))*rendering->dim.y + i_voxel.y)*rendering->dim.x;
+      float_density_row = NULL;
+    }
+
+    /* the bottom (in z) of the center line of the first voxel in the row */
+    i_voxel.x = 0;
+    VOXEL_TO_POINT(i_voxel, voxel_size, start_point);
+    start_point.z = i_voxel.z*rendering->voxel_size;
+    point = amitk_space_s2s_point(&(lds->to_ds), start_point);
+
+    for (i_voxel.x = 0; i_voxel.x < rendering->dim.x; i_voxel.x++) {
+      sum = total_weight = 0.0;
+      value = NAN;
+
+      for (ds_voxel.t = lds->start_frame; ds_voxel.t <= lds->end_frame; ds_voxel.t++) {
+	for (i_gate=0; i_gate < lds->num_gates; i_gate++) {
+	  ds_voxel.g = i_gate+lds->view_start_gate;
+	  if (ds_voxel.g >= AMITK_DATA_SET_NUM_GATES(lds->ds))
+	    ds_voxel.g -= AMITK_DATA_SET_NUM_GATES(lds->ds);
+
+	  for (k=0; k < lds->num_z_steps; k++) {
+	    POINT_ADD(point, lds->z_strides[k], sample_point);
+	    sample = (*lds->sample_func)(lds->ds, ds_voxel, sample_point);
+	    if (isnan(sample)) continue;
+
+	    switch(AMITK_DATA_SET_RENDERING(lds->ds)) {
+	    case AMITK_RENDERING_MIP:
+	      if (isnan(value) || (sample > value)) value = sample;
+	      break;
+	    case AMITK_RENDERING_MINIP:
+	      if (isnan(value) || (sample < value)) value = sample;
+	      break;
+	    case AMITK_RENDERING_MPR:
+	    default:
+	      weight = lds->time_weights[ds_voxel.t-lds->start_frame]*lds->z_weights[k];
+	      sum += weight*sample;
+	      total_weight += weight;
+	      break;
+	    }
+	  }
+	}
+      }
+
+      if (total_weight > 0.0)
+	value = sum/total_weight;
+
+      temp_val = lds->scale * (value-lds->min);
+      if (isnan(temp_val)) 
+	temp_val = 0.0;
+      else if (temp_val > RENDERING_DENSITY_MAX) 
+	temp_val = rendering->zero_fill ? 0.0 : RENDERING_DENSITY_MAX;
+      else if (temp_val < 0.0) 
+	temp_val = 0.0;
+      if (float_density_row != NULL)
+	float_density_row[i_voxel.x] = temp_val;
+      else
+	density_row[i_voxel.x] = temp_val;
 
+      POINT_ADD(point, lds->stride_x, point);
+    }
+  }
+
+  return;
+}
+
+/* resamples the data set at the given time and gates over the rendering's extraction 
+   volume directly into density, or float_density if that's not NULL.  Same sampling as 
+   amitk_data_set_get_slice, without building a slice for each plane.  Doesn't change
+   the rendering or the data set, so it can be run for several frames at once */
+static gboolean load_data_set(const rendering_t * rendering, 
+			      const rendering_frame_t * frame,
+			      rendering_density_t * density,
+			      gfloat * float_density,
+			      AmitkUpdateFunc update_func,
+			      gpointer update_data) {
+
+  load_data_set_t lds;
+  AmitkDataSet * ds;
+  AmitkPoint alt;
+  amide_real_t voxel_length, z_steps;
+  amide_time_t end_time;
+  amide_intpoint_t i_frame;
+  amide_data_t max;
+  gint k;
+  gint batch;
+  gboolean continue_work=TRUE;
+
+  ds = AMITK_DATA_SET(rendering->object);
+  lds.ds = ds;
+  lds.sample_func = amitk_data_set_get_sample_func(ds);
+  lds.rendering = (rendering_t *) rendering;
+  lds.density = density;
+  lds.float_density = float_density;
+  lds.time_weights = NULL;
+  lds.z_strides = NULL;
+  lds.z_weights = NULL;
+
+  /* the affine from the extraction volume to the data set, computed once */
+  amitk_space_s2s_init(&(lds.to_ds), AMITK_SPACE(rendering->extraction_volume), AMITK_SPACE(ds));
+  lds.stride_x = amitk_space_s2s_stride(&(lds.to_ds), AMITK_AXIS_X, rendering->voxel_size);
+
+  /* figure out what frames of this data set to include, and their weighting */
+  end_time = frame->start+frame->duration;
+  lds.start_frame = amitk_data_set_get_frame(ds, frame->start+EPSILON);
+  lds.end_frame = amitk_data_set_get_frame(ds, end_time-EPSILON);
+  lds.view_start_gate = frame->view_start_gate;
+  if (frame->view_start_gate > frame->view_end_gate)
+    lds.num_gates = AMITK_DATA_SET_NUM_GATES(ds) - (frame->view_start_gate-frame->view_end_gate-1);
+  else
+    lds.num_gates = frame->view_end_gate-frame->view_start_gate+1;
+
+  if ((lds.time_weights = g_try_new(amide_data_t, lds.end_frame-lds.start_frame+1)) == NULL) {
+    g_warning(_("Could not allocate memory space for density data for %s"), rendering->name);
+    continue_work = FALSE;
+    goto exit_strategy;
+  }
+  for (i_frame = lds.start_frame; i_frame <= lds.end_frame; i_frame++) {
+    amitk_raw_data_use_frame(AMITK_DATA_SET_RAW_DATA(ds), i_frame);
+    if (lds.end_frame-lds.start_frame > 0) {
+      if (i_frame == lds.start_frame)
+	lds.time_weights[0] = (amitk_data_set_get_end_time(ds, lds.start_frame)-frame->start);
+      else if (i_frame == lds.end_frame)
+	lds.time_weights[i_frame-lds.start_frame] = (end_time-amitk_data_set_get_start_time(ds, lds.end_frame));
+      else
+	lds.time_weights[i_frame-lds.start_frame] = amitk_data_set_get_frame_duration(ds, i_frame);
+      lds.time_weights[i_frame-lds.start_frame] /= (frame->duration*lds.num_gates);
+    } else
+      lds.time_weights[0] = 1.0/((gdouble) lds.num_gates);
+  }
+
+  /* the samples along z within a rendering voxel, one per data set voxel length */
+  alt.x = alt.y = 0.0;
+  alt.z = 1.0;
+  alt = amitk_space_s2s_dim(AMITK_SPACE(rendering->extraction_volume), AMITK_SPACE(ds), alt);
+  alt = point_mult(alt, AMITK_DATA_SET_VOXEL_SIZE(ds));
+  voxel_length = POINT_MAGNITUDE(alt);
+  z_steps = rendering->voxel_size/voxel_length; /* non-integer */
+  lds.num_z_steps = ceil(z_steps);
+  if (lds.num_z_steps < 1) lds.num_z_steps = 1;
+
+  lds.z_strides = g_try_new(AmitkPoint, lds.num_z_steps);
+  lds.z_weights = g_try_new(amide_data_t, lds.num_z_steps);
+  if ((lds.z_strides == NULL) || (lds.z_weights == NULL)) {
+    g_warning(_("Could not allocate memory space for density data for %s"), rendering->name);
+    continue_work = FALSE;
+    goto exit_strategy;
+  }
+  for (k=0; k < lds.num_z_steps; k++) {
+    if (lds.num_z_steps > 1)
+      lds.z_strides[k] = amitk_space_s2s_stride(&(lds.to_ds), AMITK_AXIS_Z, (k+0.5)*voxel_length);
+    else
+      lds.z_strides[k] = amitk_space_s2s_stride(&(lds.to_ds), AMITK_AXIS_Z, 0.5*rendering->voxel_size);
+
+    /* this is used to weight the last sample in the z direction */
+    if (floor(z_steps) > k)
+      lds.z_weights[k] = 1.0/z_steps;
+    else
+      lds.z_weights[k] = (z_steps-floor(z_steps)) / z_steps;
+  }
+
+  /* per slice thresholding isn't used for renderings, so this is the same for all planes */
+  amitk_data_set_get_thresholding_min_max(ds, NULL, frame->start, frame->duration, 
+					  &(lds.min), &max);
+  lds.scale = ((amide_data_t) RENDERING_DENSITY_MAX) / (max-lds.min);
+
+  /* hand out the planes in batches, so we can update the progress bar in between */
+  batch = amitk_get_num_threads()*AMITK_PARALLEL_TASKS_PER_THREAD;
+  for (lds.first_plane = 0; (lds.first_plane < rendering->dim.z) && continue_work; lds.first_plane += batch) {
+    if (update_func != NULL)
+      continue_work = (*update_func)(update_data, NULL, (gdouble) lds.first_plane/rendering->dim.z);
+    if (continue_work)
+      amitk_parallel_for(MIN(batch, rendering->dim.z-lds.first_plane), load_data_set_plane, &lds);
+  }
+
+ exit_strategy:
+  g_free(lds.time_weights);
+  g_free(lds.z_strides);
+  g_free(lds.z_weights);
+
+  return continue_work;
+}
+
+
+/* converts the rendering's object at the given frame into a new volume, which
+   isn't loaded into the rendering or added to the volume cache.  Doesn't change
+   the rendering, so several frames can be converted at once if update_func is NULL */
+static rendering_volume_t * convert_volume(const rendering_t * rendering, 
+					   const rendering_frame_t * frame,
+					   AmitkUpdateFunc update_func,
+					   gpointer update_data) {
+
+  rendering_volume_t * volume;
+  vpContext * vpc;
   AmitkVoxel i_voxel, j_voxel;
   rendering_density_t * density; /* buffer for density data */
   guint density_size;/* size of density data */
@@ -408,15 +838,12 @@ gboolean rendering_load_object(rendering_t * rendering,
   gettimeofday(&tv1, NULL);
 #endif
 
-
-  /* tell the volpack context the dimensions of our rendering context */
-  if (vpSetVolumeSize(rendering->vpc, rendering->dim.x, 
-		      rendering->dim.y, rendering->dim.z) != VP_OK) {
-    g_warning(_("Error Setting the Context Size (%s): %s"), 
-	      rendering->name, 
-	      vpGetErrorString(vpGetError(rendering->vpc)));
-    return FALSE;
+  if ((volume = g_try_new0(rendering_volume_t, 1)) == NULL) {
+    g_warning(_("couldn't allocate memory space for rendering volume"));
+    return NULL;
   }
+  volume->rendering = (rendering_t *) rendering;
+  volume->frame = *frame;
 
   /* allocate space for the raw data and the context */
   density_size =  rendering->dim.x *  rendering->dim.y *  
@@ -424,29 +851,29 @@ gboolean rendering_load_object(rendering_t * rendering,
   context_size =  rendering->dim.x *  rendering->dim.y * 
      rendering->dim.z * RENDERING_BYTES_PER_VOXEL;
 
-  if ((density = (rendering_density_t * ) g_try_malloc0(density_size)) == NULL) {
-    g_warning(_("Could not allocate memory space for density data for %s"), 
-	      rendering->name);
-    return FALSE;
-  }
-
-
-  if (rendering->rendering_data != NULL) {
-    g_free(rendering->rendering_data);
-    rendering->rendering_data = NULL;
+  if (rendering->engine == RENDERING_ENGINE_RAY_CASTER) {
+    /* the ray caster keeps its own float density volume */
+    if ((volume->ray_caster = ray_caster_new(rendering->dim)) == NULL)
+      return volume_free(volume);
+    volume->num_bytes = density_size*sizeof(gfloat);
+  } else {
+    if ((volume->rendering_data = (rendering_voxel_t * ) g_try_malloc(context_size)) == NULL) {
+      g_warning(_("Could not allocate memory space for rendering context volume for %s"), 
+		rendering->name);
+      return volume_free(volume);
+    }
+    volume->num_bytes = context_size;
   }
 
-  if ((rendering->rendering_data = (rendering_voxel_t * ) g_try_malloc(context_size)) == NULL) {
-    g_warning(_("Could not allocate memory space for rendering context volume for %s"), 
+  /* data sets get resampled straight into the ray caster's volume */
+  if ((rendering->engine == RENDERING_ENGINE_RAY_CASTER) && AMITK_IS_DATA_SET(rendering->object)) 
+    density = NULL;
+  else if ((density = (rendering_density_t * ) g_try_malloc0(density_size)) == NULL) {
+    g_warning(_("Could not allocate memory space for density data for %s"), 
 	      rendering->name);
-    g_free(density);
-    return FALSE;
+    return volume_free(volume);
   }
 
-  vpSetRawVoxels(rendering->vpc, rendering->rendering_data, context_size, 
-		 RENDERING_BYTES_PER_VOXEL,  rendering->dim.x * RENDERING_BYTES_PER_VOXEL,
-		 rendering->dim.x* rendering->dim.y * RENDERING_BYTES_PER_VOXEL);
-
   /* setup the progress information */
   if (update_func != NULL) {
     temp_string = g_strdup_printf(_("Converting for rendering: %s"), rendering->name);
@@ -465,8 +892,13 @@ gboolean rendering_load_object(rendering_t * rendering,
     AmitkVoxel start, end;
     AmitkCorners intersection_corners;
     AmitkPoint voxel_size;
+    AmitkSpaceS2S volume_to_roi;
+    AmitkPoint stride_x;
 
     voxel_size.x = voxel_size.y = voxel_size.z = rendering->voxel_size;
+    amitk_space_s2s_init(&volume_to_roi, AMITK_SPACE(rendering->extraction_volume),
+			 AMITK_SPACE(rendering->object));
+    stride_x = amitk_space_s2s_stride(&volume_to_roi, AMITK_AXIS_X, rendering->voxel_size);
     
     radius = point_cmult(0.5, AMITK_VOLUME_CORNER(rendering->object));
     center = amitk_space_b2s(AMITK_SPACE(rendering->object),
@@ -487,9 +919,9 @@ gboolean rendering_load_object(rendering_t * rendering,
       end = voxel_sub(end, one_voxel);
     }
 
-    g_return_val_if_fail(end.x < rendering->dim.x, FALSE);
-    g_return_val_if_fail(end.y < rendering->dim.y, FALSE);
-    g_return_val_if_fail(end.z < rendering->dim.z, FALSE);
+    g_return_val_if_fail(end.x < rendering->dim.x, NULL);
+    g_return_val_if_fail(end.y < rendering->dim.y, NULL);
+    g_return_val_if_fail(end.z < rendering->dim.z, NULL);
 
     for (i_voxel.z = start.z; (i_voxel.z <= end.z) && (continue_work); i_voxel.z++) {
       if (update_func != NULL) {
@@ -498,11 +930,12 @@ gboolean rendering_load_object(rendering_t * rendering,
 	  continue_work = (*update_func)(update_data, NULL, (gdouble) i_voxel.z/(end.z-start.z));
       }
 
-      for (i_voxel.y = start.y; i_voxel.y <=  end.y; i_voxel.y++)
+      for (i_voxel.y = start.y; i_voxel.y <=  end.y; i_voxel.y++) {
+	i_voxel.x = start.x;
+	VOXEL_TO_POINT(i_voxel, voxel_size, temp_point);
+	temp_point = amitk_space_s2s_point(&volume_to_roi, temp_point); /* advanced at bottom of loop */
+
 	for (i_voxel.x = start.x; i_voxel.x <=  end.x; i_voxel.x++) {
-	  VOXEL_TO_POINT(i_voxel, voxel_size, temp_point);
-	  temp_point = amitk_space_s2s(AMITK_SPACE(rendering->extraction_volume),
-				       AMITK_SPACE(rendering->object),temp_point);
 	  switch(AMITK_ROI_TYPE(rendering->object)) {
 	  case AMITK_ROI_TYPE_ISOCONTOUR_2D:
 	  case AMITK_ROI_TYPE_ISOCONTOUR_3D:
@@ -543,100 +976,19 @@ gboolean rendering_load_object(rendering_t * rendering,
 	  density[i_voxel.x +
 		  i_voxel.y*rendering->dim.x+
 		  (rendering->dim.z-i_voxel.z-1)*rendering->dim.y*rendering->dim.x] = temp_int;
+
+	  POINT_ADD(temp_point, stride_x, temp_point);
 	}
+      }
     }
 
 
 
   } else { /* DATA SET */
-
-    AmitkVolume * slice_volume;
-    AmitkDataSet * slice;
-    AmitkPoint new_offset;
-    AmitkPoint temp_corner;
-    amide_data_t temp_val, scale;
-    amide_data_t max, min;
-    AmitkVoxel dim;
-    gboolean unmatched_dimensions = FALSE;
-    AmitkCanvasPoint pixel_size;
-
-    
-    slice_volume = AMITK_VOLUME(amitk_object_copy(AMITK_OBJECT(rendering->extraction_volume)));
-
-    /* define the slice that we're trying to pull out of the data set */
-    temp_corner = AMITK_VOLUME_CORNER(slice_volume);
-    temp_corner.z = rendering->voxel_size;
-    amitk_volume_set_corner(slice_volume, temp_corner);
-
-    new_offset = zero_point; /* in slice_volume space */
-    new_offset.z = rendering->voxel_size; 
-
-    /* copy the info from a data set structure into our rendering_volume structure */
-    j_voxel.t = j_voxel.g = j_voxel.z = i_voxel.t= i_voxel.g = 0;
-    for (i_voxel.z = 0; ((i_voxel.z < rendering->dim.z) && continue_work); i_voxel.z++) {
-      if  (update_func != 0) {
-	x = div(i_voxel.z,divider);
-	if (x.rem == 0)
-	    continue_work = (*update_func)(update_data, NULL, (gdouble) i_voxel.z/rendering->dim.z);
-      }
-      
-      pixel_size.x = pixel_size.y = rendering->voxel_size;
-      slice = amitk_data_set_get_slice(AMITK_DATA_SET(rendering->object), 
-				       rendering->start, 
-				       rendering->duration, 
-				       -1,
-				       pixel_size,
-				       slice_volume);
-
-      if (!unmatched_dimensions && 
-	  ((rendering->dim.x != AMITK_DATA_SET_DIM_X(slice)) || 
-	   (rendering->dim.y != AMITK_DATA_SET_DIM_Y(slice)))) {
-	g_warning("unmatched dimensions between rendering and slices (%dx%d != %dx%d) in %s\n", 
-		  rendering->dim.x, rendering->dim.y,
-		  AMITK_DATA_SET_DIM_X(slice), AMITK_DATA_SET_DIM_Y(slice),
-		  __FILE__);
-	unmatched_dimensions = TRUE;
-      }
-      dim.x = MIN(rendering->dim.x, AMITK_DATA_SET_DIM_X(slice));
-      dim.y = MIN(rendering->dim.y, AMITK_DATA_SET_DIM_Y(slice));
-
-
-      amitk_data_set_get_thresholding_min_max(AMITK_DATA_SET_SLICE_PARENT(slice),
-					      AMITK_DATA_SET(slice),
-					      rendering->start, 
-					      rendering->duration, &min, &max);
-
-      scale = ((amide_data_t) RENDERING_DENSITY_MAX) / (max-min);
-
-      /* note, volpack needs a mirror reversal on the z axis */
-      if (rendering->zero_fill) {
-	for (j_voxel.y = i_voxel.y = 0; i_voxel.y <  dim.y; j_voxel.y++, i_voxel.y++)
-	  for (j_voxel.x = i_voxel.x = 0; i_voxel.x <  dim.x; j_voxel.x++, i_voxel.x++) {
-	    temp_val = scale * (AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,j_voxel)-min);
-	    if (temp_val > RENDERING_DENSITY_MAX) temp_val = 0.0;
-	    if (temp_val < 0.0) temp_val = 0.0;
-	    density[i_voxel.x+
-		    i_voxel.y*rendering->dim.x+
-		    (rendering->dim.z-i_voxel.z-1)* rendering->dim.y* rendering->dim.x] = temp_val;
-	  }
-      } else {
-	for (j_voxel.y = i_voxel.y = 0; i_voxel.y <  dim.y; j_voxel.y++, i_voxel.y++)
-	  for (j_voxel.x = i_voxel.x = 0; i_voxel.x <  dim.x; j_voxel.x++, i_voxel.x++) {
-	    temp_val = scale * (AMITK_DATA_SET_DOUBLE_0D_SCALING_CONTENT(slice,j_voxel)-min);
-	    if (temp_val > RENDERING_DENSITY_MAX) temp_val = RENDERING_DENSITY_MAX;
-	    if (temp_val < 0.0) temp_val = 0.0;
-	    density[i_voxel.x+
-		    i_voxel.y*rendering->dim.x+
-		    (rendering->dim.z-i_voxel.z-1)* rendering->dim.y* rendering->dim.x] = temp_val;
-	  }
-      }
-      amitk_object_unref(slice);
-
-      /* advance the requested slice volume for next iteration */
-      amitk_space_set_offset(AMITK_SPACE(slice_volume), 
-			     amitk_space_s2b(AMITK_SPACE(slice_volume), new_offset));
-    }
-    amitk_object_unref(slice_volume);
+    continue_work = load_data_set(rendering, frame, density, 
+				  (rendering->engine == RENDERING_ENGINE_RAY_CASTER) ? 
+				  volume->ray_caster->density : NULL,
+				  update_func, update_data);
   }
 
   /* if we quit, get out of here */
@@ -645,21 +997,49 @@ gboolean rendering_load_object(rendering_t * rendering,
 
   if (!continue_work) {
     g_free(density);
-    return FALSE;
+    return volume_free(volume);
   }
 
-  /* compute surface normals (for shading) and gradient magnitudes (for classification) */
-  if (vpVolumeNormals(rendering->vpc, density, density_size, RENDERING_DENSITY_FIELD, 
-		      RENDERING_GRADIENT_FIELD, RENDERING_NORMAL_FIELD) != VP_OK) {
-    g_warning(_("Error Computing the Rendering Normals (%s): %s"),
-	      rendering->name, vpGetErrorString(vpGetError(rendering->vpc)));
-    g_free(density);
-    return FALSE;
-  }                   
+  /* the ray caster needs no normals, just its brick tree */
+  if (rendering->engine == RENDERING_ENGINE_RAY_CASTER) {
+    if (density != NULL) {
+      gsize i, num_voxels = ((gsize) rendering->dim.x)*rendering->dim.y*rendering->dim.z;
+      for (i=0; i < num_voxels; i++)
+	volume->ray_caster->density[i] = density[i];
+      g_free(density);
+    }
+    ray_caster_calc_bricks(volume->ray_caster);
+    return volume;
+  }
+
+  /* compute surface normals (for shading) and gradient magnitudes (for classification).  
+     This uses a context of its own, as the rendering's context belongs to the main thread */
+  vpc = vpCreateContext();
+  if (!set_voxel_layout(vpc, rendering->name)) 
+    continue_work = FALSE;
+  else if (vpSetVolumeSize(vpc, rendering->dim.x, rendering->dim.y, rendering->dim.z) != VP_OK) {
+    g_warning(_("Error Setting the Context Size (%s): %s"), 
+	      rendering->name, vpGetErrorString(vpGetError(vpc)));
+    continue_work = FALSE;
+  } else {
+    vpSetRawVoxels(vpc, volume->rendering_data, context_size, 
+		   RENDERING_BYTES_PER_VOXEL,  rendering->dim.x * RENDERING_BYTES_PER_VOXEL,
+		   rendering->dim.x* rendering->dim.y * RENDERING_BYTES_PER_VOXEL);
+    if (vpVolumeNormals(vpc, density, density_size, RENDERING_DENSITY_FIELD, 
+			RENDERING_GRADIENT_FIELD, RENDERING_NORMAL_FIELD) != VP_OK) {
+      g_warning(_("Error Computing the Rendering Normals (%s): %s"),
+		rendering->name, vpGetErrorString(vpGetError(vpc)));
+      continue_work = FALSE;
+    }                   
+  }
+  vpDestroyContext(vpc);
 
   /* we're now done with the density volume, free it */
   g_free(density);
 
+  if (!continue_work)
+    return volume_free(volume);
+
 #ifdef AMIDE_DEBUG
   /* and wrapup our timing */
   gettimeofday(&tv2, NULL);
@@ -669,6 +1049,40 @@ gboolean rendering_load_object(rendering_t * rendering,
 	  AMITK_OBJECT_NAME(rendering->object), time2-time1);
 #endif
 
+  return volume;
+}
+
+
+/* makes the given volume the one the rendering draws */
+static gboolean install_volume(rendering_t * rendering, rendering_volume_t * volume) {
+
+  guint context_size;
+
+  rendering->volume = volume;
+  rendering->rendering_data = volume->rendering_data;
+  rendering->ray_caster = volume->ray_caster;
+  rendering->need_rerender = TRUE;
+  rendering->need_reclassify = TRUE;
+
+  /* the ray caster needs no octree or shading tables */
+  if (rendering->engine == RENDERING_ENGINE_RAY_CASTER)
+    return TRUE;
+
+  /* tell the volpack context the dimensions of our rendering context */
+  if (vpSetVolumeSize(rendering->vpc, rendering->dim.x, 
+		      rendering->dim.y, rendering->dim.z) != VP_OK) {
+    g_warning(_("Error Setting the Context Size (%s): %s"), 
+	      rendering->name, 
+	      vpGetErrorString(vpGetError(rendering->vpc)));
+    return FALSE;
+  }
+
+  context_size =  rendering->dim.x *  rendering->dim.y * 
+     rendering->dim.z * RENDERING_BYTES_PER_VOXEL;
+  vpSetRawVoxels(rendering->vpc, rendering->rendering_data, context_size, 
+		 RENDERING_BYTES_PER_VOXEL,  rendering->dim.x * RENDERING_BYTES_PER_VOXEL,
+		 rendering->dim.x* rendering->dim.y * RENDERING_BYTES_PER_VOXEL);
+
   /* we'll be using min-max octree's as the classifying functions will probably be changed a lot */
   /* octrees supposedly allow faster classification */
   if (rendering->optimize_rendering) { 
@@ -747,6 +1161,176 @@ gboolean rendering_load_object(rendering_t * rendering,
 }
 
 
+/* function to update the rendering structure's concept of the object.  Volumes
+   that have already been converted are reused from the volume cache */
+gboolean rendering_load_object(rendering_t * rendering, 
+			       AmitkUpdateFunc update_func,
+			       gpointer update_data) {
+
+  rendering_frame_t frame;
+  rendering_volume_t * volume;
+  gboolean cached;
+
+  frame.start = rendering->start;
+  frame.duration = rendering->duration;
+  frame.view_start_gate = rendering->view_start_gate;
+  frame.view_end_gate = rendering->view_end_gate;
+
+  volume = volume_cache_lookup(rendering, &frame);
+  cached = (volume != NULL);
+  if (!cached) 
+    if ((volume = convert_volume(rendering, &frame, update_func, update_data)) == NULL)
+      return FALSE;
+
+  if (!install_volume(rendering, volume)) {
+    if (!cached) 
+      volume_free(volume);
+    rendering->volume = NULL;
+    rendering->rendering_data = NULL;
+    rendering->ray_caster = NULL;
+    return FALSE;
+  }
+
+  if (!cached)
+    volume_cache_add(volume);
+
+  return TRUE;
+}
+
+
+/* everything preload_task needs */
+typedef struct {
+  rendering_t * rendering;
+  const rendering_frame_t * frames;
+  rendering_volume_t ** volumes;
+} preload_frames_t;
+
+static void preload_task(gint task, gpointer data) {
+  preload_frames_t * pf = data;
+  pf->volumes[task] = convert_volume(pf->rendering, &(pf->frames[task]), NULL, NULL);
+  return;
+}
+
+/* starts a new round of rendering_preload_frames calls, e.g. one for each rendering 
+   of a movie.  Volumes preloaded or found in the cache during a round aren't dropped 
+   to make room for the rest of the round, anything older can be */
+void renderings_preload_start(void) {
+  volume_cache_round++;
+  return;
+}
+
+/* converts the given frames of a data set into the volume cache ahead of time, 
+   several at once, so that stepping through them later (e.g. when generating a 
+   movie) only needs a reclassification.  Frames that are already cached are 
+   skipped.  Volumes not needed by the current round are dropped to make room, and
+   only as many frames as then fit in the cache get converted.  Returns FALSE if 
+   the user canceled */
+gboolean rendering_preload_frames(rendering_t * rendering,
+				  const rendering_frame_t * frames,
+				  const gint num_frames,
+				  AmitkUpdateFunc update_func,
+				  gpointer update_data) {
+
+  rendering_frame_t * needed;
+  rendering_volume_t ** volumes;
+  rendering_volume_t * volume;
+  preload_frames_t pf;
+  gint num_needed;
+  gint i_frame, j_frame;
+  gint first, batch, num;
+  gsize num_bytes, budget;
+  gchar * temp_string;
+  gboolean continue_work=TRUE;
+
+  /* only dynamic data sets ever get reloaded */
+  if (!AMITK_IS_DATA_SET(rendering->object))
+    return TRUE;
+  if (!(AMITK_DATA_SET_DYNAMIC(rendering->object) || AMITK_DATA_SET_GATED(rendering->object)))
+    return TRUE;
+
+  num_bytes = ((gsize) rendering->dim.x)*rendering->dim.y*rendering->dim.z*
+    ((rendering->engine == RENDERING_ENGINE_RAY_CASTER) ? sizeof(gfloat) : RENDERING_BYTES_PER_VOXEL);
+  budget = volume_cache_budget(num_bytes);
+
+  /* figure out which frames still need converting, the ones already cached 
+     are kept for this round */
+  if ((needed = g_try_new(rendering_frame_t, num_frames)) == NULL) {
+    g_warning(_("couldn't allocate memory space for rendering volume"));
+    return TRUE;
+  }
+  num_needed = 0;
+  for (i_frame = 0; i_frame < num_frames; i_frame++) {
+    if ((volume = volume_cache_lookup(rendering, &(frames[i_frame]))) != NULL) {
+      volume->preload_round = volume_cache_round;
+      continue;
+    }
+    for (j_frame = 0; j_frame < num_needed; j_frame++)
+      if (frames_equal(rendering, &(needed[j_frame]), &(frames[i_frame])))
+	break;
+    if (j_frame == num_needed) 
+      needed[num_needed++] = frames[i_frame];
+  }
+
+  /* make room by dropping volumes from earlier rounds (e.g. other time ranges), 
+     and only convert as many frames as then fit */
+  if (num_needed > 0) 
+    volume_cache_trim(num_bytes, num_needed*num_bytes, TRUE);
+  if (volume_cache_used+num_bytes > budget)
+    num_needed = 0;
+  else if ((budget-volume_cache_used)/num_bytes < num_needed)
+    num_needed = (budget-volume_cache_used)/num_bytes;
+
+  if (num_needed == 0) {
+    g_free(needed);
+    return TRUE;
+  }
+
+  if ((volumes = g_try_new0(rendering_volume_t *, num_needed)) == NULL) {
+    g_warning(_("couldn't allocate memory space for rendering volume"));
+    g_free(needed);
+    return TRUE;
+  }
+
+  /* the max/min's get calculated lazily, make sure that's done before we go parallel */
+  amitk_data_set_calc_min_max_if_needed(AMITK_DATA_SET(rendering->object), update_func, update_data);
+
+  if (update_func != NULL) {
+    temp_string = g_strdup_printf(_("Converting frames for rendering: %s"), rendering->name);
+    continue_work = (*update_func)(update_data, temp_string, (gdouble) 0.0);
+    g_free(temp_string);
+  }
+
+  /* one frame per thread at a time, which bounds the memory used for density buffers */
+  pf.rendering = rendering;
+  batch = amitk_get_num_threads();
+  for (first = 0; (first < num_needed) && continue_work; first += batch) {
+    num = MIN(batch, num_needed-first);
+    pf.frames = needed+first;
+    pf.volumes = volumes+first;
+    amitk_parallel_for(num, preload_task, &pf);
+
+    /* the cache is only touched from here */
+    for (i_frame = first; i_frame < first+num; i_frame++)
+      if (volumes[i_frame] != NULL) {
+	volumes[i_frame]->preload_round = volume_cache_round;
+	volume_cache_add(volumes[i_frame]);
+      }
+
+    if (update_func != NULL)
+      continue_work = (*update_func)(update_data, NULL, (gdouble) (first+num)/num_needed);
+  }
+
+  if (update_func != NULL) 
+    (*update_func)(update_data, NULL, (gdouble) 2.0); /* remove progress bar */
+
+  g_free(volumes);
+  g_free(needed);
+
+  return continue_work;
+}
+
+
+
 
 static void set_space(rendering_t * rendering) {
 
@@ -823,6 +1407,25 @@ void rendering_reset_rotation(rendering_t * rendering) {
 }
 
 
+/* the max ray opacity actually used, previews terminate rays early */
+static gdouble get_max_ray_opacity(const rendering_t * rendering) {
+  if (rendering->refinement > 0)
+    return MIN(rendering->max_ray_opacity, RENDERING_REFINEMENT_MAX_RAY_OPACITY);
+  else
+    return rendering->max_ray_opacity;
+}
+
+static void set_max_ray_opacity(rendering_t * rendering) {
+
+  /* set the maximum ray opacity (the renderer quits follow a ray if this value is reached */
+  if (vpSetd(rendering->vpc, VP_MAX_RAY_OPACITY, get_max_ray_opacity(rendering)) != VP_OK){
+    g_warning(_("Error Setting Rendering Max Ray Opacity (%s): %s"),
+	      rendering->name, vpGetErrorString(vpGetError(rendering->vpc)));
+  }
+
+  return;
+}
+
 /* set the speed versus quality parameters of a rendering context */
 void rendering_set_quality(rendering_t * rendering, rendering_quality_t quality) {
 
@@ -851,13 +1454,9 @@ void rendering_set_quality(rendering_t * rendering, rendering_quality_t quality)
     min_voxel_opacity = 0.0;
     break;
   }
-
-
-  /* set the maximum ray opacity (the renderer quits follow a ray if this value is reached */
-  if (vpSetd(rendering->vpc, VP_MAX_RAY_OPACITY, max_ray_opacity) != VP_OK){
-    g_warning(_("Error Setting Rendering Max Ray Opacity (%s): %s"),
-	      rendering->name, vpGetErrorString(vpGetError(rendering->vpc)));
-  }
+  rendering->max_ray_opacity = max_ray_opacity;
+  rendering->min_voxel_opacity = min_voxel_opacity;
+  set_max_ray_opacity(rendering);
 
   /* set the minimum voxel opacity (the render ignores voxels with values below this*/
   if (vpSetd(rendering->vpc, VP_MIN_VOXEL_OPACITY, min_voxel_opacity) != VP_OK) {
@@ -870,15 +1469,19 @@ void rendering_set_quality(rendering_t * rendering, rendering_quality_t quality)
   return;
 }
 
-/* function to set up the image that we'll be getting back from the rendering */
-void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdouble zoom) {
+/* the size in one dimension of the image rendered at the given refinement, height == width */
+static amide_intpoint_t get_image_size(const rendering_t * rendering, const gint refinement) {
+  return ceil(rendering->zoom*POINT_MAX(rendering->dim)/((gdouble) (1 << refinement)));
+}
 
-  guint volpack_pixel_type;
-  amide_intpoint_t size_dim; /* size in one dimension, note that height == width */
+/* point volpack at the image for the current refinement */
+static void set_render_image(rendering_t * rendering) {
 
-  rendering->need_rerender = TRUE;
+  guint volpack_pixel_type;
+  amide_intpoint_t size_dim; 
+  guchar * render_image;
 
-  switch (pixel_type) {
+  switch (rendering->pixel_type) {
   case GRAYSCALE:
     volpack_pixel_type = VP_LUMINANCE;
     break;
@@ -887,6 +1490,35 @@ void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdoub
     volpack_pixel_type = VP_ALPHA;
     break;
   }
+
+  size_dim = get_image_size(rendering, rendering->refinement);
+  g_free(rendering->preview_image);
+  rendering->preview_image = NULL;
+  if (rendering->refinement > 0) {
+    if ((rendering->preview_image = g_try_new(guchar,size_dim*size_dim)) == NULL) {
+      g_warning(_("Could not allocate memory space for Rendering Image for %s"), 
+		rendering->name);
+      rendering->refinement = 0;
+      size_dim = get_image_size(rendering, rendering->refinement);
+    }
+  }
+  render_image = (rendering->refinement > 0) ? rendering->preview_image : rendering->image;
+
+  if (vpSetImage(rendering->vpc, render_image, size_dim,
+		 size_dim, size_dim* RENDERING_DENSITY_SIZE, volpack_pixel_type)) {
+    g_warning(_("Error Switching the Rendering Image Pixel Return Type (%s): %s"),
+	      rendering->name, vpGetErrorString(vpGetError(rendering->vpc)));
+  }
+  return;
+}
+
+/* function to set up the image that we'll be getting back from the rendering */
+void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdouble zoom) {
+
+  amide_intpoint_t size_dim; /* size in one dimension, note that height == width */
+
+  rendering->need_rerender = TRUE;
+
   size_dim = ceil(zoom*POINT_MAX(rendering->dim));
   g_free(rendering->image);
   if ((rendering->image = g_try_new(guchar,size_dim*size_dim)) == NULL) {
@@ -896,11 +1528,26 @@ void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdoub
   }
 
   rendering->pixel_type = pixel_type;
-  if (vpSetImage(rendering->vpc, (guchar *) rendering->image, size_dim,
-		 size_dim, size_dim* RENDERING_DENSITY_SIZE, volpack_pixel_type)) {
-    g_warning(_("Error Switching the Rendering Image Pixel Return Type (%s): %s"),
-	      rendering->name, vpGetErrorString(vpGetError(rendering->vpc)));
-  }
+  rendering->zoom = zoom;
+  set_render_image(rendering);
+  return;
+}
+
+/* switch the level of progressive refinement, 0 is full quality.  Higher 
+   levels render a smaller image with rays that stop sooner, and scale the
+   result up, for quick previews while the user is interacting */
+void rendering_set_refinement(rendering_t * rendering, gint refinement) {
+
+  refinement = CLAMP(refinement, 0, RENDERING_NUM_REFINEMENTS-1);
+  if (rendering->refinement == refinement)
+    return;
+
+  rendering->need_rerender = TRUE;
+  rendering->refinement = refinement;
+  set_max_ray_opacity(rendering);
+  if (rendering->image != NULL)
+    set_render_image(rendering);
+
   return;
 }
 
@@ -908,6 +1555,7 @@ void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdoub
 void rendering_set_depth_cueing(rendering_t * rendering, gboolean state) {
 
   rendering->need_rerender = TRUE;
+  rendering->depth_cueing = state;
 
   if (vpEnable(rendering->vpc, VP_DEPTH_CUE, state) != VP_OK) {
       g_warning(_("Error Setting the Rendering Depth Cue (%s): %s"),
@@ -924,6 +1572,8 @@ void rendering_set_depth_cueing_parameters(rendering_t * rendering,
 					   gdouble front_factor, gdouble density) {
 
   rendering->need_rerender = TRUE;
+  rendering->front_factor = front_factor;
+  rendering->depth_cueing_density = density;
 
   /* the defaults should be 1.0 and 1.0 */
   if (vpSetDepthCueing(rendering->vpc, front_factor, density) != VP_OK){
@@ -935,6 +1585,37 @@ void rendering_set_depth_cueing_parameters(rendering_t * rendering,
 }
 
 
+/* bilinearly scales the preview image up into the full size image */
+static void scale_up_preview(rendering_t * rendering) {
+
+  amide_intpoint_t preview_size, size;
+  gint x, y, x0, y0, x1, y1;
+  gdouble scale, fx, fy, top, bottom;
+  guchar * preview = rendering->preview_image;
+
+  preview_size = get_image_size(rendering, rendering->refinement);
+  size = get_image_size(rendering, 0);
+  scale = preview_size/((gdouble) size);
+
+  for (y=0; y < size; y++) {
+    fy = (y+0.5)*scale-0.5;
+    y0 = CLAMP(floor(fy), 0, preview_size-1);
+    y1 = MIN(y0+1, preview_size-1);
+    fy = CLAMP(fy-y0, 0.0, 1.0);
+    for (x=0; x < size; x++) {
+      fx = (x+0.5)*scale-0.5;
+      x0 = CLAMP(floor(fx), 0, preview_size-1);
+      x1 = MIN(x0+1, preview_size-1);
+      fx = CLAMP(fx-x0, 0.0, 1.0);
+      bottom = preview[x0+y0*preview_size] + fx*(preview[x1+y0*preview_size]-preview[x0+y0*preview_size]);
+      top = preview[x0+y1*preview_size] + fx*(preview[x1+y1*preview_size]-preview[x0+y1*preview_size]);
+      rendering->image[x+y*size] = bottom + fy*(top-bottom) + 0.5;
+    }
+  }
+
+  return;
+}
+
 /* to render a rendering context... */
 void rendering_render(rendering_t * rendering)
 {
@@ -949,8 +1630,38 @@ void rendering_render(rendering_t * rendering)
   gettimeofday(&tv1, NULL);
 #endif
 
+  if ((rendering->cancel != NULL) && g_atomic_int_get(rendering->cancel))
+    return;
+
   if (rendering->need_rerender) {
-    if (rendering->vpc != NULL) {
+    if ((rendering->engine == RENDERING_ENGINE_RAY_CASTER) && (rendering->ray_caster != NULL)) {
+      ray_caster_view_t view;
+      AmitkAxis i_axis;
+
+      for (i_axis=0; i_axis < AMITK_AXIS_NUM; i_axis++)
+	view.axes[i_axis] = amitk_space_get_axis(AMITK_SPACE(rendering->transformed_volume), i_axis);
+      view.zoom = rendering->zoom*get_image_size(rendering, rendering->refinement)/
+	((gdouble) get_image_size(rendering, 0));
+      view.step = 1.0 + rendering->refinement;
+      view.grayscale = (rendering->pixel_type == GRAYSCALE);
+      view.density_ramp = rendering->density_ramp;
+      view.gradient_ramp = rendering->gradient_ramp;
+      view.density_max = RENDERING_DENSITY_MAX;
+      view.gradient_max = RENDERING_GRADIENT_MAX;
+      view.max_ray_opacity = get_max_ray_opacity(rendering);
+      view.min_voxel_opacity = rendering->min_voxel_opacity;
+      view.depth_cueing = rendering->depth_cueing;
+      view.front_factor = rendering->front_factor;
+      view.depth_cueing_density = rendering->depth_cueing_density;
+      view.cancel = rendering->cancel;
+
+      if (rendering->need_reclassify)
+	ray_caster_classify(rendering->ray_caster, &view);
+      if (rendering->image != NULL)
+	ray_caster_render(rendering->ray_caster, &view, 
+			  (rendering->refinement > 0) ? rendering->preview_image : rendering->image,
+			  get_image_size(rendering, rendering->refinement));
+    } else if ((rendering->vpc != NULL) && (rendering->rendering_data != NULL)) {
       if (rendering->optimize_rendering) {
 	if (rendering->need_reclassify) {
 #if AMIDE_DEBUG
@@ -975,6 +1686,13 @@ void rendering_render(rendering_t * rendering)
 	}
       }
     }
+
+    /* cut short, the image is incomplete and still needs rendering */
+    if ((rendering->cancel != NULL) && g_atomic_int_get(rendering->cancel))
+      return;
+
+    if ((rendering->refinement > 0) && (rendering->image != NULL))
+      scale_up_preview(rendering);
   }
 
 #ifdef AMIDE_COMMENT_OUT
@@ -1033,6 +1751,7 @@ static renderings_t * renderings_init_recurse(GList * objects,
 					      const gboolean zero_fill,
 					      const gboolean optimize_rendering,
 					      const gboolean no_gradient_opacity,
+					      const rendering_engine_t engine,
 					      AmitkUpdateFunc update_func,
 					      gpointer update_data) {
 
@@ -1044,11 +1763,11 @@ static renderings_t * renderings_init_recurse(GList * objects,
 
   /* recurse first */
   rest_of_list = renderings_init_recurse(objects->next, render_volume, voxel_size, start, duration, 
-					 zero_fill, optimize_rendering, no_gradient_opacity,
+					 zero_fill, optimize_rendering, no_gradient_opacity, engine,
 					 update_func, update_data);
 
   new_rendering = rendering_init(objects->data, render_volume,voxel_size, start, duration, 
-				 zero_fill, optimize_rendering, no_gradient_opacity,
+				 zero_fill, optimize_rendering, no_gradient_opacity, engine,
 				 update_func, update_data);
 
   if (new_rendering != NULL) {
@@ -1070,6 +1789,7 @@ static renderings_t * renderings_init_recurse(GList * objects,
 renderings_t * renderings_init(GList * objects,const amide_time_t start, const amide_time_t duration,
 			       const gboolean zero_fill, const gboolean optimize_rendering, 
 			       const gboolean no_gradient_opacity,
+			       const rendering_engine_t engine,
 			       const amide_real_t fov,
 			       const AmitkPoint view_center,
 			       AmitkUpdateFunc update_func,
@@ -1137,7 +1857,7 @@ renderings_t * renderings_init(GList * objects,const amide_time_t start, const a
 
   /* and generate our rendering list */
   return_list = renderings_init_recurse(objects, render_volume,voxel_size, start, duration, 
-					zero_fill, optimize_rendering, no_gradient_opacity,
+					zero_fill, optimize_rendering, no_gradient_opacity, engine,
 					update_func, update_data);
   amitk_object_unref(render_volume);
   return return_list;
@@ -1238,6 +1958,31 @@ void renderings_set_depth_cueing(renderings_t * renderings, gboolean state) {
   return;
 }
 
+/* set the level of progressive refinement on a list of rendering contexts */
+void renderings_set_refinement(renderings_t * renderings, gint refinement) {
+
+  while (renderings != NULL) {
+    rendering_set_refinement(renderings->rendering, refinement);
+    renderings = renderings->next;
+  }
+
+  return;
+}
+
+
+/* point a list of rendering contexts at a flag that cuts rendering short
+   when set from another thread.  The ray caster checks it between image 
+   tiles, volpack only before starting on each context.  NULL to unset */
+void renderings_set_cancel(renderings_t * renderings, gint * cancel) {
+
+  while (renderings != NULL) {
+    renderings->rendering->cancel = cancel;
+    renderings = renderings->next;
+  }
+
+  return;
+}
+
 
 /* sets the depth cueing parameters for a list of rendering contexts */
 void renderings_set_depth_cueing_parameters(renderings_t * renderings, 
@@ -1254,12 +1999,51 @@ void renderings_set_depth_cueing_parameters(renderings_t * renderings,
 
 
 /* to render a list of rendering contexts... */
+static void render_task(gint task, gpointer data) {
+  rendering_t ** contexts = data;
+  rendering_render(contexts[task]);
+}
+
+/* renders each context on its own worker, they're independent of each other
+   (separate volpack contexts or ray casters).  Returns once they're all done */
 void renderings_render(renderings_t * renderings) {
 
- while (renderings != NULL) {
-    rendering_render(renderings->rendering);
-    renderings = renderings->next;
+  rendering_t ** contexts;
+  guint num_contexts, i;
+
+  num_contexts = renderings_count(renderings);
+  if ((contexts = g_try_new(rendering_t *, num_contexts)) == NULL) {
+    /* just do them one at a time */
+    while (renderings != NULL) {
+      rendering_render(renderings->rendering);
+      renderings = renderings->next;
+    }
+    return;
+  }
+
+  for (i=0; i < num_contexts; i++, renderings = renderings->next)
+    contexts[i] = renderings->rendering;
+  amitk_parallel_for(num_contexts, render_task, contexts);
+  g_free(contexts);
+
+  return;
+}
+
+/* set the memory budget for converted volumes kept for reuse by all renderings, 
+   in bytes.  0 sizes it automatically from the volumes being loaded */
+void renderings_set_volume_cache_size(const gsize new_size) {
+
+  GList * link;
+  gsize largest=0;
+  rendering_volume_t * volume;
+
+  volume_cache_size = new_size;
+
+  for (link = volume_cache.head; link != NULL; link = link->next) {
+    volume = link->data;
+    largest = MAX(largest, volume->num_bytes);
   }
+  volume_cache_trim(largest, 0, FALSE);
 
   return;
 }
@@ -32,6 +32,7 @@
 #include <volpack.h>
 #include "amitk_object.h"
 #include "amitk_data_set.h"
+#include "render_ray.h"
 
 /* -------------- structures and such ------------- */
 
@@ -42,6 +43,7 @@ typedef enum {DENSITY_CLASSIFICATION, GRADIENT_CLASSIFICATION, NUM_CLASSIFICATIO
 typedef enum {HIGHEST, HIGH, FAST, FASTEST, NUM_QUALITIES} rendering_quality_t;
 typedef enum {OPACITY, GRAYSCALE, NUM_PIXEL_TYPES} pixel_type_t;
 typedef enum {CURVE_LINEAR, CURVE_SPLINE, NUM_CURVE_TYPES} curve_type_t;
+typedef enum {RENDERING_ENGINE_VOLPACK, RENDERING_ENGINE_RAY_CASTER, NUM_RENDERING_ENGINES} rendering_engine_t;
 
 typedef struct {        /*   contents of a voxel */
   rendering_normal_t normal;        /*   encoded surface normal vector */
@@ -108,12 +110,39 @@ rendering_voxel_t * dummy_voxel;
 #define RENDERING_DEFAULT_DEPTH_CUEING FALSE
 #define RENDERING_DEFAULT_FRONT_FACTOR 1.0
 #define RENDERING_DEFAULT_DENSITY 1.0
+#define RENDERING_DEFAULT_ENGINE RENDERING_ENGINE_VOLPACK
+
+/* progressive refinement, level 0 is full quality, each level above 
+   that halves the image size and takes longer steps along the rays */
+#define RENDERING_NUM_REFINEMENTS 3
+#define RENDERING_REFINEMENT_MAX_RAY_OPACITY 0.95
+
+/* bytes of converted volumes kept around for reuse, see rendering_preload_frames.
+   Unless a size is given with renderings_set_volume_cache_size, the budget is the
+   default, or room for RENDERING_VOLUME_CACHE_MIN_VOLUMES of the volumes being 
+   loaded if that's more, but never more than 1/RENDERING_VOLUME_CACHE_MEMORY_FRACTION 
+   of physical memory */
+#define RENDERING_VOLUME_CACHE_DEFAULT_SIZE (((gsize) 512)*1024*1024)
+#define RENDERING_VOLUME_CACHE_MIN_VOLUMES 4
+#define RENDERING_VOLUME_CACHE_MEMORY_FRACTION 4
 
 /* ------------ some more structures ------------ */
 
+/* the part of a data set that gets converted into a rendering volume */
+typedef struct {
+  amide_time_t start;
+  amide_time_t duration;
+  gint view_start_gate;
+  gint view_end_gate;
+} rendering_frame_t;
+
+typedef struct _rendering_volume_t rendering_volume_t;
+
 /* our rendering context structure */
 typedef struct _rendering_t {
-  vpContext * vpc;      /*  VolPack rendering Context */
+  rendering_engine_t engine;
+  vpContext * vpc;      /*  VolPack rendering Context, also used for the ramps by the ray caster */
+  ray_caster_t * ray_caster; /* only used with RENDERING_ENGINE_RAY_CASTER */
   AmitkObject * object;
   gchar * name;
   AmitkColorTable color_table;
@@ -124,10 +153,13 @@ typedef struct _rendering_t {
   gint view_end_gate;
   AmitkVolume * transformed_volume; /* volume in rendering space in which the data resides  */
   AmitkVolume * extraction_volume; /* set on init, used for extracting data into the context */
-  rendering_voxel_t * rendering_data;
+  rendering_volume_t * volume; /* what's loaded now, owned by the volume cache */
+  rendering_voxel_t * rendering_data; /* these two point into volume */
   amide_real_t voxel_size; /* volpack needs isotropic voxels */
   AmitkVoxel dim; /* dimensions of our rendering_data and image */
   guchar * image;
+  gint refinement; /* see RENDERING_NUM_REFINEMENTS */
+  guchar * preview_image; /* what gets rendered when refinement > 0, scaled up into image */
   gfloat shade_table[RENDERING_NORMAL_MAX+1];	/* shading lookup table */
   gfloat density_ramp[RENDERING_DENSITY_MAX+1]; /* opacity as a function */
   gfloat gradient_ramp[RENDERING_GRADIENT_MAX+1]; /* opacity as a function */
@@ -137,12 +169,31 @@ typedef struct _rendering_t {
   curve_type_t curve_type[NUM_CLASSIFICATIONS];
   gboolean zero_fill;
   gboolean optimize_rendering;
+  gdouble zoom; /* these are kept for the ray caster, volpack keeps its own copies */
+  gfloat max_ray_opacity;
+  gfloat min_voxel_opacity;
+  gboolean depth_cueing;
+  gdouble front_factor;
+  gdouble depth_cueing_density;
   gboolean need_rerender;
   gboolean need_reclassify;
+  gint * cancel; /* see renderings_set_cancel */
   guint ref_count;
 } rendering_t;
 
 
+/* an object converted for rendering at one frame, either volpack's voxels
+   (density, gradient, and normals) or the ray caster's volume */
+struct _rendering_volume_t {
+  rendering_t * rendering;
+  rendering_frame_t frame;
+  rendering_voxel_t * rendering_data;
+  ray_caster_t * ray_caster;
+  gsize num_bytes;
+  guint preload_round; /* last preload round that needed it, see renderings_preload_start */
+};
+
+
 /* a list of rendering contexts */
 typedef struct _renderings_t renderings_t;
 struct _renderings_t {
@@ -168,6 +219,7 @@ rendering_t * rendering_init(const AmitkObject * object,
 			     const gboolean zero_fill,
 			     const gboolean optimize_rendering,
 			     const gboolean no_gradient_opacity,
+			     const rendering_engine_t engine,
 			     AmitkUpdateFunc update_func,
 			     gpointer update_data);
 gboolean rendering_reload_object(rendering_t * rendering, 
@@ -178,12 +230,19 @@ gboolean rendering_reload_object(rendering_t * rendering,
 gboolean rendering_load_object(rendering_t * rendering, 
 			       AmitkUpdateFunc update_func,
 			       gpointer update_data);
+void renderings_preload_start(void);
+gboolean rendering_preload_frames(rendering_t * rendering,
+				  const rendering_frame_t * frames,
+				  const gint num_frames,
+				  AmitkUpdateFunc update_func,
+				  gpointer update_data);
 void rendering_set_space(rendering_t * rendering, AmitkSpace * space);
 void rendering_set_rotation(rendering_t * rendering, AmitkAxis dir, gdouble rotation);
 void rendering_reset_rotation(rendering_t * rendering);
 void rendering_set_quality(rendering_t * rendering, rendering_quality_t quality);
 void rendering_set_image(rendering_t * rendering, pixel_type_t pixel_type, gdouble zoom);
 void rendering_set_depth_cueing(rendering_t * rendering, gboolean state);
+void rendering_set_refinement(rendering_t * rendering, gint refinement);
 void rendering_set_depth_cueing_parameters(rendering_t * rendering, 
 						   gdouble front_factor, gdouble density);
 void rendering_render(rendering_t * rendering);
@@ -194,6 +253,7 @@ renderings_t * renderings_init(GList * objects,
 			       const gboolean zero_fill,
 			       const gboolean optimize_rendering,
 			       const gboolean no_gradient_opacity,
+			       const rendering_engine_t engine,
 			       const amide_real_t fov,
 			       const AmitkPoint view_center,
 			       AmitkUpdateFunc update_func,
@@ -209,14 +269,18 @@ void renderings_reset_rotation(renderings_t * renderings);
 void renderings_set_quality(renderings_t * renderlings, rendering_quality_t quality);
 void renderings_set_zoom(renderings_t * renderings, gdouble zoom);
 void renderings_set_depth_cueing(renderings_t * renderings, gboolean state);
+void renderings_set_refinement(renderings_t * renderings, gint refinement);
+void renderings_set_cancel(renderings_t * renderings, gint * cancel);
 void renderings_set_depth_cueing_parameters(renderings_t * renderings, 
 					    gdouble front_factor, gdouble density);
 void renderings_render(renderings_t * renderings);
 guint renderings_count(renderings_t * renderings);
+void renderings_set_volume_cache_size(const gsize volume_cache_size);
 
 /* external variables */
 extern gchar * rendering_quality_names[];
 extern gchar * pixel_type_names[];
+extern gchar * rendering_engine_names[];
 
 
 
@@ -0,0 +1,540 @@
+/* render_ray.c
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#include "amide_config.h"
+
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+
+#include <glib.h>
+#include <math.h>
+#include "amitk_common.h"
+#include "render_ray.h"
+
+
+/* shading, about the same as volpack's default material and light with
+   the zero shinyness render.c uses */
+#define RAY_CASTER_AMBIENT 0.1
+#define RAY_CASTER_DIFFUSE 0.4
+#define RAY_CASTER_SPECULAR 0.5
+#define RAY_CASTER_LIGHT_X 0.3
+#define RAY_CASTER_LIGHT_Y 0.3
+#define RAY_CASTER_LIGHT_Z 1.0
+
+#define RAY_CASTER_DENSITY(rc, ix, iy, iz) \
+  ((rc)->density[(((gsize) (iz))*(rc)->dim.y + (iy))*(rc)->dim.x + (ix)])
+
+
+/* the edge length, in voxels, of a brick at the given level of the tree */
+static gint brick_size(const gint level) {
+
+  gint size = RAY_CASTER_BRICK_SIZE;
+  gint i;
+
+  for (i=0; i<level; i++)
+    size *= RAY_CASTER_BRICK_FANOUT;
+
+  return size;
+}
+
+#define RAY_CASTER_BRICK_INDEX(rc, level, ix, iy, iz) \
+  ((((gsize) (iz))*(rc)->brick_dim[level].y + (iy))*(rc)->brick_dim[level].x + (ix))
+
+
+
+ray_caster_t * ray_caster_new(const AmitkVoxel dim) {
+
+  ray_caster_t * ray_caster;
+  gint level, size;
+  gsize num_bricks;
+
+  if ((ray_caster = g_try_new0(ray_caster_t, 1)) == NULL) {
+    g_warning(_("couldn't allocate memory space for the ray caster"));
+    return NULL;
+  }
+  ray_caster->dim = dim;
+
+  if ((ray_caster->density = g_try_new(gfloat, ((gsize) dim.x)*dim.y*dim.z)) == NULL) {
+    g_warning(_("couldn't allocate memory space for the ray caster"));
+    return ray_caster_free(ray_caster);
+  }
+
+  for (level=0; level < RAY_CASTER_BRICK_LEVELS; level++) {
+    size = brick_size(level);
+    ray_caster->brick_dim[level].x = (dim.x+size-1)/size;
+    ray_caster->brick_dim[level].y = (dim.y+size-1)/size;
+    ray_caster->brick_dim[level].z = (dim.z+size-1)/size;
+    ray_caster->brick_dim[level].g = ray_caster->brick_dim[level].t = 1;
+    num_bricks = ((gsize) ray_caster->brick_dim[level].x)*
+      ray_caster->brick_dim[level].y*ray_caster->brick_dim[level].z;
+
+    ray_caster->bricks[level] = g_try_new(ray_brick_t, num_bricks);
+    ray_caster->brick_empty[level] = g_try_new0(gboolean, num_bricks); /* nothing's empty yet */
+    if ((ray_caster->bricks[level] == NULL) || (ray_caster->brick_empty[level] == NULL)) {
+      g_warning(_("couldn't allocate memory space for the ray caster"));
+      return ray_caster_free(ray_caster);
+    }
+  }
+
+  return ray_caster;
+}
+
+ray_caster_t * ray_caster_free(ray_caster_t * ray_caster) {
+
+  gint level;
+
+  if (ray_caster == NULL)
+    return NULL;
+
+  g_free(ray_caster->density);
+  for (level=0; level < RAY_CASTER_BRICK_LEVELS; level++) {
+    g_free(ray_caster->bricks[level]);
+    g_free(ray_caster->brick_empty[level]);
+  }
+  g_free(ray_caster);
+
+  return NULL;
+}
+
+
+
+/* finds the density range of one z slab of the finest bricks */
+static void calc_bricks_slab(gint task, gpointer data) {
+
+  ray_caster_t * rc = data;
+  AmitkVoxel i_brick, start, end, i;
+  ray_brick_t * brick;
+  gfloat value;
+
+  i_brick.z = task;
+  for (i_brick.y=0; i_brick.y < rc->brick_dim[0].y; i_brick.y++) {
+    for (i_brick.x=0; i_brick.x < rc->brick_dim[0].x; i_brick.x++) {
+
+      /* trilinear samples in the brick can reach one voxel further out */
+      start.x = MAX(i_brick.x*RAY_CASTER_BRICK_SIZE-1, 0);
+      start.y = MAX(i_brick.y*RAY_CASTER_BRICK_SIZE-1, 0);
+      start.z = MAX(i_brick.z*RAY_CASTER_BRICK_SIZE-1, 0);
+      end.x = MIN((i_brick.x+1)*RAY_CASTER_BRICK_SIZE, rc->dim.x-1);
+      end.y = MIN((i_brick.y+1)*RAY_CASTER_BRICK_SIZE, rc->dim.y-1);
+      end.z = MIN((i_brick.z+1)*RAY_CASTER_BRICK_SIZE, rc->dim.z-1);
+
+      brick = &(rc->bricks[0][RAY_CASTER_BRICK_INDEX(rc, 0, i_brick.x, i_brick.y, i_brick.z)]);
+      brick->min = brick->max = RAY_CASTER_DENSITY(rc, start.x, start.y, start.z);
+      for (i.z=start.z; i.z <= end.z; i.z++)
+	for (i.y=start.y; i.y <= end.y; i.y++)
+	  for (i.x=start.x; i.x <= end.x; i.x++) {
+	    value = RAY_CASTER_DENSITY(rc, i.x, i.y, i.z);
+	    if (value < brick->min) brick->min = value;
+	    else if (value > brick->max) brick->max = value;
+	  }
+    }
+  }
+
+  return;
+}
+
+/* build the min/max brick tree, call after the density has been filled in */
+void ray_caster_calc_bricks(ray_caster_t * rc) {
+
+  gint level;
+  AmitkVoxel i_brick, i_child, start, end;
+  ray_brick_t * brick;
+  ray_brick_t * child;
+
+  g_return_if_fail(rc != NULL);
+
+  amitk_parallel_for(rc->brick_dim[0].z, calc_bricks_slab, rc);
+
+  /* the coarser levels come from the level below */
+  for (level=1; level < RAY_CASTER_BRICK_LEVELS; level++) {
+    for (i_brick.z=0; i_brick.z < rc->brick_dim[level].z; i_brick.z++)
+      for (i_brick.y=0; i_brick.y < rc->brick_dim[level].y; i_brick.y++)
+	for (i_brick.x=0; i_brick.x < rc->brick_dim[level].x; i_brick.x++) {
+	  start.x = i_brick.x*RAY_CASTER_BRICK_FANOUT;
+	  start.y = i_brick.y*RAY_CASTER_BRICK_FANOUT;
+	  start.z = i_brick.z*RAY_CASTER_BRICK_FANOUT;
+	  end.x = MIN(start.x+RAY_CASTER_BRICK_FANOUT, rc->brick_dim[level-1].x)-1;
+	  end.y = MIN(start.y+RAY_CASTER_BRICK_FANOUT, rc->brick_dim[level-1].y)-1;
+	  end.z = MIN(start.z+RAY_CASTER_BRICK_FANOUT, rc->brick_dim[level-1].z)-1;
+
+	  brick = &(rc->bricks[level][RAY_CASTER_BRICK_INDEX(rc, level, i_brick.x, i_brick.y, i_brick.z)]);
+	  *brick = rc->bricks[level-1][RAY_CASTER_BRICK_INDEX(rc, level-1, start.x, start.y, start.z)];
+	  for (i_child.z=start.z; i_child.z <= end.z; i_child.z++)
+	    for (i_child.y=start.y; i_child.y <= end.y; i_child.y++)
+	      for (i_child.x=start.x; i_child.x <= end.x; i_child.x++) {
+		child = &(rc->bricks[level-1][RAY_CASTER_BRICK_INDEX(rc, level-1, i_child.x, i_child.y, i_child.z)]);
+		brick->min = MIN(brick->min, child->min);
+		brick->max = MAX(brick->max, child->max);
+	      }
+	}
+  }
+
+  return;
+}
+
+
+
+/* marks which bricks can't contribute to the image with the view's
+   classification, so the rays can skip them.  This is cheap, so there's
+   no reason to reclassify the volume itself when the ramps change */
+void ray_caster_classify(ray_caster_t * rc, const ray_caster_view_t * view) {
+
+  gfloat * range_max = NULL; /* range_max[k][i] is the max of density_ramp[i..i+2^k-1] */
+  gfloat * gradient_prefix_max = NULL;
+  gint num_levels, k, i, n;
+  gint level;
+  gsize i_brick, num_bricks;
+  ray_brick_t * brick;
+  gint low, high, gradient;
+  gfloat bound;
+
+  g_return_if_fail(rc != NULL);
+
+  n = view->density_max+1;
+  for (num_levels=1; (1 << num_levels) <= n; num_levels++);
+
+  range_max = g_try_new(gfloat, num_levels*n);
+  gradient_prefix_max = g_try_new(gfloat, view->gradient_max+1);
+  if ((range_max == NULL) || (gradient_prefix_max == NULL)) {
+    /* just won't skip anything */
+    for (level=0; level < RAY_CASTER_BRICK_LEVELS; level++)
+      for (i_brick=0; i_brick < ((gsize) rc->brick_dim[level].x)*rc->brick_dim[level].y*rc->brick_dim[level].z; i_brick++)
+	rc->brick_empty[level][i_brick] = FALSE;
+    goto exit_strategy;
+  }
+
+  for (i=0; i<n; i++)
+    range_max[i] = view->density_ramp[i];
+  for (k=1; k < num_levels; k++)
+    for (i=0; i + (1 << k) <= n; i++)
+      range_max[k*n+i] = MAX(range_max[(k-1)*n+i], range_max[(k-1)*n+i+(1 << (k-1))]);
+
+  gradient_prefix_max[0] = view->gradient_ramp[0];
+  for (i=1; i <= view->gradient_max; i++)
+    gradient_prefix_max[i] = MAX(gradient_prefix_max[i-1], view->gradient_ramp[i]);
+
+  for (level=0; level < RAY_CASTER_BRICK_LEVELS; level++) {
+    num_bricks = ((gsize) rc->brick_dim[level].x)*rc->brick_dim[level].y*rc->brick_dim[level].z;
+    for (i_brick=0; i_brick < num_bricks; i_brick++) {
+      brick = &(rc->bricks[level][i_brick]);
+
+      /* the most opaque any sample in the brick could be.  Each component of the
+	 gradient of a trilinear interpolant is at most the density range */
+      low = CLAMP(floor(brick->min), 0, view->density_max);
+      high = CLAMP(ceil(brick->max), 0, view->density_max);
+      for (k=0; (1 << (k+1)) <= (high-low+1); k++);
+      gradient = CLAMP(ceil(sqrt(3.0)*(brick->max-brick->min)), 0, view->gradient_max);
+      bound = MAX(range_max[k*n+low], range_max[k*n+high-(1 << k)+1]) *
+	gradient_prefix_max[gradient];
+
+      rc->brick_empty[level][i_brick] = (bound <= 0.0) || (bound < view->min_voxel_opacity);
+    }
+  }
+
+ exit_strategy:
+  g_free(range_max);
+  g_free(gradient_prefix_max);
+
+  return;
+}
+
+
+
+/* everything the tile workers need */
+typedef struct {
+  const ray_caster_t * rc;
+  const ray_caster_view_t * view;
+  guchar * image;
+  gint image_size;
+  gint tiles_per_row;
+  AmitkPoint center; /* of the volume, in voxels */
+  AmitkPoint direction; /* of the rays, front to back */
+  AmitkPoint light;
+  gdouble max_dim;
+} ray_render_t;
+
+/* linearly interpolated lookup in one of the classification ramps */
+static inline gfloat ramp_lookup(const gfloat * ramp, const gfloat value, const gint max) {
+
+  gint i;
+
+  if (value <= 0.0) return ramp[0];
+  if (value >= max) return ramp[max];
+  i = (gint) value;
+  return ramp[i] + (value-i)*(ramp[i+1]-ramp[i]);
+}
+
+/* where along the ray it leaves the region that samples from the given
+   brick come from, the bricks on the edges extend out forever */
+static gdouble brick_exit(const ray_render_t * rr, const gint level,
+			  const AmitkVoxel i_brick, const AmitkPoint point) {
+
+  gint size = brick_size(level);
+  AmitkPoint low, high;
+  gdouble t, t_exit = G_MAXDOUBLE;
+
+  low.x = (i_brick.x == 0) ? -G_MAXDOUBLE : i_brick.x*size+0.5;
+  low.y = (i_brick.y == 0) ? -G_MAXDOUBLE : i_brick.y*size+0.5;
+  low.z = (i_brick.z == 0) ? -G_MAXDOUBLE : i_brick.z*size+0.5;
+  high.x = (i_brick.x == rr->rc->brick_dim[level].x-1) ? G_MAXDOUBLE : (i_brick.x+1)*size+0.5;
+  high.y = (i_brick.y == rr->rc->brick_dim[level].y-1) ? G_MAXDOUBLE : (i_brick.y+1)*size+0.5;
+  high.z = (i_brick.z == rr->rc->brick_dim[level].z-1) ? G_MAXDOUBLE : (i_brick.z+1)*size+0.5;
+
+  if (rr->direction.x > 0.0) t = (high.x-point.x)/rr->direction.x;
+  else if (rr->direction.x < 0.0) t = (low.x-point.x)/rr->direction.x;
+  else t = G_MAXDOUBLE;
+  t_exit = MIN(t_exit, t);
+
+  if (rr->direction.y > 0.0) t = (high.y-point.y)/rr->direction.y;
+  else if (rr->direction.y < 0.0) t = (low.y-point.y)/rr->direction.y;
+  else t = G_MAXDOUBLE;
+  t_exit = MIN(t_exit, t);
+
+  if (rr->direction.z > 0.0) t = (high.z-point.z)/rr->direction.z;
+  else if (rr->direction.z < 0.0) t = (low.z-point.z)/rr->direction.z;
+  else t = G_MAXDOUBLE;
+  t_exit = MIN(t_exit, t);
+
+  return t_exit;
+}
+
+/* clips the ray to the volume, returns FALSE if it misses */
+static gboolean clip_ray(const ray_render_t * rr, const AmitkPoint origin,
+			 gdouble * t_near, gdouble * t_far) {
+
+  AmitkAxis i_axis;
+  gdouble o, d, limit, t0, t1;
+
+  *t_near = -G_MAXDOUBLE;
+  *t_far = G_MAXDOUBLE;
+  for (i_axis=0; i_axis < AMITK_AXIS_NUM; i_axis++) {
+    o = point_get_component(origin, i_axis);
+    d = point_get_component(rr->direction, i_axis);
+    limit = voxel_get_dim(rr->rc->dim, i_axis);
+    if (d == 0.0) {
+      if ((o < 0.0) || (o > limit)) return FALSE;
+    } else {
+      t0 = (0.0-o)/d;
+      t1 = (limit-o)/d;
+      if (t0 > t1) { gdouble temp = t0; t0 = t1; t1 = temp; }
+      *t_near = MAX(*t_near, t0);
+      *t_far = MIN(*t_far, t1);
+    }
+  }
+
+  return (*t_near < *t_far);
+}
+
+/* casts the ray for one pixel, returns a value between 0 and 1 */
+static gfloat cast_ray(const ray_render_t * rr, const AmitkPoint origin) {
+
+  const ray_caster_t * rc = rr->rc;
+  const ray_caster_view_t * view = rr->view;
+  gdouble t, t_near, t_far;
+  AmitkPoint point;
+  AmitkVoxel i0, i1, i_brick;
+  gfloat fx, fy, fz;
+  gfloat c000, c100, c010, c110, c001, c101, c011, c111;
+  gfloat c00, c10, c01, c11, c0, c1;
+  gfloat density, opacity, shade, depth;
+  AmitkPoint gradient;
+  gdouble gradient_magnitude;
+  gfloat transparency = 1.0;
+  gfloat color = 0.0;
+  gint level;
+  gboolean skipped;
+
+  if (!clip_ray(rr, origin, &t_near, &t_far))
+    return 0.0;
+
+  /* keep the samples on planes a fixed distance from the center, so they
+     don't crawl through the volume as the view changes */
+  t = ceil(t_near/view->step)*view->step;
+
+  while (t < t_far) {
+    point.x = origin.x + t*rr->direction.x;
+    point.y = origin.y + t*rr->direction.y;
+    point.z = origin.z + t*rr->direction.z;
+
+    i0.x = CLAMP((gint) floor(point.x-0.5), 0, rc->dim.x-1);
+    i0.y = CLAMP((gint) floor(point.y-0.5), 0, rc->dim.y-1);
+    i0.z = CLAMP((gint) floor(point.z-0.5), 0, rc->dim.z-1);
+
+    /* skip over any empty bricks, coarsest first */
+    skipped = FALSE;
+    for (level=RAY_CASTER_BRICK_LEVELS-1; (level >= 0) && !skipped; level--) {
+      i_brick.x = i0.x/brick_size(level);
+      i_brick.y = i0.y/brick_size(level);
+      i_brick.z = i0.z/brick_size(level);
+      if (rc->brick_empty[level][RAY_CASTER_BRICK_INDEX(rc, level, i_brick.x, i_brick.y, i_brick.z)]) {
+	t_near = t + brick_exit(rr, level, i_brick, point);
+	t_near = ceil(t_near/view->step)*view->step;
+	t = (t_near > t) ? t_near : t+view->step;
+	skipped = TRUE;
+      }
+    }
+    if (skipped) continue;
+
+    /* trilinear interpolation, voxel centers are at +0.5 */
+    fx = point.x-0.5-floor(point.x-0.5);
+    fy = point.y-0.5-floor(point.y-0.5);
+    fz = point.z-0.5-floor(point.z-0.5);
+    if (point.x-0.5 < 0.0) fx = 0.0;
+    if (point.y-0.5 < 0.0) fy = 0.0;
+    if (point.z-0.5 < 0.0) fz = 0.0;
+    i1.x = MIN(i0.x+1, rc->dim.x-1);
+    i1.y = MIN(i0.y+1, rc->dim.y-1);
+    i1.z = MIN(i0.z+1, rc->dim.z-1);
+
+    c000 = RAY_CASTER_DENSITY(rc, i0.x, i0.y, i0.z);
+    c100 = RAY_CASTER_DENSITY(rc, i1.x, i0.y, i0.z);
+    c010 = RAY_CASTER_DENSITY(rc, i0.x, i1.y, i0.z);
+    c110 = RAY_CASTER_DENSITY(rc, i1.x, i1.y, i0.z);
+    c001 = RAY_CASTER_DENSITY(rc, i0.x, i0.y, i1.z);
+    c101 = RAY_CASTER_DENSITY(rc, i1.x, i0.y, i1.z);
+    c011 = RAY_CASTER_DENSITY(rc, i0.x, i1.y, i1.z);
+    c111 = RAY_CASTER_DENSITY(rc, i1.x, i1.y, i1.z);
+
+    c00 = c000 + fx*(c100-c000);
+    c10 = c010 + fx*(c110-c010);
+    c01 = c001 + fx*(c101-c001);
+    c11 = c011 + fx*(c111-c011);
+    c0 = c00 + fy*(c10-c00);
+    c1 = c01 + fy*(c11-c01);
+    density = c0 + fz*(c1-c0);
+
+    /* the gradient of the interpolant, from the same 8 voxels */
+    gradient.x =
+      (1.0-fz)*((1.0-fy)*(c100-c000) + fy*(c110-c010)) +
+      fz*((1.0-fy)*(c101-c001) + fy*(c111-c011));
+    gradient.y = (1.0-fz)*(c10-c00) + fz*(c11-c01);
+    gradient.z = c1-c0;
+    gradient_magnitude = POINT_MAGNITUDE(gradient);
+
+    opacity = ramp_lookup(view->density_ramp, density, view->density_max) *
+      ramp_lookup(view->gradient_ramp, gradient_magnitude, view->gradient_max);
+
+    if ((opacity > 0.0) && (opacity >= view->min_voxel_opacity)) {
+      /* the ramps are per voxel of distance, correct for longer steps */
+      if (view->step != 1.0)
+	opacity = 1.0-pow(1.0-opacity, view->step);
+
+      if (view->grayscale) {
+	shade = RAY_CASTER_AMBIENT + RAY_CASTER_SPECULAR;
+	if (gradient_magnitude > 0.0)
+	  shade += RAY_CASTER_DIFFUSE *
+	    fabs(POINT_DOT_PRODUCT(gradient, rr->light))/gradient_magnitude;
+	if (view->depth_cueing) {
+	  depth = CLAMP(0.5 + t/rr->max_dim, 0.0, 1.0);
+	  shade *= view->front_factor*exp(-view->depth_cueing_density*depth);
+	}
+	color += transparency*opacity*shade;
+      }
+      transparency *= (1.0-opacity);
+
+      /* early ray termination */
+      if ((1.0-transparency) >= view->max_ray_opacity)
+	break;
+    }
+
+    t += view->step;
+  }
+
+  return view->grayscale ? color : (1.0-transparency);
+}
+
+static void render_tile(gint task, gpointer data) {
+
+  const ray_render_t * rr = data;
+  const ray_caster_view_t * view = rr->view;
+  gint start_x, start_y, end_x, end_y;
+  gint x, y;
+  gdouble u, v;
+  AmitkPoint origin;
+  gfloat value;
+
+  if ((view->cancel != NULL) && g_atomic_int_get(view->cancel))
+    return;
+
+  start_x = (task % rr->tiles_per_row)*RAY_CASTER_TILE_SIZE;
+  start_y = (task / rr->tiles_per_row)*RAY_CASTER_TILE_SIZE;
+  end_x = MIN(start_x+RAY_CASTER_TILE_SIZE, rr->image_size);
+  end_y = MIN(start_y+RAY_CASTER_TILE_SIZE, rr->image_size);
+
+  for (y=start_y; y < end_y; y++) {
+    /* the image is centered on the volume, with the first row at the bottom */
+    v = (y+0.5-rr->image_size/2.0)/view->zoom;
+    for (x=start_x; x < end_x; x++) {
+      u = (x+0.5-rr->image_size/2.0)/view->zoom;
+      origin.x = rr->center.x + u*view->axes[AMITK_AXIS_X].x + v*view->axes[AMITK_AXIS_Y].x;
+      origin.y = rr->center.y + u*view->axes[AMITK_AXIS_X].y + v*view->axes[AMITK_AXIS_Y].y;
+      origin.z = rr->center.z + u*view->axes[AMITK_AXIS_X].z + v*view->axes[AMITK_AXIS_Y].z;
+
+      value = cast_ray(rr, origin)*view->density_max;
+      rr->image[x+y*rr->image_size] = CLAMP(value+0.5, 0.0, view->density_max);
+    }
+  }
+
+  return;
+}
+
+/* renders the volume into a square image of image_size pixels on a side,
+   laid out like the images volpack returns */
+void ray_caster_render(const ray_caster_t * rc,
+		       const ray_caster_view_t * view,
+		       guchar * image,
+		       const gint image_size) {
+
+  ray_render_t rr;
+  amide_real_t light_magnitude;
+
+  g_return_if_fail(rc != NULL);
+  g_return_if_fail(image != NULL);
+
+  rr.rc = rc;
+  rr.view = view;
+  rr.image = image;
+  rr.image_size = image_size;
+  rr.tiles_per_row = (image_size+RAY_CASTER_TILE_SIZE-1)/RAY_CASTER_TILE_SIZE;
+  rr.center.x = rc->dim.x/2.0;
+  rr.center.y = rc->dim.y/2.0;
+  rr.center.z = rc->dim.z/2.0;
+  rr.max_dim = POINT_MAX(rc->dim);
+
+  /* the viewer looks down the rotated z axis */
+  rr.direction = point_cmult(-1.0, view->axes[AMITK_AXIS_Z]);
+
+  /* the light is fixed relative to the viewer */
+  rr.light = point_add(point_add(point_cmult(RAY_CASTER_LIGHT_X, view->axes[AMITK_AXIS_X]),
+				 point_cmult(RAY_CASTER_LIGHT_Y, view->axes[AMITK_AXIS_Y])),
+		       point_cmult(RAY_CASTER_LIGHT_Z, view->axes[AMITK_AXIS_Z]));
+  light_magnitude = POINT_MAGNITUDE(rr.light);
+  rr.light = point_cmult(1.0/light_magnitude, rr.light);
+
+  amitk_parallel_for(rr.tiles_per_row*rr.tiles_per_row, render_tile, &rr);
+
+  return;
+}
+
+#endif /* AMIDE_LIBVOLPACK_SUPPORT */
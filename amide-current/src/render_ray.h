@@ -0,0 +1,93 @@
+/* render_ray.h
+ *
+ * Part of amide - Amide's a Medical Image Dataset Examiner
+ * Copyright (C) 2017 Andy Loening
+ *
+ * Author: Andy Loening <loening@alum.mit.edu>
+ */
+
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+  02111-1307, USA.
+*/
+
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+
+#ifndef __RENDER_RAY_H__
+#define __RENDER_RAY_H__
+
+/* header files that are always needed with this file */
+#include "amitk_point.h"
+
+/* ----------- defines ------------- */
+
+#define RAY_CASTER_BRICK_SIZE   8 /* voxels on a side of the smallest bricks */
+#define RAY_CASTER_BRICK_FANOUT 8 /* bricks on a side of a brick one level up */
+#define RAY_CASTER_BRICK_LEVELS 2
+#define RAY_CASTER_TILE_SIZE    32 /* pixels on a side of the image tiles handed to threads */
+
+/* ------------ structures ------------ */
+
+/* the range of densities in a brick, including the voxels just outside of
+   it that trilinear sampling inside of the brick can reach */
+typedef struct {
+  gfloat min;
+  gfloat max;
+} ray_brick_t;
+
+/* a software ray caster, used as an alternative to volpack.  The density
+   volume has the same layout as the volume handed to volpack, but is
+   kept as floats between 0 and RENDERING_DENSITY_MAX */
+typedef struct {
+  AmitkVoxel dim;
+  gfloat * density;
+
+  /* min/max brick tree for skipping empty space, level 0 is the finest */
+  AmitkVoxel brick_dim[RAY_CASTER_BRICK_LEVELS];
+  ray_brick_t * bricks[RAY_CASTER_BRICK_LEVELS];
+  gboolean * brick_empty[RAY_CASTER_BRICK_LEVELS]; /* from the last classification */
+} ray_caster_t;
+
+/* everything about how the volume gets rendered into an image */
+typedef struct {
+  AmitkAxes axes; /* the rotation, same as the matrix handed to volpack */
+  gdouble zoom; /* pixels per voxel */
+  gdouble step; /* voxels between samples along a ray, 1.0 like volpack */
+  gboolean grayscale; /* otherwise opacity */
+  const gfloat * density_ramp; /* opacity vs. density, RENDERING_DENSITY_MAX+1 entries */
+  const gfloat * gradient_ramp; /* opacity vs. gradient, RENDERING_GRADIENT_MAX+1 entries */
+  gint density_max;
+  gint gradient_max;
+  gfloat max_ray_opacity; /* rays stop once they get this opaque */
+  gfloat min_voxel_opacity; /* samples less opaque than this are ignored */
+  gboolean depth_cueing;
+  gdouble front_factor;
+  gdouble depth_cueing_density;
+  gint * cancel; /* if not NULL, tiles that haven't been started get skipped once it's set */
+} ray_caster_view_t;
+
+
+/* external functions */
+ray_caster_t * ray_caster_new(const AmitkVoxel dim);
+ray_caster_t * ray_caster_free(ray_caster_t * ray_caster);
+void ray_caster_calc_bricks(ray_caster_t * ray_caster);
+void ray_caster_classify(ray_caster_t * ray_caster, const ray_caster_view_t * view);
+void ray_caster_render(const ray_caster_t * ray_caster,
+		       const ray_caster_view_t * view,
+		       guchar * image,
+		       const gint image_size);
+
+#endif /* __RENDER_RAY_H__ */
+#endif /* AMIDE_LIBVOLPACK_SUPPORT */
@@ -43,6 +43,10 @@
 #define MAX_FWHM 100.0 /* mm */
 #define MIN_FWHM 0.0 /* mm */
 
+#define MIN_ITERATIONS 1
+#define MAX_ITERATIONS 100
+#define DEFAULT_ITERATIONS 10
+
 static const char * wizard_name = N_("Data Set Filtering Wizard");
 
 static const char * finish_page_text = 
@@ -50,10 +54,8 @@ N_("When the apply button is hit, a new data set will be created "
    "and placed into the study's tree, consisting of the appropriately "
    "filtered data\n");
 
-#ifdef AMIDE_LIBGSL_SUPPORT
 static const char * gaussian_filter_text = 
 N_("The Gaussian filter is an effective smoothing filter");
-#endif
 
 
 static const char * median_3d_filter_text = 
@@ -71,11 +73,20 @@ N_("Median filters work relatively well at preserving edges while\n"
    "determining the median will be of the given kernel size, and the\n"
    "data set will be filtered 3x (once for each direction).");
 
-#ifndef AMIDE_LIBGSL_SUPPORT
-static const char *no_libgsl_text =
-N_("This filter requires support from the GNU Scientific Library (GSL).\n"
-   "This version of AMIDE has not been compiled with GSL support enabled.");
-#endif
+static const char * bilateral_filter_text = 
+N_("The bilateral filter smooths like a Gaussian filter, but weights\n"
+   "each neighbor by how close its value is to the center voxel, so\n"
+   "edges are preserved.\n"
+   "\n"
+   "Differences in value much larger than the edge scale (given as a\n"
+   "FWHM in the data set's units) are not smoothed across.");
+
+static const char * anisotropic_diffusion_filter_text = 
+N_("Perona-Malik anisotropic diffusion iteratively smooths the data\n"
+   "set within regions, while leaving edges larger than the edge\n"
+   "threshold intact.\n"
+   "\n"
+   "More iterations give more smoothing.");
 
 
 typedef enum {
@@ -83,6 +94,8 @@ typedef enum {
   GAUSSIAN_FILTER_PAGE,
   MEDIAN_LINEAR_FILTER_PAGE,
   MEDIAN_3D_FILTER_PAGE,
+  BILATERAL_FILTER_PAGE,
+  ANISOTROPIC_DIFFUSION_FILTER_PAGE,
   CONCLUSION_PAGE,
   NUM_PAGES
 } which_page_t;
@@ -92,8 +105,10 @@ typedef struct tb_filter_t {
   GtkWidget * dialog;
 
   AmitkFilter filter;
-  gint kernel_size;
-  amide_real_t fwhm;
+  gint kernel_size[AMITK_FILTER_NUM]; /* each filter page has its own settings */
+  amide_real_t fwhm[AMITK_FILTER_NUM];
+  amide_data_t edge_scale;
+  gint iterations;
 
   AmitkDataSet * data_set;
   AmitkStudy * study;
@@ -108,6 +123,8 @@ typedef struct tb_filter_t {
 static void filter_cb(GtkWidget * widget, gpointer data);
 static void kernel_size_spinner_cb(GtkSpinButton * spin_button, gpointer data);
 static void fwhm_spinner_cb(GtkSpinButton * spin_button, gpointer data);
+static void edge_scale_spinner_cb(GtkSpinButton * spin_button, gpointer data);
+static void iterations_spinner_cb(GtkSpinButton * spin_button, gpointer data);
 
 static void apply_cb(GtkAssistant * assistant, gpointer data);
 static void close_cb(GtkAssistant * assistant, gpointer data);
@@ -131,18 +148,20 @@ static void filter_cb(GtkWidget * widget, gpointer data) {
 static void kernel_size_spinner_cb(GtkSpinButton * spin_button, gpointer data) {
 
   tb_filter_t * tb_filter = data;
+  AmitkFilter filter;
   gint int_value;
 
+  filter = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(spin_button), "which_filter"));
   int_value = gtk_spin_button_get_value_as_int(spin_button);
   
   if (!(int_value & 0x1)) {
     int_value++; /* make it odd */
   }
   
-  tb_filter->kernel_size = int_value;
+  tb_filter->kernel_size[filter] = int_value;
   g_signal_handlers_block_by_func(G_OBJECT(spin_button),
 				  G_CALLBACK(kernel_size_spinner_cb), tb_filter);
-  gtk_spin_button_set_value(spin_button, tb_filter->kernel_size); 
+  gtk_spin_button_set_value(spin_button, tb_filter->kernel_size[filter]); 
   g_signal_handlers_unblock_by_func(G_OBJECT(spin_button),
 				    G_CALLBACK(kernel_size_spinner_cb), tb_filter);
 
@@ -152,8 +171,10 @@ static void kernel_size_spinner_cb(GtkSpinButton * spin_button, gpointer data) {
 static void fwhm_spinner_cb(GtkSpinButton * spin_button, gpointer data) {
 
   tb_filter_t * tb_filter = data;
+  AmitkFilter filter;
   amide_real_t value;
 
+  filter = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(spin_button), "which_filter"));
   value = gtk_spin_button_get_value(spin_button);
 
   if (value < MIN_FWHM)
@@ -161,16 +182,46 @@ static void fwhm_spinner_cb(GtkSpinButton * spin_button, gpointer data) {
   else if (value > MAX_FWHM) 
     value = MAX_FWHM;
   
-  tb_filter->fwhm = value;
+  tb_filter->fwhm[filter] = value;
   g_signal_handlers_block_by_func(G_OBJECT(spin_button),
 				  G_CALLBACK(fwhm_spinner_cb), tb_filter);
-  gtk_spin_button_set_value(spin_button, tb_filter->fwhm);
+  gtk_spin_button_set_value(spin_button, tb_filter->fwhm[filter]);
   g_signal_handlers_unblock_by_func(G_OBJECT(spin_button),
 				    G_CALLBACK(fwhm_spinner_cb), tb_filter);
 
   return;
 }
 
+static void edge_scale_spinner_cb(GtkSpinButton * spin_button, gpointer data) {
+
+  tb_filter_t * tb_filter = data;
+  amide_data_t value;
+
+  value = gtk_spin_button_get_value(spin_button);
+
+  if (value < 0.0) {
+    value = 0.0;
+    g_signal_handlers_block_by_func(G_OBJECT(spin_button),
+				    G_CALLBACK(edge_scale_spinner_cb), tb_filter);
+    gtk_spin_button_set_value(spin_button, value);
+    g_signal_handlers_unblock_by_func(G_OBJECT(spin_button),
+				      G_CALLBACK(edge_scale_spinner_cb), tb_filter);
+  }
+  
+  tb_filter->edge_scale = value;
+
+  return;
+}
+
+static void iterations_spinner_cb(GtkSpinButton * spin_button, gpointer data) {
+
+  tb_filter_t * tb_filter = data;
+
+  tb_filter->iterations = gtk_spin_button_get_value_as_int(spin_button);
+
+  return;
+}
+
 
 
 
@@ -186,8 +237,10 @@ static void apply_cb(GtkAssistant * assistant, gpointer data) {
   /* generate the new data set */
   filtered = amitk_data_set_get_filtered(tb_filter->data_set, 
   					 tb_filter->filter,
-  					 tb_filter->kernel_size,
-  					 tb_filter->fwhm,
+  					 tb_filter->kernel_size[tb_filter->filter],
+  					 tb_filter->fwhm[tb_filter->filter],
+					 tb_filter->edge_scale,
+					 tb_filter->iterations,
 					 amitk_progress_dialog_update,
 					 tb_filter->progress_dialog);
 
@@ -225,6 +278,8 @@ static gint forward_page_function (gint current_page, gpointer data) {
   case GAUSSIAN_FILTER_PAGE:
   case MEDIAN_LINEAR_FILTER_PAGE:
   case MEDIAN_3D_FILTER_PAGE:
+  case BILATERAL_FILTER_PAGE:
+  case ANISOTROPIC_DIFFUSION_FILTER_PAGE:
     return CONCLUSION_PAGE;
     break;
   default:
@@ -276,6 +331,7 @@ static tb_filter_t * tb_filter_free(tb_filter_t * tb_filter) {
 static tb_filter_t * tb_filter_init(void) {
 
   tb_filter_t * tb_filter;
+  AmitkFilter i_filter;
 
   /* alloc space for the data structure for passing ui info */
   if ((tb_filter = g_try_new(tb_filter_t,1)) == NULL) {
@@ -287,8 +343,13 @@ static tb_filter_t * tb_filter_init(void) {
   tb_filter->filter = AMITK_FILTER_GAUSSIAN; /* default filter */
   tb_filter->dialog = NULL;
   tb_filter->study = NULL;
-  tb_filter->kernel_size=3;
-  tb_filter->fwhm = 1.0;
+  for (i_filter=0; i_filter<AMITK_FILTER_NUM; i_filter++) {
+    tb_filter->kernel_size[i_filter] = DEFAULT_MEDIAN_FILTER_SIZE;
+    tb_filter->fwhm[i_filter] = 1.0;
+  }
+  tb_filter->kernel_size[AMITK_FILTER_GAUSSIAN] = DEFAULT_GAUSSIAN_FILTER_SIZE;
+  tb_filter->edge_scale = 1.0;
+  tb_filter->iterations = DEFAULT_ITERATIONS;
 
   return tb_filter;
 }
@@ -309,6 +370,7 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
     
   table_row=0;
   table_column=0;
+  i_filter = i_page-GAUSSIAN_FILTER_PAGE; /* filter for the filter pages */
       
   switch(i_page) {
   case PICK_FILTER_PAGE:
@@ -330,9 +392,6 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
     
     break;
   case GAUSSIAN_FILTER_PAGE:
-#ifdef AMIDE_LIBGSL_SUPPORT
-    tb_filter->kernel_size = DEFAULT_GAUSSIAN_FILTER_SIZE;
-    
     label = gtk_label_new(_(gaussian_filter_text));
     gtk_table_attach(GTK_TABLE(table), label, 
 		     table_column,table_column+2, table_row,table_row+1,
@@ -349,7 +408,8 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
 						  MAX_FIR_FILTER_SIZE,2);
     gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_button),0);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), 
-			      tb_filter->kernel_size);
+			      tb_filter->kernel_size[i_filter]);
+    g_object_set_data(G_OBJECT(spin_button), "which_filter", GINT_TO_POINTER(i_filter));
     g_signal_connect(G_OBJECT(spin_button), "value_changed",  
 		     G_CALLBACK(kernel_size_spinner_cb), tb_filter);
     gtk_table_attach(GTK_TABLE(table), spin_button, 
@@ -364,7 +424,8 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
     
     spin_button =  gtk_spin_button_new_with_range(MIN_FWHM, MAX_FWHM,0.2);
     gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(spin_button), FALSE);
-    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), tb_filter->fwhm);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), tb_filter->fwhm[i_filter]);
+    g_object_set_data(G_OBJECT(spin_button), "which_filter", GINT_TO_POINTER(i_filter));
     g_signal_connect(G_OBJECT(spin_button), "value_changed",  
 		     G_CALLBACK(fwhm_spinner_cb), tb_filter);
     g_signal_connect(G_OBJECT(spin_button), "output",
@@ -372,18 +433,9 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
     gtk_table_attach(GTK_TABLE(table), spin_button, 
 		     table_column+1,table_column+2, table_row,table_row+1,
 		     FALSE,FALSE, X_PADDING, Y_PADDING);
-#else /* no libgsl support */
-    label = gtk_label_new(_(no_libgsl_text));
-    gtk_table_attach(GTK_TABLE(table), label, 
-		     table_column,table_column+2, table_row,table_row+1,
-		     FALSE,FALSE, X_PADDING, Y_PADDING);
-    table_row++;
-#endif
     break;
   case MEDIAN_3D_FILTER_PAGE:
   case MEDIAN_LINEAR_FILTER_PAGE:
-    tb_filter->kernel_size = DEFAULT_MEDIAN_FILTER_SIZE;
-    
     label = gtk_label_new((i_page == MEDIAN_3D_FILTER_PAGE) ? _(median_3d_filter_text) : _(median_linear_filter_text));
     gtk_table_attach(GTK_TABLE(table), label, 
 		     table_column,table_column+2, table_row,table_row+1,
@@ -400,7 +452,8 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
 						  MAX_NONLINEAR_FILTER_SIZE,2);
     gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_button),0);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), 
-			      tb_filter->kernel_size);
+			      tb_filter->kernel_size[i_filter]);
+    g_object_set_data(G_OBJECT(spin_button), "which_filter", GINT_TO_POINTER(i_filter));
     g_signal_connect(G_OBJECT(spin_button), "value_changed",  
 		     G_CALLBACK(kernel_size_spinner_cb), tb_filter);
     gtk_table_attach(GTK_TABLE(table), spin_button, 
@@ -408,6 +461,86 @@ static GtkWidget * create_page(tb_filter_t * tb_filter, which_page_t i_page) {
 		     FALSE,FALSE, X_PADDING, Y_PADDING);
     table_row++;
     break;
+  case BILATERAL_FILTER_PAGE:
+  case ANISOTROPIC_DIFFUSION_FILTER_PAGE:
+    label = gtk_label_new((i_page == BILATERAL_FILTER_PAGE) ? _(bilateral_filter_text) : _(anisotropic_diffusion_filter_text));
+    gtk_table_attach(GTK_TABLE(table), label, 
+		     table_column,table_column+2, table_row,table_row+1,
+		     FALSE,FALSE, X_PADDING, Y_PADDING);
+    table_row++;
+
+    if (i_page == BILATERAL_FILTER_PAGE) {
+      /* the kernel selection */
+      label = gtk_label_new(_("Kernel Size"));
+      gtk_table_attach(GTK_TABLE(table), label, 
+		       table_column,table_column+1, table_row,table_row+1,
+		       FALSE,FALSE, X_PADDING, Y_PADDING);
+    
+      spin_button =  gtk_spin_button_new_with_range(MIN_NONLINEAR_FILTER_SIZE, 
+						    MAX_NONLINEAR_FILTER_SIZE,2);
+      gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_button),0);
+      gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), 
+				tb_filter->kernel_size[i_filter]);
+      g_object_set_data(G_OBJECT(spin_button), "which_filter", GINT_TO_POINTER(i_filter));
+      g_signal_connect(G_OBJECT(spin_button), "value_changed",  
+		       G_CALLBACK(kernel_size_spinner_cb), tb_filter);
+      gtk_table_attach(GTK_TABLE(table), spin_button, 
+		       table_column+1,table_column+2, table_row,table_row+1,
+		       FALSE,FALSE, X_PADDING, Y_PADDING);
+      table_row++;
+
+      label = gtk_label_new(_("FWHM (mm)"));
+      gtk_table_attach(GTK_TABLE(table), label, 
+		       table_column,table_column+1, table_row,table_row+1,
+		       FALSE,FALSE, X_PADDING, Y_PADDING);
+    
+      spin_button =  gtk_spin_button_new_with_range(MIN_FWHM, MAX_FWHM,0.2);
+      gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(spin_button), FALSE);
+      gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), tb_filter->fwhm[i_filter]);
+      g_object_set_data(G_OBJECT(spin_button), "which_filter", GINT_TO_POINTER(i_filter));
+      g_signal_connect(G_OBJECT(spin_button), "value_changed",  
+		       G_CALLBACK(fwhm_spinner_cb), tb_filter);
+      g_signal_connect(G_OBJECT(spin_button), "output",
+		       G_CALLBACK(amitk_spin_button_scientific_output), NULL);
+      gtk_table_attach(GTK_TABLE(table), spin_button, 
+		       table_column+1,table_column+2, table_row,table_row+1,
+		       FALSE,FALSE, X_PADDING, Y_PADDING);
+      table_row++;
+    } else {
+      label = gtk_label_new(_("Iterations"));
+      gtk_table_attach(GTK_TABLE(table), label, 
+		       table_column,table_column+1, table_row,table_row+1,
+		       FALSE,FALSE, X_PADDING, Y_PADDING);
+    
+      spin_button =  gtk_spin_button_new_with_range(MIN_ITERATIONS, MAX_ITERATIONS,1);
+      gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_button),0);
+      gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), tb_filter->iterations);
+      g_signal_connect(G_OBJECT(spin_button), "value_changed",  
+		       G_CALLBACK(iterations_spinner_cb), tb_filter);
+      gtk_table_attach(GTK_TABLE(table), spin_button, 
+		       table_column+1,table_column+2, table_row,table_row+1,
+		       FALSE,FALSE, X_PADDING, Y_PADDING);
+      table_row++;
+    }
+
+    label = gtk_label_new((i_page == BILATERAL_FILTER_PAGE) ? _("Edge Scale") : _("Edge Threshold"));
+    gtk_table_attach(GTK_TABLE(table), label, 
+		     table_column,table_column+1, table_row,table_row+1,
+		     FALSE,FALSE, X_PADDING, Y_PADDING);
+    
+    spin_button =  gtk_spin_button_new_with_range(0.0, G_MAXDOUBLE, 
+						  tb_filter->edge_scale/10.0);
+    gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(spin_button), FALSE);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), tb_filter->edge_scale);
+    g_signal_connect(G_OBJECT(spin_button), "value_changed",  
+		     G_CALLBACK(edge_scale_spinner_cb), tb_filter);
+    g_signal_connect(G_OBJECT(spin_button), "output",
+		     G_CALLBACK(amitk_spin_button_scientific_output), NULL);
+    gtk_table_attach(GTK_TABLE(table), spin_button, 
+		     table_column+1,table_column+2, table_row,table_row+1,
+		     FALSE,FALSE, X_PADDING, Y_PADDING);
+    table_row++;
+    break;
   default:
     table = NULL;
     g_error("unhandled case in %s at line %d\n", __FILE__, __LINE__);
@@ -435,7 +568,13 @@ void tb_filter(AmitkStudy * study, AmitkDataSet * active_ds, GtkWindow * parent)
   tb_filter->data_set = amitk_object_ref(active_ds);
 
   /* take a guess at a good fwhm */
-  tb_filter->fwhm = point_min_dim(AMITK_DATA_SET_VOXEL_SIZE(tb_filter->data_set));
+  tb_filter->fwhm[AMITK_FILTER_GAUSSIAN] = point_min_dim(AMITK_DATA_SET_VOXEL_SIZE(tb_filter->data_set));
+  tb_filter->fwhm[AMITK_FILTER_BILATERAL] = tb_filter->fwhm[AMITK_FILTER_GAUSSIAN];
+
+  /* and at an edge size, a tenth of the data set's range */
+  tb_filter->edge_scale = (amitk_data_set_get_global_max(tb_filter->data_set) -
+			   amitk_data_set_get_global_min(tb_filter->data_set))/10.0;
+  if (tb_filter->edge_scale <= 0.0) tb_filter->edge_scale = 1.0;
 
   tb_filter->dialog = gtk_assistant_new();
   gtk_window_set_transient_for(GTK_WINDOW(tb_filter->dialog), parent);
@@ -476,10 +615,6 @@ void tb_filter(AmitkStudy * study, AmitkDataSet * active_ds, GtkWindow * parent)
   }
   g_object_unref(logo);
 
-#ifndef AMIDE_LIBGSL_SUPPORT
-  gtk_assistant_set_page_complete(GTK_ASSISTANT(tb_filter->dialog), tb_filter->page[GAUSSIAN_FILTER_PAGE], FALSE);
-#endif
-
   gtk_widget_show_all(tb_filter->dialog);
 
   return;
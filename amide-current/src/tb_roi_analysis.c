@@ -178,6 +178,30 @@ static void export_data(tb_roi_analysis_t * tb_roi_analysis, gboolean raw_data)
   return;
 }
 
+typedef struct {
+  FILE * file_pointer;
+  AmitkDataSet * data_set;
+} export_raw_t;
+
+/* writes out a voxel of an roi, the analyses themselves don't keep the values around */
+static void export_raw_voxel(AmitkVoxel ds_voxel,
+			     amide_data_t value,
+			     amide_real_t voxel_fraction,
+			     gpointer data) {
+
+  export_raw_t * export = data;
+  AmitkPoint location;
+
+  if (voxel_fraction > 0.0) {
+    VOXEL_TO_POINT(ds_voxel, AMITK_DATA_SET_VOXEL_SIZE(export->data_set),location);
+    location = amitk_space_s2b(AMITK_SPACE(export->data_set), location);
+    fprintf(export->file_pointer, "%12g\t%12g\t%12g\t%12g\t%12g\n", 
+	    value, voxel_fraction, location.x, location.y, location.z);
+  }
+
+  return;
+}
+
 static void export_analyses(const gchar * save_filename, analysis_roi_t * roi_analyses, gboolean raw_data) {
 
   FILE * file_pointer;
@@ -190,8 +214,7 @@ static void export_analyses(const gchar * save_filename, analysis_roi_t * roi_an
   guint i;
   amide_real_t voxel_volume;
   gboolean title_printed;
-  AmitkPoint location;
-  analysis_element_t * element;
+  export_raw_t export;
 
   /* sanity checks */
   g_return_if_fail(save_filename != NULL);
@@ -318,12 +341,9 @@ static void export_analyses(const gchar * save_filename, analysis_roi_t * roi_an
 	  } else { /* raw data */
 	    fprintf(file_pointer, "#   Frame %d, Gate %d, Gate Time %5.3f\n", frame, gate,gate_analyses->gate_time);
 	    fprintf(file_pointer, "#      Value\t      Weight\t      X (mm)\t      Y (mm)\t      Z (mm)\n");
-	    for (i=0; i < gate_analyses->data_array->len; i++) {
-	      element = g_ptr_array_index(gate_analyses->data_array, i);
-	      VOXEL_TO_POINT(element->ds_voxel, AMITK_DATA_SET_VOXEL_SIZE(volume_analyses->data_set),location);
-	      location = amitk_space_s2b(AMITK_SPACE(volume_analyses->data_set), location);
-	      fprintf(file_pointer, "%12g\t%12g\t%12g\t%12g\t%12g\n", element->value, element->weight, location.x, location.y, location.z);
-	    }
+	    export.file_pointer = file_pointer;
+	    export.data_set = volume_analyses->data_set;
+	    analysis_volume_foreach_voxel(volume_analyses, frame, gate, export_raw_voxel, &export);
 	  }
 
 	  gate_analyses = gate_analyses->next_gate_analysis;
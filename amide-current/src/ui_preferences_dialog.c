@@ -62,7 +62,15 @@ static void threshold_style_cb(GtkWidget * widget, gpointer data);
 
 static void warnings_to_console_cb(GtkWidget * widget, gpointer data);
 static void save_on_exit_cb(GtkWidget * widget, gpointer data);
+#ifdef AMIDE_ZLIB_SUPPORT
+static void compress_raw_data_cb(GtkWidget * widget, gpointer data);
+#endif
 static void which_default_directory_cb(GtkWidget * widget, gpointer data);
+static void slice_cache_size_cb(GtkWidget * widget, gpointer data);
+static void frame_store_size_cb(GtkWidget * widget, gpointer data);
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+static void rendering_cache_size_cb(GtkWidget * widget, gpointer data);
+#endif
 static void default_directory_cb(GtkWidget * fc, gpointer data);
 static void response_cb (GtkDialog * dialog, gint response_id, gpointer data);
 static gboolean delete_event_cb(GtkWidget* widget, GdkEvent * event, gpointer preferences);
@@ -210,6 +218,46 @@ static void save_on_exit_cb(GtkWidget * widget, gpointer data) {
   return;
 }
 
+#ifdef AMIDE_ZLIB_SUPPORT
+static void compress_raw_data_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_compress_raw_data(ui_study->preferences, 
+					  gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+
+  return;
+}
+#endif
+
+static void slice_cache_size_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_slice_cache_size(ui_study->preferences, 
+					 gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(widget)));
+
+  return;
+}
+
+static void frame_store_size_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_frame_store_size(ui_study->preferences, 
+					 gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(widget)));
+
+  return;
+}
+
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+static void rendering_cache_size_cb(GtkWidget * widget, gpointer data) {
+
+  ui_study_t * ui_study = data;
+  amitk_preferences_set_rendering_cache_size(ui_study->preferences, 
+					     gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(widget)));
+
+  return;
+}
+#endif
+
 static void which_default_directory_cb(GtkWidget * widget, gpointer data) {
 
   ui_study_t * ui_study = data;
@@ -289,6 +337,7 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
   GtkWidget * packing_table;
   GtkWidget * label;
   GtkWidget * check_button;
+  GtkWidget * spin_button;
   GtkWidget * notebook;
   guint table_row;
 
@@ -545,7 +594,7 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
 
 
   /* start making the widgets for this dialog box */
-  packing_table = gtk_table_new(4,5,FALSE);
+  packing_table = gtk_table_new(7,5,FALSE);
   label = gtk_label_new(_("Miscellaneous"));
   table_row=0;
   gtk_notebook_append_page(GTK_NOTEBOOK(notebook), packing_table, label);
@@ -580,6 +629,23 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
   table_row++;
 
 
+#ifdef AMIDE_ZLIB_SUPPORT
+  label = gtk_label_new(_("Compress Raw Data when Saving:"));
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  check_button = gtk_check_button_new();
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_button), 
+			       AMITK_PREFERENCES_COMPRESS_RAW_DATA(ui_study->preferences));
+  g_signal_connect(G_OBJECT(check_button), "toggled", G_CALLBACK(compress_raw_data_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), check_button, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+#endif
+
+
   label = gtk_label_new(_("Which Default Directory:"));
   gtk_table_attach(GTK_TABLE(packing_table), label, 
 		   0,1, table_row, table_row+1,
@@ -618,6 +684,58 @@ void ui_preferences_dialog_create(ui_study_t * ui_study) {
 
   table_row++;
 
+
+  label = gtk_label_new(_("Slice Cache Size (MB):"));
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  spin_button = gtk_spin_button_new_with_range(AMITK_PREFERENCES_MIN_SLICE_CACHE_SIZE,
+					       AMITK_PREFERENCES_MAX_SLICE_CACHE_SIZE, 8.0);
+  gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_button), 0);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), 
+			    AMITK_PREFERENCES_SLICE_CACHE_SIZE(ui_study->preferences));
+  g_signal_connect(G_OBJECT(spin_button), "value_changed", G_CALLBACK(slice_cache_size_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), spin_button, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+
+
+  label = gtk_label_new(_("Frame Store Size (MB):"));
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  spin_button = gtk_spin_button_new_with_range(AMITK_PREFERENCES_MIN_FRAME_STORE_SIZE,
+					       AMITK_PREFERENCES_MAX_FRAME_STORE_SIZE, 64.0);
+  gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_button), 0);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), 
+			    AMITK_PREFERENCES_FRAME_STORE_SIZE(ui_study->preferences));
+  g_signal_connect(G_OBJECT(spin_button), "value_changed", G_CALLBACK(frame_store_size_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), spin_button, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+
+#ifdef AMIDE_LIBVOLPACK_SUPPORT
+  label = gtk_label_new(_("Rendering Cache Size (MB, 0 = automatic):"));
+  gtk_table_attach(GTK_TABLE(packing_table), label, 
+		   0,1, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+
+  spin_button = gtk_spin_button_new_with_range(AMITK_PREFERENCES_MIN_RENDERING_CACHE_SIZE,
+					       AMITK_PREFERENCES_MAX_RENDERING_CACHE_SIZE, 64.0);
+  gtk_spin_button_set_digits(GTK_SPIN_BUTTON(spin_button), 0);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(spin_button), 
+			    AMITK_PREFERENCES_RENDERING_CACHE_SIZE(ui_study->preferences));
+  g_signal_connect(G_OBJECT(spin_button), "value_changed", G_CALLBACK(rendering_cache_size_cb), ui_study);
+  gtk_table_attach(GTK_TABLE(packing_table), spin_button, 
+		   1,2, table_row, table_row+1,
+		   GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+#endif
+
   gtk_widget_show_all(packing_table);
 
   /* and show all our widgets */
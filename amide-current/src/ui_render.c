@@ -58,10 +58,25 @@ static void movie_cb(GtkAction * action, gpointer data);
 #endif
 static gboolean delete_event_cb(GtkWidget* widget, GdkEvent * event, gpointer data);
 static void close_cb(GtkAction * action, gpointer data);
+static void add_update(ui_render_t * ui_render, gint refinement);
+static void add_interactive_update(ui_render_t * ui_render);
+static gboolean refine_cb(gpointer data);
+static gboolean refine_done_cb(gpointer data);
+static void refine_start(ui_render_t * ui_render, gint refinement);
+static void refine_abandon(ui_render_t * ui_render);
+static void rotate_renderings(ui_render_t * ui_render, AmitkAxis axis, gdouble angle);
+static void reset_renderings_rotation(ui_render_t * ui_render);
+
+/* a rotation held back while a refinement is being rendered */
+typedef struct {
+  AmitkAxis axis;
+  gdouble angle;
+} pending_rotation_t;
 
 
 static void read_render_preferences(gboolean * strip_highs, gboolean * optimize_renderings,
-				    gboolean * initially_no_gradient_opacity);
+				    gboolean * initially_no_gradient_opacity,
+				    rendering_engine_t * engine);
 static ui_render_t * ui_render_init(GtkWindow * window, GtkWidget *window_vbox, AmitkStudy * study, GList * selected_objects, AmitkPreferences * preferences);
 static ui_render_t * ui_render_free(ui_render_t * ui_render);
 
@@ -180,6 +195,7 @@ static gboolean canvas_event_cb(GtkWidget* widget,  GdkEvent * event, gpointer d
     case GDK_MOTION_NOTIFY:
       if (dragging && (event->motion.state & (GDK_BUTTON1_MASK | GDK_BUTTON2_MASK))) {
 
+	ui_render_stop_refinement(ui_render);
 	if (event->motion.state & GDK_BUTTON1_MASK) {
 	  diff_cpoint = canvas_point_sub(initial_cpoint, canvas_cpoint);
 	  theta.y = M_PI * diff_cpoint.x / dim;
@@ -193,10 +209,10 @@ static gboolean canvas_event_cb(GtkWidget* widget,  GdkEvent * event, gpointer d
 				       amitk_space_get_axis(ui_render->box_space, AMITK_AXIS_Y),
 				       theta.y, zero_point);
 
-	  renderings_set_rotation(ui_render->renderings, AMITK_AXIS_Y, prev_theta.y);
-	  renderings_set_rotation(ui_render->renderings, AMITK_AXIS_X, -prev_theta.x);
-	  renderings_set_rotation(ui_render->renderings, AMITK_AXIS_X, theta.x);
-	  renderings_set_rotation(ui_render->renderings, AMITK_AXIS_Y, -theta.y);
+	  rotate_renderings(ui_render, AMITK_AXIS_Y, prev_theta.y);
+	  rotate_renderings(ui_render, AMITK_AXIS_X, -prev_theta.x);
+	  rotate_renderings(ui_render, AMITK_AXIS_X, theta.x);
+	  rotate_renderings(ui_render, AMITK_AXIS_Y, -theta.y);
 	} else {/* button 2 */
 	  temp_cpoint1 = canvas_point_sub(initial_cpoint,center_cpoint);
 	  temp_cpoint2 = canvas_point_sub(canvas_cpoint,center_cpoint);
@@ -212,8 +228,8 @@ static gboolean canvas_event_cb(GtkWidget* widget,  GdkEvent * event, gpointer d
 				       amitk_space_get_axis(ui_render->box_space, AMITK_AXIS_Z),
 				       -theta.z, zero_point);
 
-	  renderings_set_rotation(ui_render->renderings, AMITK_AXIS_Z, -prev_theta.z);
-	  renderings_set_rotation(ui_render->renderings, AMITK_AXIS_Z, theta.z);
+	  rotate_renderings(ui_render, AMITK_AXIS_Z, -prev_theta.z);
+	  rotate_renderings(ui_render, AMITK_AXIS_Z, theta.z);
 	}
 	/* recalculate the offset */
 	temp_point.x = temp_point.y = temp_point.z = -dim/2.0;
@@ -250,7 +266,9 @@ static gboolean canvas_event_cb(GtkWidget* widget,  GdkEvent * event, gpointer d
 	for (i=0; i<8; i++)
 	  box_point[i] = amitk_space_s2b(ui_render->box_space, box_point[i]);
 
-	if (ui_render->update_without_release) 
+	if (ui_render->progressive)
+	  add_interactive_update(ui_render);
+	else if (ui_render->update_without_release) 
 	  ui_render_add_update(ui_render); 
 
 	prev_theta = theta;
@@ -267,8 +285,8 @@ static gboolean canvas_event_cb(GtkWidget* widget,  GdkEvent * event, gpointer d
 	for (i=0; i<8; i++)
 	  gtk_object_destroy(GTK_OBJECT(rotation_box[i]));
 
-	/* render now if appropriate*/
-	if (!ui_render->update_without_release) 
+	/* render now if appropriate, progressive updates are already refining */
+	if (!ui_render->update_without_release && !ui_render->progressive) 
 	  ui_render_add_update(ui_render); 
 
       }
@@ -299,10 +317,14 @@ static void change_zoom_cb(GtkWidget * widget, gpointer data) {
     return;
   if (temp_val > 10) /* 10x zoom seems like quite a bit... */
     return;
+
+  if (ui_render_defer_change(ui_render, change_zoom_cb, widget, data))
+    return;
   
   /* set the zoom */
   if (!REAL_EQUAL(ui_render->zoom, temp_val)) {
     ui_render->zoom = temp_val;
+    ui_render_stop_refinement(ui_render);
     renderings_set_zoom(ui_render->renderings, ui_render->zoom);
     
     /* do updating */
@@ -327,10 +349,11 @@ static void rotate_cb(GtkAdjustment * adjustment, gpointer data) {
   rot = (adjustment->value/180.0)*M_PI; /* get rotation in radians */
 
   /* update the rotation values */
-  renderings_set_rotation(ui_render->renderings, i_axis, rot);
+  ui_render_stop_refinement(ui_render);
+  rotate_renderings(ui_render, i_axis, rot);
 
   /* render now if appropriate*/
-  ui_render_add_update(ui_render); 
+  add_interactive_update(ui_render); 
 
   /* return adjustment back to normal */
   adjustment->value = 0.0;
@@ -344,7 +367,8 @@ static void reset_axis_pressed_cb(GtkWidget * widget, gpointer data) {
   ui_render_t * ui_render = data;
 
   /* reset the rotations */
-  renderings_reset_rotation(ui_render->renderings);
+  ui_render_stop_refinement(ui_render);
+  reset_renderings_rotation(ui_render);
 
   ui_render_add_update(ui_render); 
 
@@ -603,7 +627,9 @@ static ui_render_t * ui_render_free(ui_render_t * ui_render) {
 
   /* things to do if we've removed all reference's */
   if (ui_render->reference_count == 0) {
+    refine_abandon(ui_render);
     ui_render->renderings = renderings_unref(ui_render->renderings);
+    g_array_free(ui_render->pending_rotations, TRUE);
 #ifdef AMIDE_DEBUG
     g_print("freeing ui_render\n");
 #endif
@@ -644,7 +670,8 @@ static ui_render_t * ui_render_free(ui_render_t * ui_render) {
 
 
 static void read_render_preferences(gboolean * strip_highs, gboolean * optimize_renderings,
-				    gboolean * initially_no_gradient_opacity) {
+				    gboolean * initially_no_gradient_opacity,
+				    rendering_engine_t * engine) {
 
   *strip_highs = 
     amide_gconf_get_bool(GCONF_AMIDE_RENDERING,"StripHighs");
@@ -652,6 +679,10 @@ static void read_render_preferences(gboolean * strip_highs, gboolean * optimize_
     amide_gconf_get_bool(GCONF_AMIDE_RENDERING,"OptimizeRendering");
   *initially_no_gradient_opacity = 
     amide_gconf_get_bool(GCONF_AMIDE_RENDERING,"InitiallyNoGradientOpacity");
+  *engine = 
+    amide_gconf_get_int(GCONF_AMIDE_RENDERING,"Engine");
+  if ((*engine < 0) || (*engine >= NUM_RENDERING_ENGINES))
+    *engine = RENDERING_DEFAULT_ENGINE;
 
   return;
 }
@@ -668,8 +699,9 @@ static ui_render_t * ui_render_init(GtkWindow * window,
   gboolean strip_highs;
   gboolean optimize_rendering;
   gboolean initially_no_gradient_opacity;
+  rendering_engine_t engine;
 
-  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity);
+  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity, &engine);
 
   /* alloc space for the data structure for passing ui info */
   if ((ui_render = g_try_new(ui_render_t,1)) == NULL) {
@@ -708,12 +740,22 @@ static ui_render_t * ui_render_init(GtkWindow * window,
   ui_render->progress_dialog = amitk_progress_dialog_new(ui_render->window);
   ui_render->disable_progress_dialog=FALSE;
   ui_render->next_update= UPDATE_NONE;
+  ui_render->next_refinement = 0;
+  ui_render->refinement = 0;
   ui_render->idle_handler_id = 0;
+  ui_render->refine_handler_id = 0;
+  ui_render->refine_job = NULL;
+  ui_render->refine_generation = 0;
+  ui_render->pending_rotations = g_array_new(FALSE, FALSE, sizeof(pending_rotation_t));
+  ui_render->pending_reset = FALSE;
+  ui_render->deferred_changes = NULL;
   ui_render->rendered_successfully=FALSE;
 
   /* load in saved render preferences */
   ui_render->update_without_release = 
     amide_gconf_get_bool(GCONF_AMIDE_RENDERING,"UpdateWithoutRelease");
+  ui_render->progressive = 
+    amide_gconf_get_bool_with_default(GCONF_AMIDE_RENDERING,"ProgressiveRendering", TRUE);
 
   ui_render->stereo_eye_width = 
     amide_gconf_get_int(GCONF_AMIDE_RENDERING,"EyeWidth");
@@ -730,6 +772,7 @@ static ui_render_t * ui_render_init(GtkWindow * window,
 					  ui_render->start, 
 					  ui_render->duration, 
 					  strip_highs, optimize_rendering, initially_no_gradient_opacity,
+					  engine,
 					  ui_render->fov,
 					  ui_render->view_center,
 					  ui_render->disable_progress_dialog ? NULL : amitk_progress_dialog_update,
@@ -748,10 +791,12 @@ GdkPixbuf * ui_render_get_pixbuf(ui_render_t * ui_render) {
 }
 
 
-void ui_render_add_update(ui_render_t * ui_render) {
+static void add_update(ui_render_t * ui_render, gint refinement) {
 
+  /* anything new cancels refining what's up now */
+  ui_render_stop_refinement(ui_render);
 
-  
+  ui_render->next_refinement = refinement;
   ui_render->next_update = ui_render->next_update | UPDATE_RENDERING;
   if (ui_render->idle_handler_id == 0) {
     ui_common_place_cursor_no_wait(UI_CURSOR_WAIT, ui_render->canvas);
@@ -762,48 +807,212 @@ void ui_render_add_update(ui_render_t * ui_render) {
   return;
 }
 
-/* render our objects and place into the canvases */
-gboolean ui_render_update_immediate(gpointer data) {
+void ui_render_add_update(ui_render_t * ui_render) {
+  add_update(ui_render, 0);
+  return;
+}
 
-  ui_render_t * ui_render = data;
-  amide_intpoint_t size_dim; 
+/* for updates while the user is still moving things, in progressive mode 
+   this is a quick preview that gets refined once they pause */
+static void add_interactive_update(ui_render_t * ui_render) {
+  add_update(ui_render, ui_render->progressive ? RENDERING_NUM_REFINEMENTS-1 : 0);
+  return;
+}
+
+/* a refinement level being rendered off the main loop.  Once started, a job always
+   renders to the end and is handed back to refine_done_cb, which joins it.  Stopping
+   a refinement only marks the job stale and asks its render to finish early, and
+   changes to the renderings are held back until it's done.  If the ui_render goes
+   away first, the job is left holding the renderings */
+typedef struct {
+  ui_render_t * ui_render; /* NULL once the ui_render is gone */
+  renderings_t * renderings; /* only referenced once the ui_render is gone */
+  guint generation;
+  gint refinement;
+  gint cancel; /* cuts the render short */
+  amide_intpoint_t size_dim;
   AmideEye eyes;
-  gboolean return_val=TRUE;
-  amide_time_t midpt_time;
-  gint hours, minutes, seconds;
-  gchar * time_str;
-  rgba_t color;
+  gdouble eye_angle;
+  gint eye_width;
+  GdkPixbuf * pixbuf;
+  GThread * thread;
+} refine_job_t;
 
-  g_return_val_if_fail(ui_render != NULL, FALSE);
-  g_return_val_if_fail(ui_render->renderings != NULL, FALSE);
+/* a callback held back by ui_render_defer_change */
+typedef struct {
+  void (* callback)();
+  gpointer instance;
+  gpointer data;
+} deferred_change_t;
 
-  ui_render->rendered_successfully=FALSE;
-  if (!renderings_reload_objects(ui_render->renderings, ui_render->start,
-				 ui_render->duration,
-				 ui_render->disable_progress_dialog ? NULL : amitk_progress_dialog_update,
-				 ui_render->disable_progress_dialog ? NULL : ui_render->progress_dialog )) {
-    return_val=FALSE;
-    goto function_end;
+static void refine_job_free(refine_job_t * job) {
+
+  if (job->pixbuf != NULL) {
+    g_object_unref(job->pixbuf);
+    job->pixbuf = NULL;
   }
+  g_free(job);
 
+  return;
+}
 
-  /* -------- render our objects ------------ */
+/* runs on the refine thread, the main loop leaves the renderings alone until 
+   refine_done_cb has joined us.  The ray caster spreads the image tiles over 
+   the amitk_parallel_for workers */
+static gpointer refine_thread(gpointer data) {
 
-  if (ui_render->stereoscopic) eyes = AMIDE_EYE_NUM;
-  else eyes = 1;
+  refine_job_t * job = data;
 
-  if (ui_render->pixbuf != NULL) {
-    g_object_unref(ui_render->pixbuf);
-    ui_render->pixbuf = NULL;
+  job->pixbuf = image_from_renderings(job->renderings, 
+				      job->size_dim, job->size_dim, job->eyes,
+				      job->eye_angle, job->eye_width);
+
+  g_idle_add(refine_done_cb, job);
+
+  return NULL;
+}
+
+/* cancels any refinement waiting to start, and has one being rendered off the main
+   loop cut its render short and its result thrown away.  Doesn't wait for it, the 
+   renderings stay in use until refine_done_cb, so changes to them have to go through 
+   ui_render_defer_change or rotate_renderings */
+void ui_render_stop_refinement(ui_render_t * ui_render) {
+
+  refine_job_t * job = ui_render->refine_job;
+
+  if (ui_render->refine_handler_id != 0) {
+    g_source_remove(ui_render->refine_handler_id);
+    ui_render->refine_handler_id = 0;
   }
 
-  /* base the dimensions on the first rendering context in the list.... */
-  size_dim = ceil(ui_render->zoom*POINT_MAX(ui_render->renderings->rendering->dim));
-  ui_render->pixbuf = image_from_renderings(ui_render->renderings, 
-					    size_dim, size_dim, eyes,
-					    ui_render->stereo_eye_angle, 
-					    ui_render->stereo_eye_width); 
+  ui_render->refine_generation++;
+  if (job != NULL)
+    g_atomic_int_set(&(job->cancel), TRUE);
+
+  return;
+}
+
+/* the renderings can't be changed while a refinement is being rendered off the main
+   loop.  If one is, stops it and has callback(instance, data) called again once it's 
+   done, returning TRUE so the caller can bail out.  Only the latest call for a given 
+   callback and instance is kept */
+gboolean ui_render_defer_change(ui_render_t * ui_render, void (* callback)(), 
+				gpointer instance, gpointer data) {
+
+  GList * changes;
+  deferred_change_t * change;
+
+  if (ui_render->refine_job == NULL) return FALSE;
+  ui_render_stop_refinement(ui_render);
+
+  for (changes = ui_render->deferred_changes; changes != NULL; changes = changes->next) {
+    change = changes->data;
+    if ((change->callback == callback) && (change->instance == instance)) {
+      change->data = data;
+      return TRUE;
+    }
+  }
+
+  change = g_new(deferred_change_t, 1);
+  change->callback = callback;
+  change->instance = (instance != NULL) ? g_object_ref(instance) : NULL;
+  change->data = data;
+  ui_render->deferred_changes = g_list_append(ui_render->deferred_changes, change);
+
+  return TRUE;
+}
+
+/* takes the list of deferred changes, calling them if do_changes is set */
+static void deferred_changes_run(GList * changes, gboolean do_changes) {
+
+  deferred_change_t * change;
+
+  while (changes != NULL) {
+    change = changes->data;
+    if (do_changes)
+      (*change->callback)(change->instance, change->data);
+    if (change->instance != NULL)
+      g_object_unref(change->instance);
+    g_free(change);
+    changes = g_list_delete_link(changes, changes);
+  }
+
+  return;
+}
+
+/* rotate the renderings, or if they're busy with a refinement, once it's done */
+static void rotate_renderings(ui_render_t * ui_render, AmitkAxis axis, gdouble angle) {
+
+  pending_rotation_t rotation;
+
+  if (ui_render->refine_job == NULL) {
+    renderings_set_rotation(ui_render->renderings, axis, angle);
+  } else {
+    rotation.axis = axis;
+    rotation.angle = angle;
+    g_array_append_val(ui_render->pending_rotations, rotation);
+  }
+
+  return;
+}
+
+static void reset_renderings_rotation(ui_render_t * ui_render) {
+
+  if (ui_render->refine_job == NULL) {
+    renderings_reset_rotation(ui_render->renderings);
+  } else {
+    g_array_set_size(ui_render->pending_rotations, 0);
+    ui_render->pending_reset = TRUE;
+  }
+
+  return;
+}
 
+static void apply_pending_rotations(ui_render_t * ui_render) {
+
+  pending_rotation_t * rotation;
+  guint i;
+
+  if (ui_render->pending_reset) {
+    renderings_reset_rotation(ui_render->renderings);
+    ui_render->pending_reset = FALSE;
+  }
+
+  for (i=0; i < ui_render->pending_rotations->len; i++) {
+    rotation = &g_array_index(ui_render->pending_rotations, pending_rotation_t, i);
+    renderings_set_rotation(ui_render->renderings, rotation->axis, rotation->angle);
+  }
+  g_array_set_size(ui_render->pending_rotations, 0);
+
+  return;
+}
+
+/* the ui_render is going away, leave the renderings to any refinement still running */
+static void refine_abandon(ui_render_t * ui_render) {
+
+  refine_job_t * job = ui_render->refine_job;
+
+  ui_render_stop_refinement(ui_render);
+  if (job != NULL) {
+    job->ui_render = NULL;
+    job->renderings = ui_render->renderings;
+    ui_render->renderings = NULL;
+    ui_render->refine_job = NULL;
+  }
+
+  deferred_changes_run(ui_render->deferred_changes, FALSE);
+  ui_render->deferred_changes = NULL;
+
+  return;
+}
+
+/* put ui_render->pixbuf up on the canvas, along with the time label */
+static void put_up_pixbuf(ui_render_t * ui_render) {
+
+  amide_time_t midpt_time;
+  gint hours, minutes, seconds;
+  gchar * time_str;
+  rgba_t color;
 
   /* put up the image */
   if (ui_render->canvas_image != NULL) 
@@ -858,9 +1067,156 @@ gboolean ui_render_update_immediate(gpointer data) {
   /* reset the min size of the widget */
   gnome_canvas_set_scroll_region(GNOME_CANVAS(ui_render->canvas), 0.0, 0.0, ui_render->pixbuf_width, ui_render->pixbuf_height);
   gtk_widget_set_size_request(ui_render->canvas, ui_render->pixbuf_width, ui_render->pixbuf_height);
+
+  return;
+}
+
+/* back on the main loop once a refinement's done.  Does whatever was held back while 
+   it was rendering, and if it hasn't been stopped, puts it up and starts on the next level */
+static gboolean refine_done_cb(gpointer data) {
+
+  refine_job_t * job = data;
+  ui_render_t * ui_render = job->ui_render;
+  GList * changes;
+
+  g_thread_join(job->thread);
+
+  if (ui_render == NULL) { /* the ui_render's gone */
+    renderings_unref(job->renderings);
+    refine_job_free(job);
+    return FALSE;
+  }
+
+  ui_render->refine_job = NULL;
+  renderings_set_cancel(ui_render->renderings, NULL);
+
+  apply_pending_rotations(ui_render);
+  changes = ui_render->deferred_changes;
+  ui_render->deferred_changes = NULL;
+  deferred_changes_run(changes, TRUE);
+
+  if ((job->generation == ui_render->refine_generation) && (job->pixbuf != NULL)) {
+    if (ui_render->pixbuf != NULL)
+      g_object_unref(ui_render->pixbuf);
+    ui_render->pixbuf = job->pixbuf;
+    job->pixbuf = NULL;
+    ui_render->refinement = job->refinement;
+    put_up_pixbuf(ui_render);
+
+    if (ui_render->refinement > 0)
+      refine_start(ui_render, ui_render->refinement-1);
+
+  } else if ((ui_render->next_update != UPDATE_NONE) && (ui_render->idle_handler_id == 0)) {
+    /* an update that was waiting on us */
+    ui_render->idle_handler_id = 
+      g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,ui_render_update_immediate, ui_render, NULL);
+  }
+
+  refine_job_free(job);
+
+  return FALSE;
+}
+
+/* start rendering the given refinement level off the main loop */
+static void refine_start(ui_render_t * ui_render, gint refinement) {
+
+  refine_job_t * job;
+
+  ui_render_stop_refinement(ui_render);
+  g_return_if_fail(ui_render->renderings != NULL);
+  if (ui_render->refine_job != NULL) return; /* a stopped one's still finishing */
+
+  job = g_new0(refine_job_t, 1);
+  job->ui_render = ui_render;
+  job->renderings = ui_render->renderings;
+  job->generation = ui_render->refine_generation;
+  job->refinement = refinement;
+  job->cancel = FALSE;
+  job->eyes = ui_render->stereoscopic ? AMIDE_EYE_NUM : 1;
+  job->eye_angle = ui_render->stereo_eye_angle;
+  job->eye_width = ui_render->stereo_eye_width;
+
+  renderings_set_refinement(ui_render->renderings, refinement);
+  job->size_dim = ceil(ui_render->zoom*POINT_MAX(ui_render->renderings->rendering->dim));
+
+  renderings_set_cancel(ui_render->renderings, &(job->cancel));
+  ui_render->refine_job = job;
+  job->thread = g_thread_new("ui_render_refine", refine_thread, job);
+
+  return;
+}
+
+/* the user's paused, refine what's up level by level off the main loop */
+static gboolean refine_cb(gpointer data) {
+
+  ui_render_t * ui_render = data;
+
+  ui_render->refine_handler_id = 0;
+  refine_start(ui_render, ui_render->refinement-1);
+
+  return FALSE;
+}
+
+/* render our objects and place into the canvases */
+gboolean ui_render_update_immediate(gpointer data) {
+
+  ui_render_t * ui_render = data;
+  amide_intpoint_t size_dim; 
+  AmideEye eyes;
+  gboolean return_val=TRUE;
+
+  g_return_val_if_fail(ui_render != NULL, FALSE);
+  g_return_val_if_fail(ui_render->renderings != NULL, FALSE);
+
+  /* whatever gets rendered now replaces anything waiting to be refined.  The 
+     renderings are in use until a refinement being rendered is done, 
+     refine_done_cb picks the update up from there */
+  ui_render_stop_refinement(ui_render);
+  if (ui_render->refine_job != NULL) {
+    ui_render->idle_handler_id = 0;
+    return FALSE;
+  }
+  ui_render->refinement = ui_render->next_refinement;
+  ui_render->next_refinement = 0;
+
+  ui_render->rendered_successfully=FALSE;
+  if (!renderings_reload_objects(ui_render->renderings, ui_render->start,
+				 ui_render->duration,
+				 ui_render->disable_progress_dialog ? NULL : amitk_progress_dialog_update,
+				 ui_render->disable_progress_dialog ? NULL : ui_render->progress_dialog )) {
+    return_val=FALSE;
+    goto function_end;
+  }
+
+
+  /* -------- render our objects ------------ */
+
+  if (ui_render->stereoscopic) eyes = AMIDE_EYE_NUM;
+  else eyes = 1;
+
+  if (ui_render->pixbuf != NULL) {
+    g_object_unref(ui_render->pixbuf);
+    ui_render->pixbuf = NULL;
+  }
+
+  renderings_set_refinement(ui_render->renderings, ui_render->refinement);
+
+  /* base the dimensions on the first rendering context in the list.... */
+  size_dim = ceil(ui_render->zoom*POINT_MAX(ui_render->renderings->rendering->dim));
+  ui_render->pixbuf = image_from_renderings(ui_render->renderings, 
+					    size_dim, size_dim, eyes,
+					    ui_render->stereo_eye_angle, 
+					    ui_render->stereo_eye_width); 
+
+  put_up_pixbuf(ui_render);
   ui_render->rendered_successfully = TRUE;
   return_val = FALSE;
 
+  /* a preview, refine it if the user doesn't move on */
+  if (ui_render->refinement > 0)
+    ui_render->refine_handler_id = 
+      g_timeout_add(UI_RENDER_REFINE_DELAY, refine_cb, ui_render);
+
  function_end:
 
   ui_common_remove_wait_cursor(ui_render->canvas);
@@ -1001,6 +1357,7 @@ void ui_render_create(AmitkStudy * study, GList * selected_objects, AmitkPrefere
 static void init_strip_highs_cb(GtkWidget * widget, gpointer data);
 static void init_optimize_rendering_cb(GtkWidget * widget, gpointer data);
 static void init_no_gradient_opacity_cb(GtkWidget * widget, gpointer data);
+static void init_engine_cb(GtkWidget * widget, gpointer data);
 
 
 
@@ -1022,6 +1379,12 @@ static void init_no_gradient_opacity_cb(GtkWidget * widget, gpointer data) {
   return;
 }
 
+static void init_engine_cb(GtkWidget * widget, gpointer data) {
+  amide_gconf_set_int(GCONF_AMIDE_RENDERING,"Engine", 
+		      gtk_combo_box_get_active(GTK_COMBO_BOX(widget)));
+  return;
+}
+
 
 /* function to setup a dialog to allow us to choose options for rendering */
 GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent) {
@@ -1030,14 +1393,18 @@ GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent)
   gchar * temp_string;
   GtkWidget * table;
   GtkWidget * check_button;
+  GtkWidget * label;
+  GtkWidget * menu;
   guint table_row;
   GtkWidget * tree_view;
   GtkWidget * scrolled;
   gboolean strip_highs;
   gboolean optimize_rendering;
   gboolean initially_no_gradient_opacity;
+  rendering_engine_t engine;
+  rendering_engine_t i_engine;
 
-  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity);
+  read_render_preferences(&strip_highs, &optimize_rendering, &initially_no_gradient_opacity, &engine);
 
   temp_string = g_strdup_printf(_("%s: Rendering Initialization Dialog"), PACKAGE);
   dialog = gtk_dialog_new_with_buttons (temp_string,  parent,
@@ -1054,7 +1421,7 @@ GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent)
   gtk_container_set_border_width(GTK_CONTAINER(dialog), 10);
 
   /* start making the widgets for this dialog box */
-  table = gtk_table_new(5,2,FALSE);
+  table = gtk_table_new(6,2,FALSE);
   table_row=0;
   gtk_container_add(GTK_CONTAINER(GTK_DIALOG(dialog)->vbox), table);
 
@@ -1098,6 +1465,20 @@ GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent)
   g_signal_connect(G_OBJECT(check_button), "toggled", G_CALLBACK(init_no_gradient_opacity_cb), dialog);
   table_row++;
 
+  /* volpack or our own ray caster */
+  label = gtk_label_new(_("Rendering Engine:"));
+  gtk_table_attach(GTK_TABLE(table), label, 
+		   0,1, table_row, table_row+1, 0, 0, X_PADDING, Y_PADDING);
+
+  menu = gtk_combo_box_new_text();
+  for (i_engine = 0; i_engine < NUM_RENDERING_ENGINES; i_engine++)
+    gtk_combo_box_append_text(GTK_COMBO_BOX(menu), _(rendering_engine_names[i_engine]));
+  gtk_combo_box_set_active(GTK_COMBO_BOX(menu), engine);
+  gtk_table_attach(GTK_TABLE(table), menu, 
+		   1,2, table_row, table_row+1, GTK_FILL, 0, X_PADDING, Y_PADDING);
+  g_signal_connect(G_OBJECT(menu), "changed", G_CALLBACK(init_engine_cb), dialog);
+  table_row++;
+
 
   /* and show all our widgets */
   gtk_widget_show_all(dialog);
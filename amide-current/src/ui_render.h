@@ -39,6 +39,7 @@
 #define UI_RENDER_BLANK_WIDTH 200
 #define UI_RENDER_BLANK_HEIGHT 200
 #define BOX_OFFSET 0.2
+#define UI_RENDER_REFINE_DELAY 150 /* ms of no interaction before refining a preview */
 
 /* ui_render data structures */
 typedef struct ui_render_t {
@@ -62,6 +63,7 @@ typedef struct ui_render_t {
   GdkPixbuf * pixbuf;
   renderings_t * renderings;
   gboolean update_without_release;
+  gboolean progressive; /* quick previews while interacting, refined once the user pauses */
   gboolean stereoscopic;
   gdouble stereo_eye_angle;
   gint stereo_eye_width; /* pixels */
@@ -73,7 +75,15 @@ typedef struct ui_render_t {
   AmitkSpace * box_space;
 
   guint next_update;
+  gint next_refinement; /* refinement level of the next update */
+  gint refinement; /* refinement level of what's being displayed */
   guint idle_handler_id;
+  guint refine_handler_id;
+  gpointer refine_job; /* refinement level being rendered off the main loop */
+  guint refine_generation; /* bumped whenever a refinement is started or stopped */
+  GArray * pending_rotations; /* rotations waiting on the refinement to finish */
+  gboolean pending_reset; /* reset the rotation before applying pending_rotations */
+  GList * deferred_changes; /* callbacks waiting on the refinement to finish */
   gboolean rendered_successfully;
 
   GtkWidget * progress_dialog;
@@ -84,6 +94,9 @@ typedef struct ui_render_t {
 /* external functions */
 GdkPixbuf * ui_render_get_pixbuf(ui_render_t * ui_render);
 void ui_render_add_update(ui_render_t * ui_render);
+void ui_render_stop_refinement(ui_render_t * ui_render);
+gboolean ui_render_defer_change(ui_render_t * ui_render, void (* callback)(), 
+				gpointer instance, gpointer data);
 gboolean ui_render_update_immediate(gpointer ui_render);
 void ui_render_create(AmitkStudy * study, GList * selected_objects, AmitkPreferences * preferences);
 GtkWidget * ui_render_init_dialog_create(AmitkStudy * study, GtkWindow * parent);
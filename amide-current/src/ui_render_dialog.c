@@ -61,12 +61,16 @@ static void change_quality_cb(GtkWidget * widget, gpointer data) {
   ui_render_t * ui_render = data;
   rendering_quality_t new_quality;
 
+  if (ui_render_defer_change(ui_render, change_quality_cb, widget, data))
+    return;
+
   new_quality = gtk_combo_box_get_active(GTK_COMBO_BOX(widget));
 
   if (ui_render->quality != new_quality) {
     ui_render->quality = new_quality;
 
     /* apply the new quality */
+    ui_render_stop_refinement(ui_render);
     renderings_set_quality(ui_render->renderings, ui_render->quality);
     
     /* do updating */
@@ -86,10 +90,13 @@ static void change_pixel_type_cb(GtkWidget * widget, gpointer data) {
   pixel_type_t new_type;
 
   ui_render = g_object_get_data(G_OBJECT(widget), "ui_render");
+  if (ui_render_defer_change(ui_render, change_pixel_type_cb, widget, data))
+    return;
 
   new_type = gtk_combo_box_get_active(GTK_COMBO_BOX(widget));
 
   if (rendering->pixel_type != new_type) {
+    ui_render_stop_refinement(ui_render);
     rendering->pixel_type = new_type;
 
     /* apply the new quality */
@@ -126,6 +133,27 @@ static void update_without_release_toggle_cb(GtkWidget * widget, gpointer data)
   
 
 
+/* function to switch progressive refinement while rotating on or off */
+static void progressive_toggle_cb(GtkWidget * widget, gpointer data) {
+  
+  ui_render_t * ui_render = data;
+  gboolean progressive;
+
+  progressive = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+
+  if (ui_render->progressive != progressive) {
+    ui_render->progressive = progressive;
+
+    /* save user preferences */
+    amide_gconf_set_bool(GCONF_AMIDE_RENDERING,"ProgressiveRendering", 
+			 ui_render->progressive);
+  }
+
+  return;
+}
+  
+
+
 /* function to change the stereo eye angle */
 static void change_eye_angle_cb(GtkWidget * widget, gpointer data) {
 
@@ -187,6 +215,9 @@ static void depth_cueing_toggle_cb(GtkWidget * widget, gpointer data) {
   ui_render_t * ui_render = data;
   gboolean depth_cueing;
 
+  if (ui_render_defer_change(ui_render, depth_cueing_toggle_cb, widget, data))
+    return;
+
   depth_cueing = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
 
   
@@ -194,6 +225,7 @@ static void depth_cueing_toggle_cb(GtkWidget * widget, gpointer data) {
     ui_render->depth_cueing = depth_cueing;
 
     /* apply the new quality */
+    ui_render_stop_refinement(ui_render);
     renderings_set_depth_cueing(ui_render->renderings, ui_render->depth_cueing);
     
     ui_render_add_update(ui_render);
@@ -211,6 +243,9 @@ static void change_front_factor_cb(GtkWidget * widget, gpointer data) {
   ui_render_t * ui_render = data;
   gdouble temp_val;
 
+  if (ui_render_defer_change(ui_render, change_front_factor_cb, widget, data))
+    return;
+
   temp_val = gtk_spin_button_get_value(GTK_SPIN_BUTTON(widget));
 
   if (!REAL_EQUAL(ui_render->front_factor, temp_val)) {
@@ -218,6 +253,7 @@ static void change_front_factor_cb(GtkWidget * widget, gpointer data) {
     /* set the front factor */
     ui_render->front_factor = temp_val;
     
+    ui_render_stop_refinement(ui_render);
     renderings_set_depth_cueing_parameters(ui_render->renderings,
 					   ui_render->front_factor,
 					   ui_render->density);
@@ -236,12 +272,16 @@ static void change_density_cb(GtkWidget * widget, gpointer data) {
   ui_render_t * ui_render = data;
   gdouble temp_val;
 
+  if (ui_render_defer_change(ui_render, change_density_cb, widget, data))
+    return;
+
   temp_val = gtk_spin_button_get_value(GTK_SPIN_BUTTON(widget));
 
   if (!REAL_EQUAL(ui_render->density, temp_val)) {
     
     ui_render->density = temp_val; /* set the density */
     
+    ui_render_stop_refinement(ui_render);
     renderings_set_depth_cueing_parameters(ui_render->renderings,
 					   ui_render->front_factor,
 					   ui_render->density);
@@ -260,11 +300,14 @@ static void color_table_cb(GtkWidget * widget, gpointer data) {
   AmitkColorTable i_color_table;
 
   ui_render = g_object_get_data(G_OBJECT(widget), "ui_render");
+  if (ui_render_defer_change(ui_render, color_table_cb, widget, data))
+    return;
 
   i_color_table = gtk_combo_box_get_active(GTK_COMBO_BOX(widget));
 
   if (rendering->color_table != i_color_table) {
     /* set the color table */
+    ui_render_stop_refinement(ui_render);
     rendering->color_table = i_color_table;
   
     ui_render_add_update(ui_render); 
@@ -291,6 +334,9 @@ static void change_opacity_cb(GtkWidget * widget, gpointer data) {
   gamma_curve[DENSITY_CLASSIFICATION] =  g_object_get_data(G_OBJECT(widget), "gamma_curve_density");
   gamma_curve[GRADIENT_CLASSIFICATION] =  g_object_get_data(G_OBJECT(widget), "gamma_curve_gradient");
   ui_render = g_object_get_data(G_OBJECT(widget), "ui_render");
+  if (ui_render_defer_change(ui_render, change_opacity_cb, widget, data))
+    return;
+  ui_render_stop_refinement(ui_render);
 
   for (i_classification = 0; i_classification < NUM_CLASSIFICATIONS; i_classification++) {
     /* figure out the curve type */
@@ -509,6 +555,14 @@ void ui_render_dialog_create_parameters(ui_render_t * ui_render) {
 		   table_row,table_row+1, GTK_FILL, 0, X_PADDING, Y_PADDING);
   table_row++;
 
+  /* quick previews while rotating, refined when the user pauses */
+  check_button = gtk_check_button_new_with_label (_("progressive refinement while rotating"));
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_button), ui_render->progressive);
+  g_signal_connect(G_OBJECT(check_button), "toggled", G_CALLBACK(progressive_toggle_cb), ui_render);
+  gtk_table_attach(GTK_TABLE(packing_table), check_button, 0,2, 
+		   table_row,table_row+1, GTK_FILL, 0, X_PADDING, Y_PADDING);
+  table_row++;
+
   /* a separator for clarity */
   hseparator = gtk_hseparator_new();
   gtk_table_attach(GTK_TABLE(packing_table), hseparator,0,2,
@@ -401,6 +401,51 @@ static ui_render_movie_t * movie_init(void) {
 
 
 
+/* figure out the time interval shown in the given movie frame, for movies
+   over time or over frames.  Other movie types leave start and duration alone */
+static void movie_frame_time(const ui_render_movie_t * ui_render_movie,
+			     AmitkDataSet * most_frames_ds,
+			     const guint i_frame,
+			     const guint num_frames,
+			     amide_time_t * start,
+			     amide_time_t * duration) {
+
+  amide_time_t start_time, frame_duration;
+  guint ds_frame;
+  gdouble ds_frame_real;
+
+  switch (ui_render_movie->type) {
+  case OVER_TIME:
+    *duration = (ui_render_movie->end_time-ui_render_movie->start_time) /((amide_time_t) num_frames);
+    *start = ui_render_movie->start_time + i_frame*(*duration);
+    break;
+  case OVER_FRAMES_SMOOTHED:
+  case OVER_FRAMES:
+    if (most_frames_ds) {
+      ds_frame_real = (i_frame/((gdouble) num_frames)) * AMITK_DATA_SET_NUM_FRAMES(most_frames_ds);
+      ds_frame = floor(ds_frame_real);
+      start_time = amitk_data_set_get_start_time(most_frames_ds, ds_frame);
+      frame_duration = amitk_data_set_get_end_time(most_frames_ds, ds_frame) - start_time;
+      *start = start_time + EPSILON*fabs(start_time) + 
+	((ui_render_movie->type == OVER_FRAMES_SMOOTHED) ? ((ds_frame_real-ds_frame)*frame_duration) : 0.0);
+      *duration = frame_duration - EPSILON*fabs(frame_duration);
+    } else { /* just have roi's.... doesn't make much sense if we get here */
+      *start = 0.0;
+      *duration = 1.0;
+    }
+    break;
+  default:
+    break;
+  }
+
+  return;
+}
+
+/* the gate shown in the given movie frame, for movies over gates */
+static gint movie_frame_gate(AmitkDataSet * ds, const guint i_frame, const guint num_frames) {
+  return floor((i_frame/((gdouble) num_frames))*AMITK_DATA_SET_NUM_GATES(ds));
+}
+
 /* perform the movie generation */
 static void movie_generate(ui_render_movie_t * ui_render_movie, gchar * output_filename) {
 
@@ -409,12 +454,11 @@ static void movie_generate(ui_render_movie_t * ui_render_movie, gchar * output_f
   AmitkAxis i_axis;
   gint return_val = TRUE;
   amide_time_t initial_start, initial_duration;
-  amide_time_t start_time, duration;
   ui_render_t * ui_render;
   AmitkDataSet * most_frames_ds=NULL;
+  AmitkDataSet * ds;
   renderings_t * renderings;
-  guint ds_frame=0;
-  gdouble ds_frame_real;
+  rendering_frame_t * frames;
   guint num_frames;
   gpointer mpeg_encode_context;
   gboolean continue_work=TRUE;
@@ -427,6 +471,12 @@ static void movie_generate(ui_render_movie_t * ui_render_movie, gchar * output_f
 
   /* save the initial times so we can set it back later */
   ui_render = ui_render_movie->ui_render;
+
+  /* the movie needs the renderings to itself, let any refinement being rendered 
+     finish up while keeping the main loop going */
+  ui_render_stop_refinement(ui_render);
+  while (ui_render->refine_job != NULL)
+    gtk_main_iteration();
   initial_start = ui_render->start;
   initial_duration = ui_render->duration;
 
@@ -456,6 +506,38 @@ static void movie_generate(ui_render_movie_t * ui_render_movie, gchar * output_f
       (ui_render_movie->end_time-ui_render_movie->start_time) /((amide_time_t) num_frames);
   }
 
+  /* convert all the frames the movie needs up front, several at once, so 
+     that generating the movie only has to render */
+  if ((ui_render_movie->type != NOT_DYNAMIC) && 
+      ((frames = g_try_new(rendering_frame_t, num_frames)) != NULL)) {
+    renderings_preload_start();
+    renderings = ui_render->renderings;
+    while ((renderings != NULL) && continue_work) {
+      if (AMITK_IS_DATA_SET(renderings->rendering->object)) {
+	ds = AMITK_DATA_SET(renderings->rendering->object);
+	for (i_frame = 0; i_frame < num_frames; i_frame++) {
+	  frames[i_frame].start = ui_render->start;
+	  frames[i_frame].duration = ui_render->duration;
+	  movie_frame_time(ui_render_movie, most_frames_ds, i_frame, num_frames,
+			   &(frames[i_frame].start), &(frames[i_frame].duration));
+	  if (ui_render_movie->type == OVER_GATES) {
+	    frames[i_frame].view_start_gate = movie_frame_gate(ds, i_frame, num_frames);
+	    frames[i_frame].view_end_gate = frames[i_frame].view_start_gate;
+	  } else {
+	    frames[i_frame].view_start_gate = AMITK_DATA_SET_VIEW_START_GATE(ds);
+	    frames[i_frame].view_end_gate = AMITK_DATA_SET_VIEW_END_GATE(ds);
+	  }
+	}
+	continue_work = rendering_preload_frames(renderings->rendering, frames, num_frames,
+						 amitk_progress_dialog_update, 
+						 ui_render_movie->progress_dialog);
+      }
+      renderings = renderings->next;
+    }
+    g_free(frames);
+    amitk_progress_dialog_set_text(AMITK_PROGRESS_DIALOG(ui_render_movie->progress_dialog),
+				   _("Rendered Movie Progress"));
+  }
   
   mpeg_encode_context = mpeg_encode_setup(output_filename, ENCODE_MPEG1,
 					  ui_render->pixbuf_width,
@@ -482,28 +564,16 @@ static void movie_generate(ui_render_movie_t * ui_render_movie, gchar * output_f
     /* figure out the start interval for this frame */
     switch (ui_render_movie->type) {
     case OVER_TIME:
-      ui_render->start = ui_render_movie->start_time + i_frame*ui_render->duration;
-      break;
     case OVER_FRAMES_SMOOTHED:
     case OVER_FRAMES:
-      if (most_frames_ds) {
-	ds_frame_real = (i_frame/((gdouble) num_frames)) * AMITK_DATA_SET_NUM_FRAMES(most_frames_ds);
-	ds_frame = floor(ds_frame_real);
-	start_time = amitk_data_set_get_start_time(most_frames_ds, ds_frame);
-	duration = amitk_data_set_get_end_time(most_frames_ds, ds_frame) - start_time;
-	ui_render->start = start_time + EPSILON*fabs(start_time) + 
-	  ((ui_render_movie->type == OVER_FRAMES_SMOOTHED) ? ((ds_frame_real-ds_frame)*duration) : 0.0);
-	ui_render->duration = duration - EPSILON*fabs(duration);
-      } else { /* just have roi's.... doesn't make much sense if we get here */
-	ui_render->start = 0.0;
-	ui_render->duration = 1.0;
-      }
+      movie_frame_time(ui_render_movie, most_frames_ds, i_frame, num_frames,
+		       &(ui_render->start), &(ui_render->duration));
       break;
     case OVER_GATES:
       renderings = ui_render->renderings;
       while (renderings != NULL) {
 	if (AMITK_IS_DATA_SET(renderings->rendering->object)) {
-	  ds_gate = floor((i_frame/((gdouble) num_frames))*AMITK_DATA_SET_NUM_GATES(renderings->rendering->object));
+	  ds_gate = movie_frame_gate(AMITK_DATA_SET(renderings->rendering->object), i_frame, num_frames);
 	  amitk_data_set_set_view_start_gate(AMITK_DATA_SET(renderings->rendering->object), ds_gate);
 	  amitk_data_set_set_view_end_gate(AMITK_DATA_SET(renderings->rendering->object), ds_gate);
 	}
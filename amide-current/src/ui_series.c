@@ -65,8 +65,6 @@ static gchar * series_explanations[] = {
 typedef struct ui_series_t {
   GtkWindow * window;
   GtkWidget * window_vbox;
-  GList * slice_cache;
-  gint max_slice_cache_size;
   GList * objects;
   AmitkDataSet * active_ds;
   GtkWidget * canvas;
@@ -282,10 +280,6 @@ static void color_table_changed_cb(gpointer dummy, AmitkViewMode view_mode, gpoi
 static void data_set_invalidate_slice_cache(AmitkDataSet *ds, gpointer data) {
   ui_series_t * ui_series=data;
 
-  if (ui_series->slice_cache != NULL) {
-    ui_series->slice_cache = amitk_objects_unref(ui_series->slice_cache);
-  }
-
   add_update(ui_series);
   return;
 }
@@ -492,10 +486,6 @@ static ui_series_t * ui_series_unref(ui_series_t * ui_series) {
       ui_series->objects = NULL;
     }
 
-    if (ui_series->slice_cache != NULL) {
-      ui_series->slice_cache = amitk_objects_unref(ui_series->slice_cache);
-    }
-
     if (ui_series->volume != NULL) {
       amitk_object_unref(ui_series->volume);
       ui_series->volume = NULL;
@@ -566,8 +556,6 @@ static ui_series_t * ui_series_init(GtkWindow * window, GtkWidget * window_vbox)
   /* set any needed parameters */
   ui_series->window = window;
   ui_series->window_vbox = window_vbox;
-  ui_series->slice_cache = NULL;
-  ui_series->max_slice_cache_size=10;
   ui_series->num_slices = 0;
   ui_series->rows = 0;
   ui_series->columns = 0;
@@ -824,8 +812,6 @@ static gboolean update_immediate(gpointer data) {
 
     if (amitk_objects_has_type(ui_series->objects, AMITK_OBJECT_TYPE_DATA_SET, FALSE)) {
       pixbuf = image_from_data_sets(NULL,
-				    &(ui_series->slice_cache),
-				    ui_series->max_slice_cache_size,
 				    ui_series->objects,
 				    ui_series->active_ds,
 				    temp_time+EPSILON*fabs(temp_time),
@@ -1239,8 +1225,6 @@ void ui_series_create(AmitkStudy * study,
     break;
   }
 
-  ui_series->max_slice_cache_size = ui_series->num_slices*num_data_sets+5;
-
   /* connect the thresholding and color table signals */
   temp_objects = ui_series->objects;
   while (temp_objects != NULL) {
@@ -837,6 +837,9 @@ ui_study_t * ui_study_free(ui_study_t * ui_study) {
   /* if we've removed all reference's, free the structure */
   if (ui_study->reference_count == 0) {
 
+    /* let any background saves finish up, they report back to their windows */
+    amitk_study_save_wait(NULL);
+
     /* these two lines forces any remaining spin button updates, so that we
        don't call any spin button callbacks with invalid data */
     gtk_widget_grab_focus(GTK_WIDGET(ui_study->window));
@@ -313,6 +313,23 @@ static gchar * verify_save_name(GtkWindow * parent, const gchar * filename) {
 }
 
 
+/* called once the study has been written out */
+static void save_xif_done(AmitkStudy * study, const gchar * filename, 
+			  gboolean successful, gpointer data) {
+
+  ui_study_t * ui_study = data;
+
+  if (!successful) {
+    g_warning(_("Failure Saving File: %s"),filename);
+    if (study == ui_study->study) {
+      ui_study->study_altered=TRUE;
+      ui_study_update_title(ui_study);
+    }
+  }
+
+  return;
+}
+
 void save_xif(ui_study_t * ui_study, gboolean as_directory) {
   GtkWidget * file_chooser;
   gchar * initial_filename;
@@ -388,19 +405,14 @@ void save_xif(ui_study_t * ui_study, gboolean as_directory) {
     initial_filename = NULL;
   }
 
-  ui_common_place_cursor(UI_CURSOR_WAIT, ui_study->canvas[AMITK_VIEW_MODE_SINGLE][AMITK_VIEW_TRANSVERSE]);
+  /* allright, save our study.  The save runs in the background, anything 
+     changed from here on marks the study as altered again */
+  ui_study->study_altered=FALSE;
+  ui_study_update_title(ui_study);
+  amitk_study_save_xml_async(ui_study->study, final_filename, as_directory,
+			     amitk_progress_dialog_update, ui_study->progress_dialog,
+			     save_xif_done, ui_study);
 
-  /* allright, save our study */
-  if (amitk_study_save_xml(ui_study->study, final_filename, as_directory) == FALSE) {
-    g_warning(_("Failure Saving File: %s"),final_filename);
-  } else {
-
-    /* indicate no new changes */
-    ui_study->study_altered=FALSE;
-    ui_study_update_title(ui_study);
-  }
-
-  ui_common_remove_wait_cursor(ui_study->canvas[AMITK_VIEW_MODE_SINGLE][AMITK_VIEW_TRANSVERSE]);
   ui_common_set_last_path_used(final_filename);
   g_free(final_filename);
 }
@@ -709,6 +721,11 @@ void ui_study_cb_canvas_erase_volume(GtkWidget * canvas, AmitkRoi * roi,
     return;
   }
 
+  if (amitk_study_save_in_progress(ui_study->study)) {
+    g_warning(_("the study is still being saved, erase once the save has finished"));
+    return;
+  }
+
   /* make sure we really want to delete */
   question = gtk_message_dialog_new(ui_study->window,
 				    GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -288,6 +288,68 @@ amide_data_t xml_get_data(xmlNodePtr nodes, const gchar * descriptor, gchar **pe
   return return_data;
 }
 
+/* returns NULL if the node doesn't exist or is corrupted */
+amide_data_t * xml_get_datas(xmlNodePtr nodes, const gchar * descriptor, guint num_datas, gchar ** perror_buf) {
+
+  gchar * temp_str;
+  gchar ** string_chunks;
+  amide_data_t * return_datas;
+  gint error;
+  guint i;
+  gchar * saved_locale;
+  gboolean corrupted=FALSE;
+  
+  temp_str = xml_get_string(nodes, descriptor);
+  if (temp_str == NULL) 
+    return NULL;
+
+  if ((return_datas = g_try_new(amide_data_t,num_datas)) == NULL) {
+    amitk_append_str_with_newline(perror_buf, _("Couldn't allocate memory space for %s"), descriptor);
+    g_free(temp_str);
+    return NULL;
+  }
+
+  saved_locale = g_strdup(setlocale(LC_NUMERIC,NULL));
+  setlocale(LC_NUMERIC,"POSIX");
+
+  /* split-up the string so we can process it */
+  string_chunks = g_strsplit(temp_str, "\t", num_datas);
+  g_free(temp_str);
+    
+  for (i=0; (i<num_datas) && (!corrupted);i++) {
+
+    if (string_chunks[i] == NULL) 
+      corrupted = TRUE;
+    else {
+
+      xml_convert_radix_to_local(string_chunks[i]);
+
+#if (SIZE_OF_AMIDE_DATA_T == 8)
+      /* convert to doubles */
+      error = sscanf(string_chunks[i], "%lf", &(return_datas[i]));
+#elif (SIZE_OF_AMIDE_DATA_T == 4)
+      /* convert to float */
+      error = sscanf(string_chunks[i], "%f", &(return_datas[i]));
+#else
+#error "Unknown size for SIZE_OF_AMIDE_DATA_T"
+#endif
+
+      if ((error == EOF) || (error == 0)) corrupted = TRUE;
+    }
+  }
+  g_strfreev(string_chunks);
+
+  if (corrupted) {
+    amitk_append_str_with_newline(perror_buf, _("Couldn't read values for %s"), descriptor);
+    g_free(return_datas);
+    return_datas = NULL;
+  }
+
+  setlocale(LC_NUMERIC, saved_locale);
+  g_free(saved_locale);
+  return return_datas;
+}
+
 amide_data_t xml_get_data_with_default(xmlNodePtr nodes, const gchar * descriptor, amide_data_t default_data) {
 
   if (xml_node_exists(nodes, descriptor))
@@ -608,6 +670,27 @@ void xml_save_data(xmlNodePtr node, const gchar * descriptor, const amide_data_t
   return;
 }
 
+/* saved at full precision, as these are used for values that get reused as is */
+void xml_save_datas(xmlNodePtr node, const gchar * descriptor, const amide_data_t * numbers, const int num) {
+
+  GString * temp_str;
+  int i;
+  gchar * saved_locale;
+  
+  saved_locale = g_strdup(setlocale(LC_NUMERIC,NULL));
+  setlocale(LC_NUMERIC,"POSIX");
+
+  temp_str = g_string_new(NULL);
+  for (i=0; i < num; i++) 
+    g_string_append_printf(temp_str, (i == 0) ? "%.17g" : "\t%.17g", (double) numbers[i]);
+  xml_save_string(node, descriptor, (num == 0) ? NULL : temp_str->str);
+  g_string_free(temp_str, TRUE);
+
+  setlocale(LC_NUMERIC, saved_locale);
+  g_free(saved_locale);
+  return;
+}
+
 void xml_save_real(xmlNodePtr node, const gchar * descriptor, const amide_real_t num) {
 
 #ifdef OLD_WIN32_HACKS
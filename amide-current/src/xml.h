@@ -43,6 +43,7 @@ amide_time_t xml_get_time(xmlNodePtr nodes, const gchar * descriptor, gchar **pe
 amide_time_t * xml_get_times(xmlNodePtr nodes, const gchar * descriptor, guint num_times, gchar **perror_buf);
 amide_data_t xml_get_data(xmlNodePtr nodes, const gchar * descriptor, gchar **perror_buf);
 amide_data_t xml_get_data_with_default(xmlNodePtr nodes, const gchar * descriptor, amide_data_t default_data);
+amide_data_t * xml_get_datas(xmlNodePtr nodes, const gchar * descriptor, guint num_datas, gchar **perror_buf);
 amide_real_t xml_get_real(xmlNodePtr node, const gchar * descriptor, gchar **perror_buf);
 amide_real_t xml_get_real_with_default(xmlNodePtr node, const gchar * descriptor, amide_real_t default_real);
 gboolean xml_get_boolean(xmlNodePtr nodes, const gchar * descriptor, gchar **perror_buf);
@@ -57,6 +58,7 @@ void xml_save_string(xmlNodePtr node, const gchar * descriptor, const gchar * st
 void xml_save_time(xmlNodePtr node, const gchar * descriptor, const amide_time_t num);
 void xml_save_times(xmlNodePtr node, const gchar * descriptor, const amide_time_t * numbers, const int num);
 void xml_save_data(xmlNodePtr node, const gchar * descriptor, const amide_data_t num);
+void xml_save_datas(xmlNodePtr node, const gchar * descriptor, const amide_data_t * numbers, const int num);
 void xml_save_real(xmlNodePtr node, const gchar * descriptor, const amide_real_t num);
 void xml_save_boolean(xmlNodePtr node, const gchar * descriptor, const gboolean value);
 void xml_save_int(xmlNodePtr node, const gchar * descriptor, const gint num);